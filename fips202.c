@@ -415,3 +415,51 @@ void shake256(unsigned char *output, unsigned long long outlen,
         }
     }
 }
+
+void shake_inc_init(uint64_t state[25])
+{
+    unsigned int i;
+
+    for (i = 0; i < 25; i++) {
+        state[i] = 0;
+    }
+}
+
+void shake_inc_blocks(uint64_t state[25], unsigned int r,
+                      const unsigned char *in, unsigned long long nblocks)
+{
+    unsigned int i;
+
+    while (nblocks > 0) {
+        for (i = 0; i < r / 8; ++i) {
+            state[i] ^= load64(in + 8 * i);
+        }
+        KeccakF1600_StatePermute(state);
+        in += r;
+        nblocks--;
+    }
+}
+
+void shake_inc_finalize(unsigned char *out, unsigned long long outlen,
+                        const uint64_t state[25], unsigned int r,
+                        const unsigned char *in, unsigned long long inlen)
+{
+    unsigned long long i;
+    uint64_t s[25];
+    unsigned char d[SHAKE128_RATE];
+
+    for (i = 0; i < 25; i++) {
+        s[i] = state[i];
+    }
+    keccak_absorb(s, r, in, inlen, 0x1F);
+
+    keccak_squeezeblocks(out, outlen / r, s, r);
+    out += (outlen / r) * r;
+
+    if (outlen % r) {
+        keccak_squeezeblocks(d, 1, s, r);
+        for (i = 0; i < outlen % r; i++) {
+            out[i] = d[i];
+        }
+    }
+}
@@ -1,6 +1,8 @@
 #ifndef XMSS_FIPS202_H
 #define XMSS_FIPS202_H
 
+#include <stdint.h>
+
 #define SHAKE128_RATE 168
 #define SHAKE256_RATE 136
 
@@ -16,4 +18,23 @@ void shake128(unsigned char *out, unsigned long long outlen,
 void shake256(unsigned char *out, unsigned long long outlen,
               const unsigned char *in, unsigned long long inlen);
 
+/* These functions absorb a long input incrementally, as the sha256_inc_*
+ * functions in sha2.h do. r is the rate, i.e. SHAKE128_RATE or SHAKE256_RATE.
+ */
+
+/* Sets the Keccak state to all-zero. */
+void shake_inc_init(uint64_t state[25]);
+
+/* Absorbs nblocks full r-byte blocks from in into state. */
+void shake_inc_blocks(uint64_t state[25], unsigned int r,
+                      const unsigned char *in, unsigned long long nblocks);
+
+/* Absorbs the last inlen bytes of the input into a copy of state, pads, and
+ * writes the first outlen bytes of output to out. The state itself is left
+ * untouched.
+ */
+void shake_inc_finalize(unsigned char *out, unsigned long long outlen,
+                        const uint64_t state[25], unsigned int r,
+                        const unsigned char *in, unsigned long long inlen);
+
 #endif
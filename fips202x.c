@@ -0,0 +1,303 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "fips202.h"
+#include "fips202x.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define XMSS_FIPS202X_X86
+#include <immintrin.h>
+#endif
+
+#ifdef XMSS_FIPS202X_X86
+
+#define NROUNDS 24
+
+static uint64_t load64(const unsigned char *x)
+{
+    unsigned long long r = 0, i;
+
+    for (i = 0; i < 8; ++i) {
+        r |= (unsigned long long)x[i] << 8 * i;
+    }
+    return r;
+}
+
+static void store64(uint8_t *x, uint64_t u)
+{
+    unsigned int i;
+
+    for (i = 0; i < 8; ++i) {
+        x[i] = u;
+        u >>= 8;
+    }
+}
+
+static const uint64_t KeccakF_RoundConstants[NROUNDS] =
+{
+    (uint64_t)0x0000000000000001ULL,
+    (uint64_t)0x0000000000008082ULL,
+    (uint64_t)0x800000000000808aULL,
+    (uint64_t)0x8000000080008000ULL,
+    (uint64_t)0x000000000000808bULL,
+    (uint64_t)0x0000000080000001ULL,
+    (uint64_t)0x8000000080008081ULL,
+    (uint64_t)0x8000000000008009ULL,
+    (uint64_t)0x000000000000008aULL,
+    (uint64_t)0x0000000000000088ULL,
+    (uint64_t)0x0000000080008009ULL,
+    (uint64_t)0x000000008000000aULL,
+    (uint64_t)0x000000008000808bULL,
+    (uint64_t)0x800000000000008bULL,
+    (uint64_t)0x8000000000008089ULL,
+    (uint64_t)0x8000000000008003ULL,
+    (uint64_t)0x8000000000008002ULL,
+    (uint64_t)0x8000000000000080ULL,
+    (uint64_t)0x000000000000800aULL,
+    (uint64_t)0x800000008000000aULL,
+    (uint64_t)0x8000000080008081ULL,
+    (uint64_t)0x8000000000008080ULL,
+    (uint64_t)0x0000000080000001ULL,
+    (uint64_t)0x8000000080008008ULL
+};
+
+/* The rotation offsets of rho and the lane order of pi, as visited when
+   walking the permutation cycle that starts at lane 1. */
+static const unsigned int keccak_rho[24] = {
+    1, 3, 6, 10, 15, 21, 28, 36, 45, 55, 2, 14,
+    27, 41, 56, 8, 25, 43, 62, 18, 39, 61, 20, 44
+};
+static const unsigned int keccak_pi[24] = {
+    10, 7, 11, 17, 18, 3, 5, 16, 8, 21, 24, 4,
+    15, 23, 19, 13, 12, 2, 20, 14, 22, 9, 6, 1
+};
+
+/* The permutations below operate on transposed states; i.e. s[j][l] is the
+ * j-th 64-bit word of the state in lane l. */
+
+#define ROL64x4(x, c) _mm256_or_si256(_mm256_slli_epi64(x, c), \
+                                      _mm256_srli_epi64(x, 64 - (c)))
+
+__attribute__((target("avx2")))
+static void KeccakF1600x4_StatePermute(uint64_t s[25][KECCAKX_MAX_LANES])
+{
+    __m256i A[25], C[5], D, t, u;
+    unsigned int round, i, j;
+
+    for (i = 0; i < 25; i++) {
+        A[i] = _mm256_loadu_si256((const __m256i *)s[i]);
+    }
+
+    for (round = 0; round < NROUNDS; round++) {
+        /* Theta */
+        for (i = 0; i < 5; i++) {
+            C[i] = _mm256_xor_si256(_mm256_xor_si256(A[i], A[i + 5]),
+                   _mm256_xor_si256(_mm256_xor_si256(A[i + 10], A[i + 15]),
+                                    A[i + 20]));
+        }
+        for (i = 0; i < 5; i++) {
+            D = _mm256_xor_si256(C[(i + 4) % 5], ROL64x4(C[(i + 1) % 5], 1));
+            for (j = 0; j < 25; j += 5) {
+                A[i + j] = _mm256_xor_si256(A[i + j], D);
+            }
+        }
+        /* Rho and pi */
+        t = A[1];
+        for (i = 0; i < 24; i++) {
+            u = A[keccak_pi[i]];
+            A[keccak_pi[i]] = ROL64x4(t, keccak_rho[i]);
+            t = u;
+        }
+        /* Chi */
+        for (j = 0; j < 25; j += 5) {
+            for (i = 0; i < 5; i++) {
+                C[i] = A[i + j];
+            }
+            for (i = 0; i < 5; i++) {
+                A[i + j] = _mm256_xor_si256(C[i],
+                    _mm256_andnot_si256(C[(i + 1) % 5], C[(i + 2) % 5]));
+            }
+        }
+        /* Iota */
+        A[0] = _mm256_xor_si256(A[0],
+            _mm256_set1_epi64x((long long)KeccakF_RoundConstants[round]));
+    }
+
+    for (i = 0; i < 25; i++) {
+        _mm256_storeu_si256((__m256i *)s[i], A[i]);
+    }
+}
+
+/* AVX-512 provides rotations, and three-input boolean functions. */
+#define XOR3_64x8(a, b, c) _mm512_ternarylogic_epi64(a, b, c, 0x96)
+#define CHI64x8(a, b, c) _mm512_ternarylogic_epi64(a, b, c, 0xd2)
+
+__attribute__((target("avx512f")))
+static void KeccakF1600x8_StatePermute(uint64_t s[25][KECCAKX_MAX_LANES])
+{
+    __m512i A[25], C[5], D, t, u;
+    unsigned int round, i, j;
+
+    for (i = 0; i < 25; i++) {
+        A[i] = _mm512_loadu_si512((const void *)s[i]);
+    }
+
+    for (round = 0; round < NROUNDS; round++) {
+        /* Theta */
+        for (i = 0; i < 5; i++) {
+            C[i] = XOR3_64x8(XOR3_64x8(A[i], A[i + 5], A[i + 10]),
+                             A[i + 15], A[i + 20]);
+        }
+        for (i = 0; i < 5; i++) {
+            D = _mm512_xor_si512(C[(i + 4) % 5],
+                                 _mm512_rol_epi64(C[(i + 1) % 5], 1));
+            for (j = 0; j < 25; j += 5) {
+                A[i + j] = _mm512_xor_si512(A[i + j], D);
+            }
+        }
+        /* Rho and pi */
+        t = A[1];
+        for (i = 0; i < 24; i++) {
+            u = A[keccak_pi[i]];
+            A[keccak_pi[i]] = _mm512_rolv_epi64(t,
+                _mm512_set1_epi64((long long)keccak_rho[i]));
+            t = u;
+        }
+        /* Chi: a ^ (~b & c) */
+        for (j = 0; j < 25; j += 5) {
+            for (i = 0; i < 5; i++) {
+                C[i] = A[i + j];
+            }
+            for (i = 0; i < 5; i++) {
+                A[i + j] = CHI64x8(C[i], C[(i + 1) % 5], C[(i + 2) % 5]);
+            }
+        }
+        /* Iota */
+        A[0] = _mm512_xor_si512(A[0],
+            _mm512_set1_epi64((long long)KeccakF_RoundConstants[round]));
+    }
+
+    for (i = 0; i < 25; i++) {
+        _mm512_storeu_si512((void *)s[i], A[i]);
+    }
+}
+
+/* Absorbs and squeezes up to 'lanes' inputs at once, with rate r. Unused
+   lanes absorb a copy of the first input, and their output is discarded. */
+static void keccakx_lanes(unsigned char *out[], unsigned long long outlen,
+                          const unsigned char *in[], unsigned long long inlen,
+                          unsigned int count, unsigned int lanes,
+                          unsigned int r)
+{
+    uint64_t s[25][KECCAKX_MAX_LANES];
+    unsigned char t[200];
+    unsigned long long offset = 0;
+    unsigned long long tail = inlen % r;
+    unsigned int i, j, l;
+
+    memset(s, 0, sizeof(s));
+
+    /* Absorb all full blocks, followed by the padded final block. */
+    for (;;) {
+        for (l = 0; l < lanes; l++) {
+            i = l < count ? l : 0;
+            if (offset + r <= inlen) {
+                for (j = 0; j < r / 8; j++) {
+                    s[j][l] ^= load64(in[i] + offset + 8 * j);
+                }
+            }
+            else {
+                memset(t, 0, r);
+                memcpy(t, in[i] + offset, tail);
+                t[tail] = 0x1F;
+                t[r - 1] |= 128;
+                for (j = 0; j < r / 8; j++) {
+                    s[j][l] ^= load64(t + 8 * j);
+                }
+            }
+        }
+        if (offset + r > inlen) {
+            break;
+        }
+        offset += r;
+        if (lanes == 8) {
+            KeccakF1600x8_StatePermute(s);
+        }
+        else {
+            KeccakF1600x4_StatePermute(s);
+        }
+    }
+
+    /* Squeeze; the last block may be partial. */
+    for (offset = 0; offset < outlen; offset += r) {
+        if (lanes == 8) {
+            KeccakF1600x8_StatePermute(s);
+        }
+        else {
+            KeccakF1600x4_StatePermute(s);
+        }
+        for (l = 0; l < count; l++) {
+            for (j = 0; j < r / 8 && offset + 8 * j < outlen; j++) {
+                store64(t, s[j][l]);
+                memcpy(out[l] + offset + 8 * j, t,
+                       outlen - offset - 8 * j < 8 ? outlen - offset - 8 * j
+                                                   : 8);
+            }
+        }
+    }
+}
+
+#endif /* XMSS_FIPS202X_X86 */
+
+unsigned int shakexn_lanes(void)
+{
+#ifdef XMSS_FIPS202X_X86
+    if (__builtin_cpu_supports("avx512f")) {
+        return 8;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return 4;
+    }
+#endif
+    return 1;
+}
+
+static void shakexn(unsigned char *out[], unsigned long long outlen,
+                    const unsigned char *in[], unsigned long long inlen,
+                    unsigned int count, unsigned int r)
+{
+    unsigned int lanes = shakexn_lanes();
+    unsigned int i;
+
+    if (lanes == 1) {
+        for (i = 0; i < count; i++) {
+            if (r == SHAKE128_RATE) {
+                shake128(out[i], outlen, in[i], inlen);
+            }
+            else {
+                shake256(out[i], outlen, in[i], inlen);
+            }
+        }
+        return;
+    }
+#ifdef XMSS_FIPS202X_X86
+    for (i = 0; i < count; i += lanes) {
+        keccakx_lanes(out + i, outlen, in + i, inlen,
+                      count - i < lanes ? count - i : lanes, lanes, r);
+    }
+#endif
+}
+
+void shake128xn(unsigned char *out[], unsigned long long outlen,
+                const unsigned char *in[], unsigned long long inlen,
+                unsigned int count)
+{
+    shakexn(out, outlen, in, inlen, count, SHAKE128_RATE);
+}
+
+void shake256xn(unsigned char *out[], unsigned long long outlen,
+                const unsigned char *in[], unsigned long long inlen,
+                unsigned int count)
+{
+    shakexn(out, outlen, in, inlen, count, SHAKE256_RATE);
+}
@@ -0,0 +1,29 @@
+#ifndef XMSS_FIPS202X_H
+#define XMSS_FIPS202X_H
+
+#define KECCAKX_MAX_LANES 8
+
+/* These functions evaluate SHAKE on many independent inputs of equal length
+ * at once. On x86-64, the Keccak states are spread over the lanes of AVX2 or
+ * AVX-512 registers (4 or 8 lanes), depending on what the CPU supports at
+ * run-time. Otherwise, this falls back to a loop over shake128 or shake256.
+ */
+
+/* Returns the number of inputs that are processed at once, or 1 if this
+ * falls back to the scalar implementation.
+ */
+unsigned int shakexn_lanes(void);
+
+/* Evaluates SHAKE-128 on in[i] (of inlen bytes) and writes the first outlen
+ * bytes of output to out[i], for i in [0, count). out[i] may alias in[i].
+ */
+void shake128xn(unsigned char *out[], unsigned long long outlen,
+                const unsigned char *in[], unsigned long long inlen,
+                unsigned int count);
+
+/* As shake128xn, but for SHAKE-256. */
+void shake256xn(unsigned char *out[], unsigned long long outlen,
+                const unsigned char *in[], unsigned long long inlen,
+                unsigned int count);
+
+#endif
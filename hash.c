@@ -1,5 +1,9 @@
+#include <pthread.h>
 #include <stdint.h>
 #include <string.h>
+#ifdef XMSS_HASH_AUTOTUNE
+#include <time.h>
+#endif
 #include <openssl/sha.h>
 
 #include "hash_address.h"
@@ -7,12 +11,19 @@
 #include "params.h"
 #include "hash.h"
 #include "fips202.h"
+#include "fips202x.h"
+#include "sha2.h"
+#include "sha2x.h"
 
 #define XMSS_HASH_PADDING_F 0
 #define XMSS_HASH_PADDING_H 1
 #define XMSS_HASH_PADDING_HASH 2
 #define XMSS_HASH_PADDING_PRF 3
 
+/* The batched functions below process at most this many inputs at once, to
+   bound their stack usage; it matches the widest SHA-256 engine. */
+#define XMSS_HASH_XN_BATCH SHA256X_MAX_LANES
+
 void addr_to_bytes(unsigned char *bytes, const uint32_t addr[8])
 {
     int i;
@@ -21,42 +32,649 @@ void addr_to_bytes(unsigned char *bytes, const uint32_t addr[8])
     }
 }
 
-static int core_hash(const xmss_params *params,
-                     unsigned char *out,
-                     const unsigned char *in, unsigned long long inlen)
+/*
+ * The implementations of the hash functions. These compute the n-byte hash
+ * function (SHA-256, SHA-512, SHAKE-128 or SHAKE-256) on inlen bytes; i.e.
+ * they underlie F, H and H_msg.
+ */
+
+static void hash_sha256_portable(const xmss_params *params, unsigned char *out,
+                                 const unsigned char *in,
+                                 unsigned long long inlen)
+{
+    uint32_t iv[8];
+
+    (void)params;
+    sha256_inc_init(iv);
+    sha256_inc_finalize_portable(out, iv, in, inlen, 0);
+}
+
+static void hash_sha256_shani(const xmss_params *params, unsigned char *out,
+                              const unsigned char *in,
+                              unsigned long long inlen)
+{
+    uint32_t iv[8];
+
+    (void)params;
+    sha256_inc_init(iv);
+    sha256_inc_finalize_shani(out, iv, in, inlen, 0);
+}
+
+static void hash_sha256_openssl(const xmss_params *params, unsigned char *out,
+                                const unsigned char *in,
+                                unsigned long long inlen)
+{
+    (void)params;
+    SHA256(in, inlen, out);
+}
+
+static void hash_sha512_portable(const xmss_params *params, unsigned char *out,
+                                 const unsigned char *in,
+                                 unsigned long long inlen)
+{
+    uint64_t iv[8];
+
+    (void)params;
+    sha512_inc_init(iv);
+    sha512_inc_finalize(out, iv, in, inlen, 0);
+}
+
+static void hash_sha512_openssl(const xmss_params *params, unsigned char *out,
+                                const unsigned char *in,
+                                unsigned long long inlen)
+{
+    (void)params;
+    SHA512(in, inlen, out);
+}
+
+static void hash_shake128(const xmss_params *params, unsigned char *out,
+                          const unsigned char *in, unsigned long long inlen)
+{
+    (void)params;
+    shake128(out, 32, in, inlen);
+}
+
+static void hash_shake256(const xmss_params *params, unsigned char *out,
+                          const unsigned char *in, unsigned long long inlen)
+{
+    (void)params;
+    shake256(out, 64, in, inlen);
+}
+
+/*
+ * The implementations of the PRF. For SHA-2, these either resume from the
+ * midstate in the PRF context, or hash the full input.
+ */
+
+/* Writes the full PRF input, toByte(3, n) || key || in, to buf. */
+static void prf_input(const xmss_params *params, unsigned char *buf,
+                      const unsigned char in[32], const xmss_prf_ctx *key)
+{
+    ull_to_bytes(buf, params->n, XMSS_HASH_PADDING_PRF);
+    memcpy(buf + params->n, key->key, params->n);
+    memcpy(buf + 2*params->n, in, 32);
+}
+
+static void prf_sha256_portable(const xmss_params *params, unsigned char *out,
+                                const unsigned char in[32],
+                                const xmss_prf_ctx *key)
+{
+    sha256_inc_finalize_portable(out, key->state.sha256, in, 32,
+                                 2*params->n);
+}
+
+static void prf_sha256_shani(const xmss_params *params, unsigned char *out,
+                             const unsigned char in[32],
+                             const xmss_prf_ctx *key)
+{
+    sha256_inc_finalize_shani(out, key->state.sha256, in, 32, 2*params->n);
+}
+
+static void prf_sha512_portable(const xmss_params *params, unsigned char *out,
+                                const unsigned char in[32],
+                                const xmss_prf_ctx *key)
+{
+    sha512_inc_finalize(out, key->state.sha512, in, 32, 2*params->n);
+}
+
+static void prf_sha256_openssl(const xmss_params *params, unsigned char *out,
+                               const unsigned char in[32],
+                               const xmss_prf_ctx *key)
+{
+    unsigned char buf[2*params->n + 32];
+
+    prf_input(params, buf, in, key);
+    SHA256(buf, 2*params->n + 32, out);
+}
+
+static void prf_sha512_openssl(const xmss_params *params, unsigned char *out,
+                               const unsigned char in[32],
+                               const xmss_prf_ctx *key)
+{
+    unsigned char buf[2*params->n + 32];
+
+    prf_input(params, buf, in, key);
+    SHA512(buf, 2*params->n + 32, out);
+}
+
+static void prf_shake(const xmss_params *params, unsigned char *out,
+                      const unsigned char in[32], const xmss_prf_ctx *key)
+{
+    unsigned char buf[2*params->n + 32];
+
+    prf_input(params, buf, in, key);
+    if (params->n == 32) {
+        shake128(out, 32, buf, 2*params->n + 32);
+    }
+    else {
+        shake256(out, 64, buf, 2*params->n + 32);
+    }
+}
+
+/*
+ * The batched implementations; these use the multi-buffer SHA-2 and Keccak
+ * code, or otherwise loop over the selected scalar implementation.
+ */
+
+static void hash_xn_sha256x(const xmss_params *params, unsigned char *out[],
+                            const unsigned char *in[],
+                            unsigned long long inlen, unsigned int count)
+{
+    (void)params;
+    sha256xn_inc_finalize(out, NULL, in, inlen, 0, count);
+}
+
+static void hash_xn_sha512x(const xmss_params *params, unsigned char *out[],
+                            const unsigned char *in[],
+                            unsigned long long inlen, unsigned int count)
+{
+    (void)params;
+    sha512xn_inc_finalize(out, NULL, in, inlen, 0, count);
+}
+
+static void hash_xn_shake128x(const xmss_params *params, unsigned char *out[],
+                              const unsigned char *in[],
+                              unsigned long long inlen, unsigned int count)
+{
+    (void)params;
+    shake128xn(out, 32, in, inlen, count);
+}
+
+static void hash_xn_shake256x(const xmss_params *params, unsigned char *out[],
+                              const unsigned char *in[],
+                              unsigned long long inlen, unsigned int count)
 {
-    if (params->n == 32 && params->func == XMSS_SHA2) {
-        SHA256(in, inlen, out);
+    (void)params;
+    shake256xn(out, 64, in, inlen, count);
+}
+
+static void f_xn_loop(const xmss_params *params, unsigned char *out[],
+                      const unsigned char *in[],
+                      unsigned long long inlen, unsigned int count)
+{
+    unsigned int i;
+
+    for (i = 0; i < count; i++) {
+        params->hash->f(params, out[i], in[i], inlen);
     }
-    else if (params->n == 32 && params->func == XMSS_SHAKE) {
-        shake128(out, 32, in, inlen);
+}
+
+static void h_xn_loop(const xmss_params *params, unsigned char *out[],
+                      const unsigned char *in[],
+                      unsigned long long inlen, unsigned int count)
+{
+    unsigned int i;
+
+    for (i = 0; i < count; i++) {
+        params->hash->h(params, out[i], in[i], inlen);
     }
-    else if (params->n == 64 && params->func == XMSS_SHA2) {
-        SHA512(in, inlen, out);
+}
+
+static void prf_xn_sha2x(const xmss_params *params, unsigned char *out[],
+                         const unsigned char *in[],
+                         const xmss_prf_ctx *key[], unsigned int count)
+{
+    const uint32_t *state256[XMSS_HASH_XN_BATCH];
+    const uint64_t *state512[XMSS_HASH_XN_BATCH];
+    unsigned int i, j, c;
+
+    for (i = 0; i < count; i += c) {
+        c = count - i < XMSS_HASH_XN_BATCH ? count - i : XMSS_HASH_XN_BATCH;
+        for (j = 0; j < c; j++) {
+            state256[j] = key[i + j]->state.sha256;
+            state512[j] = key[i + j]->state.sha512;
+        }
+        if (params->n == 32) {
+            sha256xn_inc_finalize(out + i, state256, in + i, 32,
+                                  2*params->n, c);
+        }
+        else {
+            sha512xn_inc_finalize(out + i, state512, in + i, 32,
+                                  2*params->n, c);
+        }
     }
-    else if (params->n == 64 && params->func == XMSS_SHAKE) {
-        shake256(out, 64, in, inlen);
+}
+
+static void prf_xn_shakex(const xmss_params *params, unsigned char *out[],
+                          const unsigned char *in[],
+                          const xmss_prf_ctx *key[], unsigned int count)
+{
+    unsigned char buf[XMSS_HASH_XN_BATCH][2*params->n + 32];
+    const unsigned char *buf_ptrs[XMSS_HASH_XN_BATCH];
+    unsigned int i, j, c;
+
+    for (i = 0; i < count; i += c) {
+        c = count - i < XMSS_HASH_XN_BATCH ? count - i : XMSS_HASH_XN_BATCH;
+        for (j = 0; j < c; j++) {
+            prf_input(params, buf[j], in[i + j], key[i + j]);
+            buf_ptrs[j] = buf[j];
+        }
+        if (params->n == 32) {
+            shake128xn(out + i, 32, buf_ptrs, 2*params->n + 32, c);
+        }
+        else {
+            shake256xn(out + i, 64, buf_ptrs, 2*params->n + 32, c);
+        }
     }
-    else {
-        return -1;
+}
+
+static void prf_xn_loop(const xmss_params *params, unsigned char *out[],
+                        const unsigned char *in[],
+                        const xmss_prf_ctx *key[], unsigned int count)
+{
+    unsigned int i;
+
+    for (i = 0; i < count; i++) {
+        params->hash->prf(params, out[i], in[i], key[i]);
     }
-    return 0;
+}
+
+static int sha256x_supported(void)
+{
+    return sha256xn_lanes() > 1;
+}
+
+static int sha512x_supported(void)
+{
+    return sha512xn_lanes() > 1;
+}
+
+static int shakex_supported(void)
+{
+    return shakexn_lanes() > 1;
 }
 
 /*
- * Computes PRF(key, in), for a key of params->n bytes, and a 32-byte input.
+ * The candidate implementations for each hash function, in order of
+ * preference. An implementation can only be selected if its 'supported'
+ * function returns 1 on this CPU, or if it has none. Each list ends with an
+ * implementation that is always available. Where there is no SHA-NI, OpenSSL
+ * comes before the portable SHA-2, as its assembly kernels are tuned for the
+ * CPU it runs on; XMSS_HASH_AUTOTUNE chooses between them by timing instead.
  */
-int prf(const xmss_params *params,
-        unsigned char *out, const unsigned char in[32],
-        const unsigned char *key)
+
+typedef struct {
+    xmss_hash_fn fn;
+    int (*supported)(void);
+    const char *name;
+} hash_impl;
+
+typedef struct {
+    xmss_prf_fn fn;
+    int (*supported)(void);
+    const char *name;
+} prf_impl;
+
+typedef struct {
+    xmss_hash_xn_fn fn;
+    int (*supported)(void);
+} hash_xn_impl;
+
+typedef struct {
+    xmss_prf_xn_fn fn;
+    int (*supported)(void);
+} prf_xn_impl;
+
+typedef struct {
+    unsigned int func;
+    unsigned int n;
+    const hash_impl *hash;
+    const prf_impl *prf;
+    const hash_xn_impl *f_xn;
+    const hash_xn_impl *h_xn;
+    const prf_xn_impl *prf_xn;
+    /* The selected implementations; this is filled in on first use, and
+       only read once selected is set, which is stored with release order. */
+    struct xmss_hash_ops ops;
+    int selected;
+} hash_family;
+
+static const hash_impl sha256_hash[] = {
+    {hash_sha256_shani, sha256_shani_supported, "shani"},
+    {hash_sha256_openssl, NULL, "openssl"},
+    {hash_sha256_portable, NULL, "portable"},
+    {NULL, NULL, NULL}
+};
+static const prf_impl sha256_prf[] = {
+    {prf_sha256_shani, sha256_shani_supported, "shani"},
+    {prf_sha256_openssl, NULL, "openssl"},
+    {prf_sha256_portable, NULL, "portable"},
+    {NULL, NULL, NULL}
+};
+static const hash_xn_impl sha256_f_xn[] = {
+    {hash_xn_sha256x, sha256x_supported},
+    {f_xn_loop, NULL},
+    {NULL, NULL}
+};
+static const hash_xn_impl sha256_h_xn[] = {
+    {hash_xn_sha256x, sha256x_supported},
+    {h_xn_loop, NULL},
+    {NULL, NULL}
+};
+static const prf_xn_impl sha256_prf_xn[] = {
+    {prf_xn_sha2x, sha256x_supported},
+    {prf_xn_loop, NULL},
+    {NULL, NULL}
+};
+
+static const hash_impl sha512_hash[] = {
+    {hash_sha512_openssl, NULL, "openssl"},
+    {hash_sha512_portable, NULL, "portable"},
+    {NULL, NULL, NULL}
+};
+static const prf_impl sha512_prf[] = {
+    {prf_sha512_openssl, NULL, "openssl"},
+    {prf_sha512_portable, NULL, "portable"},
+    {NULL, NULL, NULL}
+};
+static const hash_xn_impl sha512_f_xn[] = {
+    {hash_xn_sha512x, sha512x_supported},
+    {f_xn_loop, NULL},
+    {NULL, NULL}
+};
+static const hash_xn_impl sha512_h_xn[] = {
+    {hash_xn_sha512x, sha512x_supported},
+    {h_xn_loop, NULL},
+    {NULL, NULL}
+};
+static const prf_xn_impl sha512_prf_xn[] = {
+    {prf_xn_sha2x, sha512x_supported},
+    {prf_xn_loop, NULL},
+    {NULL, NULL}
+};
+
+static const hash_impl shake128_hash[] = {
+    {hash_shake128, NULL, "fips202"},
+    {NULL, NULL, NULL}
+};
+static const hash_impl shake256_hash[] = {
+    {hash_shake256, NULL, "fips202"},
+    {NULL, NULL, NULL}
+};
+static const prf_impl shake_prf[] = {
+    {prf_shake, NULL, "fips202"},
+    {NULL, NULL, NULL}
+};
+static const hash_xn_impl shake128_f_xn[] = {
+    {hash_xn_shake128x, shakex_supported},
+    {f_xn_loop, NULL},
+    {NULL, NULL}
+};
+static const hash_xn_impl shake128_h_xn[] = {
+    {hash_xn_shake128x, shakex_supported},
+    {h_xn_loop, NULL},
+    {NULL, NULL}
+};
+static const hash_xn_impl shake256_f_xn[] = {
+    {hash_xn_shake256x, shakex_supported},
+    {f_xn_loop, NULL},
+    {NULL, NULL}
+};
+static const hash_xn_impl shake256_h_xn[] = {
+    {hash_xn_shake256x, shakex_supported},
+    {h_xn_loop, NULL},
+    {NULL, NULL}
+};
+static const prf_xn_impl shake_prf_xn[] = {
+    {prf_xn_shakex, shakex_supported},
+    {prf_xn_loop, NULL},
+    {NULL, NULL}
+};
+
+static hash_family hash_families[] = {
+    {XMSS_SHA2, 32, sha256_hash, sha256_prf,
+     sha256_f_xn, sha256_h_xn, sha256_prf_xn, {0}, 0},
+    {XMSS_SHA2, 64, sha512_hash, sha512_prf,
+     sha512_f_xn, sha512_h_xn, sha512_prf_xn, {0}, 0},
+    {XMSS_SHAKE, 32, shake128_hash, shake_prf,
+     shake128_f_xn, shake128_h_xn, shake_prf_xn, {0}, 0},
+    {XMSS_SHAKE, 64, shake256_hash, shake_prf,
+     shake256_f_xn, shake256_h_xn, shake_prf_xn, {0}, 0},
+};
+
+#define IMPL_AVAILABLE(impl) ((impl).supported == NULL || (impl).supported())
+
+#ifdef XMSS_HASH_AUTOTUNE
+
+/* The number of calls per measurement, and the number of measurements of
+   which the fastest counts. The messages for H_msg are assumed to be of
+   XMSS_HASH_AUTOTUNE_MLEN bytes. */
+#define XMSS_HASH_AUTOTUNE_CALLS 64
+#define XMSS_HASH_AUTOTUNE_ROUNDS 5
+#define XMSS_HASH_AUTOTUNE_MLEN 1024
+
+static unsigned long long autotune_time_ns(void)
 {
-    unsigned char buf[2*params->n + 32];
+    struct timespec t;
 
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (unsigned long long)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+#define AUTOTUNE_SELECT(selected, impls, call)                               \
+    do {                                                                     \
+        unsigned long long best_ = 0, t_, start_;                            \
+        unsigned int i_, r_, k_;                                             \
+        for (i_ = 0; impls[i_].fn != NULL; i_++) {                           \
+            if (!IMPL_AVAILABLE(impls[i_])) {                                \
+                continue;                                                    \
+            }                                                                \
+            for (r_ = 0; r_ < XMSS_HASH_AUTOTUNE_ROUNDS; r_++) {             \
+                start_ = autotune_time_ns();                                 \
+                for (k_ = 0; k_ < XMSS_HASH_AUTOTUNE_CALLS; k_++) {          \
+                    impls[i_].fn call;                                       \
+                }                                                            \
+                t_ = autotune_time_ns() - start_;                            \
+                if (selected == NULL || t_ < best_) {                        \
+                    selected = impls[i_].fn;                                 \
+                    best_ = t_;                                              \
+                }                                                            \
+            }                                                                \
+        }                                                                    \
+    } while (0)
+
+/*
+ * Selects the fastest available implementation for each of the hash
+ * functions, by timing them on inputs of the lengths that XMSS uses.
+ */
+static void hash_family_select(hash_family *family)
+{
+    xmss_params params;
+    unsigned int n = family->n;
+    unsigned char in[XMSS_HASH_XN_BATCH][4*n + XMSS_HASH_AUTOTUNE_MLEN];
+    unsigned char out[XMSS_HASH_XN_BATCH][n];
+    unsigned char key[n];
+    unsigned char *out_ptrs[XMSS_HASH_XN_BATCH];
+    const unsigned char *in_ptrs[XMSS_HASH_XN_BATCH];
+    const xmss_prf_ctx *key_ptrs[XMSS_HASH_XN_BATCH];
+    xmss_prf_ctx key_ctx;
+    struct xmss_hash_ops *ops = &family->ops;
+    unsigned int j;
+
+    memset(&params, 0, sizeof(params));
+    params.func = family->func;
+    params.n = n;
+    params.hash = ops;
+
+    memset(in, 0x5a, sizeof(in));
+    memset(key, 0xa5, sizeof(key));
+    prf_ctx_init(&params, &key_ctx, key);
+    for (j = 0; j < XMSS_HASH_XN_BATCH; j++) {
+        out_ptrs[j] = out[j];
+        in_ptrs[j] = in[j];
+        key_ptrs[j] = &key_ctx;
+    }
+
+    ops->f = ops->h = ops->h_msg = NULL;
+    ops->prf = NULL;
+    ops->f_xn = ops->h_xn = NULL;
+    ops->prf_xn = NULL;
+
+    AUTOTUNE_SELECT(ops->f, family->hash, (&params, out[0], in[0], 3*n));
+    AUTOTUNE_SELECT(ops->h, family->hash, (&params, out[0], in[0], 4*n));
+    AUTOTUNE_SELECT(ops->h_msg, family->hash,
+                    (&params, out[0], in[0], 4*n + XMSS_HASH_AUTOTUNE_MLEN));
+    AUTOTUNE_SELECT(ops->prf, family->prf, (&params, out[0], in[0], &key_ctx));
+    /* The loops over the scalar implementations use the selection above. */
+    AUTOTUNE_SELECT(ops->f_xn, family->f_xn,
+                    (&params, out_ptrs, in_ptrs, 3*n, XMSS_HASH_XN_BATCH));
+    AUTOTUNE_SELECT(ops->h_xn, family->h_xn,
+                    (&params, out_ptrs, in_ptrs, 4*n, XMSS_HASH_XN_BATCH));
+    AUTOTUNE_SELECT(ops->prf_xn, family->prf_xn,
+                    (&params, out_ptrs, in_ptrs, key_ptrs,
+                     XMSS_HASH_XN_BATCH));
+}
+
+#else
+
+#define FIRST_AVAILABLE(selected, impls)                                     \
+    do {                                                                     \
+        unsigned int i_;                                                     \
+        for (i_ = 0; !IMPL_AVAILABLE(impls[i_]); i_++);                      \
+        selected = impls[i_].fn;                                             \
+    } while (0)
+
+/*
+ * Selects the first available implementation for each of the hash
+ * functions, based on the features of this CPU.
+ */
+static void hash_family_select(hash_family *family)
+{
+    struct xmss_hash_ops *ops = &family->ops;
+
+    FIRST_AVAILABLE(ops->f, family->hash);
+    FIRST_AVAILABLE(ops->h, family->hash);
+    FIRST_AVAILABLE(ops->h_msg, family->hash);
+    FIRST_AVAILABLE(ops->prf, family->prf);
+    FIRST_AVAILABLE(ops->f_xn, family->f_xn);
+    FIRST_AVAILABLE(ops->h_xn, family->h_xn);
+    FIRST_AVAILABLE(ops->prf_xn, family->prf_xn);
+}
+
+#endif /* XMSS_HASH_AUTOTUNE */
+
+/* Keeps threads that use a family for the first time at once from selecting
+   its implementations, and writing its ops, at the same time. */
+static pthread_mutex_t hash_select_lock = PTHREAD_MUTEX_INITIALIZER;
+
+const struct xmss_hash_ops *xmss_hash_select(const xmss_params *params)
+{
+    hash_family *family;
+    unsigned int i;
+
+    for (i = 0; i < sizeof(hash_families) / sizeof(hash_families[0]); i++) {
+        family = &hash_families[i];
+        if (family->func != params->func || family->n != params->n) {
+            continue;
+        }
+        if (!__atomic_load_n(&family->selected, __ATOMIC_ACQUIRE)) {
+            pthread_mutex_lock(&hash_select_lock);
+            if (!family->selected) {
+                hash_family_select(family);
+                __atomic_store_n(&family->selected, 1, __ATOMIC_RELEASE);
+            }
+            pthread_mutex_unlock(&hash_select_lock);
+        }
+        return &family->ops;
+    }
+    return NULL;
+}
+
+/*
+ * Returns the name of the implementation that xmss_hash_select chose for f
+ * of params, or for prf if prf is set, or NULL if params are not supported.
+ */
+const char *xmss_hash_impl_name(const xmss_params *params, int prf)
+{
+    const struct xmss_hash_ops *ops = xmss_hash_select(params);
+    unsigned int i, j;
+
+    for (i = 0; ops != NULL && i < sizeof(hash_families) / sizeof(hash_families[0]); i++) {
+        if (ops != &hash_families[i].ops) {
+            continue;
+        }
+        for (j = 0; prf && hash_families[i].prf[j].fn != NULL; j++) {
+            if (hash_families[i].prf[j].fn == ops->prf) {
+                return hash_families[i].prf[j].name;
+            }
+        }
+        for (j = 0; !prf && hash_families[i].hash[j].fn != NULL; j++) {
+            if (hash_families[i].hash[j].fn == ops->f) {
+                return hash_families[i].hash[j].name;
+            }
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Prepares a PRF context for the n-byte key. For SHA-2, the first input block
+ * of the PRF, toByte(3, n) || key, is exactly one block of the compression
+ * function; we absorb it here, once per key, rather than for every PRF call.
+ */
+void prf_ctx_init(const xmss_params *params,
+                  xmss_prf_ctx *ctx, const unsigned char *key)
+{
+    unsigned char buf[2*params->n];
+
+    ctx->key = key;
+
+    if (params->func != XMSS_SHA2) {
+        return;
+    }
     ull_to_bytes(buf, params->n, XMSS_HASH_PADDING_PRF);
     memcpy(buf + params->n, key, params->n);
-    memcpy(buf + 2*params->n, in, 32);
 
-    return core_hash(params, out, buf, 2*params->n + 32);
+    if (params->n == 32) {
+        sha256_inc_init(ctx->state.sha256);
+        sha256_inc_blocks(ctx->state.sha256, buf, 1);
+    }
+    else if (params->n == 64) {
+        sha512_inc_init(ctx->state.sha512);
+        sha512_inc_blocks(ctx->state.sha512, buf, 1);
+    }
+}
+
+/*
+ * Computes PRF(key, in), for a key of params->n bytes, and a 32-byte input.
+ */
+int prf(const xmss_params *params,
+        unsigned char *out, const unsigned char in[32],
+        const xmss_prf_ctx *key)
+{
+    params->hash->prf(params, out, in, key);
+    return 0;
+}
+
+/*
+ * Computes out[i] = PRF(key[i], in[i]) for i in [0, count).
+ */
+int prf_xn(const xmss_params *params,
+           unsigned char *out[], const unsigned char *in[],
+           const xmss_prf_ctx *key[], unsigned int count)
+{
+    params->hash->prf_xn(params, out, in, key, count);
+    return 0;
 }
 
 /*
@@ -77,7 +695,138 @@ int hash_message(const xmss_params *params, unsigned char *out,
     memcpy(m_with_prefix + 2*params->n, root, params->n);
     ull_to_bytes(m_with_prefix + 3*params->n, params->n, idx);
 
-    return core_hash(params, out, m_with_prefix, mlen + 4*params->n);
+    params->hash->h_msg(params, out, m_with_prefix, mlen + 4*params->n);
+    return 0;
+}
+
+/* Returns the block size of the hash function that underlies H_msg. */
+static unsigned int hash_message_block_bytes(const xmss_params *params)
+{
+    if (params->func == XMSS_SHA2) {
+        return params->n == 32 ? SHA256_BLOCK_BYTES : SHA512_BLOCK_BYTES;
+    }
+    return params->n == 32 ? SHAKE128_RATE : SHAKE256_RATE;
+}
+
+/* Absorbs nblocks full blocks from in into the H_msg state. */
+static void hash_message_blocks(const xmss_params *params,
+                                xmss_hash_msg_ctx *ctx,
+                                const unsigned char *in,
+                                unsigned long long nblocks)
+{
+    unsigned int r = hash_message_block_bytes(params);
+
+    if (params->func == XMSS_SHA2) {
+        if (params->n == 32) {
+            sha256_inc_blocks(ctx->state.sha256, in, nblocks);
+        }
+        else {
+            sha512_inc_blocks(ctx->state.sha512, in, nblocks);
+        }
+    }
+    else {
+        shake_inc_blocks(ctx->state.keccak, r, in, nblocks);
+    }
+    ctx->absorbed += nblocks * r;
+}
+
+void hash_message_init(const xmss_params *params, xmss_hash_msg_ctx *ctx,
+                       const unsigned char *R, const unsigned char *root,
+                       unsigned long long idx)
+{
+    unsigned char prefix[4 * params->n];
+
+    if (params->func == XMSS_SHA2) {
+        if (params->n == 32) {
+            sha256_inc_init(ctx->state.sha256);
+        }
+        else {
+            sha512_inc_init(ctx->state.sha512);
+        }
+    }
+    else {
+        shake_inc_init(ctx->state.keccak);
+    }
+    ctx->buflen = 0;
+    ctx->absorbed = 0;
+
+    /* As in hash_message: toByte(X, 32) || R || root || index */
+    ull_to_bytes(prefix, params->n, XMSS_HASH_PADDING_HASH);
+    memcpy(prefix + params->n, R, params->n);
+    memcpy(prefix + 2*params->n, root, params->n);
+    ull_to_bytes(prefix + 3*params->n, params->n, idx);
+
+    hash_message_update(params, ctx, prefix, 4 * params->n);
+}
+
+void hash_message_update(const xmss_params *params, xmss_hash_msg_ctx *ctx,
+                         const unsigned char *m, unsigned long long mlen)
+{
+    unsigned int r = hash_message_block_bytes(params);
+    unsigned long long nblocks;
+    unsigned int t;
+
+    /* First complete the buffered block, if any. */
+    if (ctx->buflen > 0) {
+        t = r - ctx->buflen;
+        if (t > mlen) {
+            t = mlen;
+        }
+        memcpy(ctx->buf + ctx->buflen, m, t);
+        ctx->buflen += t;
+        m += t;
+        mlen -= t;
+        if (ctx->buflen < r) {
+            return;
+        }
+        hash_message_blocks(params, ctx, ctx->buf, 1);
+        ctx->buflen = 0;
+    }
+
+    /* Full blocks are absorbed straight from the message. */
+    nblocks = mlen / r;
+    hash_message_blocks(params, ctx, m, nblocks);
+    m += nblocks * r;
+    mlen -= nblocks * r;
+
+    memcpy(ctx->buf, m, mlen);
+    ctx->buflen = mlen;
+}
+
+void hash_message_final(const xmss_params *params, xmss_hash_msg_ctx *ctx,
+                        unsigned char *out)
+{
+    if (params->func == XMSS_SHA2) {
+        if (params->n == 32) {
+            sha256_inc_finalize(out, ctx->state.sha256,
+                                ctx->buf, ctx->buflen, ctx->absorbed);
+        }
+        else {
+            sha512_inc_finalize(out, ctx->state.sha512,
+                                ctx->buf, ctx->buflen, ctx->absorbed);
+        }
+    }
+    else {
+        shake_inc_finalize(out, params->n, ctx->state.keccak,
+                           hash_message_block_bytes(params),
+                           ctx->buf, ctx->buflen);
+    }
+}
+
+int hash_message_iov(const xmss_params *params, unsigned char *out,
+                     const unsigned char *R, const unsigned char *root,
+                     unsigned long long idx,
+                     const struct iovec *iov, unsigned int iovcnt)
+{
+    xmss_hash_msg_ctx ctx;
+    unsigned int i;
+
+    hash_message_init(params, &ctx, R, root, idx);
+    for (i = 0; i < iovcnt; i++) {
+        hash_message_update(params, &ctx, iov[i].iov_base, iov[i].iov_len);
+    }
+    hash_message_final(params, &ctx, out);
+    return 0;
 }
 
 /**
@@ -85,7 +834,7 @@ int hash_message(const xmss_params *params, unsigned char *out,
  */
 int thash_h(const xmss_params *params,
             unsigned char *out, const unsigned char *in,
-            const unsigned char *pub_seed, uint32_t addr[8])
+            const xmss_prf_ctx *pub_seed, uint32_t addr[8])
 {
     unsigned char buf[4 * params->n];
     unsigned char bitmask[2 * params->n];
@@ -112,12 +861,13 @@ int thash_h(const xmss_params *params,
     for (i = 0; i < 2 * params->n; i++) {
         buf[2*params->n + i] = in[i] ^ bitmask[i];
     }
-    return core_hash(params, out, buf, 4 * params->n);
+    params->hash->h(params, out, buf, 4 * params->n);
+    return 0;
 }
 
 int thash_f(const xmss_params *params,
             unsigned char *out, const unsigned char *in,
-            const unsigned char *pub_seed, uint32_t addr[8])
+            const xmss_prf_ctx *pub_seed, uint32_t addr[8])
 {
     unsigned char buf[3 * params->n];
     unsigned char bitmask[params->n];
@@ -140,5 +890,104 @@ int thash_f(const xmss_params *params,
     for (i = 0; i < params->n; i++) {
         buf[2*params->n + i] = in[i] ^ bitmask[i];
     }
-    return core_hash(params, out, buf, 3 * params->n);
+    params->hash->f(params, out, buf, 3 * params->n);
+    return 0;
+}
+
+/*
+ * Computes thash_h for count independent inputs at once. The key and masks of
+ * all inputs are generated as a single batch of PRF calls, and the final hash
+ * calls as another. As for thash_h, in[i] holds both halves, and the
+ * key_and_mask fields of the addresses are modified.
+ */
+int thash_h_xn(const xmss_params *params,
+               unsigned char *out[], const unsigned char *in[],
+               const xmss_prf_ctx *pub_seed, uint32_t addr[][8],
+               unsigned int count)
+{
+    unsigned char buf[XMSS_HASH_XN_BATCH][4 * params->n];
+    unsigned char bitmask[XMSS_HASH_XN_BATCH][2 * params->n];
+    unsigned char addr_as_bytes[3 * XMSS_HASH_XN_BATCH][32];
+    unsigned char *prf_out[3 * XMSS_HASH_XN_BATCH];
+    const unsigned char *prf_in[3 * XMSS_HASH_XN_BATCH];
+    const xmss_prf_ctx *prf_key[3 * XMSS_HASH_XN_BATCH];
+    const unsigned char *hash_in[XMSS_HASH_XN_BATCH];
+    unsigned int i, j, k, c;
+
+    for (i = 0; i < count; i += c) {
+        c = count - i < XMSS_HASH_XN_BATCH ? count - i : XMSS_HASH_XN_BATCH;
+
+        for (j = 0; j < c; j++) {
+            /* Set the function padding. */
+            ull_to_bytes(buf[j], params->n, XMSS_HASH_PADDING_H);
+
+            /* The n-byte key, followed by the two halves of the mask. */
+            for (k = 0; k < 3; k++) {
+                set_key_and_mask(addr[i + j], k);
+                addr_to_bytes(addr_as_bytes[3*j + k], addr[i + j]);
+                prf_in[3*j + k] = addr_as_bytes[3*j + k];
+                prf_key[3*j + k] = pub_seed;
+            }
+            prf_out[3*j] = buf[j] + params->n;
+            prf_out[3*j + 1] = bitmask[j];
+            prf_out[3*j + 2] = bitmask[j] + params->n;
+        }
+        params->hash->prf_xn(params, prf_out, prf_in, prf_key, 3 * c);
+
+        for (j = 0; j < c; j++) {
+            for (k = 0; k < 2 * params->n; k++) {
+                buf[j][2*params->n + k] = in[i + j][k] ^ bitmask[j][k];
+            }
+            hash_in[j] = buf[j];
+        }
+        params->hash->h_xn(params, out + i, hash_in, 4 * params->n, c);
+    }
+    return 0;
+}
+
+/*
+ * Computes thash_f for count independent inputs at once; see thash_h_xn.
+ */
+int thash_f_xn(const xmss_params *params,
+               unsigned char *out[], const unsigned char *in[],
+               const xmss_prf_ctx *pub_seed, uint32_t addr[][8],
+               unsigned int count)
+{
+    unsigned char buf[XMSS_HASH_XN_BATCH][3 * params->n];
+    unsigned char bitmask[XMSS_HASH_XN_BATCH][params->n];
+    unsigned char addr_as_bytes[2 * XMSS_HASH_XN_BATCH][32];
+    unsigned char *prf_out[2 * XMSS_HASH_XN_BATCH];
+    const unsigned char *prf_in[2 * XMSS_HASH_XN_BATCH];
+    const xmss_prf_ctx *prf_key[2 * XMSS_HASH_XN_BATCH];
+    const unsigned char *hash_in[XMSS_HASH_XN_BATCH];
+    unsigned int i, j, k, c;
+
+    for (i = 0; i < count; i += c) {
+        c = count - i < XMSS_HASH_XN_BATCH ? count - i : XMSS_HASH_XN_BATCH;
+
+        for (j = 0; j < c; j++) {
+            /* Set the function padding. */
+            ull_to_bytes(buf[j], params->n, XMSS_HASH_PADDING_F);
+
+            /* The n-byte key, followed by the n-byte mask. */
+            for (k = 0; k < 2; k++) {
+                set_key_and_mask(addr[i + j], k);
+                addr_to_bytes(addr_as_bytes[2*j + k], addr[i + j]);
+                prf_in[2*j + k] = addr_as_bytes[2*j + k];
+                prf_key[2*j + k] = pub_seed;
+            }
+            prf_out[2*j] = buf[j] + params->n;
+            prf_out[2*j + 1] = bitmask[j];
+        }
+        params->hash->prf_xn(params, prf_out, prf_in, prf_key, 2 * c);
+
+        for (j = 0; j < c; j++) {
+            for (k = 0; k < params->n; k++) {
+                buf[j][2*params->n + k] = in[i + j][k] ^ bitmask[j][k];
+            }
+            hash_in[j] = buf[j];
+        }
+        params->hash->f_xn(params, out + i, hash_in, 3 * params->n, c);
+    }
+    return 0;
 }
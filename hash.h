@@ -2,13 +2,109 @@
 #define XMSS_HASH_H
 
 #include <stdint.h>
+#include <sys/uio.h>
 #include "params.h"
+#include "fips202.h"
+
+/**
+ * A PRF key, together with the hash function state after absorbing the first
+ * input block of every PRF call under that key, i.e. toByte(3, n) || key.
+ * For the SHA-2 parameter sets, this allows prf to resume from this midstate
+ * and only compress the final block. Initialize using prf_ctx_init.
+ */
+typedef struct {
+    const unsigned char *key;
+    union {
+        uint32_t sha256[8];
+        uint64_t sha512[8];
+    } state;
+} xmss_prf_ctx;
+
+/**
+ * The state of an incremental computation of H_msg; see hash_message_init.
+ * buf holds the input that does not fill a complete block yet, which is at
+ * most one SHAKE-128 block, the largest of the four block sizes.
+ */
+typedef struct {
+    union {
+        uint32_t sha256[8];
+        uint64_t sha512[8];
+        uint64_t keccak[25];
+    } state;
+    unsigned char buf[SHAKE128_RATE];
+    unsigned int buflen;
+    unsigned long long absorbed;
+} xmss_hash_msg_ctx;
+
+typedef void (*xmss_hash_fn)(const xmss_params *params, unsigned char *out,
+                             const unsigned char *in,
+                             unsigned long long inlen);
+typedef void (*xmss_hash_xn_fn)(const xmss_params *params,
+                                unsigned char *out[],
+                                const unsigned char *in[],
+                                unsigned long long inlen, unsigned int count);
+typedef void (*xmss_prf_fn)(const xmss_params *params, unsigned char *out,
+                            const unsigned char in[32],
+                            const xmss_prf_ctx *key);
+typedef void (*xmss_prf_xn_fn)(const xmss_params *params,
+                               unsigned char *out[],
+                               const unsigned char *in[],
+                               const xmss_prf_ctx *key[], unsigned int count);
+
+/**
+ * The implementations of the hash functions for a parameter set; see
+ * xmss_hash_select. f, h and h_msg compute the n-byte hash function on the
+ * (already prefixed and masked) inputs of F, H and H_msg, and prf computes
+ * the PRF. The _xn variants do the same for count independent inputs.
+ */
+struct xmss_hash_ops {
+    xmss_hash_fn f;
+    xmss_hash_fn h;
+    xmss_hash_fn h_msg;
+    xmss_prf_fn prf;
+    xmss_hash_xn_fn f_xn;
+    xmss_hash_xn_fn h_xn;
+    xmss_prf_xn_fn prf_xn;
+};
+
+/**
+ * Returns the hash function implementations for params->func and params->n,
+ * or NULL if these are not supported. The choice between the portable,
+ * OpenSSL, SHA-NI and multi-buffer implementations is made once, on first
+ * use, based on what the CPU supports. When compiled with
+ * XMSS_HASH_AUTOTUNE, it is instead based on a short benchmark. This may be
+ * called from any number of threads at once.
+ */
+const struct xmss_hash_ops *xmss_hash_select(const xmss_params *params);
+
+/**
+ * Returns the name of the implementation that xmss_hash_select chose for f
+ * of params, or for prf if prf is set: "shani", "openssl", "portable" or
+ * "fips202". Returns NULL if params are not supported.
+ */
+const char *xmss_hash_impl_name(const xmss_params *params, int prf);
 
 void addr_to_bytes(unsigned char *bytes, const uint32_t addr[8]);
 
+/**
+ * Prepares a PRF context for the n-byte key. Note that the context refers to
+ * key rather than copying it, so it should remain available.
+ */
+void prf_ctx_init(const xmss_params *params,
+                  xmss_prf_ctx *ctx, const unsigned char *key);
+
 int prf(const xmss_params *params,
         unsigned char *out, const unsigned char in[32],
-        const unsigned char *key);
+        const xmss_prf_ctx *key);
+
+/**
+ * Computes out[i] = PRF(key[i], in[i]) for i in [0, count). Where
+ * available, the calls are spread over the lanes of the multi-buffer SHA-2
+ * or Keccak implementation.
+ */
+int prf_xn(const xmss_params *params,
+           unsigned char *out[], const unsigned char *in[],
+           const xmss_prf_ctx *key[], unsigned int count);
 
 int h_msg(const xmss_params *params,
           unsigned char *out,
@@ -17,15 +113,56 @@ int h_msg(const xmss_params *params,
 
 int thash_h(const xmss_params *params,
             unsigned char *out, const unsigned char *in,
-            const unsigned char *pub_seed, uint32_t addr[8]);
+            const xmss_prf_ctx *pub_seed, uint32_t addr[8]);
 
 int thash_f(const xmss_params *params,
             unsigned char *out, const unsigned char *in,
-            const unsigned char *pub_seed, uint32_t addr[8]);
+            const xmss_prf_ctx *pub_seed, uint32_t addr[8]);
+
+/**
+ * Batched variants of thash_h and thash_f: out[i] is computed from in[i] and
+ * addr[i], for i in [0, count), using the same pub_seed. The results are
+ * identical to count calls of the scalar functions. out[i] may alias in[i].
+ */
+int thash_h_xn(const xmss_params *params,
+               unsigned char *out[], const unsigned char *in[],
+               const xmss_prf_ctx *pub_seed, uint32_t addr[][8],
+               unsigned int count);
+
+int thash_f_xn(const xmss_params *params,
+               unsigned char *out[], const unsigned char *in[],
+               const xmss_prf_ctx *pub_seed, uint32_t addr[][8],
+               unsigned int count);
 
 int hash_message(const xmss_params *params, unsigned char *out,
                  const unsigned char *R, const unsigned char *root,
                  unsigned long long idx,
                  unsigned char *m_with_prefix, unsigned long long mlen);
 
+/**
+ * Computes the same message hash as hash_message, but incrementally, so that
+ * the message does not need to be in memory at once and needs no space for
+ * the prefix. hash_message_init absorbs the prefix, hash_message_update can
+ * be called repeatedly on consecutive parts of the message, and
+ * hash_message_final writes the n-byte hash to out.
+ */
+void hash_message_init(const xmss_params *params, xmss_hash_msg_ctx *ctx,
+                       const unsigned char *R, const unsigned char *root,
+                       unsigned long long idx);
+
+void hash_message_update(const xmss_params *params, xmss_hash_msg_ctx *ctx,
+                         const unsigned char *m, unsigned long long mlen);
+
+void hash_message_final(const xmss_params *params, xmss_hash_msg_ctx *ctx,
+                        unsigned char *out);
+
+/**
+ * Computes the message hash of the concatenation of the iovcnt buffers in
+ * iov, using the functions above.
+ */
+int hash_message_iov(const xmss_params *params, unsigned char *out,
+                     const unsigned char *R, const unsigned char *root,
+                     unsigned long long idx,
+                     const struct iovec *iov, unsigned int iovcnt);
+
 #endif
@@ -2,6 +2,7 @@
 #include <string.h>
 
 #include "params.h"
+#include "hash.h"
 #include "xmss_core.h"
 
 int xmss_str_to_oid(uint32_t *oid, const char *s)
@@ -229,8 +230,9 @@ int xmss_parse_oid(xmss_params *params, const uint32_t oid)
     params->d = 1;
     params->wots_w = 16;
 
-    // TODO figure out sensible and legal values for this based on the above
+    // Keep no BDS retain nodes by default; see xmss_xmssmt_set_bds_k
     params->bds_k = 0;
+    params->bds_schedule = XMSS_BDS_SCHEDULE_DEFAULT;
 
     return xmss_xmssmt_initialize_params(params);
 }
@@ -434,8 +436,9 @@ int xmssmt_parse_oid(xmss_params *params, const uint32_t oid)
 
     params->wots_w = 16;
 
-    // TODO figure out sensible and legal values for this based on the above
+    // Keep no BDS retain nodes by default; see xmss_xmssmt_set_bds_k
     params->bds_k = 0;
+    params->bds_schedule = XMSS_BDS_SCHEDULE_DEFAULT;
 
     return xmss_xmssmt_initialize_params(params);
 }
@@ -447,7 +450,7 @@ int xmssmt_parse_oid(xmss_params *params, const uint32_t oid)
  *  - d; the number of layers (d > 1 implies XMSSMT)
  *  - func; one of {XMSS_SHA2, XMSS_SHAKE}
  *  - wots_w; the Winternitz parameter
- *  - optionally, bds_k; the BDS traversal trade-off parameter,
+ *  - optionally, bds_k and bds_schedule; the BDS traversal parameters,
  * this function initializes the remainder of the params structure.
  */
 int xmss_xmssmt_initialize_params(xmss_params *params)
@@ -491,6 +494,61 @@ int xmss_xmssmt_initialize_params(xmss_params *params)
 
     params->pk_bytes = 2 * params->n;
     params->sk_bytes = xmss_xmssmt_core_sk_bytes(params);
+    params->threads = 1;
 
+    params->hash = xmss_hash_select(params);
+    if (params->hash == NULL) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Returns 1 if bds_k is a legal BDS traversal parameter for the tree height
+ * of params, 0 otherwise.
+ */
+int xmss_xmssmt_bds_k_legal(const xmss_params *params, unsigned int bds_k)
+{
+    /* BDS computes (h - bds_k) / 2 treehash updates per signature, which
+       only keeps up with the authentication path if h - bds_k is even.
+       bds_k = 0 is the default and works for every height. */
+    if (bds_k == 0) {
+        return 1;
+    }
+    return bds_k <= params->tree_height
+        && (params->tree_height - bds_k) % 2 == 0;
+}
+
+/**
+ * Sets the BDS traversal trade-off parameter of params to bds_k, and updates
+ * sk_bytes accordingly. A larger bds_k keeps the top bds_k levels of each
+ * tree's authentication paths in the secret key, 2^bds_k - bds_k - 1 nodes,
+ * and in return needs fewer hash calls per signature.
+ * Returns -1 if bds_k is not legal for the tree height, 0 otherwise.
+ */
+int xmss_xmssmt_set_bds_k(xmss_params *params, unsigned int bds_k)
+{
+    if (!xmss_xmssmt_bds_k_legal(params, bds_k)) {
+        return -1;
+    }
+    params->bds_k = bds_k;
+    params->sk_bytes = xmss_xmssmt_core_sk_bytes(params);
+    return 0;
+}
+
+/**
+ * Sets the BDS traversal schedule of params to one of XMSS_BDS_SCHEDULE_*,
+ * and updates sk_bytes accordingly.
+ * Returns -1 if the schedule is unknown, 0 otherwise.
+ */
+int xmss_xmssmt_set_bds_schedule(xmss_params *params, unsigned int schedule)
+{
+    if (schedule != XMSS_BDS_SCHEDULE_DEFAULT &&
+            schedule != XMSS_BDS_SCHEDULE_CONSTANT) {
+        return -1;
+    }
+    params->bds_schedule = schedule;
+    params->sk_bytes = xmss_xmssmt_core_sk_bytes(params);
     return 0;
 }
@@ -10,6 +10,17 @@
 /* This is a result of the OID definitions in the draft; needed for parsing. */
 #define XMSS_OID_LEN 4
 
+/* The BDS traversal schedules of the fast implementation; see
+   xmss_xmssmt_set_bds_schedule. */
+#define XMSS_BDS_SCHEDULE_DEFAULT 0
+#define XMSS_BDS_SCHEDULE_CONSTANT 1
+
+/* The hash function implementations; see hash.h. */
+struct xmss_hash_ops;
+
+/* A secret key loaded for signing; see xmss_signer_load. */
+typedef struct xmss_signer xmss_signer;
+
 /* This structure will be populated when calling xmss[mt]_parse_oid. */
 typedef struct {
     unsigned int func;
@@ -28,8 +39,39 @@ typedef struct {
     unsigned int pk_bytes;
     unsigned long long sk_bytes;
     unsigned int bds_k;
+    unsigned int bds_schedule;
+    /* The number of threads used for key generation, and for signing in the
+       reference implementation; defaults to 1, and may be raised after
+       parsing the OID, through xmss_keygen_opts or xmss_signer_threads. */
+    unsigned int threads;
+    const struct xmss_hash_ops *hash;
 } xmss_params;
 
+/* Optional settings for key generation; see xmss_keypair_resumable. */
+typedef struct {
+    /* The BDS traversal parameter to generate the key for; 0 by default.
+       See xmss_xmssmt_set_bds_k, which also gives the size of the key. */
+    unsigned int bds_k;
+    /* The BDS traversal schedule to generate the key for; one of
+       XMSS_BDS_SCHEDULE_*. See xmss_xmssmt_set_bds_schedule. */
+    unsigned int bds_schedule;
+    /* If not NULL, the progress is saved to this file whenever at least
+       checkpoint_interval seconds have passed since the last save, and key
+       generation resumes from it if it exists. As it contains the secret seeds,
+       it is created with mode 0600, and it is removed when the key is done. */
+    const char *checkpoint_file;
+    unsigned int checkpoint_interval;
+    /* If not NULL, called regularly with the number of leaves that have been
+       computed so far, the total number of leaves to compute, and an estimate
+       of the number of seconds left. */
+    void (*progress)(void *ctx, unsigned long long leaves_done,
+                     unsigned long long leaves_total, double seconds_left);
+    void *progress_ctx;
+    /* The number of threads to compute the key on; 0 or 1 for the calling
+       thread only. The key does not depend on it. */
+    unsigned int threads;
+} xmss_keygen_opts;
+
 /**
  * Accepts strings such as "XMSS-SHA2_10_256"
  *  and outputs OIDs such as 0x01000001.
@@ -63,8 +105,37 @@ int xmssmt_parse_oid(xmss_params *params, const uint32_t oid);
     - d; the number of layers (d > 1 implies XMSSMT)
     - func; one of {XMSS_SHA2, XMSS_SHAKE}
     - wots_w; the Winternitz parameter
-    - optionally, bds_k; the BDS traversal trade-off parameter,
+    - optionally, bds_k and bds_schedule; the BDS traversal parameters,
     this function initializes the remainder of the params structure. */
 int xmss_xmssmt_initialize_params(xmss_params *params);
 
+/**
+ * Returns 1 if bds_k is a legal BDS traversal parameter for the tree height
+ * of params, 0 otherwise.
+ */
+int xmss_xmssmt_bds_k_legal(const xmss_params *params, unsigned int bds_k);
+
+/**
+ * Sets the BDS traversal trade-off parameter of params to bds_k, and updates
+ * sk_bytes accordingly. A larger bds_k keeps the top bds_k levels of each
+ * tree's authentication paths in the secret key, 2^bds_k - bds_k - 1 nodes,
+ * and in return needs fewer hash calls per signature.
+ * Returns -1 if bds_k is not legal for the tree height, 0 otherwise.
+ */
+int xmss_xmssmt_set_bds_k(xmss_params *params, unsigned int bds_k);
+
+/**
+ * Sets the BDS traversal schedule of params to one of XMSS_BDS_SCHEDULE_*,
+ * and updates sk_bytes accordingly. With XMSS_BDS_SCHEDULE_CONSTANT, the
+ * fast implementation spends a fixed budget of leaf computations on every
+ * signature, on top of the WOTS signature on the message, and fills what the
+ * BDS traversal leaves of it with work on the next trees of all layers and
+ * the WOTS signatures on their roots, rather than building those whenever
+ * the current trees run out. This bounds the worst-case signing latency
+ * below that of the default schedule, and needs room for d - 1 more WOTS
+ * signatures in the secret key.
+ * Returns -1 if the schedule is unknown, 0 otherwise.
+ */
+int xmss_xmssmt_set_bds_schedule(xmss_params *params, unsigned int schedule);
+
 #endif
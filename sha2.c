@@ -0,0 +1,407 @@
+/* Based on the public domain implementations in crypto_hashblocks/sha256/ref
+ * and crypto_hashblocks/sha512/ref from http://bench.cr.yp.to/supercop.html
+ * by D. J. Bernstein */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "sha2.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define XMSS_SHA2_SHANI
+#include <immintrin.h>
+#endif
+
+#define ROTR32(x, c) (((x) >> (c)) | ((x) << (32 - (c))))
+#define ROTR64(x, c) (((x) >> (c)) | ((x) << (64 - (c))))
+
+#define CH(x, y, z) (((x) & (y)) ^ (~(x) & (z)))
+#define MAJ(x, y, z) (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+
+#define SIGMA0_256(x) (ROTR32(x, 2) ^ ROTR32(x, 13) ^ ROTR32(x, 22))
+#define SIGMA1_256(x) (ROTR32(x, 6) ^ ROTR32(x, 11) ^ ROTR32(x, 25))
+#define sigma0_256(x) (ROTR32(x, 7) ^ ROTR32(x, 18) ^ ((x) >> 3))
+#define sigma1_256(x) (ROTR32(x, 17) ^ ROTR32(x, 19) ^ ((x) >> 10))
+
+#define SIGMA0_512(x) (ROTR64(x, 28) ^ ROTR64(x, 34) ^ ROTR64(x, 39))
+#define SIGMA1_512(x) (ROTR64(x, 14) ^ ROTR64(x, 18) ^ ROTR64(x, 41))
+#define sigma0_512(x) (ROTR64(x, 1) ^ ROTR64(x, 8) ^ ((x) >> 7))
+#define sigma1_512(x) (ROTR64(x, 19) ^ ROTR64(x, 61) ^ ((x) >> 6))
+
+static uint32_t load_bigendian_32(const unsigned char *x)
+{
+    return (uint32_t)x[3] | ((uint32_t)x[2] << 8) |
+           ((uint32_t)x[1] << 16) | ((uint32_t)x[0] << 24);
+}
+
+static uint64_t load_bigendian_64(const unsigned char *x)
+{
+    return (uint64_t)load_bigendian_32(x + 4) |
+           ((uint64_t)load_bigendian_32(x) << 32);
+}
+
+static void store_bigendian_32(unsigned char *x, uint32_t u)
+{
+    x[3] = (unsigned char)u; u >>= 8;
+    x[2] = (unsigned char)u; u >>= 8;
+    x[1] = (unsigned char)u; u >>= 8;
+    x[0] = (unsigned char)u;
+}
+
+static void store_bigendian_64(unsigned char *x, uint64_t u)
+{
+    store_bigendian_32(x, (uint32_t)(u >> 32));
+    store_bigendian_32(x + 4, (uint32_t)u);
+}
+
+static const uint32_t sha256_iv[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+const uint32_t sha256_round_constants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+    0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+    0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+    0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+    0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+    0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint64_t sha512_iv[8] = {
+    0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL,
+    0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+    0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL,
+    0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+};
+
+const uint64_t sha512_round_constants[80] = {
+    0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL,
+    0xe9b5dba58189dbbcULL, 0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL,
+    0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL, 0xd807aa98a3030242ULL,
+    0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+    0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL,
+    0xc19bf174cf692694ULL, 0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL,
+    0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL, 0x2de92c6f592b0275ULL,
+    0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+    0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL,
+    0xbf597fc7beef0ee4ULL, 0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL,
+    0x06ca6351e003826fULL, 0x142929670a0e6e70ULL, 0x27b70a8546d22ffcULL,
+    0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+    0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL,
+    0x92722c851482353bULL, 0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL,
+    0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL, 0xd192e819d6ef5218ULL,
+    0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+    0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL,
+    0x34b0bcb5e19b48a8ULL, 0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL,
+    0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL, 0x748f82ee5defb2fcULL,
+    0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+    0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL,
+    0xc67178f2e372532bULL, 0xca273eceea26619cULL, 0xd186b8c721c0c207ULL,
+    0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL, 0x06f067aa72176fbaULL,
+    0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+    0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL,
+    0x431d67c49c100d4cULL, 0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL,
+    0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL
+};
+
+/* The padding of the final block for the input lengths that XMSS uses with
+   n = 32, i.e. 96 bytes (F, and the PRF after its key block) and 128 bytes
+   (H). For 96 bytes, this follows the last 32 input bytes in the block. */
+static const unsigned char sha256_final_96[SHA256_BLOCK_BYTES - 32] = {
+    0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x03, 0x00
+};
+
+static const unsigned char sha256_final_128[SHA256_BLOCK_BYTES] = {
+    0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x04, 0x00
+};
+
+void sha256_inc_init(uint32_t state[8])
+{
+    memcpy(state, sha256_iv, sizeof(sha256_iv));
+}
+
+#ifdef XMSS_SHA2_SHANI
+
+/* The SHA-256 compression function using the x86 SHA extensions. The state
+   is kept in the ABEF/CDGH word order that the sha256rnds2 instruction
+   expects, and is only converted on entry and exit. */
+__attribute__((target("sha,sse4.1")))
+static void sha256ni_blocks(uint32_t state[8],
+                            const unsigned char *in, unsigned long long nblocks)
+{
+    const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+                                         0x0405060700010203ULL);
+    __m128i abef, cdgh, abef_save, cdgh_save, w[4], msg, tmp;
+    unsigned int i;
+
+    tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state), 0xB1);
+    cdgh = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(state + 4)),
+                             0x1B);
+    abef = _mm_alignr_epi8(tmp, cdgh, 8);
+    cdgh = _mm_blend_epi16(cdgh, tmp, 0xF0);
+
+    while (nblocks > 0) {
+        abef_save = abef;
+        cdgh_save = cdgh;
+
+        /* Each iteration computes four rounds, and extends the message
+           schedule by four words in w[i & 3] once the first 16 are used. */
+        for (i = 0; i < 16; i++) {
+            if (i < 4) {
+                w[i] = _mm_shuffle_epi8(
+                    _mm_loadu_si128((const __m128i *)(in + 16*i)), bswap);
+            }
+            else {
+                tmp = _mm_sha256msg1_epu32(w[i & 3], w[(i + 1) & 3]);
+                tmp = _mm_add_epi32(tmp,
+                    _mm_alignr_epi8(w[(i + 3) & 3], w[(i + 2) & 3], 4));
+                w[i & 3] = _mm_sha256msg2_epu32(tmp, w[(i + 3) & 3]);
+            }
+            msg = _mm_add_epi32(w[i & 3], _mm_loadu_si128(
+                (const __m128i *)(sha256_round_constants + 4*i)));
+            cdgh = _mm_sha256rnds2_epu32(cdgh, abef, msg);
+            abef = _mm_sha256rnds2_epu32(abef, cdgh,
+                                         _mm_shuffle_epi32(msg, 0x0E));
+        }
+
+        abef = _mm_add_epi32(abef, abef_save);
+        cdgh = _mm_add_epi32(cdgh, cdgh_save);
+
+        in += SHA256_BLOCK_BYTES;
+        nblocks--;
+    }
+
+    tmp = _mm_shuffle_epi32(abef, 0x1B);
+    cdgh = _mm_shuffle_epi32(cdgh, 0xB1);
+    _mm_storeu_si128((__m128i *)state, _mm_blend_epi16(tmp, cdgh, 0xF0));
+    _mm_storeu_si128((__m128i *)(state + 4), _mm_alignr_epi8(cdgh, tmp, 8));
+}
+
+#endif /* XMSS_SHA2_SHANI */
+
+int sha256_shani_supported(void)
+{
+#ifdef XMSS_SHA2_SHANI
+    return __builtin_cpu_supports("sha") != 0;
+#else
+    return 0;
+#endif
+}
+
+static void sha256_blocks_portable(uint32_t state[8], const unsigned char *in,
+                                   unsigned long long nblocks)
+{
+    uint32_t w[64];
+    uint32_t a, b, c, d, e, f, g, h, t1, t2;
+    unsigned int i;
+
+    while (nblocks > 0) {
+        for (i = 0; i < 16; i++) {
+            w[i] = load_bigendian_32(in + 4*i);
+        }
+        for (i = 16; i < 64; i++) {
+            w[i] = sigma1_256(w[i - 2]) + w[i - 7]
+                 + sigma0_256(w[i - 15]) + w[i - 16];
+        }
+
+        a = state[0]; b = state[1]; c = state[2]; d = state[3];
+        e = state[4]; f = state[5]; g = state[6]; h = state[7];
+
+        for (i = 0; i < 64; i++) {
+            t1 = h + SIGMA1_256(e) + CH(e, f, g)
+               + sha256_round_constants[i] + w[i];
+            t2 = SIGMA0_256(a) + MAJ(a, b, c);
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+
+        in += SHA256_BLOCK_BYTES;
+        nblocks--;
+    }
+}
+
+void sha256_inc_blocks(uint32_t state[8],
+                       const unsigned char *in, unsigned long long nblocks)
+{
+#ifdef XMSS_SHA2_SHANI
+    if (sha256_shani_supported()) {
+        sha256ni_blocks(state, in, nblocks);
+        return;
+    }
+#endif
+    sha256_blocks_portable(state, in, nblocks);
+}
+
+/* Implements sha256_inc_finalize using the given compression function. */
+static void sha256_finalize(void (*blocks)(uint32_t *, const unsigned char *,
+                                           unsigned long long),
+                            unsigned char *out, const uint32_t state[8],
+                            const unsigned char *in, unsigned long long inlen,
+                            unsigned long long absorbed)
+{
+    uint32_t s[8];
+    unsigned char padded[2 * SHA256_BLOCK_BYTES];
+    unsigned long long bits = (absorbed + inlen) << 3;
+    unsigned int padlen;
+    unsigned int i;
+
+    memcpy(s, state, sizeof(s));
+
+    blocks(s, in, inlen / SHA256_BLOCK_BYTES);
+    in += inlen - (inlen % SHA256_BLOCK_BYTES);
+    inlen %= SHA256_BLOCK_BYTES;
+
+    /* Use the precomputed final blocks for the common XMSS input lengths. */
+    if (bits == 96 * 8 && inlen == 32) {
+        memcpy(padded, in, 32);
+        memcpy(padded + 32, sha256_final_96, sizeof(sha256_final_96));
+        blocks(s, padded, 1);
+    }
+    else if (bits == 128 * 8 && inlen == 0) {
+        blocks(s, sha256_final_128, 1);
+    }
+    else {
+        /* The final block(s) hold the remaining input, a 1-bit, zero padding
+           and the 64-bit message length; this requires 9 bytes after the
+           input. */
+        padlen = inlen + 9 <= SHA256_BLOCK_BYTES ? SHA256_BLOCK_BYTES
+                                                 : 2 * SHA256_BLOCK_BYTES;
+        memset(padded, 0, padlen);
+        memcpy(padded, in, inlen);
+        padded[inlen] = 0x80;
+        store_bigendian_64(padded + padlen - 8, bits);
+        blocks(s, padded, padlen / SHA256_BLOCK_BYTES);
+    }
+
+    for (i = 0; i < 8; i++) {
+        store_bigendian_32(out + 4*i, s[i]);
+    }
+}
+
+void sha256_inc_finalize(unsigned char *out, const uint32_t state[8],
+                         const unsigned char *in, unsigned long long inlen,
+                         unsigned long long absorbed)
+{
+#ifdef XMSS_SHA2_SHANI
+    if (sha256_shani_supported()) {
+        sha256_finalize(sha256ni_blocks, out, state, in, inlen, absorbed);
+        return;
+    }
+#endif
+    sha256_finalize(sha256_blocks_portable, out, state, in, inlen, absorbed);
+}
+
+void sha256_inc_finalize_portable(unsigned char *out, const uint32_t state[8],
+                                  const unsigned char *in,
+                                  unsigned long long inlen,
+                                  unsigned long long absorbed)
+{
+    sha256_finalize(sha256_blocks_portable, out, state, in, inlen, absorbed);
+}
+
+void sha256_inc_finalize_shani(unsigned char *out, const uint32_t state[8],
+                               const unsigned char *in,
+                               unsigned long long inlen,
+                               unsigned long long absorbed)
+{
+#ifdef XMSS_SHA2_SHANI
+    sha256_finalize(sha256ni_blocks, out, state, in, inlen, absorbed);
+#else
+    sha256_finalize(sha256_blocks_portable, out, state, in, inlen, absorbed);
+#endif
+}
+
+void sha256(unsigned char *out,
+            const unsigned char *in, unsigned long long inlen)
+{
+    sha256_inc_finalize(out, sha256_iv, in, inlen, 0);
+}
+
+void sha512_inc_init(uint64_t state[8])
+{
+    memcpy(state, sha512_iv, sizeof(sha512_iv));
+}
+
+void sha512_inc_blocks(uint64_t state[8],
+                       const unsigned char *in, unsigned long long nblocks)
+{
+    uint64_t w[80];
+    uint64_t a, b, c, d, e, f, g, h, t1, t2;
+    unsigned int i;
+
+    while (nblocks > 0) {
+        for (i = 0; i < 16; i++) {
+            w[i] = load_bigendian_64(in + 8*i);
+        }
+        for (i = 16; i < 80; i++) {
+            w[i] = sigma1_512(w[i - 2]) + w[i - 7]
+                 + sigma0_512(w[i - 15]) + w[i - 16];
+        }
+
+        a = state[0]; b = state[1]; c = state[2]; d = state[3];
+        e = state[4]; f = state[5]; g = state[6]; h = state[7];
+
+        for (i = 0; i < 80; i++) {
+            t1 = h + SIGMA1_512(e) + CH(e, f, g)
+               + sha512_round_constants[i] + w[i];
+            t2 = SIGMA0_512(a) + MAJ(a, b, c);
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+
+        in += SHA512_BLOCK_BYTES;
+        nblocks--;
+    }
+}
+
+void sha512_inc_finalize(unsigned char *out, const uint64_t state[8],
+                         const unsigned char *in, unsigned long long inlen,
+                         unsigned long long absorbed)
+{
+    uint64_t s[8];
+    unsigned char padded[2 * SHA512_BLOCK_BYTES];
+    unsigned long long bits = (absorbed + inlen) << 3;
+    unsigned int padlen;
+    unsigned int i;
+
+    memcpy(s, state, sizeof(s));
+
+    sha512_inc_blocks(s, in, inlen / SHA512_BLOCK_BYTES);
+    in += inlen - (inlen % SHA512_BLOCK_BYTES);
+    inlen %= SHA512_BLOCK_BYTES;
+
+    /* As for SHA-256, but the message length is encoded in 128 bits. We only
+       support lengths below 2^64 bits, so the upper half is always zero. */
+    padlen = inlen + 17 <= SHA512_BLOCK_BYTES ? SHA512_BLOCK_BYTES
+                                              : 2 * SHA512_BLOCK_BYTES;
+    memset(padded, 0, padlen);
+    memcpy(padded, in, inlen);
+    padded[inlen] = 0x80;
+    store_bigendian_64(padded + padlen - 8, bits);
+    sha512_inc_blocks(s, padded, padlen / SHA512_BLOCK_BYTES);
+
+    for (i = 0; i < 8; i++) {
+        store_bigendian_64(out + 8*i, s[i]);
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef XMSS_SHA2_H
+#define XMSS_SHA2_H
+
+#include <stdint.h>
+
+#define SHA256_BLOCK_BYTES 64
+#define SHA512_BLOCK_BYTES 128
+
+/* The round constants; these are shared with the multi-lane implementations
+   in sha2x.c. */
+extern const uint32_t sha256_round_constants[64];
+extern const uint64_t sha512_round_constants[80];
+
+/* These functions expose the SHA-256 and SHA-512 compression functions, so
+ * that a hash state can be precomputed over a prefix that is shared between
+ * many inputs (e.g. the padded key block of the PRF), and then be resumed.
+ */
+
+/* Sets state to the SHA-256 initial hash value. */
+void sha256_inc_init(uint32_t state[8]);
+
+/* Absorbs nblocks full 64-byte blocks from in into state. */
+void sha256_inc_blocks(uint32_t state[8],
+                       const unsigned char *in, unsigned long long nblocks);
+
+/* Absorbs the last inlen bytes of the message into a copy of state, pads and
+ * writes the 32-byte digest to out. 'absorbed' is the number of bytes that
+ * were absorbed into state by preceding calls to sha256_inc_blocks.
+ * The state itself is left untouched, so that it can be reused.
+ */
+void sha256_inc_finalize(unsigned char *out, const uint32_t state[8],
+                         const unsigned char *in, unsigned long long inlen,
+                         unsigned long long absorbed);
+
+/* As sha256_inc_finalize, but always using the portable C implementation or
+ * the x86 SHA extensions respectively. The latter may only be used if
+ * sha256_shani_supported returns 1.
+ */
+void sha256_inc_finalize_portable(unsigned char *out, const uint32_t state[8],
+                                  const unsigned char *in,
+                                  unsigned long long inlen,
+                                  unsigned long long absorbed);
+
+void sha256_inc_finalize_shani(unsigned char *out, const uint32_t state[8],
+                               const unsigned char *in,
+                               unsigned long long inlen,
+                               unsigned long long absorbed);
+
+/* Returns 1 if the CPU supports the x86 SHA extensions, 0 otherwise. */
+int sha256_shani_supported(void);
+
+/* Computes the SHA-256 digest of inlen bytes of in, and writes it to out.
+ * On x86-64 CPUs with the SHA extensions, this uses those instructions.
+ */
+void sha256(unsigned char *out,
+            const unsigned char *in, unsigned long long inlen);
+
+/* Sets state to the SHA-512 initial hash value. */
+void sha512_inc_init(uint64_t state[8]);
+
+/* Absorbs nblocks full 128-byte blocks from in into state. */
+void sha512_inc_blocks(uint64_t state[8],
+                       const unsigned char *in, unsigned long long nblocks);
+
+/* As sha256_inc_finalize, but for SHA-512; writes a 64-byte digest. */
+void sha512_inc_finalize(unsigned char *out, const uint64_t state[8],
+                         const unsigned char *in, unsigned long long inlen,
+                         unsigned long long absorbed);
+
+#endif
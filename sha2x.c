@@ -0,0 +1,454 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "sha2.h"
+#include "sha2x.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define XMSS_SHA2X_X86
+#include <immintrin.h>
+#endif
+
+static uint32_t load_bigendian_32(const unsigned char *x)
+{
+    return (uint32_t)x[3] | ((uint32_t)x[2] << 8) |
+           ((uint32_t)x[1] << 16) | ((uint32_t)x[0] << 24);
+}
+
+static uint64_t load_bigendian_64(const unsigned char *x)
+{
+    return (uint64_t)load_bigendian_32(x + 4) |
+           ((uint64_t)load_bigendian_32(x) << 32);
+}
+
+static void store_bigendian_32(unsigned char *x, uint32_t u)
+{
+    x[3] = (unsigned char)u; u >>= 8;
+    x[2] = (unsigned char)u; u >>= 8;
+    x[1] = (unsigned char)u; u >>= 8;
+    x[0] = (unsigned char)u;
+}
+
+static void store_bigendian_64(unsigned char *x, uint64_t u)
+{
+    store_bigendian_32(x, (uint32_t)(u >> 32));
+    store_bigendian_32(x + 4, (uint32_t)u);
+}
+
+/* Writes the final block(s) of a message with inlen remaining bytes to out,
+ * i.e. the input followed by a 1-bit, zero padding and the message length of
+ * lenbytes bytes (8 for SHA-256, 16 for SHA-512). Returns the number of
+ * blocks. */
+static unsigned int pad_blocks(unsigned char *out, unsigned int blockbytes,
+                               unsigned int lenbytes,
+                               const unsigned char *in, unsigned int inlen,
+                               unsigned long long bits)
+{
+    unsigned int padlen = inlen + 1 + lenbytes <= blockbytes ? blockbytes
+                                                             : 2 * blockbytes;
+    memset(out, 0, padlen);
+    memcpy(out, in, inlen);
+    out[inlen] = 0x80;
+    store_bigendian_64(out + padlen - 8, bits);
+    return padlen / blockbytes;
+}
+
+#ifdef XMSS_SHA2X_X86
+
+/* The compression functions below operate on transposed states and message
+ * blocks; i.e. s[j][l] is the j-th word of the state in lane l, and w[j][l]
+ * is the j-th (native-endian) message word for lane l. */
+
+#define ADD32x8(a, b) _mm256_add_epi32(a, b)
+#define XOR32x8(a, b) _mm256_xor_si256(a, b)
+#define ROTR32x8(x, c) \
+    _mm256_or_si256(_mm256_srli_epi32(x, c), _mm256_slli_epi32(x, 32 - (c)))
+/* The boolean functions are bitwise, so these serve both SHA-256 and SHA-512
+   on 256-bit registers. */
+#define CH_YMM(x, y, z) \
+    _mm256_xor_si256(_mm256_and_si256(x, y), _mm256_andnot_si256(x, z))
+#define MAJ_YMM(x, y, z) _mm256_or_si256(_mm256_and_si256(x, y), \
+    _mm256_and_si256(z, _mm256_or_si256(x, y)))
+
+__attribute__((target("avx2")))
+static void sha256x8_compress(uint32_t s[8][SHA256X_MAX_LANES],
+                              const uint32_t win[16][SHA256X_MAX_LANES])
+{
+    __m256i w[16], v[8], t1, t2;
+    unsigned int i, j;
+
+    for (i = 0; i < 16; i++) {
+        w[i] = _mm256_loadu_si256((const __m256i *)win[i]);
+    }
+    for (j = 0; j < 8; j++) {
+        v[j] = _mm256_loadu_si256((const __m256i *)s[j]);
+    }
+
+    for (i = 0; i < 64; i++) {
+        if (i >= 16) {
+            t1 = w[(i - 2) & 15];
+            t1 = XOR32x8(XOR32x8(ROTR32x8(t1, 17), ROTR32x8(t1, 19)),
+                         _mm256_srli_epi32(t1, 10));
+            t2 = w[(i - 15) & 15];
+            t2 = XOR32x8(XOR32x8(ROTR32x8(t2, 7), ROTR32x8(t2, 18)),
+                         _mm256_srli_epi32(t2, 3));
+            w[i & 15] = ADD32x8(ADD32x8(t1, w[(i - 7) & 15]),
+                                ADD32x8(t2, w[i & 15]));
+        }
+        t1 = XOR32x8(XOR32x8(ROTR32x8(v[4], 6), ROTR32x8(v[4], 11)),
+                     ROTR32x8(v[4], 25));
+        t1 = ADD32x8(ADD32x8(v[7], t1), CH_YMM(v[4], v[5], v[6]));
+        t1 = ADD32x8(t1, ADD32x8(w[i & 15],
+             _mm256_set1_epi32((int)sha256_round_constants[i])));
+        t2 = XOR32x8(XOR32x8(ROTR32x8(v[0], 2), ROTR32x8(v[0], 13)),
+                     ROTR32x8(v[0], 22));
+        t2 = ADD32x8(t2, MAJ_YMM(v[0], v[1], v[2]));
+        v[7] = v[6]; v[6] = v[5]; v[5] = v[4]; v[4] = ADD32x8(v[3], t1);
+        v[3] = v[2]; v[2] = v[1]; v[1] = v[0]; v[0] = ADD32x8(t1, t2);
+    }
+
+    for (j = 0; j < 8; j++) {
+        _mm256_storeu_si256((__m256i *)s[j],
+            ADD32x8(v[j], _mm256_loadu_si256((const __m256i *)s[j])));
+    }
+}
+
+/* AVX-512 provides rotations and three-input boolean functions. */
+#define ADD32x16(a, b) _mm512_add_epi32(a, b)
+#define XOR3_32x16(a, b, c) _mm512_ternarylogic_epi32(a, b, c, 0x96)
+#define CH32x16(x, y, z) _mm512_ternarylogic_epi32(x, y, z, 0xca)
+#define MAJ32x16(x, y, z) _mm512_ternarylogic_epi32(x, y, z, 0xe8)
+
+__attribute__((target("avx512f")))
+static void sha256x16_compress(uint32_t s[8][SHA256X_MAX_LANES],
+                               const uint32_t win[16][SHA256X_MAX_LANES])
+{
+    __m512i w[16], v[8], t1, t2;
+    unsigned int i, j;
+
+    for (i = 0; i < 16; i++) {
+        w[i] = _mm512_loadu_si512((const void *)win[i]);
+    }
+    for (j = 0; j < 8; j++) {
+        v[j] = _mm512_loadu_si512((const void *)s[j]);
+    }
+
+    for (i = 0; i < 64; i++) {
+        if (i >= 16) {
+            t1 = w[(i - 2) & 15];
+            t1 = XOR3_32x16(_mm512_ror_epi32(t1, 17), _mm512_ror_epi32(t1, 19),
+                            _mm512_srli_epi32(t1, 10));
+            t2 = w[(i - 15) & 15];
+            t2 = XOR3_32x16(_mm512_ror_epi32(t2, 7), _mm512_ror_epi32(t2, 18),
+                            _mm512_srli_epi32(t2, 3));
+            w[i & 15] = ADD32x16(ADD32x16(t1, w[(i - 7) & 15]),
+                                 ADD32x16(t2, w[i & 15]));
+        }
+        t1 = XOR3_32x16(_mm512_ror_epi32(v[4], 6), _mm512_ror_epi32(v[4], 11),
+                        _mm512_ror_epi32(v[4], 25));
+        t1 = ADD32x16(ADD32x16(v[7], t1), CH32x16(v[4], v[5], v[6]));
+        t1 = ADD32x16(t1, ADD32x16(w[i & 15],
+             _mm512_set1_epi32((int)sha256_round_constants[i])));
+        t2 = XOR3_32x16(_mm512_ror_epi32(v[0], 2), _mm512_ror_epi32(v[0], 13),
+                        _mm512_ror_epi32(v[0], 22));
+        t2 = ADD32x16(t2, MAJ32x16(v[0], v[1], v[2]));
+        v[7] = v[6]; v[6] = v[5]; v[5] = v[4]; v[4] = ADD32x16(v[3], t1);
+        v[3] = v[2]; v[2] = v[1]; v[1] = v[0]; v[0] = ADD32x16(t1, t2);
+    }
+
+    for (j = 0; j < 8; j++) {
+        _mm512_storeu_si512((void *)s[j],
+            ADD32x16(v[j], _mm512_loadu_si512((const void *)s[j])));
+    }
+}
+
+#define ADD64x4(a, b) _mm256_add_epi64(a, b)
+#define XOR64x4(a, b) _mm256_xor_si256(a, b)
+#define ROTR64x4(x, c) \
+    _mm256_or_si256(_mm256_srli_epi64(x, c), _mm256_slli_epi64(x, 64 - (c)))
+
+__attribute__((target("avx2")))
+static void sha512x4_compress(uint64_t s[8][SHA512X_MAX_LANES],
+                              const uint64_t win[16][SHA512X_MAX_LANES])
+{
+    __m256i w[16], v[8], t1, t2;
+    unsigned int i, j;
+
+    for (i = 0; i < 16; i++) {
+        w[i] = _mm256_loadu_si256((const __m256i *)win[i]);
+    }
+    for (j = 0; j < 8; j++) {
+        v[j] = _mm256_loadu_si256((const __m256i *)s[j]);
+    }
+
+    for (i = 0; i < 80; i++) {
+        if (i >= 16) {
+            t1 = w[(i - 2) & 15];
+            t1 = XOR64x4(XOR64x4(ROTR64x4(t1, 19), ROTR64x4(t1, 61)),
+                         _mm256_srli_epi64(t1, 6));
+            t2 = w[(i - 15) & 15];
+            t2 = XOR64x4(XOR64x4(ROTR64x4(t2, 1), ROTR64x4(t2, 8)),
+                         _mm256_srli_epi64(t2, 7));
+            w[i & 15] = ADD64x4(ADD64x4(t1, w[(i - 7) & 15]),
+                                ADD64x4(t2, w[i & 15]));
+        }
+        t1 = XOR64x4(XOR64x4(ROTR64x4(v[4], 14), ROTR64x4(v[4], 18)),
+                     ROTR64x4(v[4], 41));
+        t1 = ADD64x4(ADD64x4(v[7], t1), CH_YMM(v[4], v[5], v[6]));
+        t1 = ADD64x4(t1, ADD64x4(w[i & 15],
+             _mm256_set1_epi64x((long long)sha512_round_constants[i])));
+        t2 = XOR64x4(XOR64x4(ROTR64x4(v[0], 28), ROTR64x4(v[0], 34)),
+                     ROTR64x4(v[0], 39));
+        t2 = ADD64x4(t2, MAJ_YMM(v[0], v[1], v[2]));
+        v[7] = v[6]; v[6] = v[5]; v[5] = v[4]; v[4] = ADD64x4(v[3], t1);
+        v[3] = v[2]; v[2] = v[1]; v[1] = v[0]; v[0] = ADD64x4(t1, t2);
+    }
+
+    for (j = 0; j < 8; j++) {
+        _mm256_storeu_si256((__m256i *)s[j],
+            ADD64x4(v[j], _mm256_loadu_si256((const __m256i *)s[j])));
+    }
+}
+
+#define ADD64x8(a, b) _mm512_add_epi64(a, b)
+#define XOR3_64x8(a, b, c) _mm512_ternarylogic_epi64(a, b, c, 0x96)
+#define CH64x8(x, y, z) _mm512_ternarylogic_epi64(x, y, z, 0xca)
+#define MAJ64x8(x, y, z) _mm512_ternarylogic_epi64(x, y, z, 0xe8)
+
+__attribute__((target("avx512f")))
+static void sha512x8_compress(uint64_t s[8][SHA512X_MAX_LANES],
+                              const uint64_t win[16][SHA512X_MAX_LANES])
+{
+    __m512i w[16], v[8], t1, t2;
+    unsigned int i, j;
+
+    for (i = 0; i < 16; i++) {
+        w[i] = _mm512_loadu_si512((const void *)win[i]);
+    }
+    for (j = 0; j < 8; j++) {
+        v[j] = _mm512_loadu_si512((const void *)s[j]);
+    }
+
+    for (i = 0; i < 80; i++) {
+        if (i >= 16) {
+            t1 = w[(i - 2) & 15];
+            t1 = XOR3_64x8(_mm512_ror_epi64(t1, 19), _mm512_ror_epi64(t1, 61),
+                           _mm512_srli_epi64(t1, 6));
+            t2 = w[(i - 15) & 15];
+            t2 = XOR3_64x8(_mm512_ror_epi64(t2, 1), _mm512_ror_epi64(t2, 8),
+                           _mm512_srli_epi64(t2, 7));
+            w[i & 15] = ADD64x8(ADD64x8(t1, w[(i - 7) & 15]),
+                                ADD64x8(t2, w[i & 15]));
+        }
+        t1 = XOR3_64x8(_mm512_ror_epi64(v[4], 14), _mm512_ror_epi64(v[4], 18),
+                       _mm512_ror_epi64(v[4], 41));
+        t1 = ADD64x8(ADD64x8(v[7], t1), CH64x8(v[4], v[5], v[6]));
+        t1 = ADD64x8(t1, ADD64x8(w[i & 15],
+             _mm512_set1_epi64((long long)sha512_round_constants[i])));
+        t2 = XOR3_64x8(_mm512_ror_epi64(v[0], 28), _mm512_ror_epi64(v[0], 34),
+                       _mm512_ror_epi64(v[0], 39));
+        t2 = ADD64x8(t2, MAJ64x8(v[0], v[1], v[2]));
+        v[7] = v[6]; v[6] = v[5]; v[5] = v[4]; v[4] = ADD64x8(v[3], t1);
+        v[3] = v[2]; v[2] = v[1]; v[1] = v[0]; v[0] = ADD64x8(t1, t2);
+    }
+
+    for (j = 0; j < 8; j++) {
+        _mm512_storeu_si512((void *)s[j],
+            ADD64x8(v[j], _mm512_loadu_si512((const void *)s[j])));
+    }
+}
+
+/* Processes up to 'lanes' inputs at once. Unused lanes hash a copy of the
+   first input, and their output is discarded. */
+static void sha256x_lanes_finalize(unsigned char *out[],
+                                   const uint32_t *state[],
+                                   const unsigned char *in[],
+                                   unsigned long long inlen,
+                                   unsigned long long absorbed,
+                                   unsigned int count, unsigned int lanes)
+{
+    uint32_t s[8][SHA256X_MAX_LANES];
+    uint32_t w[16][SHA256X_MAX_LANES];
+    unsigned char tail[SHA256X_MAX_LANES][2 * SHA256_BLOCK_BYTES];
+    unsigned long long fullblocks = inlen / SHA256_BLOCK_BYTES;
+    unsigned long long nblocks = 0;
+    unsigned long long b;
+    const unsigned char *block;
+    uint32_t iv[8];
+    unsigned int i, j, l;
+
+    sha256_inc_init(iv);
+
+    for (l = 0; l < lanes; l++) {
+        i = l < count ? l : 0;
+        for (j = 0; j < 8; j++) {
+            s[j][l] = state ? state[i][j] : iv[j];
+        }
+        nblocks = fullblocks + pad_blocks(tail[l], SHA256_BLOCK_BYTES, 8,
+            in[i] + fullblocks * SHA256_BLOCK_BYTES,
+            inlen % SHA256_BLOCK_BYTES, (absorbed + inlen) << 3);
+    }
+
+    for (b = 0; b < nblocks; b++) {
+        for (l = 0; l < lanes; l++) {
+            i = l < count ? l : 0;
+            if (b < fullblocks) {
+                block = in[i] + b * SHA256_BLOCK_BYTES;
+            }
+            else {
+                block = tail[l] + (b - fullblocks) * SHA256_BLOCK_BYTES;
+            }
+            for (j = 0; j < 16; j++) {
+                w[j][l] = load_bigendian_32(block + 4*j);
+            }
+        }
+        if (lanes == 16) {
+            sha256x16_compress(s, (const uint32_t (*)[SHA256X_MAX_LANES])w);
+        }
+        else {
+            sha256x8_compress(s, (const uint32_t (*)[SHA256X_MAX_LANES])w);
+        }
+    }
+
+    for (l = 0; l < count; l++) {
+        for (j = 0; j < 8; j++) {
+            store_bigendian_32(out[l] + 4*j, s[j][l]);
+        }
+    }
+}
+
+/* As sha256x_lanes_finalize, for SHA-512. */
+static void sha512x_lanes_finalize(unsigned char *out[],
+                                   const uint64_t *state[],
+                                   const unsigned char *in[],
+                                   unsigned long long inlen,
+                                   unsigned long long absorbed,
+                                   unsigned int count, unsigned int lanes)
+{
+    uint64_t s[8][SHA512X_MAX_LANES];
+    uint64_t w[16][SHA512X_MAX_LANES];
+    unsigned char tail[SHA512X_MAX_LANES][2 * SHA512_BLOCK_BYTES];
+    unsigned long long fullblocks = inlen / SHA512_BLOCK_BYTES;
+    unsigned long long nblocks = 0;
+    unsigned long long b;
+    const unsigned char *block;
+    uint64_t iv[8];
+    unsigned int i, j, l;
+
+    sha512_inc_init(iv);
+
+    for (l = 0; l < lanes; l++) {
+        i = l < count ? l : 0;
+        for (j = 0; j < 8; j++) {
+            s[j][l] = state ? state[i][j] : iv[j];
+        }
+        nblocks = fullblocks + pad_blocks(tail[l], SHA512_BLOCK_BYTES, 16,
+            in[i] + fullblocks * SHA512_BLOCK_BYTES,
+            inlen % SHA512_BLOCK_BYTES, (absorbed + inlen) << 3);
+    }
+
+    for (b = 0; b < nblocks; b++) {
+        for (l = 0; l < lanes; l++) {
+            i = l < count ? l : 0;
+            if (b < fullblocks) {
+                block = in[i] + b * SHA512_BLOCK_BYTES;
+            }
+            else {
+                block = tail[l] + (b - fullblocks) * SHA512_BLOCK_BYTES;
+            }
+            for (j = 0; j < 16; j++) {
+                w[j][l] = load_bigendian_64(block + 8*j);
+            }
+        }
+        if (lanes == 8) {
+            sha512x8_compress(s, (const uint64_t (*)[SHA512X_MAX_LANES])w);
+        }
+        else {
+            sha512x4_compress(s, (const uint64_t (*)[SHA512X_MAX_LANES])w);
+        }
+    }
+
+    for (l = 0; l < count; l++) {
+        for (j = 0; j < 8; j++) {
+            store_bigendian_64(out[l] + 8*j, s[j][l]);
+        }
+    }
+}
+
+#endif /* XMSS_SHA2X_X86 */
+
+unsigned int sha256xn_lanes(void)
+{
+#ifdef XMSS_SHA2X_X86
+    if (__builtin_cpu_supports("avx512f")) {
+        return 16;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return 8;
+    }
+#endif
+    return 1;
+}
+
+unsigned int sha512xn_lanes(void)
+{
+#ifdef XMSS_SHA2X_X86
+    if (__builtin_cpu_supports("avx512f")) {
+        return 8;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return 4;
+    }
+#endif
+    return 1;
+}
+
+void sha256xn_inc_finalize(unsigned char *out[], const uint32_t *state[],
+                           const unsigned char *in[], unsigned long long inlen,
+                           unsigned long long absorbed, unsigned int count)
+{
+    unsigned int lanes = sha256xn_lanes();
+    unsigned int i;
+    uint32_t iv[8];
+
+    if (lanes == 1) {
+        sha256_inc_init(iv);
+        for (i = 0; i < count; i++) {
+            sha256_inc_finalize(out[i], state ? state[i] : iv,
+                                in[i], inlen, absorbed);
+        }
+        return;
+    }
+#ifdef XMSS_SHA2X_X86
+    for (i = 0; i < count; i += lanes) {
+        sha256x_lanes_finalize(out + i, state ? state + i : NULL, in + i,
+                               inlen, absorbed,
+                               count - i < lanes ? count - i : lanes, lanes);
+    }
+#endif
+}
+
+void sha512xn_inc_finalize(unsigned char *out[], const uint64_t *state[],
+                           const unsigned char *in[], unsigned long long inlen,
+                           unsigned long long absorbed, unsigned int count)
+{
+    unsigned int lanes = sha512xn_lanes();
+    unsigned int i;
+    uint64_t iv[8];
+
+    if (lanes == 1) {
+        sha512_inc_init(iv);
+        for (i = 0; i < count; i++) {
+            sha512_inc_finalize(out[i], state ? state[i] : iv,
+                                in[i], inlen, absorbed);
+        }
+        return;
+    }
+#ifdef XMSS_SHA2X_X86
+    for (i = 0; i < count; i += lanes) {
+        sha512x_lanes_finalize(out + i, state ? state + i : NULL, in + i,
+                               inlen, absorbed,
+                               count - i < lanes ? count - i : lanes, lanes);
+    }
+#endif
+}
@@ -0,0 +1,37 @@
+#ifndef XMSS_SHA2X_H
+#define XMSS_SHA2X_H
+
+#include <stdint.h>
+
+#define SHA256X_MAX_LANES 16
+#define SHA512X_MAX_LANES 8
+
+/* These functions compute SHA-256 and SHA-512 over many independent inputs
+ * of equal length at once. On x86-64, the inputs are spread over the lanes
+ * of AVX2 or AVX-512 registers (8 or 16 lanes for SHA-256, 4 or 8 lanes for
+ * SHA-512), depending on what the CPU supports at run-time. Otherwise, this
+ * falls back to a loop over sha256_inc_finalize or sha512_inc_finalize.
+ */
+
+/* Return the number of inputs that are processed at once, or 1 if this
+ * falls back to the scalar implementation.
+ */
+unsigned int sha256xn_lanes(void);
+unsigned int sha512xn_lanes(void);
+
+/* Computes, for i in [0, count), the SHA-256 digest of in[i] (of inlen bytes)
+ * and writes it to out[i]. Each computation continues from state[i], after
+ * 'absorbed' bytes, as in sha256_inc_finalize. If state is NULL, all
+ * computations start from the initial hash value (and absorbed must be 0).
+ * out[i] may alias in[i].
+ */
+void sha256xn_inc_finalize(unsigned char *out[], const uint32_t *state[],
+                           const unsigned char *in[], unsigned long long inlen,
+                           unsigned long long absorbed, unsigned int count);
+
+/* As sha256xn_inc_finalize, but for SHA-512. */
+void sha512xn_inc_finalize(unsigned char *out[], const uint64_t *state[],
+                           const unsigned char *in[], unsigned long long inlen,
+                           unsigned long long absorbed, unsigned int count);
+
+#endif
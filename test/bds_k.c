@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../xmss.h"
+#include "../xmss_core.h"
+#include "../params.h"
+#include "../randombytes.h"
+#include "../utils.h"
+
+#define XMSS_MLEN 32
+
+#ifndef XMSS_SIGNATURES
+    #define XMSS_SIGNATURES 4
+#endif
+
+/* Derives a key pair with the OID prepended, as xmss[mt]_keypair does. */
+static void seed_keypair(const xmss_params *params, int is_xmssmt,
+                         uint32_t oid, unsigned char *pk, unsigned char *sk,
+                         const unsigned char *seed)
+{
+    ull_to_bytes(pk, XMSS_OID_LEN, oid);
+    ull_to_bytes(sk, XMSS_OID_LEN, oid);
+    if (is_xmssmt) {
+        xmssmt_core_seed_keypair(params, pk + XMSS_OID_LEN, sk + XMSS_OID_LEN,
+                                 seed);
+    }
+    else {
+        xmss_core_seed_keypair(params, pk + XMSS_OID_LEN, sk + XMSS_OID_LEN,
+                               seed);
+    }
+}
+
+/* Derives a key from the same seed for every legal bds_k, and checks that
+   they all produce the signatures of the bds_k = 0 key, when signing through
+   the OID wrappers, which read bds_k from the key. */
+static int test_bds_k(const char *name, unsigned int signatures)
+{
+    xmss_params params0, params;
+    xmss_keygen_opts opts = {0};
+    uint32_t oid;
+    int is_xmssmt = strncmp(name, "XMSSMT", 6) == 0;
+    unsigned long long siglen;
+    unsigned int i, k;
+    int (*sign_detached)(unsigned char *, unsigned char *,
+                         unsigned long long *, const unsigned char *,
+                         unsigned long long);
+
+    if (is_xmssmt) {
+        xmssmt_str_to_oid(&oid, name);
+        xmssmt_parse_oid(&params0, oid);
+        sign_detached = xmssmt_sign_detached;
+    }
+    else {
+        xmss_str_to_oid(&oid, name);
+        xmss_parse_oid(&params0, oid);
+        sign_detached = xmss_sign_detached;
+    }
+    if (signatures > (1U << params0.full_height)) {
+        signatures = 1U << params0.full_height;
+    }
+
+    unsigned char seed[3 * params0.n];
+    unsigned char pk0[XMSS_OID_LEN + params0.pk_bytes];
+    unsigned char pk[XMSS_OID_LEN + params0.pk_bytes];
+    unsigned char m[XMSS_MLEN] = {0};
+    unsigned char *sk0 = malloc(XMSS_OID_LEN + params0.sk_bytes);
+    unsigned char *sigs0 = malloc(signatures * params0.sig_bytes);
+    unsigned char *sig = malloc(params0.sig_bytes);
+
+    printf("  %s, %u signatures per bds_k.. ", name, signatures);
+    fflush(stdout);
+
+    /* bds_k must not exceed the tree height, and leave an even difference. */
+    params = params0;
+    if (!xmss_xmssmt_set_bds_k(&params, params.tree_height + 1) ||
+            !xmss_xmssmt_set_bds_k(&params, params.tree_height - 1) ||
+            params.sk_bytes != params0.sk_bytes) {
+        printf("illegal bds_k accepted!\n");
+        return -1;
+    }
+    opts.bds_k = params.tree_height + 1;
+    if (!(is_xmssmt ? xmssmt_keypair_resumable : xmss_keypair_resumable)(
+            pk, sk0, oid, &opts)) {
+        printf("illegal bds_k accepted for key generation!\n");
+        return -1;
+    }
+
+    randombytes(seed, sizeof(seed));
+    seed_keypair(&params0, is_xmssmt, oid, pk0, sk0, seed);
+    for (i = 0; i < signatures; i++) {
+        m[0] = i;
+        sign_detached(sk0, sigs0 + i * params0.sig_bytes, &siglen,
+                      m, XMSS_MLEN);
+    }
+
+    for (k = 1; k <= params0.tree_height; k++) {
+        params = params0;
+        if (xmss_xmssmt_set_bds_k(&params, k)) {
+            continue;
+        }
+        unsigned char *sk = malloc(XMSS_OID_LEN + params.sk_bytes);
+
+        seed_keypair(&params, is_xmssmt, oid, pk, sk, seed);
+        if (memcmp(pk, pk0, sizeof(pk))) {
+            printf("public key differs for bds_k %u!\n", k);
+            return -1;
+        }
+        params = params0;
+        if ((is_xmssmt ? xmssmt_parse_sk : xmss_parse_sk)(&params, sk) ||
+                xmss_xmssmt_set_bds_k(&params0, k) ||
+                params.sk_bytes != params0.sk_bytes) {
+            printf("bds_k %u not read back from the key!\n", k);
+            return -1;
+        }
+        xmss_xmssmt_set_bds_k(&params0, 0);
+
+        for (i = 0; i < signatures; i++) {
+            m[0] = i;
+            if (sign_detached(sk, sig, &siglen, m, XMSS_MLEN) ||
+                    memcmp(sig, sigs0 + i * params0.sig_bytes,
+                           params0.sig_bytes)) {
+                printf("signature %u differs for bds_k %u!\n", i, k);
+                return -1;
+            }
+        }
+        free(sk);
+    }
+
+    free(sk0);
+    free(sigs0);
+    free(sig);
+
+    printf("successful.\n");
+    return 0;
+}
+
+int main()
+{
+    int ret = 0;
+
+    printf("Testing BDS traversal parameters..\n");
+
+    ret |= test_bds_k("XMSS-SHA2_10_256", XMSS_SIGNATURES);
+    ret |= test_bds_k("XMSSMT-SHA2_20/4_256", XMSS_SIGNATURES);
+
+    return ret;
+}
@@ -0,0 +1,270 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include "../xmss.h"
+#include "../xmss_core.h"
+#include "../params.h"
+#include "../hash.h"
+#include "../randombytes.h"
+#include "../utils.h"
+
+#define XMSS_MLEN 32
+
+#ifndef XMSS_SIGNATURES
+    #define XMSS_SIGNATURES 16
+#endif
+
+/* Counts the calls to the hash functions that the signatures below make. */
+static const struct xmss_hash_ops *hash_ops;
+static unsigned long long hash_calls;
+
+static void count_f(const xmss_params *params, unsigned char *out,
+                    const unsigned char *in, unsigned long long inlen)
+{
+    hash_calls++;
+    hash_ops->f(params, out, in, inlen);
+}
+
+static void count_h(const xmss_params *params, unsigned char *out,
+                    const unsigned char *in, unsigned long long inlen)
+{
+    hash_calls++;
+    hash_ops->h(params, out, in, inlen);
+}
+
+static void count_h_msg(const xmss_params *params, unsigned char *out,
+                        const unsigned char *in, unsigned long long inlen)
+{
+    hash_calls++;
+    hash_ops->h_msg(params, out, in, inlen);
+}
+
+static void count_prf(const xmss_params *params, unsigned char *out,
+                      const unsigned char in[32], const xmss_prf_ctx *key)
+{
+    hash_calls++;
+    hash_ops->prf(params, out, in, key);
+}
+
+static void count_f_xn(const xmss_params *params, unsigned char *out[],
+                       const unsigned char *in[], unsigned long long inlen,
+                       unsigned int count)
+{
+    hash_calls += count;
+    hash_ops->f_xn(params, out, in, inlen, count);
+}
+
+static void count_h_xn(const xmss_params *params, unsigned char *out[],
+                       const unsigned char *in[], unsigned long long inlen,
+                       unsigned int count)
+{
+    hash_calls += count;
+    hash_ops->h_xn(params, out, in, inlen, count);
+}
+
+static void count_prf_xn(const xmss_params *params, unsigned char *out[],
+                         const unsigned char *in[], const xmss_prf_ctx *key[],
+                         unsigned int count)
+{
+    hash_calls += count;
+    hash_ops->prf_xn(params, out, in, key, count);
+}
+
+static const struct xmss_hash_ops counting_ops = {
+    count_f, count_h, count_h_msg, count_prf,
+    count_f_xn, count_h_xn, count_prf_xn
+};
+
+/* Returns the most hash calls that a signature with the constant BDS schedule
+   may take, from the cost of its parts: the message takes R and a WOTS
+   signature; every index then computes a leaf for the BDS round, (h-k)/2
+   treehash updates and, to keep the next trees on schedule, 2 more units on
+   the lowest layer and 1 on every other layer but the top, where each unit
+   is a leaf and the h nodes that it may complete, or a WOTS signature on a
+   next root; and the BDS round hashes a node when it takes no leaf. */
+static unsigned long long constant_bound(const xmss_params *params)
+{
+    const unsigned long long len = params->wots_len;
+    const unsigned long long h = params->tree_height;
+    /* the seed of the key pair, its len secret keys and chains */
+    const unsigned long long wots = 1 + len + 3 * len * (params->wots_w - 1);
+    /* the L-tree takes len - 1 nodes; a node takes 3 PRF calls and H */
+    const unsigned long long leaf = wots + 4 * (len - 1);
+    const unsigned long long units = 1 + ((h - params->bds_k) >> 1)
+                                     + (params->d > 1 ? params->d : 0);
+
+    return 1 + wots + units * (leaf + 4 * h) + 4;
+}
+
+/* Signs with a key of the constant BDS schedule and bds_k k, derived from the
+   same seed as the default key that made sigs0. Checks that the signatures are
+   the same, that the schedule is read back from the key, and that no
+   signature takes more hash calls than constant_bound. Returns the
+   largest number of hash calls of a signature, or 0 on failure.
+   The middle third is signed with a signer loaded from the key, and the last
+   third again with the key it was flushed to. */
+static unsigned long long sign_constant(const xmss_params *params0,
+                                        uint32_t oid, unsigned int k,
+                                        const unsigned char *seed,
+                                        const unsigned char *sigs0,
+                                        unsigned int signatures)
+{
+    xmss_params params = *params0;
+    unsigned long long default_sk_bytes;
+    unsigned long long siglen, most = 0;
+    unsigned char m[XMSS_MLEN] = {0};
+    struct iovec iov = { m, XMSS_MLEN };
+    xmss_signer *signer = NULL;
+    unsigned int i;
+
+    if (xmss_xmssmt_set_bds_k(&params, k)) {
+        printf("bds_k %u not legal!\n", k);
+        return 0;
+    }
+    /* The WOTS signatures on the next roots, and whether they are ready. */
+    default_sk_bytes = params.sk_bytes;
+    if (xmss_xmssmt_set_bds_schedule(&params, XMSS_BDS_SCHEDULE_CONSTANT) ||
+            params.sk_bytes != default_sk_bytes
+                + (params.d - 1) * (params.wots_sig_bytes + 1)) {
+        printf("wrong key size for the constant schedule!\n");
+        return 0;
+    }
+
+    unsigned char pk[XMSS_OID_LEN + params.pk_bytes];
+    unsigned char *sk = malloc(XMSS_OID_LEN + params.sk_bytes);
+    unsigned char *sig = malloc(params.sig_bytes);
+    xmss_params parsed;
+
+    ull_to_bytes(pk, XMSS_OID_LEN, oid);
+    ull_to_bytes(sk, XMSS_OID_LEN, oid);
+    xmssmt_core_seed_keypair(&params, pk + XMSS_OID_LEN, sk + XMSS_OID_LEN,
+                             seed);
+    if (xmssmt_parse_sk(&parsed, sk) ||
+            parsed.bds_schedule != XMSS_BDS_SCHEDULE_CONSTANT ||
+            parsed.bds_k != k || parsed.sk_bytes != params.sk_bytes) {
+        printf("schedule not read back from the key!\n");
+        return 0;
+    }
+
+    hash_ops = params.hash;
+    params.hash = &counting_ops;
+
+    for (i = 0; i < signatures; i++) {
+        m[0] = i;
+        m[1] = i >> 8;
+        if (i == signatures / 3) {
+            signer = xmss_core_signer_load(&params, sk + XMSS_OID_LEN);
+        }
+        if (i == 2 * signatures / 3) {
+            xmss_core_signer_flush(signer, sk + XMSS_OID_LEN);
+            xmss_core_signer_free(signer);
+            signer = NULL;
+        }
+        hash_calls = 0;
+        if (signer != NULL) {
+            xmss_core_signer_sign_detached(signer, sig, &siglen, &iov, 1);
+        }
+        else {
+            xmssmt_core_sign_detached(&params, sk + XMSS_OID_LEN,
+                                      sig, &siglen, &iov, 1);
+        }
+        if (memcmp(sig, sigs0 + i * params.sig_bytes, params.sig_bytes)) {
+            printf("signature %u differs for bds_k %u!\n", i, k);
+            return 0;
+        }
+        if (hash_calls > most) {
+            most = hash_calls;
+        }
+    }
+
+    printf("at most %llu hash calls, of %llu.\n", most,
+           constant_bound(&params));
+    if (most > constant_bound(&params)) {
+        printf("    above the bound!\n");
+        return 0;
+    }
+
+    free(sk);
+    free(sig);
+
+    return most;
+}
+
+/* Compares the largest number of hash calls per signature of the default
+   and constant BDS schedules, for every legal bds_k; spreading the work of
+   the next trees must keep the constant one strictly below the default. */
+static int test_bds_schedule(const char *name, unsigned int signatures)
+{
+    xmss_params params;
+    uint32_t oid;
+    unsigned long long siglen, most, most0 = 0;
+    unsigned char m[XMSS_MLEN] = {0};
+    struct iovec iov = { m, XMSS_MLEN };
+    unsigned int i, k;
+
+    xmssmt_str_to_oid(&oid, name);
+    xmssmt_parse_oid(&params, oid);
+
+    unsigned char seed[3 * params.n];
+    unsigned char pk[params.pk_bytes];
+    unsigned char *sk = malloc(params.sk_bytes);
+    unsigned char *sigs0 = malloc(signatures * params.sig_bytes);
+
+    printf("  %s, %u signatures per bds_k..\n", name, signatures);
+
+    if (!xmss_xmssmt_set_bds_schedule(&params, 2)) {
+        printf("    unknown schedule accepted!\n");
+        return -1;
+    }
+
+    randombytes(seed, sizeof(seed));
+    xmssmt_core_seed_keypair(&params, pk, sk, seed);
+    hash_ops = params.hash;
+    params.hash = &counting_ops;
+    for (i = 0; i < signatures; i++) {
+        m[0] = i;
+        m[1] = i >> 8;
+        hash_calls = 0;
+        xmssmt_core_sign_detached(&params, sk, sigs0 + i * params.sig_bytes,
+                                  &siglen, &iov, 1);
+        if (hash_calls > most0) {
+            most0 = hash_calls;
+        }
+    }
+    params.hash = hash_ops;
+    printf("    default schedule: at most %llu hash calls.\n", most0);
+
+    for (k = 0; k <= params.tree_height; k++) {
+        if (!xmss_xmssmt_bds_k_legal(&params, k)) {
+            continue;
+        }
+        printf("    constant schedule, bds_k %u: ", k);
+        most = sign_constant(&params, oid, k, seed, sigs0, signatures);
+        if (most == 0) {
+            return -1;
+        }
+        if (most >= most0) {
+            printf("    not below the default schedule!\n");
+            return -1;
+        }
+    }
+
+    free(sk);
+    free(sigs0);
+
+    return 0;
+}
+
+int main()
+{
+    int ret = 0;
+
+    printf("Testing the constant BDS schedule..\n");
+
+    ret |= test_bds_schedule("XMSSMT-SHA2_20/4_256", XMSS_SIGNATURES);
+
+    return ret;
+}
@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../xmss.h"
+#include "../xmss_core.h"
+#include "../params.h"
+#include "../utils.h"
+
+#define XMSS_MLEN 32
+
+#ifndef XMSS_SIGNATURES
+    #define XMSS_SIGNATURES 4
+#endif
+
+/* The number of signatures from each start on for XMSSMT. */
+#define XMSSMT_SIGNATURES (XMSS_SIGNATURES < 100 ? XMSS_SIGNATURES : 100)
+
+/* Signs signatures messages from each of the indices in starts on with a
+   key that is compacted and expanded again before every signature, and
+   checks that it signs as the key that never was. With a BDS state, the
+   encoding must take at most four fifths of the room of the states in sk;
+   the head, the selectors and the WOTS signatures are kept as they are.
+   Keys without a state are encoded as they are, plus the version byte. */
+static int test_compact(const char *name, unsigned int schedule,
+                        const unsigned long long *starts, unsigned int count,
+                        unsigned int signatures)
+{
+    xmss_params params;
+    xmss_keygen_opts opts = {0};
+    uint32_t oid;
+    int is_xmssmt = strncmp(name, "XMSSMT", 6) == 0;
+    unsigned long long siglen, outlen, outlen2, idx, max_outlen = 0;
+    unsigned long long head, kept, states, max_states;
+    unsigned char m[XMSS_MLEN] = {0};
+    unsigned int i, j;
+    int (*sign_detached)(unsigned char *, unsigned char *,
+                         unsigned long long *, const unsigned char *,
+                         unsigned long long);
+    int (*sk_compact)(unsigned char *, unsigned long long *,
+                      const unsigned char *);
+    int (*sk_expand)(unsigned char *, const unsigned char *,
+                     unsigned long long);
+
+    if (is_xmssmt) {
+        xmssmt_str_to_oid(&oid, name);
+        xmssmt_parse_oid(&params, oid);
+        sign_detached = xmssmt_sign_detached;
+        sk_compact = xmssmt_sk_compact;
+        sk_expand = xmssmt_sk_expand;
+    }
+    else {
+        xmss_str_to_oid(&oid, name);
+        xmss_parse_oid(&params, oid);
+        sign_detached = xmss_sign_detached;
+        sk_compact = xmss_sk_compact;
+        sk_expand = xmss_sk_expand;
+    }
+    xmss_xmssmt_set_bds_schedule(&params, schedule);
+
+    /* The key and the encoding both hold the OID and the head, and for
+       every layer but the top one a selector and the WOTS signature on the
+       root below, as well as that on the next root and whether it is ready
+       with the constant schedule. The rest of the key is the BDS states. */
+    head = xmss_xmssmt_core_sk_state_idx_offset(&params);
+    if (head != 0) {
+        kept = XMSS_OID_LEN + head + XMSS_SK_STATE_IDX_BYTES
+            + (params.d - 1) * (1 + params.wots_sig_bytes);
+        if (schedule == XMSS_BDS_SCHEDULE_CONSTANT) {
+            kept += (params.d - 1) * (1 + params.wots_sig_bytes);
+        }
+        states = XMSS_OID_LEN + params.sk_bytes - kept;
+        max_states = states * 4 / 5;
+        /* the version byte */
+        kept++;
+    }
+    else {
+        kept = XMSS_OID_LEN + params.sk_bytes + 1;
+        states = max_states = 0;
+    }
+
+    unsigned char pk[XMSS_OID_LEN + params.pk_bytes];
+    unsigned char *sk = malloc(XMSS_OID_LEN + params.sk_bytes);
+    unsigned char *sk_expanded = malloc(XMSS_OID_LEN + params.sk_bytes);
+    unsigned char *out = malloc(XMSS_OID_LEN + params.sk_bytes + 1);
+    unsigned char *out2 = malloc(XMSS_OID_LEN + params.sk_bytes + 1);
+    unsigned char *sig = malloc(params.sig_bytes);
+    unsigned char *sig_expanded = malloc(params.sig_bytes);
+
+    printf("  %s, schedule %u.. ", name, schedule);
+    fflush(stdout);
+
+    opts.bds_schedule = schedule;
+    (is_xmssmt ? xmssmt_keypair_resumable : xmss_keypair_resumable)(
+        pk, sk, oid, &opts);
+    memcpy(sk_expanded, sk, XMSS_OID_LEN + params.sk_bytes);
+
+    for (i = 0; i < count; i++) {
+        if ((is_xmssmt ? xmssmt_restore_state : xmss_restore_state)(
+                sk, starts[i]) ||
+                (is_xmssmt ? xmssmt_restore_state : xmss_restore_state)(
+                    sk_expanded, starts[i])) {
+            printf("restoring to %llu failed!\n", starts[i]);
+            return -1;
+        }
+        for (j = 0; j < signatures; j++) {
+            idx = starts[i] + j;
+            if (sk_compact(out, &outlen, sk_expanded) ||
+                    sk_expand(sk_expanded, out, outlen)) {
+                printf("round trip at %llu failed!\n", idx);
+                return -1;
+            }
+            if (outlen > kept + max_states) {
+                printf("%llu bytes at %llu, over %llu!\n",
+                       outlen, idx, kept + max_states);
+                return -1;
+            }
+            /* Expanding and compacting again gives the same encoding. */
+            if (sk_compact(out2, &outlen2, sk_expanded) ||
+                    outlen2 != outlen || memcmp(out, out2, outlen)) {
+                printf("encoding at %llu is not stable!\n", idx);
+                return -1;
+            }
+            if (outlen > max_outlen) {
+                max_outlen = outlen;
+            }
+
+            m[0] = idx;
+            m[1] = idx >> 8;
+            if (sign_detached(sk, sig, &siglen, m, XMSS_MLEN) ||
+                    sign_detached(sk_expanded, sig_expanded, &siglen,
+                                  m, XMSS_MLEN) ||
+                    memcmp(sig, sig_expanded, params.sig_bytes)) {
+                printf("signature %llu differs!\n", idx);
+                return -1;
+            }
+        }
+    }
+
+    /* Truncated or extended encodings are refused. */
+    sk_compact(out, &outlen, sk_expanded);
+    if (!sk_expand(sk_expanded, out, outlen - 1) ||
+            !sk_expand(sk_expanded, out, outlen + 1)) {
+        printf("expanded a malformed encoding!\n");
+        return -1;
+    }
+
+    free(sk);
+    free(sk_expanded);
+    free(out);
+    free(out2);
+    free(sig);
+    free(sig_expanded);
+
+    printf("successful; at most %llu of %llu bytes",
+           max_outlen, XMSS_OID_LEN + params.sk_bytes);
+    if (states != 0) {
+        printf(", states %llu of %llu", max_outlen - kept, states);
+    }
+    printf(".\n");
+    return 0;
+}
+
+int main()
+{
+    /* The start, shortly before the next tree of the second layer of 20/4,
+       and the last indices, where the upper layers have no next trees. */
+    const unsigned long long starts[] = {
+        0, 1024 - XMSSMT_SIGNATURES / 2, (1ULL << 20) - XMSSMT_SIGNATURES
+    };
+    int ret = 0;
+
+    printf("Testing compact secret keys..\n");
+
+    ret |= test_compact("XMSS-SHA2_10_256", XMSS_BDS_SCHEDULE_DEFAULT,
+                        starts, 1, XMSS_SIGNATURES);
+    ret |= test_compact("XMSSMT-SHA2_20/4_256", XMSS_BDS_SCHEDULE_DEFAULT,
+                        starts, 3, XMSSMT_SIGNATURES);
+    ret |= test_compact("XMSSMT-SHA2_20/4_256", XMSS_BDS_SCHEDULE_CONSTANT,
+                        starts, 3, XMSSMT_SIGNATURES);
+
+    return ret;
+}
@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../hash.h"
+#include "../randombytes.h"
+#include "../params.h"
+
+#define XMSS_MSG_MAXLEN 600
+
+/* Compares the incremental message hash to hash_message, for messages of
+   mlen bytes that are passed in parts of at most step bytes. */
+static int test_hash_msg(const xmss_params *params,
+                         unsigned long long mlen, unsigned int step)
+{
+    unsigned char m_with_prefix[4 * params->n + XMSS_MSG_MAXLEN];
+    unsigned char *m = m_with_prefix + 4 * params->n;
+    unsigned char R[params->n];
+    unsigned char root[params->n];
+    unsigned char expected[params->n];
+    unsigned char out[params->n];
+    unsigned long long idx = 0x0123456789ULL;
+    unsigned long long i, len;
+    xmss_hash_msg_ctx ctx;
+
+    randombytes(m, mlen);
+    randombytes(R, params->n);
+    randombytes(root, params->n);
+
+    hash_message_init(params, &ctx, R, root, idx);
+    for (i = 0; i < mlen; i += len) {
+        len = mlen - i < step ? mlen - i : step;
+        hash_message_update(params, &ctx, m + i, len);
+    }
+    hash_message_final(params, &ctx, out);
+
+    hash_message(params, expected, R, root, idx, m_with_prefix, mlen);
+
+    return memcmp(out, expected, params->n) ? -1 : 0;
+}
+
+int main()
+{
+    xmss_params params;
+    /* SHA2 and SHAKE, with n = 32 and n = 64. */
+    uint32_t oids[4] = {0x00000001, 0x00000004, 0x00000007, 0x0000000a};
+    unsigned long long mlens[6] = {0, 1, 63, 136, 169, XMSS_MSG_MAXLEN};
+    unsigned int steps[4] = {1, 7, 128, XMSS_MSG_MAXLEN};
+    unsigned int i, j, k;
+    int ret = 0;
+
+    printf("Testing incremental message hash against hash_message.. ");
+
+    for (i = 0; i < 4; i++) {
+        xmss_parse_oid(&params, oids[i]);
+        for (j = 0; j < 6; j++) {
+            for (k = 0; k < 4; k++) {
+                if (test_hash_msg(&params, mlens[j], steps[k])) {
+                    printf("failed for OID %u, mlen %llu, step %u; ",
+                           oids[i], mlens[j], steps[k]);
+                    ret = -1;
+                }
+            }
+        }
+    }
+
+    if (ret) {
+        printf("failed!\n");
+        return -1;
+    }
+    printf("successful.\n");
+    return 0;
+}
@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../hash.h"
+#include "../randombytes.h"
+#include "../params.h"
+#include "../sha2.h"
+#include "../threads.h"
+
+#define XMSS_XN_COUNT 37
+
+/* Compares the batched hash functions to the scalar ones, for count inputs. */
+static int test_xn(const xmss_params *params, unsigned int count)
+{
+    unsigned char in[XMSS_XN_COUNT][2 * params->n];
+    unsigned char out[XMSS_XN_COUNT][params->n];
+    unsigned char expected[XMSS_XN_COUNT][params->n];
+    unsigned char keys[XMSS_XN_COUNT][params->n];
+    xmss_prf_ctx key_ctx[XMSS_XN_COUNT];
+    unsigned char *out_ptrs[XMSS_XN_COUNT];
+    const unsigned char *in_ptrs[XMSS_XN_COUNT];
+    const xmss_prf_ctx *key_ptrs[XMSS_XN_COUNT];
+    uint32_t addr[XMSS_XN_COUNT][8];
+    uint32_t addr_xn[XMSS_XN_COUNT][8];
+    unsigned int i;
+    int ret = 0;
+
+    randombytes((unsigned char *)in, sizeof(in));
+    randombytes((unsigned char *)keys, sizeof(keys));
+    randombytes((unsigned char *)addr, sizeof(addr));
+
+    for (i = 0; i < count; i++) {
+        prf_ctx_init(params, &key_ctx[i], keys[i]);
+        out_ptrs[i] = out[i];
+        in_ptrs[i] = in[i];
+        key_ptrs[i] = &key_ctx[i];
+    }
+
+    for (i = 0; i < count; i++) {
+        prf(params, expected[i], in[i], &key_ctx[i]);
+    }
+    prf_xn(params, out_ptrs, in_ptrs, key_ptrs, count);
+    if (memcmp(out, expected, count * params->n)) {
+        printf("prf_xn differs from prf; ");
+        ret = -1;
+    }
+
+    memcpy(addr_xn, addr, sizeof(addr));
+    for (i = 0; i < count; i++) {
+        thash_f(params, expected[i], in[i], &key_ctx[0], addr[i]);
+    }
+    thash_f_xn(params, out_ptrs, in_ptrs, &key_ctx[0], addr_xn, count);
+    if (memcmp(out, expected, count * params->n) ||
+            memcmp(addr, addr_xn, count * sizeof(addr[0]))) {
+        printf("thash_f_xn differs from thash_f; ");
+        ret = -1;
+    }
+
+    for (i = 0; i < count; i++) {
+        thash_h(params, expected[i], in[i], &key_ctx[0], addr[i]);
+    }
+    thash_h_xn(params, out_ptrs, in_ptrs, &key_ctx[0], addr_xn, count);
+    if (memcmp(out, expected, count * params->n) ||
+            memcmp(addr, addr_xn, count * sizeof(addr[0]))) {
+        printf("thash_h_xn differs from thash_h; ");
+        ret = -1;
+    }
+
+    return ret;
+}
+
+/* The number of threads that select the hash functions of a family at once. */
+#define XMSS_SELECT_THREADS 8
+
+/* SHA2 and SHAKE, with n = 32 and n = 64. */
+static const uint32_t oids[4] = {
+    0x00000001, 0x00000004, 0x00000007, 0x0000000a
+};
+
+/* Selects the hash functions of family i / XMSS_SELECT_THREADS. */
+static void select_ops(void *arg, unsigned int i)
+{
+    const struct xmss_hash_ops **ops = arg;
+    xmss_params params;
+
+    xmss_parse_oid(&params, oids[i / XMSS_SELECT_THREADS]);
+    ops[i] = params.hash;
+}
+
+/* Has threads use every family for the first time at once, and checks that
+   they all get the same, complete selection of it. */
+static int test_select(void)
+{
+    const struct xmss_hash_ops *ops[4 * XMSS_SELECT_THREADS];
+    unsigned int i;
+
+    xmss_parallel_for(4 * XMSS_SELECT_THREADS, 4 * XMSS_SELECT_THREADS,
+                      select_ops, ops);
+    for (i = 0; i < 4 * XMSS_SELECT_THREADS; i++) {
+        if (ops[i] == NULL ||
+                ops[i] != ops[i - i % XMSS_SELECT_THREADS] ||
+                ops[i]->f == NULL || ops[i]->h == NULL ||
+                ops[i]->h_msg == NULL || ops[i]->prf == NULL ||
+                ops[i]->f_xn == NULL || ops[i]->h_xn == NULL ||
+                ops[i]->prf_xn == NULL) {
+            printf("concurrent selection differs; ");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+#ifndef XMSS_HASH_AUTOTUNE
+/* Checks that without autotuning, SHA-2 uses SHA-NI where the CPU has it and
+   OpenSSL otherwise, rather than the portable implementation. */
+static int test_default_impl(void)
+{
+    static const char *const expected[4] = {
+        "openssl", "openssl", "fips202", "fips202"
+    };
+    xmss_params params;
+    const char *name;
+    unsigned int i;
+    int prf;
+
+    for (i = 0; i < 4; i++) {
+        xmss_parse_oid(&params, oids[i]);
+        for (prf = 0; prf <= 1; prf++) {
+            name = xmss_hash_impl_name(&params, prf);
+            if (name == NULL || strcmp(name, i == 0 && sha256_shani_supported()
+                                             ? "shani" : expected[i])) {
+                printf("%s selected for %s; ", name ? name : "nothing",
+                       prf ? "prf" : "f");
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+#endif
+
+int main()
+{
+    xmss_params params;
+    unsigned int counts[5] = {1, 3, 8, 16, XMSS_XN_COUNT};
+    unsigned int i, j;
+    int ret = 0;
+
+    printf("Testing batched hash functions against scalar versions.. ");
+
+    /* This must come first, while no family has been used yet. */
+    ret |= test_select();
+#ifndef XMSS_HASH_AUTOTUNE
+    ret |= test_default_impl();
+#endif
+
+    for (i = 0; i < 4; i++) {
+        xmss_parse_oid(&params, oids[i]);
+        for (j = 0; j < 5; j++) {
+            ret |= test_xn(&params, counts[j]);
+        }
+    }
+
+    if (ret) {
+        printf("failed!\n");
+        return -1;
+    }
+    printf("successful.\n");
+    return 0;
+}
@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "../params.h"
+#include "../xmss_commons.h"
+#include "../xmss_core.h"
+
+#define CHECKPOINT_FILE "test/keygen_resume.ckpt"
+
+static unsigned long long last_done, last_total;
+
+/* Stands in for the node being preempted, right after the first checkpoint. */
+static void exit_progress(void *ctx, unsigned long long leaves_done,
+                          unsigned long long leaves_total, double seconds_left)
+{
+    (void)ctx;
+    (void)leaves_done;
+    (void)leaves_total;
+    (void)seconds_left;
+    _exit(0);
+}
+
+static void record_progress(void *ctx, unsigned long long leaves_done,
+                            unsigned long long leaves_total,
+                            double seconds_left)
+{
+    (void)ctx;
+    (void)seconds_left;
+    last_done = leaves_done;
+    last_total = leaves_total;
+}
+
+/* Interrupts key generation after the first checkpoint, resumes it with
+   another number of threads, and compares the result with a key pair that is
+   derived from the same seed in one go. */
+static int test_keygen_resume(const char *name, const char *other_name)
+{
+    xmss_params params, other_params;
+    xmss_keygen_opts opts = {0};
+    uint32_t oid;
+    pid_t pid;
+    int status;
+
+    xmssmt_str_to_oid(&oid, name);
+    xmssmt_parse_oid(&params, oid);
+    xmssmt_str_to_oid(&oid, other_name);
+    xmssmt_parse_oid(&other_params, oid);
+
+    unsigned char seed[3 * params.n];
+    unsigned char pk1[params.pk_bytes];
+    unsigned char pk2[params.pk_bytes];
+    unsigned char sk1[params.sk_bytes];
+    unsigned char sk2[params.sk_bytes];
+    unsigned char other_pk[other_params.pk_bytes];
+    unsigned char other_sk[other_params.sk_bytes];
+
+    printf("  %s.. ", name);
+    fflush(stdout);
+
+    unlink(CHECKPOINT_FILE);
+    opts.checkpoint_file = CHECKPOINT_FILE;
+    opts.checkpoint_interval = 0;
+
+    pid = fork();
+    if (pid == 0) {
+        params.threads = 1;
+        opts.progress = exit_progress;
+        memset(sk1, 0, params.sk_bytes);
+        xmssmt_core_keypair_resumable(&params, pk1, sk1, &opts);
+        _exit(1);
+    }
+    if (pid < 0 || waitpid(pid, &status, 0) != pid ||
+            !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        printf("interrupted key generation failed!\n");
+        return -1;
+    }
+
+    if (keygen_checkpoint_seed(&params, seed, &opts) != 1) {
+        printf("no checkpoint to resume from!\n");
+        return -1;
+    }
+    if (xmssmt_core_keypair_resumable(&other_params, other_pk, other_sk,
+                                      &opts) != -1) {
+        printf("resumed with the wrong parameters!\n");
+        return -1;
+    }
+
+    params.threads = 3;
+    opts.progress = record_progress;
+    memset(sk1, 0, params.sk_bytes);
+    if (xmssmt_core_keypair_resumable(&params, pk1, sk1, &opts)) {
+        printf("resuming failed!\n");
+        return -1;
+    }
+    /* The reference core only computes the top tree, the fast core all d. */
+    if (last_done != last_total ||
+            last_total % (1ULL << params.tree_height) != 0) {
+        printf("unexpected progress %llu / %llu!\n", last_done, last_total);
+        return -1;
+    }
+    if (access(CHECKPOINT_FILE, F_OK) == 0) {
+        printf("checkpoint not removed!\n");
+        return -1;
+    }
+
+    memset(sk2, 0, params.sk_bytes);
+    xmssmt_core_seed_keypair(&params, pk2, sk2, seed);
+    if (memcmp(pk1, pk2, params.pk_bytes) ||
+            memcmp(sk1, sk2, params.sk_bytes)) {
+        printf("resumed key pair differs!\n");
+        return -1;
+    }
+    printf("successful.\n");
+    return 0;
+}
+
+int main()
+{
+    int ret = 0;
+
+    printf("Testing interrupted and resumed key generation..\n");
+
+    ret |= test_keygen_resume("XMSSMT-SHA2_20/2_256", "XMSSMT-SHA2_20/4_256");
+    ret |= test_keygen_resume("XMSSMT-SHA2_40/4_256", "XMSSMT-SHA2_40/8_256");
+
+    if (ret) {
+        return -1;
+    }
+    return 0;
+}
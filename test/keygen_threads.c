@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../params.h"
+#include "../xmss_core.h"
+#include "../randombytes.h"
+
+#define XMSS_MLEN 32
+#define XMSS_SIGNATURES 2
+
+/* Derives a key pair from the same seed with 1 and with several threads, and
+   checks that the key pairs are identical, and that they sign alike. */
+static int test_keygen_threads(const char *name, unsigned int threads)
+{
+    xmss_params params;
+    uint32_t oid;
+    int is_xmssmt = strncmp(name, "XMSSMT", 6) == 0;
+
+    if (is_xmssmt) {
+        xmssmt_str_to_oid(&oid, name);
+        xmssmt_parse_oid(&params, oid);
+    }
+    else {
+        xmss_str_to_oid(&oid, name);
+        xmss_parse_oid(&params, oid);
+    }
+
+    unsigned char seed[3 * params.n];
+    unsigned char pk1[params.pk_bytes];
+    unsigned char pk2[params.pk_bytes];
+    unsigned char sk1[params.sk_bytes];
+    unsigned char sk2[params.sk_bytes];
+    unsigned char m[XMSS_MLEN] = {0};
+    unsigned char sig1[params.sig_bytes];
+    unsigned char sig2[params.sig_bytes];
+    unsigned long long siglen;
+    struct iovec iov = { m, XMSS_MLEN };
+    xmss_signer *signer;
+    unsigned int i;
+    int (*seed_keypair)(const xmss_params *, unsigned char *, unsigned char *,
+                        const unsigned char *);
+    int (*sign_detached)(const xmss_params *, unsigned char *, unsigned char *,
+                         unsigned long long *, const struct iovec *,
+                         unsigned int);
+
+    seed_keypair = is_xmssmt ? xmssmt_core_seed_keypair
+                             : xmss_core_seed_keypair;
+    sign_detached = is_xmssmt ? xmssmt_core_sign_detached
+                              : xmss_core_sign_detached;
+
+    printf("  %s with %u threads.. ", name, threads);
+
+    /* Only callers that ask for threads get them. */
+    if (params.threads != 1) {
+        printf("%u threads by default!\n", params.threads);
+        return -1;
+    }
+
+    randombytes(seed, 3 * params.n);
+    memset(sk1, 0, params.sk_bytes);
+    memset(sk2, 0, params.sk_bytes);
+
+    params.threads = 1;
+    seed_keypair(&params, pk1, sk1, seed);
+    params.threads = threads;
+    seed_keypair(&params, pk2, sk2, seed);
+
+    if (memcmp(pk1, pk2, params.pk_bytes)) {
+        printf("public keys differ!\n");
+        return -1;
+    }
+    if (memcmp(sk1, sk2, params.sk_bytes)) {
+        printf("secret keys differ!\n");
+        return -1;
+    }
+
+    for (i = 0; i < XMSS_SIGNATURES; i++) {
+        m[0] = i;
+        params.threads = 1;
+        sign_detached(&params, sk1, sig1, &siglen, &iov, 1);
+        params.threads = threads;
+        sign_detached(&params, sk2, sig2, &siglen, &iov, 1);
+        if (memcmp(sig1, sig2, params.sig_bytes)) {
+            printf("signature %u differs!\n", i);
+            return -1;
+        }
+    }
+
+    /* A signer of a single thread can be given more. */
+    params.threads = 1;
+    signer = xmss_core_signer_load(&params, sk2);
+    xmss_core_signer_threads(signer, threads);
+    m[0] = i;
+    sign_detached(&params, sk1, sig1, &siglen, &iov, 1);
+    if (signer == NULL ||
+            xmss_core_signer_sign_detached(signer, sig2, &siglen, &iov, 1) ||
+            memcmp(sig1, sig2, params.sig_bytes)) {
+        printf("signature of the signer differs!\n");
+        return -1;
+    }
+    xmss_core_signer_free(signer);
+    printf("successful.\n");
+    return 0;
+}
+
+int main()
+{
+    int ret = 0;
+
+    printf("Testing if multi-threaded key generation and signing match the "
+           "serial ones..\n");
+
+    ret |= test_keygen_threads("XMSS-SHA2_10_256", 4);
+    ret |= test_keygen_threads("XMSS-SHAKE_10_256", 7);
+    ret |= test_keygen_threads("XMSSMT-SHA2_20/4_256", 3);
+    ret |= test_keygen_threads("XMSSMT-SHA2_40/8_256", 16);
+
+    if (ret) {
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../xmss.h"
+#include "../xmss_file.h"
+#include "../params.h"
+#include "../utils.h"
+
+#define XMSS_MLEN 32
+
+#ifndef XMSS_SIGNATURES
+    #define XMSS_SIGNATURES 8
+#endif
+
+/* Signs with a node store and with the key alone, and checks that the
+   signatures are identical; first at the start of the key, then with the
+   key alone after the node store left it behind, and up to its end. */
+static int test_node_store(const char *name)
+{
+    xmss_params params;
+    uint32_t oid;
+    xmss_node_store *s;
+    char path[] = "/tmp/xmss_node_store_XXXXXX";
+    unsigned long long siglen, siglen_ref, idx;
+    unsigned char m[XMSS_MLEN] = {0};
+    struct iovec iov = { m, XMSS_MLEN };
+    unsigned int i;
+    int fd;
+
+    xmss_str_to_oid(&oid, name);
+    xmss_parse_oid(&params, oid);
+
+    unsigned char pk[XMSS_OID_LEN + params.pk_bytes];
+    unsigned char *sk = malloc(XMSS_OID_LEN + params.sk_bytes);
+    unsigned char *sk_ref = malloc(XMSS_OID_LEN + params.sk_bytes);
+    unsigned char *other = malloc(XMSS_OID_LEN + params.sk_bytes);
+    unsigned char *sig = malloc(params.sig_bytes);
+    unsigned char *sig_ref = malloc(params.sig_bytes);
+
+    printf("  %s, %u signatures.. ", name, XMSS_SIGNATURES);
+    fflush(stdout);
+
+    xmss_keypair(pk, sk, oid);
+    memcpy(sk_ref, sk, XMSS_OID_LEN + params.sk_bytes);
+    fd = mkstemp(path);
+    if (fd < 0) {
+        printf("cannot create the node store file!\n");
+        return -1;
+    }
+    close(fd);
+    if (xmss_node_store_create(path, sk, 2)) {
+        printf("creating the node store failed!\n");
+        return -1;
+    }
+    s = xmss_node_store_open(path, sk);
+    if (s == NULL) {
+        printf("cannot open the node store!\n");
+        return -1;
+    }
+
+    for (i = 0; i < XMSS_SIGNATURES; i++) {
+        m[0] = i;
+        /* Every other quarter of the signatures is made with the key alone. */
+        if (((i / (XMSS_SIGNATURES / 4)) % 2 == 0 ?
+                xmss_node_store_sign_detached_iov(s, sk, sig, &siglen,
+                                                  &iov, 1) :
+                xmss_sign_detached(sk, sig, &siglen, m, XMSS_MLEN)) ||
+                xmss_sign_detached(sk_ref, sig_ref, &siglen_ref,
+                                   m, XMSS_MLEN) ||
+                siglen != siglen_ref || memcmp(sig, sig_ref, siglen) ||
+                xmss_verify_detached(sig, siglen, m, XMSS_MLEN, pk)) {
+            printf("signature %u differs!\n", i);
+            return -1;
+        }
+    }
+
+    /* The last indices, and none past them. */
+    idx = (1ULL << params.full_height) - 2;
+    if (xmss_restore_state(sk, idx) || xmss_restore_state(sk_ref, idx)) {
+        printf("restoring to %llu failed!\n", idx);
+        return -1;
+    }
+    for (; idx < (1ULL << params.full_height); idx++) {
+        m[0] = idx;
+        if (xmss_node_store_sign_detached_iov(s, sk, sig, &siglen, &iov, 1) ||
+                xmss_sign_detached(sk_ref, sig_ref, &siglen_ref,
+                                   m, XMSS_MLEN) ||
+                memcmp(sig, sig_ref, siglen)) {
+            printf("signature %llu differs!\n", idx);
+            return -1;
+        }
+    }
+    if (!xmss_node_store_sign_detached_iov(s, sk, sig, &siglen, &iov, 1)) {
+        printf("signed past the last index!\n");
+        return -1;
+    }
+    xmss_node_store_close(s);
+
+    /* The store only opens for the key it holds the tree of. */
+    xmss_keypair(pk, other, oid);
+    if (xmss_node_store_open(path, other) != NULL) {
+        printf("opened the node store for another key!\n");
+        return -1;
+    }
+
+    unlink(path);
+    free(sk);
+    free(sk_ref);
+    free(other);
+    free(sig);
+    free(sig_ref);
+
+    printf("successful.\n");
+    return 0;
+}
+
+int main()
+{
+    int ret = 0;
+
+    printf("Testing node stores..\n");
+
+    ret |= test_node_store("XMSS-SHA2_10_256");
+
+    return ret;
+}
@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../xmss.h"
+#include "../xmss_core.h"
+#include "../params.h"
+#include "../randombytes.h"
+#include "../utils.h"
+
+#define XMSS_MLEN 32
+
+#ifndef XMSS_SIGNATURES
+    #define XMSS_SIGNATURES 4
+#endif
+
+/* The number of signatures that are compared after restoring a key. */
+#define XMSS_COMPARED 40
+
+/* Restores a fresh key to each of a few indices below signatures, and checks
+   that it then signs as the key that signed every index before. */
+static int test_restore(const char *name, unsigned long long signatures)
+{
+    /* Early, the last leaf of a lowest tree, the last index before the next
+       tree on the second layer of 20/4, and the last index that is signed. */
+    const unsigned long long targets[] = {
+        1, 31, 1000, signatures - 1
+    };
+    xmss_params params;
+    uint32_t oid;
+    int is_xmssmt = strncmp(name, "XMSSMT", 6) == 0;
+    unsigned long long siglen, idx, end;
+    unsigned char m[XMSS_MLEN] = {0};
+    unsigned int t;
+    int (*sign_detached)(unsigned char *, unsigned char *,
+                         unsigned long long *, const unsigned char *,
+                         unsigned long long);
+    int (*restore_state)(unsigned char *, unsigned long long);
+
+    if (is_xmssmt) {
+        xmssmt_str_to_oid(&oid, name);
+        xmssmt_parse_oid(&params, oid);
+        sign_detached = xmssmt_sign_detached;
+        restore_state = xmssmt_restore_state;
+    }
+    else {
+        xmss_str_to_oid(&oid, name);
+        xmss_parse_oid(&params, oid);
+        sign_detached = xmss_sign_detached;
+        restore_state = xmss_restore_state;
+    }
+    if (signatures > (1ULL << params.full_height)) {
+        signatures = 1ULL << params.full_height;
+    }
+
+    unsigned char pk[XMSS_OID_LEN + params.pk_bytes];
+    unsigned char *sk0 = malloc(XMSS_OID_LEN + params.sk_bytes);
+    unsigned char *backup = malloc(XMSS_OID_LEN + params.sk_bytes);
+    unsigned char *sk = malloc(XMSS_OID_LEN + params.sk_bytes);
+    unsigned char *sigs0 = malloc(signatures * params.sig_bytes);
+    unsigned char *sig = malloc(params.sig_bytes);
+
+    printf("  %s, %llu signatures.. ", name, signatures);
+    fflush(stdout);
+
+    (is_xmssmt ? xmssmt_keypair : xmss_keypair)(pk, sk0, oid);
+    memcpy(backup, sk0, XMSS_OID_LEN + params.sk_bytes);
+    for (idx = 0; idx < signatures; idx++) {
+        m[0] = idx;
+        m[1] = idx >> 8;
+        sign_detached(sk0, sigs0 + idx * params.sig_bytes, &siglen,
+                      m, XMSS_MLEN);
+    }
+
+    for (t = 0; t < sizeof(targets) / sizeof(targets[0]); t++) {
+        if (targets[t] >= signatures) {
+            continue;
+        }
+        memcpy(sk, backup, XMSS_OID_LEN + params.sk_bytes);
+        if (restore_state(sk, targets[t]) ||
+                bytes_to_ull(sk + XMSS_OID_LEN, params.index_bytes)
+                    != targets[t]) {
+            printf("restoring to %llu failed!\n", targets[t]);
+            return -1;
+        }
+        end = targets[t] + XMSS_COMPARED;
+        if (end > signatures) {
+            end = signatures;
+        }
+        for (idx = targets[t]; idx < end; idx++) {
+            m[0] = idx;
+            m[1] = idx >> 8;
+            if (sign_detached(sk, sig, &siglen, m, XMSS_MLEN) ||
+                    memcmp(sig, sigs0 + idx * params.sig_bytes,
+                           params.sig_bytes)) {
+                printf("signature %llu differs after restoring to %llu!\n",
+                       idx, targets[t]);
+                return -1;
+            }
+        }
+    }
+
+    /* Restoring only moves forward, and not past the last index. */
+    if (!restore_state(sk, idx - 1) ||
+            !restore_state(sk, 1ULL << params.full_height)) {
+        printf("restored backwards or past the end!\n");
+        return -1;
+    }
+    /* A key can also skip a few indices. */
+    idx = bytes_to_ull(backup + XMSS_OID_LEN, params.index_bytes);
+    if (restore_state(backup, idx + 2) ||
+            sign_detached(backup, sig, &siglen, m, XMSS_MLEN) ||
+            (is_xmssmt ? xmssmt_verify_detached : xmss_verify_detached)(
+                sig, siglen, m, XMSS_MLEN, pk) ||
+            bytes_to_ull(sig, params.index_bytes) != idx + 2) {
+        printf("skipping to %llu failed!\n", idx + 2);
+        return -1;
+    }
+    /* Restoring a key whose root does not match its seeds leaves it as it
+       was, rather than with states that are half rebuilt. */
+    backup[XMSS_OID_LEN + params.index_bytes + 2*params.n] ^= 1;
+    memcpy(sk, backup, XMSS_OID_LEN + params.sk_bytes);
+    if (params.sk_bytes > params.index_bytes + 4*params.n &&
+            (!restore_state(sk, idx + 4) ||
+             memcmp(sk, backup, XMSS_OID_LEN + params.sk_bytes))) {
+        printf("a failed restore changed the key!\n");
+        return -1;
+    }
+
+    free(sk0);
+    free(backup);
+    free(sk);
+    free(sigs0);
+    free(sig);
+
+    printf("successful.\n");
+    return 0;
+}
+
+/* Converts a key of the baseline layout, which has the BDS states right after
+   the seeds and the root, and checks that it then signs as the key it was
+   taken from; the key of the old layout itself must not be parsed. */
+static int test_convert(const char *name, unsigned long long signatures)
+{
+    xmss_params params;
+    uint32_t oid;
+    int is_xmssmt = strncmp(name, "XMSSMT", 6) == 0;
+    unsigned long long siglen, idx, head;
+    unsigned char m[XMSS_MLEN] = {0};
+    int (*sign_detached)(unsigned char *, unsigned char *,
+                         unsigned long long *, const unsigned char *,
+                         unsigned long long);
+    int (*sk_convert)(unsigned char *, const unsigned char *);
+
+    if (is_xmssmt) {
+        xmssmt_str_to_oid(&oid, name);
+        xmssmt_parse_oid(&params, oid);
+        sign_detached = xmssmt_sign_detached;
+        sk_convert = xmssmt_sk_convert;
+    }
+    else {
+        xmss_str_to_oid(&oid, name);
+        xmss_parse_oid(&params, oid);
+        sign_detached = xmss_sign_detached;
+        sk_convert = xmss_sk_convert;
+    }
+    head = XMSS_OID_LEN + params.index_bytes + 4*params.n;
+
+    unsigned char pk[XMSS_OID_LEN + params.pk_bytes];
+    unsigned char *sk0 = malloc(XMSS_OID_LEN + params.sk_bytes);
+    unsigned char *old = malloc(XMSS_OID_LEN + params.sk_bytes);
+    unsigned char *sk = malloc(XMSS_OID_LEN + params.sk_bytes);
+    unsigned char *sig0 = malloc(params.sig_bytes);
+    unsigned char *sig = malloc(params.sig_bytes);
+
+    printf("  %s, converting after %llu signatures.. ", name, signatures);
+    fflush(stdout);
+
+    (is_xmssmt ? xmssmt_keypair : xmss_keypair)(pk, sk0, oid);
+    for (idx = 0; idx < signatures; idx++) {
+        sign_detached(sk0, sig0, &siglen, m, XMSS_MLEN);
+    }
+
+    /* Whatever the old states held follows the seeds and the root; a zero
+       where the version now is, as the stack of a state may hold. */
+    memcpy(old, sk0, head);
+    randombytes(old + head, params.sk_bytes + XMSS_OID_LEN - head);
+    if (params.sk_bytes + XMSS_OID_LEN > head) {
+        old[head] = 0;
+        if (!(is_xmssmt ? xmssmt_parse_sk : xmss_parse_sk)(&params, old)) {
+            printf("parsed a key of the old layout!\n");
+            return -1;
+        }
+    }
+
+    if (sk_convert(sk, old) ||
+            bytes_to_ull(sk + XMSS_OID_LEN, params.index_bytes) != signatures ||
+            sign_detached(sk0, sig0, &siglen, m, XMSS_MLEN) ||
+            sign_detached(sk, sig, &siglen, m, XMSS_MLEN) ||
+            memcmp(sig, sig0, params.sig_bytes)) {
+        printf("the converted key does not sign as the old one!\n");
+        return -1;
+    }
+    /* The root must match the seeds, unless keys keep no state to build. */
+    old[head - 2*params.n] ^= 1;
+    if (params.sk_bytes + XMSS_OID_LEN > head && !sk_convert(sk, old)) {
+        printf("converted a key with the wrong root!\n");
+        return -1;
+    }
+
+    free(sk0);
+    free(old);
+    free(sk);
+    free(sig0);
+    free(sig);
+
+    printf("successful.\n");
+    return 0;
+}
+
+int main()
+{
+    int ret = 0;
+
+    printf("Testing state restoration..\n");
+
+    ret |= test_restore("XMSS-SHA2_10_256", XMSS_SIGNATURES);
+    ret |= test_restore("XMSSMT-SHA2_20/4_256", XMSS_SIGNATURES);
+    ret |= test_convert("XMSS-SHA2_10_256", 3);
+    ret |= test_convert("XMSSMT-SHA2_20/4_256", 3);
+
+    return ret;
+}
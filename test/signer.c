@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../xmss.h"
+#include "../params.h"
+#include "../randombytes.h"
+#include "../utils.h"
+
+#define XMSS_MLEN 32
+
+/* Signs with a loaded signer and with the secret key bytes side by side, and
+   checks that the signatures are the same, and so are the keys after every
+   flush. The signer is reloaded from the flushed key halfway through.
+   With a lookahead, the signer precomputes its signatures in the background,
+   and is stopped and restarted a quarter of the way through; with cache, it
+   keeps the upper layers of its signatures, and drops them there. */
+static int test_signer(const char *name, unsigned int signatures,
+                       unsigned int lookahead, int cache)
+{
+    xmss_params params;
+    uint32_t oid;
+    int is_xmssmt = strncmp(name, "XMSSMT", 6) == 0;
+    unsigned int i;
+
+    if (is_xmssmt) {
+        xmssmt_str_to_oid(&oid, name);
+        xmssmt_parse_oid(&params, oid);
+    }
+    else {
+        xmss_str_to_oid(&oid, name);
+        xmss_parse_oid(&params, oid);
+    }
+
+    unsigned char pk[XMSS_OID_LEN + params.pk_bytes];
+    unsigned char sk[XMSS_OID_LEN + params.sk_bytes];
+    unsigned char sk_flushed[XMSS_OID_LEN + params.sk_bytes];
+    unsigned char m[XMSS_MLEN];
+    unsigned char sm[params.sig_bytes + XMSS_MLEN];
+    unsigned char sm_signer[params.sig_bytes + XMSS_MLEN];
+    unsigned char mout[params.sig_bytes + XMSS_MLEN];
+    unsigned long long smlen, smlen_signer, mlen;
+    xmss_signer *signer;
+
+    printf("  %s, %u signatures, lookahead %u%s.. ", name, signatures,
+           lookahead, cache ? ", cached layers" : "");
+    fflush(stdout);
+
+    if (is_xmssmt) {
+        xmssmt_keypair(pk, sk, oid);
+        signer = xmssmt_signer_load(sk);
+    }
+    else {
+        xmss_keypair(pk, sk, oid);
+        signer = xmss_signer_load(sk);
+    }
+    if (signer == NULL) {
+        printf("loading failed!\n");
+        return -1;
+    }
+    if (lookahead && xmss_signer_precompute(signer, lookahead)) {
+        printf("starting precomputation failed!\n");
+        return -1;
+    }
+    if (cache && xmss_signer_cache(signer, 1)) {
+        printf("enabling the cache failed!\n");
+        return -1;
+    }
+    memcpy(sk_flushed, sk, sizeof(sk));
+
+    for (i = 0; i < signatures; i++) {
+        randombytes(m, XMSS_MLEN);
+        if (is_xmssmt) {
+            xmssmt_sign(sk, sm, &smlen, m, XMSS_MLEN);
+        }
+        else {
+            xmss_sign(sk, sm, &smlen, m, XMSS_MLEN);
+        }
+        if (xmss_signer_sign(signer, sm_signer, &smlen_signer, m, XMSS_MLEN)) {
+            printf("signing failed!\n");
+            return -1;
+        }
+        if (smlen != smlen_signer || memcmp(sm, sm_signer, smlen)) {
+            printf("signature %u differs!\n", i);
+            return -1;
+        }
+        if ((is_xmssmt ? xmssmt_sign_open : xmss_sign_open)(
+                mout, &mlen, sm_signer, smlen_signer, pk)) {
+            printf("signature %u does not verify!\n", i);
+            return -1;
+        }
+
+        xmss_signer_flush(signer, sk_flushed);
+        if (memcmp(sk, sk_flushed, sizeof(sk))) {
+            printf("flushed key differs after signature %u!\n", i);
+            return -1;
+        }
+        if (lookahead && i == signatures / 4) {
+            xmss_signer_precompute(signer, 0);
+            xmss_signer_precompute(signer, lookahead);
+        }
+        if (cache && i == signatures / 4) {
+            xmss_signer_cache(signer, 0);
+            xmss_signer_cache(signer, 1);
+        }
+        if (i == signatures / 2) {
+            xmss_signer_free(signer);
+            signer = is_xmssmt ? xmssmt_signer_load(sk_flushed)
+                               : xmss_signer_load(sk_flushed);
+            if (lookahead) {
+                xmss_signer_precompute(signer, lookahead);
+            }
+            if (cache) {
+                xmss_signer_cache(signer, 1);
+            }
+        }
+    }
+    xmss_signer_free(signer);
+
+    /* A key whose index is past the last leaf must not sign anymore. */
+    ull_to_bytes(sk + XMSS_OID_LEN, params.index_bytes,
+                 1ULL << params.full_height);
+    signer = is_xmssmt ? xmssmt_signer_load(sk) : xmss_signer_load(sk);
+    if (lookahead) {
+        xmss_signer_precompute(signer, lookahead);
+    }
+    if (!xmss_signer_sign(signer, sm_signer, &smlen_signer, m, XMSS_MLEN)) {
+        printf("signed with an exhausted key!\n");
+        return -1;
+    }
+    xmss_signer_free(signer);
+
+    printf("successful.\n");
+    return 0;
+}
+
+/* Loads a signer, then overwrites and frees the key it was loaded from, and
+   checks that the signer still signs as a copy of the key does; the key is
+   only read while loading. */
+static int test_signer_freed_sk(const char *name, unsigned int signatures)
+{
+    xmss_params params;
+    uint32_t oid;
+    int is_xmssmt = strncmp(name, "XMSSMT", 6) == 0;
+    unsigned int i;
+
+    if (is_xmssmt) {
+        xmssmt_str_to_oid(&oid, name);
+        xmssmt_parse_oid(&params, oid);
+    }
+    else {
+        xmss_str_to_oid(&oid, name);
+        xmss_parse_oid(&params, oid);
+    }
+
+    unsigned char pk[XMSS_OID_LEN + params.pk_bytes];
+    unsigned char *sk = malloc(XMSS_OID_LEN + params.sk_bytes);
+    unsigned char sk_copy[XMSS_OID_LEN + params.sk_bytes];
+    unsigned char m[XMSS_MLEN];
+    unsigned char sm[params.sig_bytes + XMSS_MLEN];
+    unsigned char sm_signer[params.sig_bytes + XMSS_MLEN];
+    unsigned long long smlen, smlen_signer;
+    xmss_signer *signer;
+
+    printf("  %s, %u signatures after freeing the key.. ", name, signatures);
+    fflush(stdout);
+
+    (is_xmssmt ? xmssmt_keypair : xmss_keypair)(pk, sk, oid);
+    memcpy(sk_copy, sk, sizeof(sk_copy));
+    signer = is_xmssmt ? xmssmt_signer_load(sk) : xmss_signer_load(sk);
+    memset(sk, 0xff, XMSS_OID_LEN + params.sk_bytes);
+    free(sk);
+    if (signer == NULL) {
+        printf("loading failed!\n");
+        return -1;
+    }
+
+    for (i = 0; i < signatures; i++) {
+        randombytes(m, XMSS_MLEN);
+        (is_xmssmt ? xmssmt_sign : xmss_sign)(sk_copy, sm, &smlen,
+                                              m, XMSS_MLEN);
+        if (xmss_signer_sign(signer, sm_signer, &smlen_signer, m, XMSS_MLEN) ||
+                smlen != smlen_signer || memcmp(sm, sm_signer, smlen)) {
+            printf("signature %u differs!\n", i);
+            return -1;
+        }
+    }
+    xmss_signer_free(signer);
+
+    printf("successful.\n");
+    return 0;
+}
+
+int main()
+{
+    int ret = 0;
+
+    printf("Testing signing with a loaded signer..\n");
+
+    ret |= test_signer("XMSS-SHA2_10_256", 6, 0, 0);
+    ret |= test_signer("XMSSMT-SHA2_20/4_256", 70, 0, 0);
+    ret |= test_signer("XMSS-SHA2_10_256", 6, 3, 0);
+    ret |= test_signer("XMSSMT-SHA2_20/4_256", 70, 2, 0);
+    ret |= test_signer("XMSSMT-SHA2_20/4_256", 70, 0, 1);
+    ret |= test_signer_freed_sk("XMSS-SHAKE_10_256", 2);
+
+    if (ret) {
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,476 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../xmss.h"
+#include "../xmss_core.h"
+#include "../xmss_file.h"
+#include "../params.h"
+#include "../threads.h"
+#include "../utils.h"
+
+#define XMSS_MLEN 32
+#define XMSS_BATCH 8
+
+/* Signs count messages with f, which was opened at index first, checks that
+   the signatures have the indices from first on and are valid under pk, and
+   that the file holds the index that follows the batch of the last one. */
+static int sign_some(xmss_sk_file *f, const char *path,
+                     const unsigned char *pk, unsigned long long first,
+                     unsigned int count)
+{
+    const xmss_params *params = xmss_sk_file_params(f);
+    unsigned char m[XMSS_MLEN] = {0};
+    unsigned char sig[params->sig_bytes];
+    unsigned char file_idx[params->index_bytes];
+    unsigned long long siglen;
+    struct iovec iov = { m, XMSS_MLEN };
+    unsigned int i;
+    FILE *fp;
+
+    for (i = 0; i < count; i++) {
+        m[0] = i;
+        if (xmss_sk_file_sign_detached_iov(f, sig, &siglen, &iov, 1) ||
+                bytes_to_ull(sig, params->index_bytes) != first + i ||
+                xmssmt_verify_detached(sig, siglen, m, XMSS_MLEN, pk)) {
+            printf("signature %llu is invalid!\n", first + i);
+            return -1;
+        }
+
+        fp = fopen(path, "rb");
+        fseek(fp, 2 * XMSS_OID_LEN + params->pk_bytes, SEEK_SET);
+        if (fread(file_idx, 1, params->index_bytes, fp) != params->index_bytes) {
+            fclose(fp);
+            return -1;
+        }
+        fclose(fp);
+        if (bytes_to_ull(file_idx, params->index_bytes) !=
+                first + (i / XMSS_BATCH + 1) * XMSS_BATCH) {
+            printf("index %llu was not reserved before its signature!\n",
+                   first + i);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Signs with a key file in batches, and checks that a crash loses no more
+   than the batch, that no index is used twice, and that closing the file
+   gives back the indices of the batch that were not used. */
+static int test_sk_file(const char *name)
+{
+    xmss_params params;
+    uint32_t oid;
+    xmss_sk_file *f;
+    char path[] = "/tmp/xmss_sk_file_XXXXXX";
+    int fd, status;
+    pid_t pid;
+
+    xmssmt_str_to_oid(&oid, name);
+    xmssmt_parse_oid(&params, oid);
+
+    unsigned char pk[XMSS_OID_LEN + params.pk_bytes];
+    unsigned char *sk = malloc(XMSS_OID_LEN + params.sk_bytes);
+    const unsigned long long offset = XMSS_OID_LEN + params.pk_bytes;
+
+    printf("  %s, batches of %u.. ", name, XMSS_BATCH);
+    fflush(stdout);
+
+    /* The key file holds [pk || sk], as the ui tools write it. */
+    xmssmt_keypair(pk, sk, oid);
+    fd = mkstemp(path);
+    if (fd < 0 || write(fd, pk, sizeof(pk)) != (ssize_t)sizeof(pk) ||
+            write(fd, sk, XMSS_OID_LEN + params.sk_bytes)
+                != (ssize_t)(XMSS_OID_LEN + params.sk_bytes)) {
+        printf("cannot write the key file!\n");
+        return -1;
+    }
+    close(fd);
+
+    if (xmssmt_sk_file_open(path, offset, 0) != NULL) {
+        printf("opened with an empty batch!\n");
+        return -1;
+    }
+
+    /* Crash in the middle of the first batch, while holding the file. */
+    pid = fork();
+    if (pid == 0) {
+        f = xmssmt_sk_file_open(path, offset, XMSS_BATCH);
+        _exit(f == NULL || sign_some(f, path, pk, 0, 3) ? 1 : 0);
+    }
+    if (pid < 0 || waitpid(pid, &status, 0) != pid ||
+            !WIFEXITED(status) || WEXITSTATUS(status)) {
+        printf("signing before the crash failed!\n");
+        return -1;
+    }
+
+    /* The rest of the batch is lost, and the state is restored for the next
+       one. Closing then gives back what is left of that. */
+    f = xmssmt_sk_file_open(path, offset, XMSS_BATCH);
+    if (f == NULL || sign_some(f, path, pk, XMSS_BATCH, XMSS_BATCH + 2) ||
+            xmss_sk_file_close(f)) {
+        return -1;
+    }
+    f = xmssmt_sk_file_open(path, offset, XMSS_BATCH);
+    if (f == NULL || sign_some(f, path, pk, 2 * XMSS_BATCH + 2, 1) ||
+            xmss_sk_file_close(f)) {
+        return -1;
+    }
+
+    unlink(path);
+    free(sk);
+
+    printf("successful.\n");
+    return 0;
+}
+
+/* Signs with a mapped key file, and checks that after every signature the
+   file holds the key as it is after signing with a copy in memory. */
+static int test_sk_file_map(const char *name, unsigned int signatures)
+{
+    xmss_params params;
+    uint32_t oid;
+    xmss_sk_file *f;
+    char path[] = "/tmp/xmss_sk_file_XXXXXX";
+    unsigned long long siglen, siglen_ref;
+    unsigned char m[XMSS_MLEN] = {0};
+    struct iovec iov = { m, XMSS_MLEN };
+    unsigned int i;
+    int fd;
+    FILE *fp;
+
+    xmssmt_str_to_oid(&oid, name);
+    xmssmt_parse_oid(&params, oid);
+
+    unsigned char pk[XMSS_OID_LEN + params.pk_bytes];
+    unsigned char *sk = malloc(XMSS_OID_LEN + params.sk_bytes);
+    unsigned char *sk_file = malloc(XMSS_OID_LEN + params.sk_bytes);
+    unsigned char *sig = malloc(params.sig_bytes);
+    unsigned char *sig_ref = malloc(params.sig_bytes);
+    const unsigned long long offset = XMSS_OID_LEN + params.pk_bytes;
+
+    printf("  %s, mapped, %u signatures.. ", name, signatures);
+    fflush(stdout);
+
+    xmssmt_keypair(pk, sk, oid);
+    fd = mkstemp(path);
+    if (fd < 0 || write(fd, pk, sizeof(pk)) != (ssize_t)sizeof(pk) ||
+            write(fd, sk, XMSS_OID_LEN + params.sk_bytes)
+                != (ssize_t)(XMSS_OID_LEN + params.sk_bytes)) {
+        printf("cannot write the key file!\n");
+        return -1;
+    }
+    close(fd);
+
+    f = xmssmt_sk_file_map(path, offset);
+    for (i = 0; i < signatures; i++) {
+        /* Closing and mapping again picks up where the key was left. */
+        if (i == signatures / 2) {
+            xmss_sk_file_close(f);
+            f = xmssmt_sk_file_map(path, offset);
+        }
+        m[0] = i;
+        if (f == NULL ||
+                xmss_sk_file_sign_detached_iov(f, sig, &siglen, &iov, 1) ||
+                xmssmt_sign_detached(sk, sig_ref, &siglen_ref, m, XMSS_MLEN) ||
+                siglen != siglen_ref || memcmp(sig, sig_ref, siglen)) {
+            printf("signature %u differs!\n", i);
+            return -1;
+        }
+
+        fp = fopen(path, "rb");
+        fseek(fp, offset, SEEK_SET);
+        if (fread(sk_file, 1, XMSS_OID_LEN + params.sk_bytes, fp)
+                != XMSS_OID_LEN + params.sk_bytes ||
+                memcmp(sk_file, sk, XMSS_OID_LEN + params.sk_bytes)) {
+            printf("the file differs after signature %u!\n", i);
+            fclose(fp);
+            return -1;
+        }
+        fclose(fp);
+    }
+    if (xmss_sk_file_close(f)) {
+        return -1;
+    }
+
+    unlink(path);
+    free(sk);
+    free(sk_file);
+    free(sig);
+    free(sig_ref);
+
+    printf("successful.\n");
+    return 0;
+}
+
+struct sign_concurrent_job {
+    xmss_sk_file *f;
+    unsigned char *sigs;
+    unsigned long long *siglens;
+    int *rets;
+};
+
+/* Signs message i with the file of the job, on any thread. */
+static void sign_concurrent(void *arg, unsigned int i)
+{
+    const struct sign_concurrent_job *job = arg;
+    const xmss_params *params = xmss_sk_file_params(job->f);
+    unsigned char m[XMSS_MLEN] = {0};
+    struct iovec iov = { m, XMSS_MLEN };
+
+    m[0] = i;
+    job->rets[i] = xmss_sk_file_sign_detached_iov(
+        job->f, job->sigs + i * params->sig_bytes, &job->siglens[i], &iov, 1);
+}
+
+/* Signs from several threads at once with a key file opened for that, and
+   checks that every signature is valid, that no index is used twice, and
+   that the file holds the index that follows the last one on close. */
+static int test_sk_file_concurrent(const char *name, unsigned int threads,
+                                   unsigned int signatures)
+{
+    xmss_params params;
+    uint32_t oid;
+    char path[] = "/tmp/xmss_sk_file_XXXXXX";
+    struct sign_concurrent_job job;
+    unsigned char m[XMSS_MLEN] = {0};
+    unsigned char file_idx[8];
+    unsigned long long idx;
+    unsigned int i;
+    int fd;
+    FILE *fp;
+
+    xmssmt_str_to_oid(&oid, name);
+    xmssmt_parse_oid(&params, oid);
+
+    unsigned char pk[XMSS_OID_LEN + params.pk_bytes];
+    unsigned char *sk = malloc(XMSS_OID_LEN + params.sk_bytes);
+    unsigned char *used = calloc(signatures, 1);
+    const unsigned long long offset = XMSS_OID_LEN + params.pk_bytes;
+
+    job.sigs = malloc(signatures * params.sig_bytes);
+    job.siglens = malloc(signatures * sizeof(unsigned long long));
+    job.rets = malloc(signatures * sizeof(int));
+
+    printf("  %s, concurrent, %u threads.. ", name, threads);
+    fflush(stdout);
+
+    xmssmt_keypair(pk, sk, oid);
+    fd = mkstemp(path);
+    if (fd < 0 || write(fd, pk, sizeof(pk)) != (ssize_t)sizeof(pk) ||
+            write(fd, sk, XMSS_OID_LEN + params.sk_bytes)
+                != (ssize_t)(XMSS_OID_LEN + params.sk_bytes)) {
+        printf("cannot write the key file!\n");
+        return -1;
+    }
+    close(fd);
+
+    job.f = xmssmt_sk_file_open_concurrent(path, offset, XMSS_BATCH);
+    /* Keys with a traversal state only sign the index that follows it. */
+    if (xmss_xmssmt_core_sk_state_idx_offset(&params) != 0) {
+        if (job.f != NULL) {
+            printf("opened a key with a traversal state!\n");
+            return -1;
+        }
+        printf("not supported, as expected.\n");
+        unlink(path);
+        return 0;
+    }
+    if (job.f == NULL) {
+        printf("cannot open the key file!\n");
+        return -1;
+    }
+
+    xmss_parallel_for(threads, signatures, sign_concurrent, &job);
+    for (i = 0; i < signatures; i++) {
+        m[0] = i;
+        idx = bytes_to_ull(job.sigs + i * params.sig_bytes, params.index_bytes);
+        if (job.rets[i] || idx >= signatures || used[idx] ||
+                xmssmt_verify_detached(job.sigs + i * params.sig_bytes,
+                                       job.siglens[i], m, XMSS_MLEN, pk)) {
+            printf("signature %u is invalid or reuses an index!\n", i);
+            return -1;
+        }
+        used[idx] = 1;
+    }
+    if (xmss_sk_file_close(job.f)) {
+        return -1;
+    }
+
+    fp = fopen(path, "rb");
+    fseek(fp, offset + XMSS_OID_LEN, SEEK_SET);
+    if (fread(file_idx, 1, params.index_bytes, fp) != params.index_bytes ||
+            bytes_to_ull(file_idx, params.index_bytes) != signatures) {
+        printf("the file does not hold the next index!\n");
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+
+    unlink(path);
+    free(sk);
+    free(used);
+    free(job.sigs);
+    free(job.siglens);
+    free(job.rets);
+
+    printf("successful.\n");
+    return 0;
+}
+
+struct open_twice_job {
+    const char *path;
+    unsigned long long offset;
+    const unsigned char *pk;
+    unsigned int signatures;
+    int opened;
+    int ret;
+};
+
+/* Opens the key file of the job a second time for concurrent signing, which
+   waits for the first open to be closed, and checks that its signatures
+   have the indices that follow the ones that the first open took. */
+static void *open_twice(void *arg)
+{
+    struct open_twice_job *job = arg;
+    xmss_sk_file *f;
+    const xmss_params *params;
+    unsigned char m[XMSS_MLEN] = {0};
+    struct iovec iov = { m, XMSS_MLEN };
+    unsigned long long siglen;
+    unsigned int i;
+
+    job->ret = -1;
+    f = xmssmt_sk_file_open_concurrent(job->path, job->offset, XMSS_BATCH);
+    __atomic_store_n(&job->opened, 1, __ATOMIC_RELEASE);
+    if (f == NULL) {
+        return NULL;
+    }
+    params = xmss_sk_file_params(f);
+    unsigned char *sig = malloc(params->sig_bytes);
+
+    for (i = 0; i < job->signatures; i++) {
+        if (xmss_sk_file_sign_detached_iov(f, sig, &siglen, &iov, 1) ||
+                bytes_to_ull(sig, params->index_bytes)
+                    != job->signatures + i ||
+                xmssmt_verify_detached(sig, siglen, m, XMSS_MLEN, job->pk)) {
+            free(sig);
+            xmss_sk_file_close(f);
+            return NULL;
+        }
+    }
+    free(sig);
+    job->ret = xmss_sk_file_close(f);
+    return NULL;
+}
+
+/* Opens a key file for concurrent signing twice, as two processes would,
+   and checks that the second open waits until the first one is closed, so
+   that the two never sign with the same index. */
+static int test_sk_file_concurrent_twice(const char *name,
+                                         unsigned int signatures)
+{
+    xmss_params params;
+    uint32_t oid;
+    char path[] = "/tmp/xmss_sk_file_XXXXXX";
+    struct open_twice_job job;
+    pthread_t thread;
+    xmss_sk_file *f;
+    unsigned char m[XMSS_MLEN] = {0};
+    struct iovec iov = { m, XMSS_MLEN };
+    unsigned long long siglen;
+    unsigned int i;
+    int fd;
+
+    xmssmt_str_to_oid(&oid, name);
+    xmssmt_parse_oid(&params, oid);
+
+    unsigned char pk[XMSS_OID_LEN + params.pk_bytes];
+    unsigned char *sk = malloc(XMSS_OID_LEN + params.sk_bytes);
+    unsigned char *sig = malloc(params.sig_bytes);
+
+    printf("  %s, concurrent, opened twice.. ", name);
+    fflush(stdout);
+
+    xmssmt_keypair(pk, sk, oid);
+    fd = mkstemp(path);
+    if (fd < 0 || write(fd, pk, sizeof(pk)) != (ssize_t)sizeof(pk) ||
+            write(fd, sk, XMSS_OID_LEN + params.sk_bytes)
+                != (ssize_t)(XMSS_OID_LEN + params.sk_bytes)) {
+        printf("cannot write the key file!\n");
+        return -1;
+    }
+    close(fd);
+
+    f = xmssmt_sk_file_open_concurrent(path, XMSS_OID_LEN + params.pk_bytes,
+                                       XMSS_BATCH);
+    if (xmss_xmssmt_core_sk_state_idx_offset(&params) != 0) {
+        printf("not supported, as expected.\n");
+        unlink(path);
+        return 0;
+    }
+    if (f == NULL) {
+        printf("cannot open the key file!\n");
+        return -1;
+    }
+
+    job.path = path;
+    job.offset = XMSS_OID_LEN + params.pk_bytes;
+    job.pk = pk;
+    job.signatures = signatures;
+    job.opened = 0;
+    if (pthread_create(&thread, NULL, open_twice, &job)) {
+        printf("cannot start a thread!\n");
+        return -1;
+    }
+
+    for (i = 0; i < signatures; i++) {
+        if (xmss_sk_file_sign_detached_iov(f, sig, &siglen, &iov, 1) ||
+                bytes_to_ull(sig, params.index_bytes) != i) {
+            printf("signature %u does not have index %u!\n", i, i);
+            return -1;
+        }
+    }
+    /* Give the second open the time to get past the lock, if it could. */
+    usleep(100000);
+    if (__atomic_load_n(&job.opened, __ATOMIC_ACQUIRE)) {
+        printf("opened the key file while it was open!\n");
+        return -1;
+    }
+    if (xmss_sk_file_close(f)) {
+        return -1;
+    }
+    pthread_join(thread, NULL);
+    if (job.ret) {
+        printf("the second open reused an index or failed!\n");
+        return -1;
+    }
+
+    unlink(path);
+    free(sk);
+    free(sig);
+
+    printf("successful.\n");
+    return 0;
+}
+
+int main()
+{
+    int ret = 0;
+
+    printf("Testing secret key files..\n");
+
+    ret |= test_sk_file("XMSSMT-SHA2_20/4_256");
+    /* The SHAKE PRF reads its key on every call, so a state that is
+       restored after the crash must keep its seeds in memory of its own. */
+    ret |= test_sk_file("XMSSMT-SHAKE_20/4_256");
+    ret |= test_sk_file_map("XMSSMT-SHA2_20/4_256", 40);
+    ret |= test_sk_file_concurrent("XMSSMT-SHA2_20/4_256", 4, 30);
+    ret |= test_sk_file_concurrent_twice("XMSSMT-SHA2_20/4_256", 10);
+
+    return ret;
+}
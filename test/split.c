@@ -0,0 +1,218 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../xmss.h"
+#include "../xmss_core.h"
+#include "../params.h"
+#include "../randombytes.h"
+#include "../utils.h"
+
+#define XMSS_MLEN 32
+
+#ifndef XMSS_SHARDS
+    #define XMSS_SHARDS 3
+#endif
+
+/* Splits a fresh XMSS key, after signing with it for a while, into
+   XMSS_SHARDS + 1 keys, and checks that these sign every index of their
+   range as the unsplit key does, and stop where the next range begins. */
+static int test_split_xmss(const char *name)
+{
+    xmss_params params;
+    uint32_t oid;
+    unsigned long long siglen, idx, first, end;
+    unsigned char m[XMSS_MLEN] = {0};
+    unsigned int s;
+
+    xmss_str_to_oid(&oid, name);
+    xmss_parse_oid(&params, oid);
+
+    unsigned long long signatures = 1ULL << params.full_height;
+    unsigned char seed[3 * params.n];
+    unsigned char pk[XMSS_OID_LEN + params.pk_bytes];
+    unsigned char *sk = malloc(XMSS_OID_LEN + params.sk_bytes);
+    unsigned char *sk0 = malloc(XMSS_OID_LEN + params.sk_bytes);
+    unsigned char *sigs0 = malloc(signatures * params.sig_bytes);
+    unsigned char *sig = malloc(params.sig_bytes);
+    unsigned char *shards[XMSS_SHARDS + 1];
+
+    printf("  %s, %u shards.. ", name, XMSS_SHARDS);
+    fflush(stdout);
+
+    randombytes(seed, sizeof(seed));
+    ull_to_bytes(pk, XMSS_OID_LEN, oid);
+    ull_to_bytes(sk0, XMSS_OID_LEN, oid);
+    xmss_core_seed_keypair(&params, pk + XMSS_OID_LEN, sk0 + XMSS_OID_LEN,
+                           seed);
+    memcpy(sk, sk0, XMSS_OID_LEN + params.sk_bytes);
+    for (idx = 0; idx < signatures; idx++) {
+        m[0] = idx;
+        m[1] = idx >> 8;
+        xmss_sign_detached(sk0, sigs0 + idx * params.sig_bytes, &siglen,
+                           m, XMSS_MLEN);
+    }
+
+    first = signatures / 10;
+    for (idx = 0; idx < first; idx++) {
+        m[0] = idx;
+        m[1] = idx >> 8;
+        xmss_sign_detached(sk, sig, &siglen, m, XMSS_MLEN);
+    }
+
+    /* The first range stays with sk. */
+    shards[0] = sk;
+    for (s = 1; s <= XMSS_SHARDS; s++) {
+        shards[s] = malloc(XMSS_OID_LEN + params.sk_bytes);
+    }
+    if (!xmss_split(sk, shards + 1, signatures)) {
+        printf("split into more ranges than indices!\n");
+        return -1;
+    }
+    if (xmss_split(sk, shards + 1, XMSS_SHARDS)) {
+        printf("split failed!\n");
+        return -1;
+    }
+
+    /* Sign with the shards in reverse, to show that they do not depend on
+       each other. */
+    for (s = XMSS_SHARDS + 1; s > 0; s--) {
+        idx = bytes_to_ull(shards[s - 1] + XMSS_OID_LEN, params.index_bytes);
+        if (idx != first + (s - 1) * ((signatures - first) / (XMSS_SHARDS + 1))) {
+            printf("shard %u starts at %llu!\n", s - 1, idx);
+            return -1;
+        }
+        m[0] = idx;
+        m[1] = idx >> 8;
+        while (!xmss_sign_detached(shards[s - 1], sig, &siglen, m, XMSS_MLEN)) {
+            if (memcmp(sig, sigs0 + idx * params.sig_bytes, params.sig_bytes)) {
+                printf("signature %llu differs in shard %u!\n", idx, s - 1);
+                return -1;
+            }
+            idx++;
+            m[0] = idx;
+            m[1] = idx >> 8;
+        }
+        end = s == XMSS_SHARDS + 1 ? signatures
+            : first + s * ((signatures - first) / (XMSS_SHARDS + 1));
+        if (idx != end) {
+            printf("shard %u stops at %llu!\n", s - 1, idx);
+            return -1;
+        }
+    }
+
+    for (s = 1; s <= XMSS_SHARDS; s++) {
+        free(shards[s]);
+    }
+    free(sk);
+    free(sk0);
+    free(sigs0);
+    free(sig);
+
+    printf("successful.\n");
+    return 0;
+}
+
+/* Splits an XMSSMT key of the given BDS schedule at the indices in mids, in
+   turn, and checks that every shard signs the first and last few indices of
+   its range, across the trees of the lowest layer, with valid signatures. */
+static int test_split_xmssmt(const char *name, unsigned int schedule,
+                             const unsigned long long *mids,
+                             unsigned int count, unsigned int signatures)
+{
+    xmss_params params;
+    xmss_keygen_opts opts = {0};
+    uint32_t oid;
+    unsigned long long siglen, idx, end;
+    unsigned char m[XMSS_MLEN] = {0};
+    unsigned int i, j;
+
+    xmssmt_str_to_oid(&oid, name);
+    xmssmt_parse_oid(&params, oid);
+    xmss_xmssmt_set_bds_schedule(&params, schedule);
+
+    unsigned char pk[XMSS_OID_LEN + params.pk_bytes];
+    unsigned char *sk = malloc(XMSS_OID_LEN + params.sk_bytes);
+    unsigned char *shard = malloc(XMSS_OID_LEN + params.sk_bytes);
+    unsigned char *sig = malloc(params.sig_bytes);
+
+    printf("  %s, schedule %u, %u splits.. ", name, schedule, count);
+    fflush(stdout);
+
+    opts.bds_schedule = schedule;
+    xmssmt_keypair_resumable(pk, sk, oid, &opts);
+    if (!xmssmt_core_split(&params, sk + XMSS_OID_LEN, shard + XMSS_OID_LEN,
+                           0)) {
+        printf("split at the current index!\n");
+        return -1;
+    }
+
+    for (i = 0; i < count; i++) {
+        memcpy(shard, sk, XMSS_OID_LEN);
+        if (xmssmt_core_split(&params, sk + XMSS_OID_LEN,
+                              shard + XMSS_OID_LEN, mids[i])) {
+            printf("split at %llu failed!\n", mids[i]);
+            return -1;
+        }
+        end = i == 0 ? 1ULL << params.full_height : mids[i - 1];
+        if (xmss_xmssmt_core_sk_end(&params, sk + XMSS_OID_LEN) != mids[i] ||
+                xmss_xmssmt_core_sk_end(&params, shard + XMSS_OID_LEN) != end) {
+            printf("wrong end after the split at %llu!\n", mids[i]);
+            return -1;
+        }
+        for (j = 0; j < signatures; j++) {
+            idx = bytes_to_ull(shard + XMSS_OID_LEN, params.index_bytes);
+            m[0] = j;
+            if (idx >= end) {
+                break;
+            }
+            if (xmssmt_sign_detached(shard, sig, &siglen, m, XMSS_MLEN) ||
+                    bytes_to_ull(sig, params.index_bytes) != idx ||
+                    xmssmt_verify_detached(sig, siglen, m, XMSS_MLEN, pk)) {
+                printf("signature %llu of the shard at %llu is invalid!\n",
+                       idx, mids[i]);
+                return -1;
+            }
+        }
+    }
+
+    /* sk itself keeps signing up to the last split. */
+    if (xmssmt_sign_detached(sk, sig, &siglen, m, XMSS_MLEN) ||
+            xmssmt_verify_detached(sig, siglen, m, XMSS_MLEN, pk)) {
+        printf("signature of the split key is invalid!\n");
+        return -1;
+    }
+    ull_to_bytes(sk + XMSS_OID_LEN, params.index_bytes, mids[count - 1]);
+    if (!xmssmt_sign_detached(sk, sig, &siglen, m, XMSS_MLEN)) {
+        printf("split key signs past its end!\n");
+        return -1;
+    }
+
+    free(sk);
+    free(shard);
+    free(sig);
+
+    printf("successful.\n");
+    return 0;
+}
+
+int main()
+{
+    /* The very last index, the middle of a tree, shortly before the next
+       tree of the second layer, and shortly before the next lowest tree. */
+    const unsigned long long mids[] = {
+        (1ULL << 20) - 1, 700000, 1024 - 40, 30
+    };
+    int ret = 0;
+
+    printf("Testing key splitting..\n");
+
+    ret |= test_split_xmss("XMSS-SHA2_10_256");
+    ret |= test_split_xmssmt("XMSSMT-SHA2_20/4_256", XMSS_BDS_SCHEDULE_DEFAULT,
+                             mids, 4, 80);
+    ret |= test_split_xmssmt("XMSSMT-SHA2_20/4_256", XMSS_BDS_SCHEDULE_CONSTANT,
+                             mids, 4, 80);
+
+    return ret;
+}
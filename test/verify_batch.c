@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../xmss.h"
+#include "../params.h"
+#include "../randombytes.h"
+
+#define XMSS_MLEN 32
+
+/* Not a multiple of the size of the groups that are verified together. */
+#define XMSS_SIGNATURES 37
+
+/* Verifies signatures in a batch, both as they are and with a few of them
+   broken in different ways, and checks that the results match those of
+   verifying them one by one. */
+static int test_verify_batch(const char *name)
+{
+    xmss_params params;
+    uint32_t oid;
+    int is_xmssmt = strncmp(name, "XMSSMT", 6) == 0;
+    const unsigned char *sig_ptrs[XMSS_SIGNATURES];
+    const unsigned char *m_ptrs[XMSS_SIGNATURES];
+    unsigned long long siglens[XMSS_SIGNATURES];
+    unsigned long long mlens[XMSS_SIGNATURES];
+    int results[XMSS_SIGNATURES];
+    unsigned int i;
+    int ret;
+    int (*verify_batch)(int *, const unsigned char *const [],
+                        const unsigned long long [],
+                        const unsigned char *const [],
+                        const unsigned long long [], unsigned int,
+                        const unsigned char *);
+    int (*verify_detached)(const unsigned char *, unsigned long long,
+                           const unsigned char *, unsigned long long,
+                           const unsigned char *);
+
+    if (is_xmssmt) {
+        xmssmt_str_to_oid(&oid, name);
+        xmssmt_parse_oid(&params, oid);
+        verify_batch = xmssmt_verify_batch;
+        verify_detached = xmssmt_verify_detached;
+    }
+    else {
+        xmss_str_to_oid(&oid, name);
+        xmss_parse_oid(&params, oid);
+        verify_batch = xmss_verify_batch;
+        verify_detached = xmss_verify_detached;
+    }
+
+    unsigned char pk[XMSS_OID_LEN + params.pk_bytes];
+    unsigned char *sk = malloc(XMSS_OID_LEN + params.sk_bytes);
+    unsigned char *sigs = malloc(XMSS_SIGNATURES * params.sig_bytes);
+    unsigned char *ms = malloc(XMSS_SIGNATURES * XMSS_MLEN);
+
+    printf("  %s, %u signatures.. ", name, XMSS_SIGNATURES);
+    fflush(stdout);
+
+    (is_xmssmt ? xmssmt_keypair : xmss_keypair)(pk, sk, oid);
+    randombytes(ms, XMSS_SIGNATURES * XMSS_MLEN);
+    for (i = 0; i < XMSS_SIGNATURES; i++) {
+        sig_ptrs[i] = sigs + i * params.sig_bytes;
+        m_ptrs[i] = ms + i * XMSS_MLEN;
+        mlens[i] = XMSS_MLEN;
+        (is_xmssmt ? xmssmt_sign_detached : xmss_sign_detached)(
+            sk, sigs + i * params.sig_bytes, &siglens[i],
+            ms + i * XMSS_MLEN, XMSS_MLEN);
+    }
+
+    ret = verify_batch(results, sig_ptrs, siglens, m_ptrs, mlens,
+                       XMSS_SIGNATURES, pk);
+    for (i = 0; i < XMSS_SIGNATURES; i++) {
+        if (results[i]) {
+            printf("signature %u is invalid!\n", i);
+            return -1;
+        }
+    }
+    if (ret) {
+        printf("the batch is invalid!\n");
+        return -1;
+    }
+
+    /* A flipped bit in a WOTS signature, in an authentication path of the
+       top layer and in a message, a wrong length and a message of another
+       signature. */
+    sigs[3 * params.sig_bytes + params.index_bytes + params.n] ^= 1;
+    sigs[17 * params.sig_bytes + params.sig_bytes - 1] ^= 0x80;
+    ms[20 * XMSS_MLEN] ^= 1;
+    siglens[31]--;
+    m_ptrs[36] = m_ptrs[0];
+
+    ret = verify_batch(results, sig_ptrs, siglens, m_ptrs, mlens,
+                       XMSS_SIGNATURES, pk);
+    for (i = 0; i < XMSS_SIGNATURES; i++) {
+        if ((results[i] != 0) != (verify_detached(sig_ptrs[i], siglens[i],
+                                                  m_ptrs[i], mlens[i],
+                                                  pk) != 0) ||
+                (results[i] != 0) != (i == 3 || i == 17 || i == 20 ||
+                                      i == 31 || i == 36)) {
+            printf("the result of signature %u is wrong!\n", i);
+            return -1;
+        }
+    }
+    if (!ret) {
+        printf("the batch is valid!\n");
+        return -1;
+    }
+
+    free(sk);
+    free(sigs);
+    free(ms);
+
+    printf("successful.\n");
+    return 0;
+}
+
+int main()
+{
+    int ret = 0;
+
+    printf("Testing batch verification..\n");
+
+    ret |= test_verify_batch("XMSS-SHA2_10_256");
+    ret |= test_verify_batch("XMSS-SHAKE_10_256");
+    ret |= test_verify_batch("XMSSMT-SHA2_20/4_256");
+
+    return ret;
+}
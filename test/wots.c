@@ -2,39 +2,88 @@
 #include <stdint.h>
 #include <string.h>
 
+#include "../hash.h"
+#include "../hash_address.h"
+#include "../utils.h"
 #include "../wots.h"
 #include "../randombytes.h"
 #include "../params.h"
 
-int main()
+/* Computes the WOTS public key one chain and one hash call at a time, as in
+   the specification, to compare the lockstep chain computation against. */
+static void wots_pkgen_ref(const xmss_params *params,
+                           unsigned char *pk, const unsigned char *seed,
+                           const xmss_prf_ctx *pub_seed, uint32_t addr[8])
 {
-    xmss_params params;
-    // TODO test more different OIDs
-    uint32_t oid = 0x00000001;
-
-    /* For WOTS it doesn't matter if we use XMSS or XMSSMT. */
-    xmss_parse_oid(&params, oid);
-
-    unsigned char seed[params.n];
-    unsigned char pub_seed[params.n];
-    unsigned char pk1[params.wots_sig_bytes];
-    unsigned char pk2[params.wots_sig_bytes];
-    unsigned char sig[params.wots_sig_bytes];
-    unsigned char m[params.n];
+    xmss_prf_ctx seed_ctx;
+    unsigned char ctr[32];
+    uint32_t i, j;
+
+    prf_ctx_init(params, &seed_ctx, seed);
+
+    for (i = 0; i < params->wots_len; i++) {
+        ull_to_bytes(ctr, 32, i);
+        prf(params, pk + i*params->n, ctr, &seed_ctx);
+
+        set_chain_addr(addr, i);
+        for (j = 0; j < params->wots_w - 1; j++) {
+            set_hash_addr(addr, j);
+            thash_f(params, pk + i*params->n, pk + i*params->n,
+                    pub_seed, addr);
+        }
+    }
+}
+
+static int test_wots(const xmss_params *params)
+{
+    unsigned char seed[params->n];
+    unsigned char pub_seed[params->n];
+    xmss_prf_ctx pub_seed_ctx;
+    unsigned char pk1[params->wots_sig_bytes];
+    unsigned char pk2[params->wots_sig_bytes];
+    unsigned char pk_ref[params->wots_sig_bytes];
+    unsigned char sig[params->wots_sig_bytes];
+    unsigned char m[params->n];
     uint32_t addr[8] = {0};
+    uint32_t addr_ref[8];
 
-    randombytes(seed, params.n);
-    randombytes(pub_seed, params.n);
-    randombytes(m, params.n);
+    randombytes(seed, params->n);
+    randombytes(pub_seed, params->n);
+    randombytes(m, params->n);
     randombytes((unsigned char *)addr, 8 * sizeof(uint32_t));
+    memcpy(addr_ref, addr, sizeof(addr));
+
+    prf_ctx_init(params, &pub_seed_ctx, pub_seed);
+
+    wots_pkgen(params, pk1, seed, &pub_seed_ctx, addr);
+    wots_sign(params, sig, m, seed, &pub_seed_ctx, addr);
+    wots_pk_from_sig(params, pk2, sig, m, &pub_seed_ctx, addr);
+    wots_pkgen_ref(params, pk_ref, seed, &pub_seed_ctx, addr_ref);
+
+    if (memcmp(pk1, pk2, params->wots_sig_bytes) ||
+            memcmp(pk1, pk_ref, params->wots_sig_bytes)) {
+        return -1;
+    }
+    return 0;
+}
+
+int main()
+{
+    xmss_params params;
+    /* SHA2 and SHAKE, with n = 32 and n = 64. */
+    uint32_t oids[4] = {0x00000001, 0x00000004, 0x00000007, 0x0000000a};
+    unsigned int i;
+    int ret = 0;
 
     printf("Testing WOTS signature and PK derivation.. ");
 
-    wots_pkgen(&params, pk1, seed, pub_seed, addr);
-    wots_sign(&params, sig, m, seed, pub_seed, addr);
-    wots_pk_from_sig(&params, pk2, sig, m, pub_seed, addr);
+    for (i = 0; i < 4; i++) {
+        /* For WOTS it doesn't matter if we use XMSS or XMSSMT. */
+        xmss_parse_oid(&params, oids[i]);
+        ret |= test_wots(&params);
+    }
 
-    if (memcmp(pk1, pk2, params.wots_sig_bytes)) {
+    if (ret) {
         printf("failed!\n");
         return -1;
     }
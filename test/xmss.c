@@ -19,6 +19,8 @@
     #define XMSS_KEYPAIR xmssmt_keypair
     #define XMSS_SIGN xmssmt_sign
     #define XMSS_SIGN_OPEN xmssmt_sign_open
+    #define XMSS_SIGN_DETACHED xmssmt_sign_detached
+    #define XMSS_VERIFY_DETACHED_IOV xmssmt_verify_detached_iov
     #define XMSS_VARIANT "XMSSMT-SHA2_20/2_256"
 #else
     #define XMSS_PARSE_OID xmss_parse_oid
@@ -26,6 +28,8 @@
     #define XMSS_KEYPAIR xmss_keypair
     #define XMSS_SIGN xmss_sign
     #define XMSS_SIGN_OPEN xmss_sign_open
+    #define XMSS_SIGN_DETACHED xmss_sign_detached
+    #define XMSS_VERIFY_DETACHED_IOV xmss_verify_detached_iov
     #define XMSS_VARIANT "XMSS-SHA2_10_256"
 #endif
 
@@ -42,10 +46,14 @@ int main()
 
     unsigned char pk[XMSS_OID_LEN + params.pk_bytes];
     unsigned char sk[XMSS_OID_LEN + params.sk_bytes];
+    unsigned char sk_copy[XMSS_OID_LEN + params.sk_bytes];
     unsigned char *m = malloc(XMSS_MLEN);
     unsigned char *sm = malloc(params.sig_bytes + XMSS_MLEN);
     unsigned char *mout = malloc(params.sig_bytes + XMSS_MLEN);
+    unsigned char *sig = malloc(params.sig_bytes);
+    struct iovec iov[3];
     unsigned long long smlen;
+    unsigned long long siglen;
     unsigned long long mlen;
 
     randombytes(m, XMSS_MLEN);
@@ -57,6 +65,7 @@ int main()
     for (i = 0; i < XMSS_SIGNATURES; i++) {
         printf("  - iteration #%d:\n", i);
 
+        memcpy(sk_copy, sk, sizeof(sk));
         XMSS_SIGN(sk, sm, &smlen, m, XMSS_MLEN);
 
         if (smlen != params.sig_bytes + XMSS_MLEN) {
@@ -106,6 +115,39 @@ int main()
         }
         sm[smlen - 1] ^= 1;
 
+        /* Sign the same index again, without attaching the message. */
+        XMSS_SIGN_DETACHED(sk_copy, sig, &siglen, m, XMSS_MLEN);
+        if (siglen != params.sig_bytes || memcmp(sig, sm, siglen) ||
+                memcmp(sk_copy, sk, sizeof(sk))) {
+            printf("  X detached signature differs!\n");
+            ret = -1;
+        }
+        else {
+            printf("    detached signature as expected.\n");
+        }
+
+        /* Verify it on the message, split into three parts. */
+        iov[0].iov_base = m;
+        iov[0].iov_len = 5;
+        iov[1].iov_base = m + 5;
+        iov[1].iov_len = 0;
+        iov[2].iov_base = m + 5;
+        iov[2].iov_len = XMSS_MLEN - 5;
+        if (XMSS_VERIFY_DETACHED_IOV(sig, siglen, iov, 3, pk)) {
+            printf("  X detached verification failed!\n");
+            ret = -1;
+        }
+        else {
+            printf("    detached verification succeeded.\n");
+        }
+        m[XMSS_MLEN - 1] ^= 1;
+        if (!XMSS_VERIFY_DETACHED_IOV(sig, siglen, iov, 3, pk)) {
+            printf("  X flipping a bit of m DID NOT invalidate detached "
+                   "signature!\n");
+            ret = -1;
+        }
+        m[XMSS_MLEN - 1] ^= 1;
+
 #ifdef XMSS_TEST_INVALIDSIG
         int j;
         /* Flip one bit per hash; the signature is almost entirely hashes.
@@ -129,6 +171,7 @@ int main()
     free(m);
     free(sm);
     free(mout);
+    free(sig);
 
     return ret;
 }
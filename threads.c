@@ -0,0 +1,87 @@
+#include <pthread.h>
+#include <unistd.h>
+
+#include "threads.h"
+
+/* Upper bound on the number of threads that xmss_parallel_for starts. */
+#define XMSS_MAX_THREADS 256
+
+struct parallel_for_job {
+    void (*fn)(void *arg, unsigned int i);
+    void *arg;
+    unsigned int count;
+    unsigned int next;
+};
+
+/* Keeps claiming the next index until all of them are taken. */
+static void *parallel_for_worker(void *p)
+{
+    struct parallel_for_job *job = p;
+    unsigned int i;
+
+    while ((i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED))
+           < job->count) {
+        job->fn(job->arg, i);
+    }
+    return NULL;
+}
+
+/**
+ * Returns the number of online processors, or 1 if it cannot be determined.
+ */
+unsigned int xmss_cpu_count(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (n < 1) {
+        return 1;
+    }
+    if (n > XMSS_MAX_THREADS) {
+        return XMSS_MAX_THREADS;
+    }
+    return n;
+}
+
+/**
+ * Calls fn(arg, i) for every i in [0, count), spread over at most nthreads
+ * threads (including the calling thread), and returns when all calls are
+ * done. The calls may run in any order and concurrently, so fn must only
+ * write to memory that is specific to i.
+ * With nthreads <= 1, or when no threads can be started, the calls are simply
+ * made in order on the calling thread.
+ */
+void xmss_parallel_for(unsigned int nthreads, unsigned int count,
+                       void (*fn)(void *arg, unsigned int i), void *arg)
+{
+    pthread_t threads[XMSS_MAX_THREADS];
+    struct parallel_for_job job;
+    unsigned int started = 0;
+    unsigned int i;
+
+    job.fn = fn;
+    job.arg = arg;
+    job.count = count;
+    job.next = 0;
+
+    if (nthreads > count) {
+        nthreads = count;
+    }
+    if (nthreads > XMSS_MAX_THREADS) {
+        nthreads = XMSS_MAX_THREADS;
+    }
+
+    /* The calling thread is the first worker; failing to start the others
+       only costs parallelism, as the remaining workers pick up their share. */
+    for (i = 1; i < nthreads; i++) {
+        if (pthread_create(&threads[started], NULL,
+                           parallel_for_worker, &job) != 0) {
+            break;
+        }
+        started++;
+    }
+    parallel_for_worker(&job);
+
+    for (i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
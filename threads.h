@@ -0,0 +1,20 @@
+#ifndef XMSS_THREADS_H
+#define XMSS_THREADS_H
+
+/**
+ * Returns the number of online processors, or 1 if it cannot be determined.
+ */
+unsigned int xmss_cpu_count(void);
+
+/**
+ * Calls fn(arg, i) for every i in [0, count), spread over at most nthreads
+ * threads (including the calling thread), and returns when all calls are
+ * done. The calls may run in any order and concurrently, so fn must only
+ * write to memory that is specific to i.
+ * With nthreads <= 1, or when no threads can be started, the calls are simply
+ * made in order on the calling thread.
+ */
+void xmss_parallel_for(unsigned int nthreads, unsigned int count,
+                       void (*fn)(void *arg, unsigned int i), void *arg);
+
+#endif
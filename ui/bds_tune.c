@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../params.h"
+#include "../xmss.h"
+
+#ifdef XMSSMT
+    #define XMSS_STR_TO_OID xmssmt_str_to_oid
+    #define XMSS_PARSE_OID xmssmt_parse_oid
+    #define XMSS_KEYPAIR_RESUMABLE xmssmt_keypair_resumable
+    #define XMSS_SIGN_DETACHED xmssmt_sign_detached
+#else
+    #define XMSS_STR_TO_OID xmss_str_to_oid
+    #define XMSS_PARSE_OID xmss_parse_oid
+    #define XMSS_KEYPAIR_RESUMABLE xmss_keypair_resumable
+    #define XMSS_SIGN_DETACHED xmss_sign_detached
+#endif
+
+#define XMSS_MLEN 32
+
+/* The number of signatures to time per bds_k, unless given. */
+#define TUNE_SIGNATURES 1024
+
+static double seconds_between(const struct timespec *start,
+                              const struct timespec *stop)
+{
+    return (stop->tv_sec - start->tv_sec)
+        + (stop->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    if (*(double *)a < *(double *)b) return -1;
+    if (*(double *)a > *(double *)b) return 1;
+    return 0;
+}
+
+/**
+ * Generates a key for every legal BDS traversal parameter and schedule of
+ * the given parameter set, and reports its secret key size along with the
+ * median and worst-case latency of signing with it, to pick bds_k for
+ * xmss_keypair -k, and whether to pass -s.
+ */
+int main(int argc, char **argv)
+{
+    xmss_params params;
+    xmss_keygen_opts opts = {0};
+    uint32_t oid = 0;
+    unsigned long long signatures = TUNE_SIGNATURES;
+    unsigned long long i;
+    unsigned long long siglen;
+    struct timespec start, stop;
+    unsigned char m[XMSS_MLEN] = {0};
+    unsigned int k, schedule;
+
+    if (argc != 2 && argc != 3) {
+        fprintf(stderr, "Expected parameter string (e.g. 'XMSS-SHA2_10_256')"
+                        " as first parameter, and optionally the number of"
+                        " signatures to time per BDS parameter.\n"
+                        "A table of secret key sizes and signing latencies"
+                        " is written to stdout.\n");
+        return -1;
+    }
+    if (argc == 3) {
+        signatures = strtoull(argv[2], NULL, 10);
+    }
+
+    if (XMSS_STR_TO_OID(&oid, argv[1]) || XMSS_PARSE_OID(&params, oid)) {
+        fprintf(stderr, "Error parsing oid.\n");
+        return -1;
+    }
+    if (signatures == 0 || signatures > (1ULL << params.full_height)) {
+        signatures = 1ULL << params.full_height;
+    }
+
+    double *latency = malloc(signatures * sizeof(double));
+    unsigned char *pk = malloc(XMSS_OID_LEN + params.pk_bytes);
+    unsigned char *sig = malloc(params.sig_bytes);
+
+    printf("%-6s %-9s %12s %14s %14s %14s\n", "bds_k", "schedule",
+           "sk bytes", "median (us)", "average (us)", "max (us)");
+
+    for (k = 0; k <= params.tree_height; k++) {
+        for (schedule = XMSS_BDS_SCHEDULE_DEFAULT;
+             schedule <= XMSS_BDS_SCHEDULE_CONSTANT; schedule++) {
+            double total = 0;
+
+            if (xmss_xmssmt_set_bds_k(&params, k) ||
+                    xmss_xmssmt_set_bds_schedule(&params, schedule)) {
+                continue;
+            }
+            opts.bds_k = k;
+            opts.bds_schedule = schedule;
+
+            unsigned char *sk = malloc(XMSS_OID_LEN + params.sk_bytes);
+            if (XMSS_KEYPAIR_RESUMABLE(pk, sk, oid, &opts)) {
+                fprintf(stderr, "Error generating keypair for bds_k %u.\n", k);
+                free(sk);
+                continue;
+            }
+
+            for (i = 0; i < signatures; i++) {
+                m[0] = i;
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                XMSS_SIGN_DETACHED(sk, sig, &siglen, m, XMSS_MLEN);
+                clock_gettime(CLOCK_MONOTONIC, &stop);
+                latency[i] = seconds_between(&start, &stop) * 1e6;
+                total += latency[i];
+            }
+            qsort(latency, signatures, sizeof(double), cmp_double);
+
+            printf("%-6u %-9s %12llu %14.1f %14.1f %14.1f\n", k,
+                   schedule == XMSS_BDS_SCHEDULE_CONSTANT ? "constant" : "default",
+                   XMSS_OID_LEN + params.sk_bytes, latency[signatures / 2],
+                   total / signatures, latency[signatures - 1]);
+            fflush(stdout);
+
+            free(sk);
+        }
+    }
+
+    free(latency);
+    free(pk);
+    free(sig);
+
+    return 0;
+}
@@ -1,5 +1,7 @@
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
 
 #include "../params.h"
 #include "../xmss.h"
@@ -8,36 +10,107 @@
     #define XMSS_STR_TO_OID xmssmt_str_to_oid
     #define XMSS_PARSE_OID xmssmt_parse_oid
     #define XMSS_KEYPAIR xmssmt_keypair
+    #define XMSS_KEYPAIR_RESUMABLE xmssmt_keypair_resumable
 #else
     #define XMSS_STR_TO_OID xmss_str_to_oid
     #define XMSS_PARSE_OID xmss_parse_oid
     #define XMSS_KEYPAIR xmss_keypair
+    #define XMSS_KEYPAIR_RESUMABLE xmss_keypair_resumable
 #endif
 
+/* Seconds between two checkpoints, when a checkpoint file is given. */
+#define CHECKPOINT_INTERVAL 60
+
+static void print_progress(void *ctx, unsigned long long leaves_done,
+                           unsigned long long leaves_total,
+                           double seconds_left)
+{
+    (void)ctx;
+    fprintf(stderr, "\r%llu / %llu leaves, about %.0f seconds left.. ",
+            leaves_done, leaves_total, seconds_left);
+    if (leaves_done == leaves_total) {
+        fprintf(stderr, "done.\n");
+    }
+}
+
 int main(int argc, char **argv)
 {
     xmss_params params;
     uint32_t oid = 0;
     int parse_oid_result = 0;
+    xmss_keygen_opts opts = {0};
+    const char *checkpoint_file = NULL;
+    int opt;
 
-    if (argc != 2) {
+    while ((opt = getopt(argc, argv, "k:st:")) != -1) {
+        if (opt == 'k') {
+            opts.bds_k = strtoul(optarg, NULL, 10);
+        }
+        else if (opt == 't') {
+            opts.threads = strtoul(optarg, NULL, 10);
+        }
+        else if (opt == 's') {
+            opts.bds_schedule = XMSS_BDS_SCHEDULE_CONSTANT;
+        }
+        else {
+            argc = 0;
+            break;
+        }
+    }
+    if (argc - optind != 1 && argc - optind != 2) {
         fprintf(stderr, "Expected parameter string (e.g. 'XMSS-SHA2_10_256')"
-                        " as only parameter.\n"
+                        " as first parameter, and optionally a checkpoint"
+                        " file to save progress to or resume from.\n"
+                        "The option -k sets the BDS traversal parameter"
+                        " (see xmss_bds_tune_fast), and -s bounds the signing"
+                        " latency with the constant BDS schedule.\n"
+                        "The option -t computes the key on that many"
+                        " threads.\n"
                         "The keypair is written to stdout.\n");
         return -1;
     }
+    if (argc - optind == 2) {
+        checkpoint_file = argv[optind + 1];
+    }
 
-    XMSS_STR_TO_OID(&oid, argv[1]);
+    XMSS_STR_TO_OID(&oid, argv[optind]);
     parse_oid_result = XMSS_PARSE_OID(&params, oid);
     if (parse_oid_result != 0) {
         fprintf(stderr, "Error parsing oid.\n");
         return parse_oid_result;
     }
+    if (xmss_xmssmt_set_bds_k(&params, opts.bds_k)) {
+        fprintf(stderr, "BDS parameter %u is not legal for this tree height.\n",
+                opts.bds_k);
+        return -1;
+    }
+    xmss_xmssmt_set_bds_schedule(&params, opts.bds_schedule);
 
     unsigned char pk[XMSS_OID_LEN + params.pk_bytes];
     unsigned char sk[XMSS_OID_LEN + params.sk_bytes];
 
-    XMSS_KEYPAIR(pk, sk, oid);
+    if (checkpoint_file != NULL) {
+        opts.checkpoint_file = checkpoint_file;
+        opts.checkpoint_interval = CHECKPOINT_INTERVAL;
+        opts.progress = print_progress;
+    }
+    if (checkpoint_file != NULL || opts.bds_k != 0 ||
+            opts.bds_schedule != XMSS_BDS_SCHEDULE_DEFAULT ||
+            opts.threads > 1) {
+        if (XMSS_KEYPAIR_RESUMABLE(pk, sk, oid, &opts)) {
+            if (checkpoint_file != NULL) {
+                fprintf(stderr, "Error using checkpoint file %s.\n",
+                        checkpoint_file);
+            }
+            else {
+                fprintf(stderr, "Error generating keypair.\n");
+            }
+            return -1;
+        }
+    }
+    else {
+        XMSS_KEYPAIR(pk, sk, oid);
+    }
 
     fwrite(pk, 1, XMSS_OID_LEN + params.pk_bytes, stdout);
     fwrite(sk, 1, XMSS_OID_LEN + params.sk_bytes, stdout);
@@ -3,23 +3,24 @@
 
 #include "../params.h"
 #include "../xmss.h"
+#include "../xmss_file.h"
 #include "../utils.h"
 
 #ifdef XMSSMT
     #define XMSS_PARSE_OID xmssmt_parse_oid
-    #define XMSS_SIGN xmssmt_sign
+    #define XMSS_SK_FILE_MAP xmssmt_sk_file_map
 #else
     #define XMSS_PARSE_OID xmss_parse_oid
-    #define XMSS_SIGN xmss_sign
+    #define XMSS_SK_FILE_MAP xmss_sk_file_map
 #endif
 
 int main(int argc, char **argv) {
     FILE *keypair_file;
     FILE *m_file;
+    xmss_sk_file *sk_file;
 
     xmss_params params;
     uint32_t oid_pk = 0;
-    uint32_t oid_sk = 0;
     uint8_t buffer[XMSS_OID_LEN];
     int parse_oid_result;
 
@@ -33,68 +34,67 @@ int main(int argc, char **argv) {
         return -1;
     }
 
-    keypair_file = fopen(argv[1], "r+b");
+    keypair_file = fopen(argv[1], "rb");
     if (keypair_file == NULL) {
         fprintf(stderr, "Could not open keypair file.\n");
         return -1;
     }
 
-    m_file = fopen(argv[2], "rb");
-    if (m_file == NULL) {
-        fprintf(stderr, "Could not open message file.\n");
+    /* Read the OID from the public key, as we need its length to seek past it */
+    if (fread(&buffer, 1, XMSS_OID_LEN, keypair_file) != XMSS_OID_LEN) {
+        fprintf(stderr, "Could not read keypair file.\n");
         fclose(keypair_file);
         return -1;
     }
-
-    /* Find out the message length. */
-    fseek(m_file, 0, SEEK_END);
-    mlen = ftell(m_file);
-
-    /* Read the OID from the public key, as we need its length to seek past it */
-    fread(&buffer, 1, XMSS_OID_LEN, keypair_file);
+    fclose(keypair_file);
     /* The XMSS_OID_LEN bytes in buffer are a big-endian uint32. */
     oid_pk = (uint32_t)bytes_to_ull(buffer, XMSS_OID_LEN);
     parse_oid_result = XMSS_PARSE_OID(&params, oid_pk);
     if (parse_oid_result != 0) {
         fprintf(stderr, "Error parsing public key oid.\n");
-        fclose(keypair_file);
-        fclose(m_file);
         return parse_oid_result;
     }
 
-    /* fseek past the public key */
-    fseek(keypair_file, params.pk_bytes, SEEK_CUR);
-    /* This is the OID we're actually going to use. Likely the same, but still. */
-    fread(&buffer, 1, XMSS_OID_LEN, keypair_file);
-    oid_sk = (uint32_t)bytes_to_ull(buffer, XMSS_OID_LEN);
-    parse_oid_result = XMSS_PARSE_OID(&params, oid_sk);
-    if (parse_oid_result != 0) {
-        fprintf(stderr, "Error parsing secret key oid.\n");
-        fclose(keypair_file);
+    m_file = fopen(argv[2], "rb");
+    if (m_file == NULL) {
+        fprintf(stderr, "Could not open message file.\n");
+        return -1;
+    }
+
+    /* Find out the message length. */
+    fseek(m_file, 0, SEEK_END);
+    mlen = ftell(m_file);
+
+    /* The secret key follows the public key. It is updated in place, and
+       its index is durable before the signature is output, so that it is
+       never used twice. */
+    sk_file = XMSS_SK_FILE_MAP(argv[1], XMSS_OID_LEN + params.pk_bytes);
+    if (sk_file == NULL) {
+        fprintf(stderr, "Error parsing secret key.\n");
         fclose(m_file);
-        return parse_oid_result;
+        return -1;
     }
 
-    unsigned char sk[XMSS_OID_LEN + params.sk_bytes];
     unsigned char *m = malloc(mlen);
-    unsigned char *sm = malloc(params.sig_bytes + mlen);
+    /* The OID of the secret key is the one that is actually used. Likely the
+       same as that of the public key, but still. */
+    unsigned char *sm = malloc(xmss_sk_file_params(sk_file)->sig_bytes + mlen);
     unsigned long long smlen;
 
-    /* fseek back to start of sk. */
-    fseek(keypair_file, -((long int)XMSS_OID_LEN), SEEK_CUR);
     fseek(m_file, 0, SEEK_SET);
-    fread(sk, 1, XMSS_OID_LEN + params.sk_bytes, keypair_file);
     fread(m, 1, mlen, m_file);
+    fclose(m_file);
 
-    XMSS_SIGN(sk, sm, &smlen, m, mlen);
-
-    fseek(keypair_file, -((long int)params.sk_bytes), SEEK_CUR);
-    fwrite(sk + XMSS_OID_LEN, 1, params.sk_bytes, keypair_file);
+    if (xmss_sk_file_sign(sk_file, sm, &smlen, m, mlen)) {
+        fprintf(stderr, "Error signing; the key may be exhausted.\n");
+        xmss_sk_file_close(sk_file);
+        free(m);
+        free(sm);
+        return -1;
+    }
+    xmss_sk_file_close(sk_file);
     fwrite(sm, 1, smlen, stdout);
 
-    fclose(keypair_file);
-    fclose(m_file);
-
     free(m);
     free(sm);
 
@@ -9,41 +9,84 @@
 
 /**
  * Helper method for pseudorandom key generation.
- * Expands an n-byte array into a len*n byte array using the `prf` function.
+ * Expands count n-byte seeds into count len*n byte arrays using the `prf`
+ * function. The outputs for consecutive seeds are stored consecutively.
  */
-static void expand_seed(const xmss_params *params,
-                        unsigned char *outseeds, const unsigned char *inseed)
+static void expand_seeds(const xmss_params *params,
+                         unsigned char *outseeds, const unsigned char *inseeds,
+                         unsigned int count)
 {
-    uint32_t i;
-    unsigned char ctr[32];
+    xmss_prf_ctx seed_ctx[count];
+    uint32_t i, k;
+    unsigned char ctr[params->wots_len][32];
+    unsigned char *out[count * params->wots_len];
+    const unsigned char *in[count * params->wots_len];
+    const xmss_prf_ctx *key[count * params->wots_len];
 
     for (i = 0; i < params->wots_len; i++) {
-        ull_to_bytes(ctr, 32, i);
-        prf(params, outseeds + i*params->n, ctr, inseed);
+        ull_to_bytes(ctr[i], 32, i);
+    }
+
+    /* All len PRF calls per seed are keyed with that seed; all of them are
+       independent, so they can be made as one batch. */
+    for (k = 0; k < count; k++) {
+        prf_ctx_init(params, &seed_ctx[k], inseeds + k*params->n);
+        for (i = 0; i < params->wots_len; i++) {
+            out[k*params->wots_len + i] =
+                outseeds + (k*params->wots_len + i)*params->n;
+            in[k*params->wots_len + i] = ctr[i];
+            key[k*params->wots_len + i] = &seed_ctx[k];
+        }
     }
+    prf_xn(params, out, in, key, count * params->wots_len);
 }
 
 /**
- * Computes the chaining function.
- * out and in have to be n-byte arrays.
+ * Computes the chaining function for all len chains of count WOTS key pairs
+ * at once. out and in have to be count*len*n byte arrays, and may be equal.
  *
- * Interprets in as start-th value of the chain.
- * addr has to contain the address of the chain.
+ * Interprets the j-th n bytes of in as the start[j]-th value of chain
+ * j mod len of key pair j / len, and applies steps[j] calls to the hash
+ * function. The chains are advanced in lockstep: in round r, every chain that
+ * has more than r steps to go takes one, and these calls are made as one
+ * batch to thash_f_xn. That way, chains of unequal lengths (as in signing
+ * and verification) still share the lanes of the multi-buffer hash
+ * implementations until they are done.
+ *
+ * addr[k] has to contain the address of the k-th WOTS key pair.
  */
-static void gen_chain(const xmss_params *params,
-                      unsigned char *out, const unsigned char *in,
-                      unsigned int start, unsigned int steps,
-                      const unsigned char *pub_seed, uint32_t addr[8])
+static void gen_chains(const xmss_params *params,
+                       unsigned char *out, const unsigned char *in,
+                       const unsigned int *start, const unsigned int *steps,
+                       const xmss_prf_ctx *pub_seed, const uint32_t addr[][8],
+                       unsigned int count)
 {
-    uint32_t i;
-
-    /* Initialize out with the value at position 'start'. */
-    memcpy(out, in, params->n);
-
-    /* Iterate 'steps' calls to the hash function. */
-    for (i = start; i < (start+steps) && i < params->wots_w; i++) {
-        set_hash_addr(addr, i);
-        thash_f(params, out, out, pub_seed, addr);
+    unsigned int chains = count * params->wots_len;
+    uint32_t chain_addr[chains][8];
+    unsigned char *chain_out[chains];
+    const unsigned char *chain_in[chains];
+    unsigned int j, r, active;
+
+    /* Initialize out with the values at position 'start'. */
+    memmove(out, in, chains * params->n);
+
+    for (r = 0; ; r++) {
+        active = 0;
+        for (j = 0; j < chains; j++) {
+            if (r < steps[j] && start[j] + r < params->wots_w) {
+                memcpy(chain_addr[active], addr[j / params->wots_len],
+                       sizeof(chain_addr[active]));
+                set_chain_addr(chain_addr[active], j % params->wots_len);
+                set_hash_addr(chain_addr[active], start[j] + r);
+                chain_out[active] = out + j*params->n;
+                chain_in[active] = out + j*params->n;
+                active++;
+            }
+        }
+        if (active == 0) {
+            break;
+        }
+        thash_f_xn(params, chain_out, chain_in, pub_seed, chain_addr, active);
     }
 }
 
@@ -104,25 +147,40 @@ static void chain_lengths(const xmss_params *params,
 /**
  * WOTS key generation. Takes a 32 byte seed for the private key, expands it to
  * a full WOTS private key and computes the corresponding public key.
- * It requires the seed pub_seed (used to generate bitmasks and hash keys)
- * and the address of this WOTS key pair.
+ * It requires the PRF context of pub_seed (used to generate bitmasks and hash
+ * keys) and the address of this WOTS key pair.
  *
  * Writes the computed public key to 'pk'.
  */
 void wots_pkgen(const xmss_params *params,
                 unsigned char *pk, const unsigned char *seed,
-                const unsigned char *pub_seed, uint32_t addr[8])
+                const xmss_prf_ctx *pub_seed, uint32_t addr[8])
 {
-    uint32_t i;
+    wots_pkgen_xn(params, pk, seed, pub_seed, (const uint32_t (*)[8])addr, 1);
+}
 
-    /* The WOTS+ private key is derived from the seed. */
-    expand_seed(params, pk, seed);
+/**
+ * Computes count WOTS public keys at once, as wots_pkgen does for one. The
+ * k-th key pair has seed seeds + k*n and address addr[k], and its public key
+ * is written to pk + k*wots_sig_bytes.
+ */
+void wots_pkgen_xn(const xmss_params *params,
+                   unsigned char *pk, const unsigned char *seeds,
+                   const xmss_prf_ctx *pub_seed, const uint32_t addr[][8],
+                   unsigned int count)
+{
+    unsigned int start[count * params->wots_len];
+    unsigned int steps[count * params->wots_len];
+    uint32_t j;
 
-    for (i = 0; i < params->wots_len; i++) {
-        set_chain_addr(addr, i);
-        gen_chain(params, pk + i*params->n, pk + i*params->n,
-                  0, params->wots_w - 1, pub_seed, addr);
+    /* The WOTS+ private keys are derived from the seeds. */
+    expand_seeds(params, pk, seeds, count);
+
+    for (j = 0; j < count * params->wots_len; j++) {
+        start[j] = 0;
+        steps[j] = params->wots_w - 1;
     }
+    gen_chains(params, pk, pk, start, steps, pub_seed, addr, count);
 }
 
 /**
@@ -131,22 +189,25 @@ void wots_pkgen(const xmss_params *params,
  */
 void wots_sign(const xmss_params *params,
                unsigned char *sig, const unsigned char *msg,
-               const unsigned char *seed, const unsigned char *pub_seed,
+               const unsigned char *seed, const xmss_prf_ctx *pub_seed,
                uint32_t addr[8])
 {
     int lengths[params->wots_len];
+    unsigned int start[params->wots_len];
+    unsigned int steps[params->wots_len];
     uint32_t i;
 
     chain_lengths(params, lengths, msg);
 
     /* The WOTS+ private key is derived from the seed. */
-    expand_seed(params, sig, seed);
+    expand_seeds(params, sig, seed, 1);
 
     for (i = 0; i < params->wots_len; i++) {
-        set_chain_addr(addr, i);
-        gen_chain(params, sig + i*params->n, sig + i*params->n,
-                  0, lengths[i], pub_seed, addr);
+        start[i] = 0;
+        steps[i] = lengths[i];
     }
+    gen_chains(params, sig, sig, start, steps, pub_seed,
+               (const uint32_t (*)[8])addr, 1);
 }
 
 /**
@@ -156,16 +217,35 @@ void wots_sign(const xmss_params *params,
  */
 void wots_pk_from_sig(const xmss_params *params, unsigned char *pk,
                       const unsigned char *sig, const unsigned char *msg,
-                      const unsigned char *pub_seed, uint32_t addr[8])
+                      const xmss_prf_ctx *pub_seed, uint32_t addr[8])
 {
-    int lengths[params->wots_len];
-    uint32_t i;
-
-    chain_lengths(params, lengths, msg);
+    wots_pk_from_sig_xn(params, pk, sig, msg, pub_seed,
+                        (const uint32_t (*)[8])addr, 1);
+}
 
-    for (i = 0; i < params->wots_len; i++) {
-        set_chain_addr(addr, i);
-        gen_chain(params, pk + i*params->n, sig + i*params->n,
-                  lengths[i], params->wots_w - 1 - lengths[i], pub_seed, addr);
+/**
+ * Computes count WOTS public keys from signatures at once, as
+ * wots_pk_from_sig does for one. The k-th signature is at
+ * sigs + k*wots_sig_bytes, on the n-byte message at msgs + k*n, under the key
+ * pair with address addr[k]; its public key is written to
+ * pk + k*wots_sig_bytes. pk may be equal to sigs.
+ */
+void wots_pk_from_sig_xn(const xmss_params *params, unsigned char *pk,
+                         const unsigned char *sigs, const unsigned char *msgs,
+                         const xmss_prf_ctx *pub_seed,
+                         const uint32_t addr[][8], unsigned int count)
+{
+    int lengths[params->wots_len];
+    unsigned int start[count * params->wots_len];
+    unsigned int steps[count * params->wots_len];
+    uint32_t i, k;
+
+    for (k = 0; k < count; k++) {
+        chain_lengths(params, lengths, msgs + k*params->n);
+        for (i = 0; i < params->wots_len; i++) {
+            start[k*params->wots_len + i] = lengths[i];
+            steps[k*params->wots_len + i] = params->wots_w - 1 - lengths[i];
+        }
     }
+    gen_chains(params, pk, sigs, start, steps, pub_seed, addr, count);
 }
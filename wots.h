@@ -3,18 +3,30 @@
 
 #include <stdint.h>
 #include "params.h"
+#include "hash.h"
 
 /**
  * WOTS key generation. Takes a 32 byte seed for the private key, expands it to
  * a full WOTS private key and computes the corresponding public key.
- * It requires the seed pub_seed (used to generate bitmasks and hash keys)
- * and the address of this WOTS key pair.
+ * It requires the PRF context of pub_seed (used to generate bitmasks and hash
+ * keys) and the address of this WOTS key pair.
  *
  * Writes the computed public key to 'pk'.
  */
 void wots_pkgen(const xmss_params *params,
                 unsigned char *pk, const unsigned char *seed,
-                const unsigned char *pub_seed, uint32_t addr[8]);
+                const xmss_prf_ctx *pub_seed, uint32_t addr[8]);
+
+/**
+ * Computes count WOTS public keys at once, as wots_pkgen does for one. The
+ * k-th key pair has seed seeds + k*n and address addr[k], and its public key
+ * is written to pk + k*wots_sig_bytes. The hash calls of all key pairs are
+ * batched together.
+ */
+void wots_pkgen_xn(const xmss_params *params,
+                   unsigned char *pk, const unsigned char *seeds,
+                   const xmss_prf_ctx *pub_seed, const uint32_t addr[][8],
+                   unsigned int count);
 
 /**
  * Takes a n-byte message and the 32-byte seed for the private key to compute a
@@ -22,7 +34,7 @@ void wots_pkgen(const xmss_params *params,
  */
 void wots_sign(const xmss_params *params,
                unsigned char *sig, const unsigned char *msg,
-               const unsigned char *seed, const unsigned char *pub_seed,
+               const unsigned char *seed, const xmss_prf_ctx *pub_seed,
                uint32_t addr[8]);
 
 /**
@@ -32,6 +44,19 @@ void wots_sign(const xmss_params *params,
  */
 void wots_pk_from_sig(const xmss_params *params, unsigned char *pk,
                       const unsigned char *sig, const unsigned char *msg,
-                      const unsigned char *pub_seed, uint32_t addr[8]);
+                      const xmss_prf_ctx *pub_seed, uint32_t addr[8]);
+
+/**
+ * Computes count WOTS public keys from signatures at once, as
+ * wots_pk_from_sig does for one. The k-th signature is at
+ * sigs + k*wots_sig_bytes, on the n-byte message at msgs + k*n, under the key
+ * pair with address addr[k]; its public key is written to
+ * pk + k*wots_sig_bytes. pk may be equal to sigs. The hash calls of all
+ * chains are batched together.
+ */
+void wots_pk_from_sig_xn(const xmss_params *params, unsigned char *pk,
+                         const unsigned char *sigs, const unsigned char *msgs,
+                         const xmss_prf_ctx *pub_seed,
+                         const uint32_t addr[][8], unsigned int count);
 
 #endif
@@ -1,7 +1,11 @@
 #include <stdint.h>
+#include <string.h>
+#include <sys/uio.h>
 
 #include "params.h"
+#include "xmss.h"
 #include "xmss_core.h"
+#include "utils.h"
 
 /* This file provides wrapper functions that take keys that include OIDs to
 identify the parameter set to be used. After setting the parameters accordingly
@@ -25,18 +29,51 @@ int xmss_keypair(unsigned char *pk, unsigned char *sk, const uint32_t oid)
     return xmss_core_keypair(&params, pk + XMSS_OID_LEN, sk + XMSS_OID_LEN);
 }
 
-int xmss_sign(unsigned char *sk,
-              unsigned char *sm, unsigned long long *smlen,
-              const unsigned char *m, unsigned long long mlen)
+int xmss_keypair_resumable(unsigned char *pk, unsigned char *sk,
+                           const uint32_t oid, const xmss_keygen_opts *opts)
 {
     xmss_params params;
+    unsigned int i;
+
+    if (xmss_parse_oid(&params, oid)) {
+        return -1;
+    }
+    if (opts != NULL && (xmss_xmssmt_set_bds_k(&params, opts->bds_k) ||
+            xmss_xmssmt_set_bds_schedule(&params, opts->bds_schedule))) {
+        return -1;
+    }
+    if (opts != NULL && opts->threads > 1) {
+        params.threads = opts->threads;
+    }
+    for (i = 0; i < XMSS_OID_LEN; i++) {
+        pk[XMSS_OID_LEN - i - 1] = (oid >> (8 * i)) & 0xFF;
+        sk[XMSS_OID_LEN - i - 1] = (oid >> (8 * i)) & 0xFF;
+    }
+    return xmss_core_keypair_resumable(&params, pk + XMSS_OID_LEN,
+                                       sk + XMSS_OID_LEN, opts);
+}
+
+int xmss_parse_sk(xmss_params *params, const unsigned char *sk)
+{
     uint32_t oid = 0;
     unsigned int i;
 
     for (i = 0; i < XMSS_OID_LEN; i++) {
         oid |= sk[XMSS_OID_LEN - i - 1] << (i * 8);
     }
-    if (xmss_parse_oid(&params, oid)) {
+    if (xmss_parse_oid(params, oid)) {
+        return -1;
+    }
+    return xmss_xmssmt_core_sk_params(params, sk + XMSS_OID_LEN);
+}
+
+int xmss_sign(unsigned char *sk,
+              unsigned char *sm, unsigned long long *smlen,
+              const unsigned char *m, unsigned long long mlen)
+{
+    xmss_params params;
+
+    if (xmss_parse_sk(&params, sk)) {
         return -1;
     }
     return xmss_core_sign(&params, sk + XMSS_OID_LEN, sm, smlen, m, mlen);
@@ -59,6 +96,197 @@ int xmss_sign_open(unsigned char *m, unsigned long long *mlen,
     return xmss_core_sign_open(&params, m, mlen, sm, smlen, pk + XMSS_OID_LEN);
 }
 
+int xmss_sign_detached(unsigned char *sk,
+                       unsigned char *sig, unsigned long long *siglen,
+                       const unsigned char *m, unsigned long long mlen)
+{
+    struct iovec iov;
+
+    iov.iov_base = (void *)m;
+    iov.iov_len = mlen;
+    return xmss_sign_detached_iov(sk, sig, siglen, &iov, 1);
+}
+
+int xmss_sign_detached_iov(unsigned char *sk,
+                           unsigned char *sig, unsigned long long *siglen,
+                           const struct iovec *iov, unsigned int iovcnt)
+{
+    xmss_params params;
+
+    if (xmss_parse_sk(&params, sk)) {
+        return -1;
+    }
+    return xmss_core_sign_detached(&params, sk + XMSS_OID_LEN,
+                                   sig, siglen, iov, iovcnt);
+}
+
+int xmss_verify_detached(const unsigned char *sig, unsigned long long siglen,
+                         const unsigned char *m, unsigned long long mlen,
+                         const unsigned char *pk)
+{
+    struct iovec iov;
+
+    iov.iov_base = (void *)m;
+    iov.iov_len = mlen;
+    return xmss_verify_detached_iov(sig, siglen, &iov, 1, pk);
+}
+
+int xmss_verify_detached_iov(const unsigned char *sig,
+                             unsigned long long siglen,
+                             const struct iovec *iov, unsigned int iovcnt,
+                             const unsigned char *pk)
+{
+    xmss_params params;
+    uint32_t oid = 0;
+    unsigned int i;
+
+    for (i = 0; i < XMSS_OID_LEN; i++) {
+        oid |= pk[XMSS_OID_LEN - i - 1] << (i * 8);
+    }
+    if (xmss_parse_oid(&params, oid)) {
+        return -1;
+    }
+    return xmss_core_verify_detached(&params, sig, siglen, iov, iovcnt,
+                                     pk + XMSS_OID_LEN);
+}
+
+int xmss_verify_batch(int *results, const unsigned char *const sigs[],
+                      const unsigned long long siglens[],
+                      const unsigned char *const ms[],
+                      const unsigned long long mlens[], unsigned int count,
+                      const unsigned char *pk)
+{
+    xmss_params params;
+    uint32_t oid = 0;
+    unsigned int i;
+
+    for (i = 0; i < XMSS_OID_LEN; i++) {
+        oid |= pk[XMSS_OID_LEN - i - 1] << (i * 8);
+    }
+    if (xmss_parse_oid(&params, oid)) {
+        for (i = 0; i < count; i++) {
+            results[i] = -1;
+        }
+        return -1;
+    }
+    return xmss_core_verify_batch(&params, results, sigs, siglens, ms, mlens,
+                                  count, pk + XMSS_OID_LEN);
+}
+
+/* Splits the indices left in sk into count + 1 ranges, handing out the last
+   ones first so that sk keeps shrinking towards its own range. */
+static int split_ranges(const xmss_params *params, unsigned char *sk,
+                        unsigned char *shards[], unsigned int count,
+                        int (*split)(const xmss_params *, unsigned char *,
+                                     unsigned char *, unsigned long long))
+{
+    unsigned long long idx, end, size;
+    unsigned int i;
+
+    idx = bytes_to_ull(sk + XMSS_OID_LEN, params->index_bytes);
+    end = xmss_xmssmt_core_sk_end(params, sk + XMSS_OID_LEN);
+    if (idx >= end || end - idx < count + 1ULL) {
+        return -1;
+    }
+    size = (end - idx) / (count + 1);
+    for (i = count; i > 0; i--) {
+        memcpy(shards[i - 1], sk, XMSS_OID_LEN);
+        if (split(params, sk + XMSS_OID_LEN, shards[i - 1] + XMSS_OID_LEN,
+                  idx + i * size)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int xmss_split(unsigned char *sk, unsigned char *shards[], unsigned int count)
+{
+    xmss_params params;
+
+    if (xmss_parse_sk(&params, sk)) {
+        return -1;
+    }
+    return split_ranges(&params, sk, shards, count, xmss_core_split);
+}
+
+int xmss_restore_state(unsigned char *sk, unsigned long long target_idx)
+{
+    xmss_params params;
+
+    if (xmss_parse_sk(&params, sk)) {
+        return -1;
+    }
+    return xmss_core_restore_state(&params, sk + XMSS_OID_LEN, target_idx);
+}
+
+/* Compacts sk, with params as parsed from it. */
+static int sk_compact(const xmss_params *params, unsigned char *out,
+                      unsigned long long *outlen, const unsigned char *sk)
+{
+    memcpy(out, sk, XMSS_OID_LEN);
+    if (xmss_xmssmt_core_sk_compact(params, out + XMSS_OID_LEN, outlen,
+                                    sk + XMSS_OID_LEN)) {
+        return -1;
+    }
+    *outlen += XMSS_OID_LEN;
+    return 0;
+}
+
+/* Expands in, whose OID parse_oid parses, into sk. */
+static int sk_expand(unsigned char *sk, const unsigned char *in,
+                     unsigned long long inlen,
+                     int (*parse_oid)(xmss_params *, const uint32_t))
+{
+    xmss_params params;
+
+    if (inlen < XMSS_OID_LEN ||
+            parse_oid(&params, bytes_to_ull(in, XMSS_OID_LEN)) ||
+            xmss_xmssmt_core_sk_expand(&params, sk + XMSS_OID_LEN,
+                                       in + XMSS_OID_LEN,
+                                       inlen - XMSS_OID_LEN)) {
+        return -1;
+    }
+    memcpy(sk, in, XMSS_OID_LEN);
+    return 0;
+}
+
+/* Converts old, whose OID parse_oid parses, into sk. */
+static int sk_convert(unsigned char *sk, const unsigned char *old,
+                      int (*parse_oid)(xmss_params *, const uint32_t))
+{
+    xmss_params params;
+
+    if (parse_oid(&params, bytes_to_ull(old, XMSS_OID_LEN)) ||
+            xmss_xmssmt_core_sk_convert(&params, sk + XMSS_OID_LEN,
+                                        old + XMSS_OID_LEN)) {
+        return -1;
+    }
+    memcpy(sk, old, XMSS_OID_LEN);
+    return 0;
+}
+
+int xmss_sk_compact(unsigned char *out, unsigned long long *outlen,
+                    const unsigned char *sk)
+{
+    xmss_params params;
+
+    if (xmss_parse_sk(&params, sk)) {
+        return -1;
+    }
+    return sk_compact(&params, out, outlen, sk);
+}
+
+int xmss_sk_expand(unsigned char *sk, const unsigned char *in,
+                   unsigned long long inlen)
+{
+    return sk_expand(sk, in, inlen, xmss_parse_oid);
+}
+
+int xmss_sk_convert(unsigned char *sk, const unsigned char *old_sk)
+{
+    return sk_convert(sk, old_sk, xmss_parse_oid);
+}
+
 int xmssmt_keypair(unsigned char *pk, unsigned char *sk, const uint32_t oid)
 {
     xmss_params params;
@@ -74,18 +302,51 @@ int xmssmt_keypair(unsigned char *pk, unsigned char *sk, const uint32_t oid)
     return xmssmt_core_keypair(&params, pk + XMSS_OID_LEN, sk + XMSS_OID_LEN);
 }
 
-int xmssmt_sign(unsigned char *sk,
-                unsigned char *sm, unsigned long long *smlen,
-                const unsigned char *m, unsigned long long mlen)
+int xmssmt_keypair_resumable(unsigned char *pk, unsigned char *sk,
+                             const uint32_t oid, const xmss_keygen_opts *opts)
 {
     xmss_params params;
+    unsigned int i;
+
+    if (xmssmt_parse_oid(&params, oid)) {
+        return -1;
+    }
+    if (opts != NULL && (xmss_xmssmt_set_bds_k(&params, opts->bds_k) ||
+            xmss_xmssmt_set_bds_schedule(&params, opts->bds_schedule))) {
+        return -1;
+    }
+    if (opts != NULL && opts->threads > 1) {
+        params.threads = opts->threads;
+    }
+    for (i = 0; i < XMSS_OID_LEN; i++) {
+        pk[XMSS_OID_LEN - i - 1] = (oid >> (8 * i)) & 0xFF;
+        sk[XMSS_OID_LEN - i - 1] = (oid >> (8 * i)) & 0xFF;
+    }
+    return xmssmt_core_keypair_resumable(&params, pk + XMSS_OID_LEN,
+                                         sk + XMSS_OID_LEN, opts);
+}
+
+int xmssmt_parse_sk(xmss_params *params, const unsigned char *sk)
+{
     uint32_t oid = 0;
     unsigned int i;
 
     for (i = 0; i < XMSS_OID_LEN; i++) {
         oid |= sk[XMSS_OID_LEN - i - 1] << (i * 8);
     }
-    if (xmssmt_parse_oid(&params, oid)) {
+    if (xmssmt_parse_oid(params, oid)) {
+        return -1;
+    }
+    return xmss_xmssmt_core_sk_params(params, sk + XMSS_OID_LEN);
+}
+
+int xmssmt_sign(unsigned char *sk,
+                unsigned char *sm, unsigned long long *smlen,
+                const unsigned char *m, unsigned long long mlen)
+{
+    xmss_params params;
+
+    if (xmssmt_parse_sk(&params, sk)) {
         return -1;
     }
     return xmssmt_core_sign(&params, sk + XMSS_OID_LEN, sm, smlen, m, mlen);
@@ -107,3 +368,200 @@ int xmssmt_sign_open(unsigned char *m, unsigned long long *mlen,
     }
     return xmssmt_core_sign_open(&params, m, mlen, sm, smlen, pk + XMSS_OID_LEN);
 }
+
+int xmssmt_sign_detached(unsigned char *sk,
+                         unsigned char *sig, unsigned long long *siglen,
+                         const unsigned char *m, unsigned long long mlen)
+{
+    struct iovec iov;
+
+    iov.iov_base = (void *)m;
+    iov.iov_len = mlen;
+    return xmssmt_sign_detached_iov(sk, sig, siglen, &iov, 1);
+}
+
+int xmssmt_sign_detached_iov(unsigned char *sk,
+                             unsigned char *sig, unsigned long long *siglen,
+                             const struct iovec *iov, unsigned int iovcnt)
+{
+    xmss_params params;
+
+    if (xmssmt_parse_sk(&params, sk)) {
+        return -1;
+    }
+    return xmssmt_core_sign_detached(&params, sk + XMSS_OID_LEN,
+                                     sig, siglen, iov, iovcnt);
+}
+
+int xmssmt_verify_detached(const unsigned char *sig, unsigned long long siglen,
+                           const unsigned char *m, unsigned long long mlen,
+                           const unsigned char *pk)
+{
+    struct iovec iov;
+
+    iov.iov_base = (void *)m;
+    iov.iov_len = mlen;
+    return xmssmt_verify_detached_iov(sig, siglen, &iov, 1, pk);
+}
+
+int xmssmt_verify_detached_iov(const unsigned char *sig,
+                               unsigned long long siglen,
+                               const struct iovec *iov, unsigned int iovcnt,
+                               const unsigned char *pk)
+{
+    xmss_params params;
+    uint32_t oid = 0;
+    unsigned int i;
+
+    for (i = 0; i < XMSS_OID_LEN; i++) {
+        oid |= pk[XMSS_OID_LEN - i - 1] << (i * 8);
+    }
+    if (xmssmt_parse_oid(&params, oid)) {
+        return -1;
+    }
+    return xmssmt_core_verify_detached(&params, sig, siglen, iov, iovcnt,
+                                       pk + XMSS_OID_LEN);
+}
+
+int xmssmt_verify_batch(int *results, const unsigned char *const sigs[],
+                        const unsigned long long siglens[],
+                        const unsigned char *const ms[],
+                        const unsigned long long mlens[], unsigned int count,
+                        const unsigned char *pk)
+{
+    xmss_params params;
+    uint32_t oid = 0;
+    unsigned int i;
+
+    for (i = 0; i < XMSS_OID_LEN; i++) {
+        oid |= pk[XMSS_OID_LEN - i - 1] << (i * 8);
+    }
+    if (xmssmt_parse_oid(&params, oid)) {
+        for (i = 0; i < count; i++) {
+            results[i] = -1;
+        }
+        return -1;
+    }
+    return xmssmt_core_verify_batch(&params, results, sigs, siglens, ms, mlens,
+                                    count, pk + XMSS_OID_LEN);
+}
+
+int xmssmt_split(unsigned char *sk, unsigned char *shards[],
+                 unsigned int count)
+{
+    xmss_params params;
+
+    if (xmssmt_parse_sk(&params, sk)) {
+        return -1;
+    }
+    return split_ranges(&params, sk, shards, count, xmssmt_core_split);
+}
+
+int xmssmt_restore_state(unsigned char *sk, unsigned long long target_idx)
+{
+    xmss_params params;
+
+    if (xmssmt_parse_sk(&params, sk)) {
+        return -1;
+    }
+    return xmssmt_core_restore_state(&params, sk + XMSS_OID_LEN, target_idx);
+}
+
+int xmssmt_sk_compact(unsigned char *out, unsigned long long *outlen,
+                      const unsigned char *sk)
+{
+    xmss_params params;
+
+    if (xmssmt_parse_sk(&params, sk)) {
+        return -1;
+    }
+    return sk_compact(&params, out, outlen, sk);
+}
+
+int xmssmt_sk_expand(unsigned char *sk, const unsigned char *in,
+                     unsigned long long inlen)
+{
+    return sk_expand(sk, in, inlen, xmssmt_parse_oid);
+}
+
+int xmssmt_sk_convert(unsigned char *sk, const unsigned char *old_sk)
+{
+    return sk_convert(sk, old_sk, xmssmt_parse_oid);
+}
+
+xmss_signer *xmss_signer_load(const unsigned char *sk)
+{
+    xmss_params params;
+
+    if (xmss_parse_sk(&params, sk)) {
+        return NULL;
+    }
+    return xmss_core_signer_load(&params, sk + XMSS_OID_LEN);
+}
+
+xmss_signer *xmssmt_signer_load(const unsigned char *sk)
+{
+    xmss_params params;
+
+    if (xmssmt_parse_sk(&params, sk)) {
+        return NULL;
+    }
+    return xmss_core_signer_load(&params, sk + XMSS_OID_LEN);
+}
+
+int xmss_signer_sign(xmss_signer *signer,
+                     unsigned char *sm, unsigned long long *smlen,
+                     const unsigned char *m, unsigned long long mlen)
+{
+    if (xmss_signer_sign_detached(signer, sm, smlen, m, mlen)) {
+        return -1;
+    }
+    memcpy(sm + *smlen, m, mlen);
+    *smlen += mlen;
+    return 0;
+}
+
+int xmss_signer_sign_detached(xmss_signer *signer,
+                              unsigned char *sig, unsigned long long *siglen,
+                              const unsigned char *m, unsigned long long mlen)
+{
+    struct iovec iov;
+
+    iov.iov_base = (void *)m;
+    iov.iov_len = mlen;
+    return xmss_core_signer_sign_detached(signer, sig, siglen, &iov, 1);
+}
+
+int xmss_signer_sign_detached_iov(xmss_signer *signer,
+                                  unsigned char *sig,
+                                  unsigned long long *siglen,
+                                  const struct iovec *iov,
+                                  unsigned int iovcnt)
+{
+    return xmss_core_signer_sign_detached(signer, sig, siglen, iov, iovcnt);
+}
+
+int xmss_signer_precompute(xmss_signer *signer, unsigned int lookahead)
+{
+    return xmss_core_signer_precompute(signer, lookahead);
+}
+
+int xmss_signer_cache(xmss_signer *signer, int enable)
+{
+    return xmss_core_signer_cache(signer, enable);
+}
+
+void xmss_signer_threads(xmss_signer *signer, unsigned int threads)
+{
+    xmss_core_signer_threads(signer, threads);
+}
+
+void xmss_signer_flush(const xmss_signer *signer, unsigned char *sk)
+{
+    xmss_core_signer_flush(signer, sk + XMSS_OID_LEN);
+}
+
+void xmss_signer_free(xmss_signer *signer)
+{
+    xmss_core_signer_free(signer);
+}
@@ -2,6 +2,9 @@
 #define XMSS_H
 
 #include <stdint.h>
+#include <sys/uio.h>
+
+#include "params.h"
 
 /**
  * Generates a XMSS key pair for a given parameter set.
@@ -10,6 +13,29 @@
  */
 int xmss_keypair(unsigned char *pk, unsigned char *sk, const uint32_t oid);
 
+/**
+ * As xmss_keypair, but reports progress and saves it to a checkpoint file as
+ * opts asks for. If the checkpoint file exists, key generation resumes from
+ * it instead of starting over with a new seed; this requires the same OID.
+ * The key is generated for the BDS traversal parameter opts->bds_k, so sk
+ * must have room for the sk_bytes that xmss_xmssmt_set_bds_k gives for it.
+ * Returns -1 if bds_k is not legal, or the checkpoint cannot be read or
+ * written.
+ */
+int xmss_keypair_resumable(unsigned char *pk, unsigned char *sk,
+                           const uint32_t oid, const xmss_keygen_opts *opts);
+
+/**
+ * Configures params for the XMSS secret key sk (including OID), as
+ * xmss_parse_oid does for its OID, and for the BDS traversal parameter it
+ * was generated with; params->sk_bytes then gives the size of the key.
+ * At most the first XMSS_OID_LEN + index_bytes + 4*n + 19 bytes of sk are
+ * read, the head that xmss_core_fast.c keys have in front of their state.
+ * Returns -1 if the OID is not found or sk is malformed, e.g. of an older
+ * layout (see xmss_sk_convert), 0 otherwise.
+ */
+int xmss_parse_sk(xmss_params *params, const unsigned char *sk);
+
 /**
  * Signs a message using an XMSS secret key.
  * Returns
@@ -31,6 +57,104 @@ int xmss_sign_open(unsigned char *m, unsigned long long *mlen,
                    const unsigned char *sm, unsigned long long smlen,
                    const unsigned char *pk);
 
+/**
+ * Signs a message using an XMSS secret key, without copying the message.
+ * Returns
+ * 1. the signature, without the message, in sig (of sig_bytes bytes) AND
+ * 2. an updated secret key!
+ */
+int xmss_sign_detached(unsigned char *sk,
+                       unsigned char *sig, unsigned long long *siglen,
+                       const unsigned char *m, unsigned long long mlen);
+
+/**
+ * As xmss_sign_detached, but signs the concatenation of the iovcnt buffers in
+ * iov; e.g. a large file that is read or mapped in parts.
+ */
+int xmss_sign_detached_iov(unsigned char *sk,
+                           unsigned char *sig, unsigned long long *siglen,
+                           const struct iovec *iov, unsigned int iovcnt);
+
+/**
+ * Verifies a detached signature on a message using a given public key.
+ * Returns 0 if the signature is valid.
+ */
+int xmss_verify_detached(const unsigned char *sig, unsigned long long siglen,
+                         const unsigned char *m, unsigned long long mlen,
+                         const unsigned char *pk);
+
+/**
+ * As xmss_verify_detached, for the concatenation of the iovcnt buffers in
+ * iov.
+ */
+int xmss_verify_detached_iov(const unsigned char *sig,
+                             unsigned long long siglen,
+                             const struct iovec *iov, unsigned int iovcnt,
+                             const unsigned char *pk);
+
+/**
+ * Verifies count detached signatures under the same public key: signature k
+ * is sigs[k], of siglens[k] bytes, on the message ms[k] of mlens[k] bytes.
+ * Sets results[k] to 0 if it is valid and to -1 otherwise. The OID is parsed
+ * once, and groups of signatures are verified together, so that their hash
+ * calls share the lanes of the multi-buffer hash implementations.
+ * Returns 0 if all signatures are valid, -1 otherwise.
+ */
+int xmss_verify_batch(int *results, const unsigned char *const sigs[],
+                      const unsigned long long siglens[],
+                      const unsigned char *const ms[],
+                      const unsigned long long mlens[], unsigned int count,
+                      const unsigned char *pk);
+
+/**
+ * Splits the indices that are left in the XMSS secret key sk into count + 1
+ * ranges of about equal size, one for sk and one for each of the count keys
+ * in shards, which need room for the sk_bytes of sk each (including OID).
+ * The keys sign independently of each other, each stopping where the next
+ * range begins; e.g. to sign with one key per thread or machine.
+ * Returns -1 if there are fewer than count + 1 indices left, or if the
+ * implementation cannot split keys.
+ */
+int xmss_split(unsigned char *sk, unsigned char *shards[], unsigned int count);
+
+/**
+ * Moves the XMSS secret key sk forward to index target_idx, as
+ * xmss_core_restore_state does.
+ */
+int xmss_restore_state(unsigned char *sk, unsigned long long target_idx);
+
+/**
+ * Writes the XMSS secret key sk (including OID) to out in the compact,
+ * versioned encoding of xmss_xmssmt_core_sk_compact, e.g. to store it or
+ * replicate it to a standby signer, and sets *outlen to its size. out needs
+ * room for XMSS_OID_LEN + sk_bytes + 1 bytes; keys of the reference
+ * implementation, which keep no traversal state, take that much, as their
+ * encoding is the key followed by the version byte.
+ */
+int xmss_sk_compact(unsigned char *out, unsigned long long *outlen,
+                    const unsigned char *sk);
+
+/**
+ * Reads the XMSS secret key that xmss_sk_compact wrote to in into sk, in the
+ * layout that signing uses. xmss_parse_sk also reads in, so params->sk_bytes
+ * it sets tells how much room sk needs, without the OID.
+ * Returns -1 if in is not a valid compact encoding, 0 otherwise.
+ */
+int xmss_sk_expand(unsigned char *sk, const unsigned char *in,
+                   unsigned long long inlen);
+
+/**
+ * Converts the XMSS secret key old_sk (including OID), of the layout that
+ * keys had before their head held a version byte and which xmss_parse_sk
+ * rejects, to the current layout in sk; this needs room for XMSS_OID_LEN
+ * plus the sk_bytes that xmss_parse_oid gives for the OID. Only the index,
+ * the seeds and the root of old_sk are read; the traversal state is rebuilt
+ * for the index, as xmss_restore_state does.
+ * Returns -1 if the OID is not found, if old_sk has no index left, or if its
+ * root does not match its seeds.
+ */
+int xmss_sk_convert(unsigned char *sk, const unsigned char *old_sk);
+
 /*
  * Generates a XMSSMT key pair for a given parameter set.
  * Format sk: [OID || (ceil(h/8) bit) idx || SK_SEED || SK_PRF || PUB_SEED || root]
@@ -38,6 +162,17 @@ int xmss_sign_open(unsigned char *m, unsigned long long *mlen,
  */
 int xmssmt_keypair(unsigned char *pk, unsigned char *sk, const uint32_t oid);
 
+/**
+ * As xmss_keypair_resumable, for XMSSMT.
+ */
+int xmssmt_keypair_resumable(unsigned char *pk, unsigned char *sk,
+                             const uint32_t oid, const xmss_keygen_opts *opts);
+
+/**
+ * As xmss_parse_sk, for XMSSMT.
+ */
+int xmssmt_parse_sk(xmss_params *params, const unsigned char *sk);
+
 /**
  * Signs a message using an XMSSMT secret key.
  * Returns
@@ -58,4 +193,150 @@ int xmssmt_sign(unsigned char *sk,
 int xmssmt_sign_open(unsigned char *m, unsigned long long *mlen,
                      const unsigned char *sm, unsigned long long smlen,
                      const unsigned char *pk);
+
+/**
+ * As xmss_sign_detached, using an XMSSMT secret key.
+ */
+int xmssmt_sign_detached(unsigned char *sk,
+                         unsigned char *sig, unsigned long long *siglen,
+                         const unsigned char *m, unsigned long long mlen);
+
+/**
+ * As xmss_sign_detached_iov, using an XMSSMT secret key.
+ */
+int xmssmt_sign_detached_iov(unsigned char *sk,
+                             unsigned char *sig, unsigned long long *siglen,
+                             const struct iovec *iov, unsigned int iovcnt);
+
+/**
+ * As xmss_verify_detached, using an XMSSMT public key.
+ */
+int xmssmt_verify_detached(const unsigned char *sig, unsigned long long siglen,
+                           const unsigned char *m, unsigned long long mlen,
+                           const unsigned char *pk);
+
+/**
+ * As xmss_verify_detached_iov, using an XMSSMT public key.
+ */
+int xmssmt_verify_detached_iov(const unsigned char *sig,
+                               unsigned long long siglen,
+                               const struct iovec *iov, unsigned int iovcnt,
+                               const unsigned char *pk);
+
+/**
+ * As xmss_verify_batch, using an XMSSMT public key.
+ */
+int xmssmt_verify_batch(int *results, const unsigned char *const sigs[],
+                        const unsigned long long siglens[],
+                        const unsigned char *const ms[],
+                        const unsigned long long mlens[], unsigned int count,
+                        const unsigned char *pk);
+
+/**
+ * As xmss_split, for an XMSSMT secret key.
+ */
+int xmssmt_split(unsigned char *sk, unsigned char *shards[],
+                 unsigned int count);
+
+/**
+ * As xmss_restore_state, for an XMSSMT secret key.
+ */
+int xmssmt_restore_state(unsigned char *sk, unsigned long long target_idx);
+
+/**
+ * As xmss_sk_compact, for an XMSSMT secret key.
+ */
+int xmssmt_sk_compact(unsigned char *out, unsigned long long *outlen,
+                      const unsigned char *sk);
+
+/**
+ * As xmss_sk_expand, for an XMSSMT secret key.
+ */
+int xmssmt_sk_expand(unsigned char *sk, const unsigned char *in,
+                     unsigned long long inlen);
+
+/**
+ * As xmss_sk_convert, for an XMSSMT secret key.
+ */
+int xmssmt_sk_convert(unsigned char *sk, const unsigned char *old_sk);
+
+/**
+ * Loads an XMSS secret key for signing many messages. The signer keeps the
+ * key and its traversal state in memory, and does not touch sk again;
+ * the updated key must be written back with xmss_signer_flush before the
+ * signatures it made are released.
+ * Returns NULL if the OID is unknown or memory runs out.
+ */
+xmss_signer *xmss_signer_load(const unsigned char *sk);
+
+/**
+ * As xmss_signer_load, for an XMSSMT secret key.
+ */
+xmss_signer *xmssmt_signer_load(const unsigned char *sk);
+
+/**
+ * As xmss_sign, using a loaded secret key.
+ */
+int xmss_signer_sign(xmss_signer *signer,
+                     unsigned char *sm, unsigned long long *smlen,
+                     const unsigned char *m, unsigned long long mlen);
+
+/**
+ * As xmss_sign_detached, using a loaded secret key.
+ */
+int xmss_signer_sign_detached(xmss_signer *signer,
+                              unsigned char *sig, unsigned long long *siglen,
+                              const unsigned char *m, unsigned long long mlen);
+
+/**
+ * As xmss_sign_detached_iov, using a loaded secret key.
+ */
+int xmss_signer_sign_detached_iov(xmss_signer *signer,
+                                  unsigned char *sig,
+                                  unsigned long long *siglen,
+                                  const struct iovec *iov,
+                                  unsigned int iovcnt);
+
+/**
+ * Starts a background thread that prepares the authentication paths and
+ * traversal updates of the next lookahead signatures of signer, so that
+ * signing only takes the WOTS signature on the message. A lookahead of 0
+ * stops it. xmss_signer_flush keeps writing the key as of the last signature
+ * handed out, so it must still be called before releasing that signature.
+ * This has no effect with the reference implementation (xmss_core.c).
+ * Returns -1 if the thread cannot be started.
+ */
+int xmss_signer_precompute(xmss_signer *signer, unsigned int lookahead);
+
+/**
+ * Makes signer keep the WOTS signatures and authentication paths of the
+ * layers above the lowest between signatures, if enable is set, so that the
+ * reference implementation (xmss_core.c) only recomputes those of the
+ * layers whose tree or leaf changed, rather than all d; if not, they are
+ * dropped. This takes (d - 1) * (wots_sig_bytes + tree_height * n) bytes.
+ * This has no effect with xmss_core_fast.c, whose BDS states hold them.
+ * Returns -1 if out of memory.
+ */
+int xmss_signer_cache(xmss_signer *signer, int enable);
+
+/**
+ * Makes signer compute the trees it needs on threads threads rather than on
+ * the calling thread only, which is the default; a value of 0 also means the
+ * calling thread only. Every signature then starts and joins its threads.
+ * This has no effect with xmss_core_fast.c, whose BDS states spread the
+ * computation of the trees over the signatures.
+ */
+void xmss_signer_threads(xmss_signer *signer, unsigned int threads);
+
+/**
+ * Writes the current state of the signer to the secret key sk, which
+ * already holds the OID.
+ */
+void xmss_signer_flush(const xmss_signer *signer, unsigned char *sk);
+
+/**
+ * Frees a signer. Any state that was not flushed is lost.
+ */
+void xmss_signer_free(xmss_signer *signer);
+
 #endif
@@ -1,10 +1,16 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "hash.h"
 #include "hash_address.h"
 #include "params.h"
+#include "threads.h"
 #include "wots.h"
 #include "utils.h"
 #include "xmss_commons.h"
@@ -15,7 +21,7 @@
  */
 static void l_tree(const xmss_params *params,
                    unsigned char *leaf, unsigned char *wots_pk,
-                   const unsigned char *pub_seed, uint32_t addr[8])
+                   const xmss_prf_ctx *pub_seed, uint32_t addr[8])
 {
     unsigned int l = params->wots_len;
     unsigned int parent_nodes;
@@ -48,13 +54,115 @@ static void l_tree(const xmss_params *params,
     memcpy(leaf, wots_pk, params->n);
 }
 
+/**
+ * Computes count leaf nodes from count WOTS public keys at once, as l_tree
+ * does for one. The k-th public key is at wots_pk + k*wots_sig_bytes, and its
+ * leaf is written to leaf + k*n. The L-trees all have the same shape, so
+ * they are processed level by level, with all hashes of a level in one batch.
+ * addr[k] has to contain the L-tree address of the k-th leaf.
+ * Note that this destroys the used WOTS public keys.
+ */
+static void l_tree_xn(const xmss_params *params,
+                      unsigned char *leaf, unsigned char *wots_pk,
+                      const xmss_prf_ctx *pub_seed, uint32_t addr[][8],
+                      unsigned int count)
+{
+    unsigned int l = params->wots_len;
+    unsigned int parent_nodes;
+    uint32_t node_addr[count * (params->wots_len >> 1)][8];
+    unsigned char *out[count * (params->wots_len >> 1)];
+    const unsigned char *in[count * (params->wots_len >> 1)];
+    unsigned char *pk;
+    uint32_t i, k, j;
+    uint32_t height = 0;
+
+    while (l > 1) {
+        parent_nodes = l >> 1;
+        j = 0;
+        for (k = 0; k < count; k++) {
+            pk = wots_pk + k*params->wots_sig_bytes;
+            for (i = 0; i < parent_nodes; i++) {
+                memcpy(node_addr[j], addr[k], sizeof(node_addr[j]));
+                set_tree_height(node_addr[j], height);
+                set_tree_index(node_addr[j], i);
+                /* Hashes the nodes at (i*2)*params->n and (i*2)*params->n + 1 */
+                out[j] = pk + i*params->n;
+                in[j] = pk + (i*2)*params->n;
+                j++;
+            }
+        }
+        thash_h_xn(params, out, in, pub_seed, node_addr, j);
+
+        for (k = 0; k < count; k++) {
+            pk = wots_pk + k*params->wots_sig_bytes;
+            /* If the row contained an odd number of nodes, the last node was
+               not hashed. Instead, we pull it up to the next layer. */
+            if (l & 1) {
+                memcpy(pk + (l >> 1)*params->n,
+                       pk + (l - 1)*params->n, params->n);
+            }
+        }
+        l = (l >> 1) + (l & 1);
+        height++;
+    }
+    for (k = 0; k < count; k++) {
+        memcpy(leaf + k*params->n,
+               wots_pk + k*params->wots_sig_bytes, params->n);
+    }
+}
+
+/**
+ * Computes count root nodes at once, as compute_root does for one. The k-th
+ * root is computed from the leaf at leaf + k*n, with index leafidx[k], and
+ * the authentication path auth_path[k], and written to root + k*n. The hashes
+ * of each level are made in one batch. addr[k] has to contain the hash tree
+ * address of the k-th subtree.
+ */
+static void compute_root_xn(const xmss_params *params, unsigned char *root,
+                            const unsigned char *leaf, const uint32_t *leafidx,
+                            const unsigned char *const auth_path[],
+                            const xmss_prf_ctx *pub_seed, uint32_t addr[][8],
+                            unsigned int count)
+{
+    unsigned char buffer[count][2*params->n];
+    unsigned char *out[count];
+    const unsigned char *in[count];
+    const unsigned char *node;
+    uint32_t idx;
+    uint32_t i, k;
+
+    for (i = 0; i < params->tree_height; i++) {
+        for (k = 0; k < count; k++) {
+            node = i == 0 ? leaf + k*params->n : root + k*params->n;
+            idx = leafidx[k] >> i;
+
+            /* If idx is odd, the node is a right child and the node of the
+               auth path goes left. Otherwise it is the other way around. */
+            if (idx & 1) {
+                memcpy(buffer[k], auth_path[k] + i*params->n, params->n);
+                memcpy(buffer[k] + params->n, node, params->n);
+            }
+            else {
+                memcpy(buffer[k], node, params->n);
+                memcpy(buffer[k] + params->n, auth_path[k] + i*params->n,
+                       params->n);
+            }
+            set_tree_height(addr[k], i);
+            set_tree_index(addr[k], idx >> 1);
+            out[k] = root + k*params->n;
+            in[k] = buffer[k];
+        }
+        thash_h_xn(params, out, in, pub_seed, addr, count);
+    }
+}
+
 /**
  * Computes a root node given a leaf and an auth path
  */
 static void compute_root(const xmss_params *params, unsigned char *root,
                          const unsigned char *leaf, unsigned long leafidx,
                          const unsigned char *auth_path,
-                         const unsigned char *pub_seed, uint32_t addr[8])
+                         const xmss_prf_ctx *pub_seed, uint32_t addr[8])
 {
     uint32_t i;
     unsigned char buffer[2*params->n];
@@ -102,7 +210,7 @@ static void compute_root(const xmss_params *params, unsigned char *root,
  * only require that addr encodes the right ltree-address.
  */
 void gen_leaf_wots(const xmss_params *params, unsigned char *leaf,
-                   const unsigned char *sk_seed, const unsigned char *pub_seed,
+                   const xmss_prf_ctx *sk_seed, const xmss_prf_ctx *pub_seed,
                    uint32_t ltree_addr[8], uint32_t ots_addr[8])
 {
     unsigned char seed[params->n];
@@ -114,6 +222,455 @@ void gen_leaf_wots(const xmss_params *params, unsigned char *leaf,
     l_tree(params, leaf, pk, pub_seed, ltree_addr);
 }
 
+/**
+ * Computes the count consecutive leaves idx, idx + 1, .. of the subtree that
+ * ltree_addr and ots_addr point to, and writes them to leaves, n bytes each.
+ * This gives the same result as count calls of gen_leaf_wots, but makes the
+ * WOTS and L-tree hash calls of all leaves in joint batches.
+ */
+void gen_leaves_wots(const xmss_params *params, unsigned char *leaves,
+                     const xmss_prf_ctx *sk_seed, const xmss_prf_ctx *pub_seed,
+                     const uint32_t ltree_addr[8], const uint32_t ots_addr[8],
+                     uint32_t idx, unsigned int count)
+{
+    unsigned char seeds[count * params->n];
+    unsigned char pks[count * params->wots_sig_bytes];
+    unsigned char addr_bytes[count][32];
+    unsigned char *seed_ptrs[count];
+    const unsigned char *addr_ptrs[count];
+    const xmss_prf_ctx *sk_seed_ptrs[count];
+    uint32_t leaf_ots_addr[count][8];
+    uint32_t leaf_ltree_addr[count][8];
+    unsigned int k;
+
+    for (k = 0; k < count; k++) {
+        memcpy(leaf_ots_addr[k], ots_addr, sizeof(leaf_ots_addr[k]));
+        set_ots_addr(leaf_ots_addr[k], idx + k);
+        memcpy(leaf_ltree_addr[k], ltree_addr, sizeof(leaf_ltree_addr[k]));
+        set_ltree_addr(leaf_ltree_addr[k], idx + k);
+
+        /* As in get_seed. */
+        set_chain_addr(leaf_ots_addr[k], 0);
+        set_hash_addr(leaf_ots_addr[k], 0);
+        set_key_and_mask(leaf_ots_addr[k], 0);
+        addr_to_bytes(addr_bytes[k], leaf_ots_addr[k]);
+
+        seed_ptrs[k] = seeds + k*params->n;
+        addr_ptrs[k] = addr_bytes[k];
+        sk_seed_ptrs[k] = sk_seed;
+    }
+    prf_xn(params, seed_ptrs, addr_ptrs, sk_seed_ptrs, count);
+
+    wots_pkgen_xn(params, pks, seeds, pub_seed,
+                  (const uint32_t (*)[8])leaf_ots_addr, count);
+
+    l_tree_xn(params, leaves, pks, pub_seed, leaf_ltree_addr, count);
+}
+
+/**
+ * Merges the 2^(height - base) consecutive nodes at height base of a subtree,
+ * the leftmost of which has index idx on that level, into their common
+ * ancestor at the given height, which is written to root. If nodes is NULL,
+ * base must be 0 and the leaves are computed on the fly.
+ * Calls store (if not NULL) for both children of every merge, left first.
+ */
+static void merge_nodes(const xmss_params *params, unsigned char *root,
+                        const unsigned char *nodes,
+                        unsigned int base, unsigned int height, uint32_t idx,
+                        const xmss_prf_ctx *sk_seed,
+                        const xmss_prf_ctx *pub_seed,
+                        const uint32_t subtree_addr[8],
+                        xmss_node_fn store, void *store_ctx)
+{
+    unsigned char stack[(height - base + 1)*params->n];
+    unsigned int heights[height - base + 1];
+    unsigned int offset = 0;
+    unsigned char leaves[XMSS_LEAF_BATCH * params->n];
+    const unsigned char *node;
+    uint32_t count = (uint32_t)1 << (height - base);
+    uint32_t batch;
+    uint32_t node_idx;
+    uint32_t i;
+
+    uint32_t ots_addr[8] = {0};
+    uint32_t ltree_addr[8] = {0};
+    uint32_t node_addr[8] = {0};
+
+    copy_subtree_addr(ots_addr, subtree_addr);
+    copy_subtree_addr(ltree_addr, subtree_addr);
+    copy_subtree_addr(node_addr, subtree_addr);
+
+    set_type(ots_addr, XMSS_ADDR_TYPE_OTS);
+    set_type(ltree_addr, XMSS_ADDR_TYPE_LTREE);
+    set_type(node_addr, XMSS_ADDR_TYPE_HASHTREE);
+
+    for (i = 0; i < count; i++) {
+        if (nodes != NULL) {
+            node = nodes + i*params->n;
+        }
+        else {
+            if (i % XMSS_LEAF_BATCH == 0) {
+                batch = count - i;
+                if (batch > XMSS_LEAF_BATCH) {
+                    batch = XMSS_LEAF_BATCH;
+                }
+                gen_leaves_wots(params, leaves, sk_seed, pub_seed,
+                                ltree_addr, ots_addr, idx + i, batch);
+            }
+            node = leaves + (i % XMSS_LEAF_BATCH)*params->n;
+        }
+        memcpy(stack + offset*params->n, node, params->n);
+        heights[offset] = base;
+        offset++;
+
+        while (offset >= 2 && heights[offset - 1] == heights[offset - 2]) {
+            node_idx = (idx + i) >> (heights[offset - 1] - base);
+            if (store != NULL) {
+                store(store_ctx, heights[offset - 1], node_idx - 1,
+                      stack + (offset - 2)*params->n);
+                store(store_ctx, heights[offset - 1], node_idx,
+                      stack + (offset - 1)*params->n);
+            }
+            set_tree_height(node_addr, heights[offset - 1]);
+            set_tree_index(node_addr, node_idx >> 1);
+            thash_h(params, stack + (offset - 2)*params->n,
+                    stack + (offset - 2)*params->n, pub_seed, node_addr);
+            offset--;
+            heights[offset - 1]++;
+        }
+    }
+    memcpy(root, stack, params->n);
+}
+
+/* The magic string that checkpoint files start with. */
+#define XMSS_CHECKPOINT_MAGIC "XMSSKGC1"
+/* The header also holds 8 four-byte fields and the eight-byte sk size. */
+#define XMSS_CHECKPOINT_HEADER_BYTES (8 + 8*4 + 8)
+
+/* Writes the header of a checkpoint file. */
+static void checkpoint_header(const xmss_params *params, unsigned char *buf,
+                              uint32_t nparts, uint32_t done)
+{
+    memcpy(buf, XMSS_CHECKPOINT_MAGIC, 8);
+    ull_to_bytes(buf + 8, 4, params->func);
+    ull_to_bytes(buf + 12, 4, params->n);
+    ull_to_bytes(buf + 16, 4, params->wots_w);
+    ull_to_bytes(buf + 20, 4, params->full_height);
+    ull_to_bytes(buf + 24, 4, params->d);
+    ull_to_bytes(buf + 28, 4, params->bds_k);
+    ull_to_bytes(buf + 32, 4, nparts);
+    ull_to_bytes(buf + 36, 4, done);
+    ull_to_bytes(buf + 40, 8, params->sk_bytes);
+}
+
+/* Reads len bytes from fd, or returns -1. */
+static int read_all(int fd, unsigned char *buf, unsigned long long len)
+{
+    ssize_t r;
+
+    while (len > 0) {
+        r = read(fd, buf, len);
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        if (r <= 0) {
+            return -1;
+        }
+        buf += r;
+        len -= r;
+    }
+    return 0;
+}
+
+/* Writes len bytes to fd, or returns -1. */
+static int write_all(int fd, const unsigned char *buf, unsigned long long len)
+{
+    ssize_t r;
+
+    while (len > 0) {
+        r = write(fd, buf, len);
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        if (r <= 0) {
+            return -1;
+        }
+        buf += r;
+        len -= r;
+    }
+    return 0;
+}
+
+/**
+ * Reads the checkpoint file at path, if it exists, for a key with the given
+ * parameters. Reads the partial secret key into sk, and unless parts is NULL,
+ * the number of finished parts into done and their roots into parts.
+ * Returns 1 if the checkpoint was read, 0 if there is none, and -1 if it
+ * cannot be read or belongs to other parameters or another split.
+ */
+static int checkpoint_read(const xmss_params *params, const char *path,
+                           unsigned char *sk, unsigned char *parts,
+                           uint32_t nparts, uint32_t *done)
+{
+    unsigned char header[XMSS_CHECKPOINT_HEADER_BYTES];
+    unsigned char expected[XMSS_CHECKPOINT_HEADER_BYTES];
+    uint32_t saved_nparts, saved_done;
+    int fd;
+    int ret = -1;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return errno == ENOENT ? 0 : -1;
+    }
+    if (read_all(fd, header, sizeof(header))) {
+        goto out;
+    }
+    saved_nparts = bytes_to_ull(header + 32, 4);
+    saved_done = bytes_to_ull(header + 36, 4);
+
+    /* Everything but the split and the progress must match. */
+    checkpoint_header(params, expected, saved_nparts, saved_done);
+    if (memcmp(header, expected, sizeof(header)) || saved_done > saved_nparts) {
+        goto out;
+    }
+    if (read_all(fd, sk, params->sk_bytes)) {
+        goto out;
+    }
+    if (parts != NULL) {
+        if (saved_nparts != nparts ||
+                read_all(fd, parts, (unsigned long long)saved_done * params->n)) {
+            goto out;
+        }
+        *done = saved_done;
+    }
+    ret = 1;
+out:
+    close(fd);
+    return ret;
+}
+
+/**
+ * Atomically replaces the checkpoint file at path with one that holds the
+ * partial secret key sk and the roots of the first done of nparts parts.
+ */
+static int checkpoint_write(const xmss_params *params, const char *path,
+                            const unsigned char *sk, const unsigned char *parts,
+                            uint32_t nparts, uint32_t done)
+{
+    unsigned char header[XMSS_CHECKPOINT_HEADER_BYTES];
+    char tmp_path[strlen(path) + 5];
+    int fd;
+
+    checkpoint_header(params, header, nparts, done);
+    strcpy(tmp_path, path);
+    strcat(tmp_path, ".tmp");
+
+    fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        return -1;
+    }
+    if (write_all(fd, header, sizeof(header)) ||
+            write_all(fd, sk, params->sk_bytes) ||
+            write_all(fd, parts, (unsigned long long)done * params->n) ||
+            fsync(fd)) {
+        close(fd);
+        unlink(tmp_path);
+        return -1;
+    }
+    close(fd);
+    if (rename(tmp_path, path)) {
+        unlink(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * If opts names a checkpoint file that exists, reads the seed of the key in
+ * it, as [SK_SEED || SK_PRF || PUB_SEED], so that key generation can resume.
+ * Returns 1 if so, 0 if there is nothing to resume, and -1 if the checkpoint
+ * cannot be used.
+ */
+int keygen_checkpoint_seed(const xmss_params *params, unsigned char *seed,
+                           const xmss_keygen_opts *opts)
+{
+    unsigned char *sk;
+    int ret;
+
+    if (opts == NULL || opts->checkpoint_file == NULL) {
+        return 0;
+    }
+    sk = malloc(params->sk_bytes);
+    if (sk == NULL) {
+        return -1;
+    }
+    ret = checkpoint_read(params, opts->checkpoint_file, sk, NULL, 0, NULL);
+    if (ret == 1) {
+        memcpy(seed, sk + params->index_bytes, 2 * params->n);
+        memcpy(seed + 2 * params->n,
+               sk + params->index_bytes + 3 * params->n, params->n);
+    }
+    free(sk);
+    return ret;
+}
+
+static double seconds_since(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+struct treehash_roots_job {
+    const xmss_params *params;
+    unsigned char *parts;
+    unsigned int split;
+    uint32_t first;
+    const xmss_prf_ctx *sk_seed;
+    const xmss_prf_ctx *pub_seed;
+    const uint32_t (*subtree_addr)[8];
+    xmss_node_fn store;
+    void *const *store_ctx;
+};
+
+/* Computes the root of part p % 2^split of subtree p / 2^split, where p is
+   the i-th part of the current round. */
+static void treehash_part(void *arg, unsigned int i)
+{
+    const struct treehash_roots_job *job = arg;
+    const xmss_params *params = job->params;
+    unsigned int height = params->tree_height - job->split;
+    uint32_t p = job->first + i;
+    unsigned int tree = p >> job->split;
+    uint32_t part = p & ((1U << job->split) - 1);
+
+    merge_nodes(params, job->parts + p*params->n, NULL, 0, height,
+                part << height, job->sk_seed, job->pub_seed,
+                job->subtree_addr[tree], job->store,
+                job->store != NULL ? job->store_ctx[tree] : NULL);
+}
+
+/**
+ * Computes the root nodes of the count subtrees whose layer and tree address
+ * parts are given by subtree_addr, and writes them to roots, n bytes each.
+ * Every subtree is split into 2^j parts of equal height, whose roots are
+ * computed by up to params->threads threads; the top j levels are then merged
+ * on the calling thread. The result does not depend on the number of threads.
+ * If store is not NULL, store(store_ctx[k], ..) is called for every child
+ * node in subtree k as it is merged; calls for different nodes may be
+ * made concurrently and in any order.
+ * If opts is not NULL, the parts are computed in rounds, after which progress
+ * is reported and the partial secret key sk (which the store calls may write
+ * to) is checkpointed as opts asks for. Returns -1 if the checkpoint cannot
+ * be read or written, and 0 otherwise.
+ */
+int treehash_roots(const xmss_params *params, unsigned char *roots,
+                   const xmss_prf_ctx *sk_seed, const xmss_prf_ctx *pub_seed,
+                   const uint32_t subtree_addr[][8], unsigned int count,
+                   xmss_node_fn store, void *const store_ctx[],
+                   unsigned char *sk, const xmss_keygen_opts *opts)
+{
+    struct treehash_roots_job job;
+    struct timespec start, last_write;
+    unsigned char *parts;
+    unsigned int split = 0;
+    unsigned int part_height;
+    uint32_t nparts, done = 0, done_at_start, round;
+    unsigned int k;
+    int ret = 0;
+
+    if (opts != NULL) {
+        /* A checkpoint must remain usable with another number of threads, so
+           the parts have a fixed height here. */
+        if (params->tree_height > XMSS_KEYGEN_PART_HEIGHT) {
+            split = params->tree_height - XMSS_KEYGEN_PART_HEIGHT;
+        }
+    }
+    else {
+        /* Make enough parts to keep all threads busy until the end, as long
+           as each part still fills the leaf batches. */
+        while (params->threads > 1 && (count << split) < 4 * params->threads &&
+               (1U << (params->tree_height - split)) > XMSS_LEAF_BATCH) {
+            split++;
+        }
+    }
+    part_height = params->tree_height - split;
+    nparts = count << split;
+
+    parts = malloc((unsigned long long)nparts * params->n);
+    if (parts == NULL) {
+        return -1;
+    }
+
+    if (opts != NULL && opts->checkpoint_file != NULL) {
+        if (checkpoint_read(params, opts->checkpoint_file, sk,
+                            parts, nparts, &done) < 0) {
+            ret = -1;
+            goto out;
+        }
+    }
+
+    job.params = params;
+    job.parts = parts;
+    job.split = split;
+    job.sk_seed = sk_seed;
+    job.pub_seed = pub_seed;
+    job.subtree_addr = subtree_addr;
+    job.store = store;
+    job.store_ctx = store_ctx;
+
+    /* Without opts there is no reason to stop in between. */
+    round = opts != NULL && params->threads > 0 ? params->threads : nparts;
+    done_at_start = done;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    last_write = start;
+
+    while (done < nparts) {
+        job.first = done;
+        if (round > nparts - done) {
+            round = nparts - done;
+        }
+        xmss_parallel_for(params->threads, round, treehash_part, &job);
+        done += round;
+
+        if (opts == NULL) {
+            continue;
+        }
+        if (opts->checkpoint_file != NULL && done < nparts &&
+                seconds_since(&last_write) >= opts->checkpoint_interval) {
+            if (checkpoint_write(params, opts->checkpoint_file,
+                                 sk, parts, nparts, done)) {
+                ret = -1;
+                goto out;
+            }
+            clock_gettime(CLOCK_MONOTONIC, &last_write);
+        }
+        if (opts->progress != NULL) {
+            opts->progress(opts->progress_ctx,
+                           (unsigned long long)done << part_height,
+                           (unsigned long long)nparts << part_height,
+                           seconds_since(&start) * (nparts - done)
+                               / (done - done_at_start));
+        }
+    }
+
+    for (k = 0; k < count; k++) {
+        merge_nodes(params, roots + k*params->n,
+                    parts + (k << split)*params->n,
+                    part_height, params->tree_height, 0,
+                    sk_seed, pub_seed, subtree_addr[k],
+                    store, store != NULL ? store_ctx[k] : NULL);
+    }
+
+    if (opts != NULL && opts->checkpoint_file != NULL) {
+        unlink(opts->checkpoint_file);
+    }
+out:
+    free(parts);
+    return ret;
+}
+
 /**
  * Used for pseudo-random key generation.
  * Generates the seed for the WOTS key pair at address 'addr'.
@@ -121,7 +678,7 @@ void gen_leaf_wots(const xmss_params *params, unsigned char *leaf,
  * Takes n-byte sk_seed and returns n-byte seed using 32 byte address 'addr'.
  */
 void get_seed(const xmss_params *params, unsigned char *seed,
-              const unsigned char *sk_seed, uint32_t addr[8])
+              const xmss_prf_ctx *sk_seed, uint32_t addr[8])
 {
     unsigned char bytes[32];
 
@@ -151,6 +708,34 @@ int xmss_core_sign_open(const xmss_params *params,
     return xmssmt_core_sign_open(params, m, mlen, sm, smlen, pk);
 }
 
+/**
+ * Verifies a detached signature on the concatenation of the iovcnt buffers
+ * in m under a given public key [root || PUB_SEED].
+ */
+int xmss_core_verify_detached(const xmss_params *params,
+                              const unsigned char *sig,
+                              unsigned long long siglen,
+                              const struct iovec *m, unsigned int iovcnt,
+                              const unsigned char *pk)
+{
+    return xmssmt_core_verify_detached(params, sig, siglen, m, iovcnt, pk);
+}
+
+/**
+ * Verifies count detached signatures under a given public key
+ * [root || PUB_SEED], as xmssmt_core_verify_batch does.
+ */
+int xmss_core_verify_batch(const xmss_params *params, int *results,
+                           const unsigned char *const sigs[],
+                           const unsigned long long siglens[],
+                           const unsigned char *const ms[],
+                           const unsigned long long mlens[],
+                           unsigned int count, const unsigned char *pk)
+{
+    return xmssmt_core_verify_batch(params, results, sigs, siglens, ms, mlens,
+                                    count, pk);
+}
+
 /**
  * Verifies a given message signature pair under a given public key.
  * Note that this assumes a pk without an OID, i.e. [root || PUB_SEED]
@@ -159,9 +744,45 @@ int xmssmt_core_sign_open(const xmss_params *params,
                           unsigned char *m, unsigned long long *mlen,
                           const unsigned char *sm, unsigned long long smlen,
                           const unsigned char *pk)
+{
+    struct iovec iov;
+
+    if (smlen < params->sig_bytes) {
+        *mlen = 0;
+        return -1;
+    }
+    *mlen = smlen - params->sig_bytes;
+
+    /* The message is hashed where it is, following the signature. */
+    iov.iov_base = (void *)(sm + params->sig_bytes);
+    iov.iov_len = *mlen;
+
+    if (xmssmt_core_verify_detached(params, sm, params->sig_bytes,
+                                    &iov, 1, pk)) {
+        /* If verification failed, zero the message. */
+        memset(m, 0, *mlen);
+        *mlen = 0;
+        return -1;
+    }
+
+    /* If verification was successful, copy the message from the signature. */
+    memcpy(m, sm + params->sig_bytes, *mlen);
+
+    return 0;
+}
+
+/**
+ * Verifies a detached signature on the concatenation of the iovcnt buffers
+ * in m under a given public key [root || PUB_SEED].
+ */
+int xmssmt_core_verify_detached(const xmss_params *params,
+                                const unsigned char *sig,
+                                unsigned long long siglen,
+                                const struct iovec *m, unsigned int iovcnt,
+                                const unsigned char *pk)
 {
     const unsigned char *pub_root = pk;
-    const unsigned char *pub_seed = pk + params->n;
+    xmss_prf_ctx pub_seed;
     unsigned char wots_pk[params->wots_sig_bytes];
     unsigned char leaf[params->n];
     unsigned char root[params->n];
@@ -174,23 +795,23 @@ int xmssmt_core_sign_open(const xmss_params *params,
     uint32_t ltree_addr[8] = {0};
     uint32_t node_addr[8] = {0};
 
+    if (siglen != params->sig_bytes) {
+        return -1;
+    }
+
     set_type(ots_addr, XMSS_ADDR_TYPE_OTS);
     set_type(ltree_addr, XMSS_ADDR_TYPE_LTREE);
     set_type(node_addr, XMSS_ADDR_TYPE_HASHTREE);
 
-    *mlen = smlen - params->sig_bytes;
+    prf_ctx_init(params, &pub_seed, pk + params->n);
 
     /* Convert the index bytes from the signature to an integer. */
-    idx = bytes_to_ull(sm, params->index_bytes);
-
-    /* Put the message all the way at the end of the m buffer, so that we can
-     * prepend the required other inputs for the hash function. */
-    memcpy(m + params->sig_bytes, sm + params->sig_bytes, *mlen);
+    idx = bytes_to_ull(sig, params->index_bytes);
 
     /* Compute the message hash. */
-    hash_message(params, mhash, sm + params->index_bytes, pk, idx,
-                 m + params->sig_bytes - 4*params->n, *mlen);
-    sm += params->index_bytes + params->n;
+    hash_message_iov(params, mhash, sig + params->index_bytes, pk, idx,
+                     m, iovcnt);
+    sig += params->index_bytes + params->n;
 
     /* For each subtree.. */
     for (i = 0; i < params->d; i++) {
@@ -209,28 +830,124 @@ int xmssmt_core_sign_open(const xmss_params *params,
         set_ots_addr(ots_addr, idx_leaf);
         /* Initially, root = mhash, but on subsequent iterations it is the root
            of the subtree below the currently processed subtree. */
-        wots_pk_from_sig(params, wots_pk, sm, root, pub_seed, ots_addr);
-        sm += params->wots_sig_bytes;
+        wots_pk_from_sig(params, wots_pk, sig, root, &pub_seed, ots_addr);
+        sig += params->wots_sig_bytes;
 
         /* Compute the leaf node using the WOTS public key. */
         set_ltree_addr(ltree_addr, idx_leaf);
-        l_tree(params, leaf, wots_pk, pub_seed, ltree_addr);
+        l_tree(params, leaf, wots_pk, &pub_seed, ltree_addr);
 
         /* Compute the root node of this subtree. */
-        compute_root(params, root, leaf, idx_leaf, sm, pub_seed, node_addr);
-        sm += params->tree_height*params->n;
+        compute_root(params, root, leaf, idx_leaf, sig, &pub_seed, node_addr);
+        sig += params->tree_height*params->n;
     }
 
     /* Check if the root node equals the root node in the public key. */
     if (memcmp(root, pub_root, params->n)) {
-        /* If not, zero the message */
-        memset(m, 0, *mlen);
-        *mlen = 0;
         return -1;
     }
 
-    /* If verification was successful, copy the message from the signature. */
-    memcpy(m, sm, *mlen);
-
     return 0;
 }
+
+/**
+ * Verifies count detached signatures under a given public key
+ * [root || PUB_SEED]: signature k is sigs[k], of siglens[k] bytes, on the
+ * mlens[k] bytes at ms[k]. Sets results[k] to 0 if it is valid and to -1
+ * otherwise. The signatures are verified XMSS_VERIFY_BATCH at a time, and the
+ * WOTS chains, L-trees and authentication paths of a group are computed
+ * layer by layer in joint batches; only the message hashes are computed one
+ * by one. Returns 0 if all signatures are valid, -1 otherwise.
+ */
+int xmssmt_core_verify_batch(const xmss_params *params, int *results,
+                             const unsigned char *const sigs[],
+                             const unsigned long long siglens[],
+                             const unsigned char *const ms[],
+                             const unsigned long long mlens[],
+                             unsigned int count, const unsigned char *pk)
+{
+    const unsigned int layer_bytes = params->wots_sig_bytes
+                                     + params->tree_height * params->n;
+    xmss_prf_ctx pub_seed;
+    unsigned char wots_pks[XMSS_VERIFY_BATCH * params->wots_sig_bytes];
+    unsigned char leaves[XMSS_VERIFY_BATCH * params->n];
+    /* Initially the message hashes, then the roots of the layer below. */
+    unsigned char roots[XMSS_VERIFY_BATCH * params->n];
+    const unsigned char *auth_paths[XMSS_VERIFY_BATCH];
+    unsigned long long idx[XMSS_VERIFY_BATCH];
+    uint32_t idx_leaf[XMSS_VERIFY_BATCH];
+    unsigned int items[XMSS_VERIFY_BATCH];
+    uint32_t ots_addr[XMSS_VERIFY_BATCH][8];
+    uint32_t ltree_addr[XMSS_VERIFY_BATCH][8];
+    uint32_t node_addr[XMSS_VERIFY_BATCH][8];
+    struct iovec iov;
+    unsigned int first, active, i, k;
+    int ret = 0;
+
+    prf_ctx_init(params, &pub_seed, pk + params->n);
+
+    for (first = 0; first < count; first += XMSS_VERIFY_BATCH) {
+        /* Collect the signatures of this group that are well-formed. */
+        active = 0;
+        for (k = first; k < count && k < first + XMSS_VERIFY_BATCH; k++) {
+            results[k] = -1;
+            if (siglens[k] != params->sig_bytes) {
+                continue;
+            }
+            items[active] = k;
+            idx[active] = bytes_to_ull(sigs[k], params->index_bytes);
+            iov.iov_base = (void *)ms[k];
+            iov.iov_len = mlens[k];
+            hash_message_iov(params, roots + active*params->n,
+                             sigs[k] + params->index_bytes, pk, idx[active],
+                             &iov, 1);
+            active++;
+        }
+
+        /* For each subtree, in all signatures of the group.. */
+        for (i = 0; active > 0 && i < params->d; i++) {
+            for (k = 0; k < active; k++) {
+                idx_leaf[k] = (idx[k] & ((1 << params->tree_height)-1));
+                idx[k] = idx[k] >> params->tree_height;
+
+                memset(ots_addr[k], 0, sizeof(ots_addr[k]));
+                set_layer_addr(ots_addr[k], i);
+                set_tree_addr(ots_addr[k], idx[k]);
+                memcpy(ltree_addr[k], ots_addr[k], sizeof(ltree_addr[k]));
+                memcpy(node_addr[k], ots_addr[k], sizeof(node_addr[k]));
+                set_type(ots_addr[k], XMSS_ADDR_TYPE_OTS);
+                set_type(ltree_addr[k], XMSS_ADDR_TYPE_LTREE);
+                set_type(node_addr[k], XMSS_ADDR_TYPE_HASHTREE);
+                set_ots_addr(ots_addr[k], idx_leaf[k]);
+                set_ltree_addr(ltree_addr[k], idx_leaf[k]);
+
+                memcpy(wots_pks + k*params->wots_sig_bytes,
+                       sigs[items[k]] + params->index_bytes + params->n
+                       + i*layer_bytes, params->wots_sig_bytes);
+                auth_paths[k] = sigs[items[k]] + params->index_bytes
+                                + params->n + i*layer_bytes
+                                + params->wots_sig_bytes;
+            }
+
+            /* The WOTS public keys are only correct if the signatures
+               were correct. */
+            wots_pk_from_sig_xn(params, wots_pks, wots_pks, roots, &pub_seed,
+                                (const uint32_t (*)[8])ots_addr, active);
+            l_tree_xn(params, leaves, wots_pks, &pub_seed, ltree_addr,
+                      active);
+            compute_root_xn(params, roots, leaves, idx_leaf, auth_paths,
+                            &pub_seed, node_addr, active);
+        }
+
+        /* Check if the root nodes equal the root node in the public key. */
+        for (k = 0; k < active; k++) {
+            results[items[k]] = memcmp(roots + k*params->n, pk, params->n)
+                                ? -1 : 0;
+        }
+        for (k = first; k < count && k < first + XMSS_VERIFY_BATCH; k++) {
+            ret |= results[k];
+        }
+    }
+
+    return ret;
+}
@@ -2,7 +2,9 @@
 #define XMSS_COMMONS_H
 
 #include <stdint.h>
+#include <sys/uio.h>
 #include "params.h"
+#include "hash.h"
 
 /**
  * Computes the leaf at a given address. First generates the WOTS key pair,
@@ -10,9 +12,78 @@
  * only require that addr encodes the right ltree-address.
  */
 void gen_leaf_wots(const xmss_params *params, unsigned char *leaf,
-                   const unsigned char *sk_seed, const unsigned char *pub_seed,
+                   const xmss_prf_ctx *sk_seed, const xmss_prf_ctx *pub_seed,
                    uint32_t ltree_addr[8], uint32_t ots_addr[8]);
 
+/**
+ * The number of consecutive leaves that treehash computes at once using
+ * gen_leaves_wots; this fills the widest multi-buffer SHA-256 engine during
+ * the L-tree computations as well.
+ */
+#define XMSS_LEAF_BATCH 16
+
+/**
+ * The number of signatures that xmss[mt]_core_verify_batch verifies at once.
+ * Even a single WOTS signature fills the lanes during the chains, but the
+ * authentication paths take one hash per level, which only the signatures
+ * of a group together fill the lanes with.
+ */
+#define XMSS_VERIFY_BATCH 16
+
+/**
+ * Computes the count consecutive leaves idx, idx + 1, .. of the subtree that
+ * ltree_addr and ots_addr point to, and writes them to leaves, n bytes each.
+ * This gives the same result as count calls of gen_leaf_wots, but makes the
+ * WOTS and L-tree hash calls of all leaves in joint batches.
+ */
+void gen_leaves_wots(const xmss_params *params, unsigned char *leaves,
+                     const xmss_prf_ctx *sk_seed, const xmss_prf_ctx *pub_seed,
+                     const uint32_t ltree_addr[8], const uint32_t ots_addr[8],
+                     uint32_t idx, unsigned int count);
+
+/**
+ * Receives a child node of a subtree from treehash_roots, along with its
+ * height and its index on that level, just before it is merged; the left
+ * child first, then the right one.
+ */
+typedef void (*xmss_node_fn)(void *ctx, unsigned int height, uint32_t index,
+                             const unsigned char *node);
+
+/**
+ * The height of the parts that treehash_roots splits subtrees into when it
+ * checkpoints or reports progress.
+ */
+#define XMSS_KEYGEN_PART_HEIGHT 8
+
+/**
+ * Computes the root nodes of the count subtrees whose layer and tree address
+ * parts are given by subtree_addr, and writes them to roots, n bytes each.
+ * Every subtree is split into 2^j parts of equal height, whose roots are
+ * computed by up to params->threads threads; the top j levels are then merged
+ * on the calling thread. The result does not depend on the number of threads.
+ * If store is not NULL, store(store_ctx[k], ..) is called for every child
+ * node in subtree k as it is merged; calls for different nodes may be
+ * made concurrently and in any order.
+ * If opts is not NULL, the parts are computed in rounds, after which progress
+ * is reported and the partial secret key sk (which the store calls may write
+ * to) is checkpointed as opts asks for. Returns -1 if the checkpoint cannot
+ * be read or written, and 0 otherwise.
+ */
+int treehash_roots(const xmss_params *params, unsigned char *roots,
+                   const xmss_prf_ctx *sk_seed, const xmss_prf_ctx *pub_seed,
+                   const uint32_t subtree_addr[][8], unsigned int count,
+                   xmss_node_fn store, void *const store_ctx[],
+                   unsigned char *sk, const xmss_keygen_opts *opts);
+
+/**
+ * If opts names a checkpoint file that exists, reads the seed of the key in
+ * it, as [SK_SEED || SK_PRF || PUB_SEED], so that key generation can resume.
+ * Returns 1 if so, 0 if there is nothing to resume, and -1 if the checkpoint
+ * cannot be used.
+ */
+int keygen_checkpoint_seed(const xmss_params *params, unsigned char *seed,
+                           const xmss_keygen_opts *opts);
+
 /**
  * Used for pseudo-random key generation.
  * Generates the seed for the WOTS key pair at address 'addr'.
@@ -20,7 +91,7 @@ void gen_leaf_wots(const xmss_params *params, unsigned char *leaf,
  * Takes n-byte sk_seed and returns n-byte seed using 32 byte address 'addr'.
  */
 void get_seed(const xmss_params *params, unsigned char *seed,
-              const unsigned char *sk_seed, uint32_t addr[8]);
+              const xmss_prf_ctx *sk_seed, uint32_t addr[8]);
 
 /**
  * Verifies a given message signature pair under a given public key.
@@ -31,6 +102,31 @@ int xmss_core_sign_open(const xmss_params *params,
                         const unsigned char *sm, unsigned long long smlen,
                         const unsigned char *pk);
 
+/**
+ * Verifies a detached signature on the concatenation of the iovcnt buffers
+ * in m under a given public key [root || PUB_SEED].
+ */
+int xmss_core_verify_detached(const xmss_params *params,
+                              const unsigned char *sig,
+                              unsigned long long siglen,
+                              const struct iovec *m, unsigned int iovcnt,
+                              const unsigned char *pk);
+
+/**
+ * Verifies count detached signatures under a given public key
+ * [root || PUB_SEED]: signature k is sigs[k], of siglens[k] bytes, on the
+ * mlens[k] bytes at ms[k]. Sets results[k] to 0 if it is valid and to -1
+ * otherwise. The signatures are verified XMSS_VERIFY_BATCH at a time, with
+ * the WOTS, L-tree and hash tree calls of each group in joint batches.
+ * Returns 0 if all signatures are valid, -1 otherwise.
+ */
+int xmss_core_verify_batch(const xmss_params *params, int *results,
+                           const unsigned char *const sigs[],
+                           const unsigned long long siglens[],
+                           const unsigned char *const ms[],
+                           const unsigned long long mlens[],
+                           unsigned int count, const unsigned char *pk);
+
 /**
  * Verifies a given message signature pair under a given public key.
  * Note that this assumes a pk without an OID, i.e. [root || PUB_SEED]
@@ -39,4 +135,23 @@ int xmssmt_core_sign_open(const xmss_params *params,
                           unsigned char *m, unsigned long long *mlen,
                           const unsigned char *sm, unsigned long long smlen,
                           const unsigned char *pk);
+
+/**
+ * As xmss_core_verify_detached, for XMSSMT.
+ */
+int xmssmt_core_verify_detached(const xmss_params *params,
+                                const unsigned char *sig,
+                                unsigned long long siglen,
+                                const struct iovec *m, unsigned int iovcnt,
+                                const unsigned char *pk);
+
+/**
+ * As xmss_core_verify_batch, for XMSSMT.
+ */
+int xmssmt_core_verify_batch(const xmss_params *params, int *results,
+                             const unsigned char *const sigs[],
+                             const unsigned long long siglens[],
+                             const unsigned char *const ms[],
+                             const unsigned long long mlens[],
+                             unsigned int count, const unsigned char *pk);
 #endif
@@ -18,13 +18,15 @@
  */
 static void treehash(const xmss_params *params,
                      unsigned char *root, unsigned char *auth_path,
-                     const unsigned char *sk_seed,
-                     const unsigned char *pub_seed,
+                     const xmss_prf_ctx *sk_seed,
+                     const xmss_prf_ctx *pub_seed,
                      uint32_t leaf_idx, const uint32_t subtree_addr[8])
 {
     unsigned char stack[(params->tree_height+1)*params->n];
     unsigned int heights[params->tree_height+1];
     unsigned int offset = 0;
+    unsigned char leaves[XMSS_LEAF_BATCH * params->n];
+    unsigned int batch = 0;
 
     /* The subtree has at most 2^20 leafs, so uint32_t suffices. */
     uint32_t idx;
@@ -45,11 +47,19 @@ static void treehash(const xmss_params *params,
     set_type(node_addr, XMSS_ADDR_TYPE_HASHTREE);
 
     for (idx = 0; idx < (uint32_t)(1 << params->tree_height); idx++) {
+        /* The leaves are computed in batches, but merged one by one. */
+        if (idx % XMSS_LEAF_BATCH == 0) {
+            batch = (1 << params->tree_height) - idx;
+            if (batch > XMSS_LEAF_BATCH) {
+                batch = XMSS_LEAF_BATCH;
+            }
+            gen_leaves_wots(params, leaves, sk_seed, pub_seed,
+                            ltree_addr, ots_addr, idx, batch);
+        }
+
         /* Add the next leaf node to the stack. */
-        set_ltree_addr(ltree_addr, idx);
-        set_ots_addr(ots_addr, idx);
-        gen_leaf_wots(params, stack + offset*params->n,
-                      sk_seed, pub_seed, ltree_addr, ots_addr);
+        memcpy(stack + offset*params->n,
+               leaves + (idx % XMSS_LEAF_BATCH)*params->n, params->n);
         offset++;
         heights[offset - 1] = 0;
 
@@ -85,6 +95,45 @@ static void treehash(const xmss_params *params,
     memcpy(root, stack, params->n);
 }
 
+/*
+ * Derives a key pair from a 3*n byte seed [SK_SEED || SK_PRF || PUB_SEED],
+ * reporting progress and checkpointing as opts asks for, if not NULL.
+ */
+static int seed_keypair(const xmss_params *params,
+                        unsigned char *pk, unsigned char *sk,
+                        const unsigned char *seed,
+                        const xmss_keygen_opts *opts)
+{
+    xmss_prf_ctx sk_seed;
+    xmss_prf_ctx pub_seed;
+    unsigned char *sk_start = sk;
+    uint32_t top_tree_addr[8] = {0};
+    set_layer_addr(top_tree_addr, params->d - 1);
+
+    /* Initialize index to 0. */
+    memset(sk, 0, params->index_bytes);
+    sk += params->index_bytes;
+
+    /* Initialize SK_SEED and SK_PRF. */
+    memcpy(sk, seed, 2 * params->n);
+
+    /* Initialize PUB_SEED. */
+    memcpy(sk + 3 * params->n, seed + 2 * params->n, params->n);
+    memcpy(pk + params->n, sk + 3*params->n, params->n);
+
+    /* Compute root node of the top-most subtree, on all threads. */
+    prf_ctx_init(params, &sk_seed, sk);
+    prf_ctx_init(params, &pub_seed, pk + params->n);
+    if (treehash_roots(params, pk, &sk_seed, &pub_seed,
+                       (const uint32_t (*)[8])&top_tree_addr, 1, NULL, NULL,
+                       sk_start, opts)) {
+        return -1;
+    }
+    memcpy(sk + 2*params->n, pk, params->n);
+
+    return 0;
+}
+
 /**
  * Given a set of parameters, this function returns the size of the secret key.
  * This is implementation specific, as varying choices in tree traversal will
@@ -95,6 +144,83 @@ unsigned long long xmss_xmssmt_core_sk_bytes(const xmss_params *params)
     return params->index_bytes + 4 * params->n;
 }
 
+/**
+ * Completes params for the secret key sk. This implementation does not keep
+ * a BDS state, so there is nothing to read from sk; this always returns 0.
+ */
+int xmss_xmssmt_core_sk_params(xmss_params *params, const unsigned char *sk)
+{
+    (void)params;
+    (void)sk;
+    return 0;
+}
+
+/**
+ * Returns the index that signing with the secret key sk stops at. Keys of
+ * this implementation cannot be split, so that is always 2^full_height.
+ */
+unsigned long long xmss_xmssmt_core_sk_end(const xmss_params *params,
+                                           const unsigned char *sk)
+{
+    (void)sk;
+    return 1ULL << params->full_height;
+}
+
+/**
+ * Returns the offset in the secret key of the index that its traversal state
+ * is for. Keys of this implementation keep no traversal state, so this is
+ * always 0.
+ */
+unsigned long long xmss_xmssmt_core_sk_state_idx_offset(const xmss_params *params)
+{
+    (void)params;
+    return 0;
+}
+
+/* The version of the compact encoding, which follows the key as is. */
+#define SK_COMPACT_VERSION 1
+
+/**
+ * Writes the secret key sk to out in the compact encoding. Keys of this
+ * implementation keep no traversal state, so this is sk followed by the
+ * version byte.
+ */
+int xmss_xmssmt_core_sk_compact(const xmss_params *params,
+                                unsigned char *out, unsigned long long *outlen,
+                                const unsigned char *sk)
+{
+    memcpy(out, sk, params->sk_bytes);
+    out[params->sk_bytes] = SK_COMPACT_VERSION;
+    *outlen = params->sk_bytes + 1;
+    return 0;
+}
+
+/**
+ * Reads the secret key that xmss_xmssmt_core_sk_compact wrote to in.
+ * Returns -1 if in is not a valid compact encoding of a key for params.
+ */
+int xmss_xmssmt_core_sk_expand(xmss_params *params, unsigned char *sk,
+                               const unsigned char *in, unsigned long long inlen)
+{
+    if (inlen != params->sk_bytes + 1 ||
+            in[params->sk_bytes] != SK_COMPACT_VERSION) {
+        return -1;
+    }
+    memcpy(sk, in, params->sk_bytes);
+    return 0;
+}
+
+/**
+ * Converts the secret key old of the baseline layout to the current one in
+ * sk. Keys of this implementation have kept the layout, so this copies old.
+ */
+int xmss_xmssmt_core_sk_convert(const xmss_params *params, unsigned char *sk,
+                                const unsigned char *old)
+{
+    memcpy(sk, old, params->sk_bytes);
+    return 0;
+}
+
 /*
  * Generates a XMSS key pair for a given parameter set.
  * Format sk: [(32bit) index || SK_SEED || SK_PRF || root || PUB_SEED]
@@ -109,6 +235,31 @@ int xmss_core_keypair(const xmss_params *params,
     return xmssmt_core_keypair(params, pk, sk);
 }
 
+/*
+ * Derives a XMSS key pair for a given parameter set from a 3*n byte seed,
+ * in the format [SK_SEED || SK_PRF || PUB_SEED].
+ * Format sk: [(32bit) index || SK_SEED || SK_PRF || root || PUB_SEED]
+ * Format pk: [root || PUB_SEED], omitting algorithm OID.
+ */
+int xmss_core_seed_keypair(const xmss_params *params,
+                           unsigned char *pk, unsigned char *sk,
+                           const unsigned char *seed)
+{
+    return xmssmt_core_seed_keypair(params, pk, sk, seed);
+}
+
+/*
+ * Generates a XMSS key pair for a given parameter set, reporting progress
+ * and checkpointing as opts asks for, and resuming from the checkpoint file
+ * if there is one.
+ */
+int xmss_core_keypair_resumable(const xmss_params *params,
+                                unsigned char *pk, unsigned char *sk,
+                                const xmss_keygen_opts *opts)
+{
+    return xmssmt_core_keypair_resumable(params, pk, sk, opts);
+}
+
 /**
  * Signs a message. Returns an array containing the signature followed by the
  * message and an updated secret key.
@@ -125,6 +276,197 @@ int xmss_core_sign(const xmss_params *params,
     return xmssmt_core_sign(params, sk, sm, smlen, m, mlen);
 }
 
+/**
+ * Signs the concatenation of the iovcnt buffers in m. Writes the signature,
+ * without the message, to sig and updates the secret key.
+ */
+int xmss_core_sign_detached(const xmss_params *params,
+                            unsigned char *sk,
+                            unsigned char *sig, unsigned long long *siglen,
+                            const struct iovec *m, unsigned int iovcnt)
+{
+    return xmssmt_core_sign_detached(params, sk, sig, siglen, m, iovcnt);
+}
+
+/**
+ * As xmssmt_core_split; keys of this implementation cannot be split.
+ */
+int xmss_core_split(const xmss_params *params, unsigned char *sk,
+                    unsigned char *shard, unsigned long long mid)
+{
+    return xmssmt_core_split(params, sk, shard, mid);
+}
+
+/**
+ * Moves the secret key sk forward to index target_idx. This implementation
+ * keeps no state besides the index, so only that is set.
+ * Returns -1 if target_idx is below the index of sk or past the last one.
+ */
+int xmss_core_restore_state(const xmss_params *params, unsigned char *sk,
+                            unsigned long long target_idx)
+{
+    return xmssmt_core_restore_state(params, sk, target_idx);
+}
+
+/**
+ * The parts of the last signature on the layers above the lowest: for layer
+ * i of 1..d-1, its WOTS signature and authentication path, and idx >> (i*h)
+ * of the index it was computed for, which identifies the tree and leaf on
+ * that layer. These only change once every 2^(i*h) signatures.
+ */
+typedef struct {
+    unsigned long long *idx;
+    unsigned char *sigs;
+    unsigned int valid; /* the number of layers that hold a signature */
+} layer_cache;
+
+/* The reference implementation has no state beyond the secret key itself,
+   so a signer holds a copy of it, and optionally a layer_cache. */
+struct xmss_signer {
+    xmss_params params;
+    layer_cache *cache;
+    unsigned char sk[];
+};
+
+static int sign_detached(const xmss_params *params, unsigned char *sk,
+                         unsigned char *sig, unsigned long long *siglen,
+                         const struct iovec *m, unsigned int iovcnt,
+                         layer_cache *cache);
+
+static void sign_idx(const xmss_params *params, const unsigned char *sk,
+                     unsigned long long idx,
+                     unsigned char *sig, unsigned long long *siglen,
+                     const struct iovec *m, unsigned int iovcnt,
+                     layer_cache *cache);
+
+/* Where store_auth_node puts the authentication path of a leaf. */
+struct auth_path_ctx {
+    const xmss_params *params;
+    unsigned char *auth_path;
+    uint32_t leaf_idx;
+};
+
+/* Keeps the nodes of the authentication path of the leaf in ctx, as
+   treehash_roots passes them by. */
+static void store_auth_node(void *ctx, unsigned int height, uint32_t index,
+                            const unsigned char *node)
+{
+    const struct auth_path_ctx *auth = ctx;
+
+    if (((auth->leaf_idx >> height) ^ 0x1) == index) {
+        memcpy(auth->auth_path + height*auth->params->n, node,
+               auth->params->n);
+    }
+}
+
+/**
+ * Loads the secret key sk into a new signer, which keeps the signing state in
+ * memory of its own. Signing with it does not modify sk; use
+ * xmss_core_signer_flush to write the updated key back.
+ * This handles both XMSS and XMSSMT parameter sets.
+ * Returns NULL if out of memory.
+ */
+xmss_signer *xmss_core_signer_load(const xmss_params *params,
+                                   const unsigned char *sk)
+{
+    xmss_signer *signer = malloc(sizeof(xmss_signer) + params->sk_bytes);
+
+    if (signer == NULL) {
+        return NULL;
+    }
+    signer->params = *params;
+    signer->cache = NULL;
+    memcpy(signer->sk, sk, params->sk_bytes);
+    return signer;
+}
+
+/**
+ * Signs the concatenation of the iovcnt buffers in m with the key in signer.
+ * Only the in-memory state of the signer is updated.
+ * Returns -1 if all signatures of the key have been used.
+ */
+int xmss_core_signer_sign_detached(xmss_signer *signer,
+                                   unsigned char *sig,
+                                   unsigned long long *siglen,
+                                   const struct iovec *m, unsigned int iovcnt)
+{
+    return sign_detached(&signer->params, signer->sk, sig, siglen, m, iovcnt,
+                         signer->cache);
+}
+
+/**
+ * Would run the tree traversal of signer ahead of its signatures, but this
+ * implementation has no traversal state to advance; it recomputes the
+ * authentication path for every signature. This always returns 0.
+ */
+int xmss_core_signer_precompute(xmss_signer *signer, unsigned int lookahead)
+{
+    (void)signer;
+    (void)lookahead;
+    return 0;
+}
+
+/**
+ * Sets the number of threads that signer computes the trees of a signature
+ * on, which sign_idx passes to treehash_roots; 0 and 1 mean the calling
+ * thread only.
+ */
+void xmss_core_signer_threads(xmss_signer *signer, unsigned int threads)
+{
+    signer->params.threads = threads > 1 ? threads : 1;
+}
+
+/**
+ * Makes signer keep the WOTS signatures and authentication paths of the
+ * layers above the lowest, if enable is set, so that these are only
+ * recomputed when their tree or leaf changes; i.e. signing then computes
+ * about one tree rather than d. This takes (d - 1) * (wots_sig_bytes +
+ * tree_height * n) bytes. If enable is not set, they are dropped.
+ * Returns -1 if out of memory.
+ */
+int xmss_core_signer_cache(xmss_signer *signer, int enable)
+{
+    const xmss_params *params = &signer->params;
+    const unsigned int layers = params->d - 1;
+    layer_cache *cache;
+
+    if (!enable || signer->cache != NULL) {
+        if (!enable && signer->cache != NULL) {
+            free(signer->cache);
+            signer->cache = NULL;
+        }
+        return 0;
+    }
+    cache = malloc(sizeof(layer_cache) + layers * sizeof(unsigned long long)
+                   + layers * (params->wots_sig_bytes
+                               + params->tree_height * params->n));
+    if (cache == NULL) {
+        return -1;
+    }
+    cache->idx = (unsigned long long *)(cache + 1);
+    cache->sigs = (unsigned char *)(cache->idx + layers);
+    cache->valid = 0;
+    signer->cache = cache;
+    return 0;
+}
+
+/**
+ * Writes the current state of signer to the secret key sk.
+ */
+void xmss_core_signer_flush(const xmss_signer *signer, unsigned char *sk)
+{
+    memcpy(sk, signer->sk, signer->params.sk_bytes);
+}
+
+/**
+ * Frees a signer; its state is lost unless it was flushed.
+ */
+void xmss_core_signer_free(xmss_signer *signer)
+{
+    free(signer->cache);
+    free(signer);
+}
+
 /*
  * Generates a XMSSMT key pair for a given parameter set.
  * Format sk: [(ceil(h/8) bit) index || SK_SEED || SK_PRF || root || PUB_SEED]
@@ -133,29 +475,46 @@ int xmss_core_sign(const xmss_params *params,
 int xmssmt_core_keypair(const xmss_params *params,
                         unsigned char *pk, unsigned char *sk)
 {
-    /* We do not need the auth path in key generation, but it simplifies the
-       code to have just one treehash routine that computes both root and path
-       in one function. */
-    unsigned char auth_path[params->tree_height * params->n];
-    uint32_t top_tree_addr[8] = {0};
-    set_layer_addr(top_tree_addr, params->d - 1);
-
-    /* Initialize index to 0. */
-    memset(sk, 0, params->index_bytes);
-    sk += params->index_bytes;
+    unsigned char seed[3 * params->n];
 
-    /* Initialize SK_SEED and SK_PRF. */
-    randombytes(sk, 2 * params->n);
+    randombytes(seed, 3 * params->n);
+    return xmssmt_core_seed_keypair(params, pk, sk, seed);
+}
 
-    /* Initialize PUB_SEED. */
-    randombytes(sk + 3 * params->n, params->n);
-    memcpy(pk + params->n, sk + 3*params->n, params->n);
+/*
+ * Derives a XMSSMT key pair for a given parameter set from a 3*n byte seed,
+ * in the format [SK_SEED || SK_PRF || PUB_SEED].
+ * Format sk: [(ceil(h/8) bit) index || SK_SEED || SK_PRF || root || PUB_SEED]
+ * Format pk: [root || PUB_SEED] omitting algorithm OID.
+ */
+int xmssmt_core_seed_keypair(const xmss_params *params,
+                             unsigned char *pk, unsigned char *sk,
+                             const unsigned char *seed)
+{
+    return seed_keypair(params, pk, sk, seed, NULL);
+}
 
-    /* Compute root node of the top-most subtree. */
-    treehash(params, pk, auth_path, sk, pk + params->n, 0, top_tree_addr);
-    memcpy(sk + 2*params->n, pk, params->n);
+/*
+ * Generates a XMSSMT key pair for a given parameter set, reporting progress
+ * and checkpointing as opts asks for, and resuming from the checkpoint file
+ * if there is one.
+ */
+int xmssmt_core_keypair_resumable(const xmss_params *params,
+                                  unsigned char *pk, unsigned char *sk,
+                                  const xmss_keygen_opts *opts)
+{
+    unsigned char seed[3 * params->n];
+    int ret;
 
-    return 0;
+    /* When resuming, the seed comes from the checkpoint. */
+    ret = keygen_checkpoint_seed(params, seed, opts);
+    if (ret < 0) {
+        return -1;
+    }
+    if (ret == 0) {
+        randombytes(seed, 3 * params->n);
+    }
+    return seed_keypair(params, pk, sk, seed, opts);
 }
 
 /**
@@ -167,69 +526,222 @@ int xmssmt_core_sign(const xmss_params *params,
                      unsigned char *sm, unsigned long long *smlen,
                      const unsigned char *m, unsigned long long mlen)
 {
-    const unsigned char *sk_seed = sk + params->index_bytes;
-    const unsigned char *sk_prf = sk + params->index_bytes + params->n;
+    struct iovec iov;
+
+    iov.iov_base = (void *)m;
+    iov.iov_len = mlen;
+
+    if (xmssmt_core_sign_detached(params, sk, sm, smlen, &iov, 1)) {
+        return -1;
+    }
+    memcpy(sm + params->sig_bytes, m, mlen);
+    *smlen += mlen;
+
+    return 0;
+}
+
+/**
+ * Signs the concatenation of the iovcnt buffers in m. Writes the signature,
+ * without the message, to sig and updates the secret key.
+ */
+int xmssmt_core_sign_detached(const xmss_params *params,
+                              unsigned char *sk,
+                              unsigned char *sig, unsigned long long *siglen,
+                              const struct iovec *m, unsigned int iovcnt)
+{
+    return sign_detached(params, sk, sig, siglen, m, iovcnt, NULL);
+}
+
+/**
+ * Signs the concatenation of the iovcnt buffers in m at index idx of the
+ * secret key sk, without reading or updating the index in sk. As keys of
+ * this implementation hold nothing else that changes, any number of threads
+ * may sign with the same sk at once; the caller must make sure that no index
+ * is used twice.
+ * Returns -1 if idx is past the last index.
+ */
+int xmss_xmssmt_core_sign_at(const xmss_params *params,
+                             const unsigned char *sk, unsigned long long idx,
+                             unsigned char *sig, unsigned long long *siglen,
+                             const struct iovec *m, unsigned int iovcnt)
+{
+    if (idx >= (1ULL << params->full_height)) {
+        *siglen = 0;
+        return -1;
+    }
+    sign_idx(params, sk, idx, sig, siglen, m, iovcnt, NULL);
+    return 0;
+}
+
+/**
+ * Signs the concatenation of the iovcnt buffers in m, as
+ * xmssmt_core_sign_detached does, using the cache of a signer if it is not
+ * NULL; see sign_idx.
+ */
+static int sign_detached(const xmss_params *params, unsigned char *sk,
+                         unsigned char *sig, unsigned long long *siglen,
+                         const struct iovec *m, unsigned int iovcnt,
+                         layer_cache *cache)
+{
+    unsigned long long idx;
+
+    /* Read and use the current index from the secret key. */
+    idx = (unsigned long)bytes_to_ull(sk, params->index_bytes);
+    if (idx >= (1ULL << params->full_height)) {
+        /* All one-time keys have been used. */
+        *siglen = 0;
+        return -1;
+    }
+
+    /* Increment the index in the secret key. To keep an index from being
+       used twice, it must be stored before the signature is released, as
+       xmss_sk_file does. */
+    ull_to_bytes(sk, params->index_bytes, idx + 1);
+
+    sign_idx(params, sk, idx, sig, siglen, m, iovcnt, cache);
+    return 0;
+}
+
+/**
+ * Signs the concatenation of the iovcnt buffers in m at index idx of sk,
+ * which must be below 2^full_height. The layers above the lowest are copied
+ * from cache rather than computed if it holds them for idx, and are stored
+ * in it otherwise; unless cache is NULL.
+ */
+static void sign_idx(const xmss_params *params, const unsigned char *sk,
+                     unsigned long long idx,
+                     unsigned char *sig, unsigned long long *siglen,
+                     const struct iovec *m, unsigned int iovcnt,
+                     layer_cache *cache)
+{
+    const unsigned int layer_bytes = params->wots_sig_bytes
+                                     + params->tree_height * params->n;
     const unsigned char *pub_root = sk + params->index_bytes + 2*params->n;
-    const unsigned char *pub_seed = sk + params->index_bytes + 3*params->n;
+    xmss_prf_ctx sk_seed;
+    xmss_prf_ctx sk_prf;
+    xmss_prf_ctx pub_seed;
 
-    unsigned char root[params->n];
-    unsigned char *mhash = root;
+    unsigned char mhash[params->n];
+    unsigned char roots[params->d * params->n];
     unsigned char ots_seed[params->n];
-    unsigned long long idx;
     unsigned char idx_bytes_32[32];
-    unsigned int i;
-    uint32_t idx_leaf;
+    unsigned int i, layers;
+    unsigned long long tree_idx[params->d];
+    uint32_t leaf_idx[params->d];
+    uint32_t subtree_addr[params->d][8];
+    struct auth_path_ctx auth_ctx[params->d];
+    void *store_ctx[params->d];
 
     uint32_t ots_addr[8] = {0};
     set_type(ots_addr, XMSS_ADDR_TYPE_OTS);
 
-    /* Already put the message in the right place, to make it easier to prepend
-     * things when computing the hash over the message. */
-    memcpy(sm + params->sig_bytes, m, mlen);
-    *smlen = params->sig_bytes + mlen;
+    prf_ctx_init(params, &sk_seed, sk + params->index_bytes);
+    prf_ctx_init(params, &sk_prf, sk + params->index_bytes + params->n);
+    prf_ctx_init(params, &pub_seed, sk + params->index_bytes + 3*params->n);
 
-    /* Read and use the current index from the secret key. */
-    idx = (unsigned long)bytes_to_ull(sk, params->index_bytes);
-    memcpy(sm, sk, params->index_bytes);
-
-    /*************************************************************************
-     * THIS IS WHERE PRODUCTION IMPLEMENTATIONS WOULD UPDATE THE SECRET KEY. *
-     *************************************************************************/
-    /* Increment the index in the secret key. */
-    ull_to_bytes(sk, params->index_bytes, idx + 1);
+    *siglen = params->sig_bytes;
+    ull_to_bytes(sig, params->index_bytes, idx);
 
     /* Compute the digest randomization value. */
     ull_to_bytes(idx_bytes_32, 32, idx);
-    prf(params, sm + params->index_bytes, idx_bytes_32, sk_prf);
+    prf(params, sig + params->index_bytes, idx_bytes_32, &sk_prf);
 
     /* Compute the message hash. */
-    hash_message(params, mhash, sm + params->index_bytes, pub_root, idx,
-                 sm + params->sig_bytes - 4*params->n, mlen);
-    sm += params->index_bytes + params->n;
-
-    set_type(ots_addr, XMSS_ADDR_TYPE_OTS);
+    hash_message_iov(params, mhash, sig + params->index_bytes, pub_root, idx,
+                     m, iovcnt);
+    sig += params->index_bytes + params->n;
+
+    for (layers = 0; layers < params->d; layers++) {
+        /* The layers from here up are the same as for the last signature;
+           idx is the tree and leaf index on this layer at this point. */
+        if (layers > 0 && cache != NULL && layers <= cache->valid &&
+                cache->idx[layers - 1] == idx) {
+            memcpy(sig + layers * layer_bytes,
+                   cache->sigs + (layers - 1) * layer_bytes,
+                   (params->d - layers) * layer_bytes);
+            break;
+        }
 
-    for (i = 0; i < params->d; i++) {
-        idx_leaf = (idx & ((1 << params->tree_height)-1));
+        leaf_idx[layers] = (idx & ((1 << params->tree_height)-1));
         idx = idx >> params->tree_height;
+        tree_idx[layers] = idx;
 
-        set_layer_addr(ots_addr, i);
-        set_tree_addr(ots_addr, idx);
-        set_ots_addr(ots_addr, idx_leaf);
+        memset(subtree_addr[layers], 0, sizeof(subtree_addr[layers]));
+        set_layer_addr(subtree_addr[layers], layers);
+        set_tree_addr(subtree_addr[layers], idx);
+    }
 
-        /* Get a seed for the WOTS keypair. */
-        get_seed(params, ots_seed, sk_seed, ots_addr);
+    /* Compute the roots and authentication paths of the used leaves. The tree
+       on each layer only depends on the seeds and its address, so with more
+       than one thread, the trees of all layers are computed at once, each
+       split into subtrees that are spread over the threads as well. Only the
+       WOTS signatures below chain the layers together. */
+    for (i = 0; i < layers; i++) {
+        auth_ctx[i].params = params;
+        auth_ctx[i].auth_path = sig + i * layer_bytes + params->wots_sig_bytes;
+        auth_ctx[i].leaf_idx = leaf_idx[i];
+        store_ctx[i] = &auth_ctx[i];
+    }
+    if (params->threads <= 1 ||
+            treehash_roots(params, roots, &sk_seed, &pub_seed,
+                           (const uint32_t (*)[8])subtree_addr, layers,
+                           store_auth_node, store_ctx, NULL, NULL)) {
+        /* Also if treehash_roots is out of memory. */
+        for (i = 0; i < layers; i++) {
+            treehash(params, roots + i*params->n, auth_ctx[i].auth_path,
+                     &sk_seed, &pub_seed, leaf_idx[i], subtree_addr[i]);
+        }
+    }
 
-        /* Compute a WOTS signature. */
-        /* Initially, root = mhash, but on subsequent iterations it is the root
-           of the subtree below the currently processed subtree. */
-        wots_sign(params, sm, root, ots_seed, pub_seed, ots_addr);
-        sm += params->wots_sig_bytes;
+    for (i = 0; i < layers; i++) {
+        copy_subtree_addr(ots_addr, subtree_addr[i]);
+        set_ots_addr(ots_addr, leaf_idx[i]);
 
-        /* Compute the authentication path for the used WOTS leaf. */
-        treehash(params, root, sm, sk_seed, pub_seed, idx_leaf, ots_addr);
-        sm += params->tree_height*params->n;
+        /* Get a seed for the WOTS keypair. */
+        get_seed(params, ots_seed, &sk_seed, ots_addr);
+
+        /* Compute a WOTS signature of the message hash on the lowest layer,
+           and of the root of the subtree below on the others. */
+        wots_sign(params, sig, i == 0 ? mhash : roots + (i - 1)*params->n,
+                  ots_seed, &pub_seed, ots_addr);
+        sig += layer_bytes;
+
+        if (i > 0 && cache != NULL) {
+            cache->idx[i - 1] = (tree_idx[i] << params->tree_height)
+                                | leaf_idx[i];
+            memcpy(cache->sigs + (i - 1) * layer_bytes, sig - layer_bytes,
+                   layer_bytes);
+            if (cache->valid < i) {
+                cache->valid = i;
+            }
+        }
     }
+}
+
+/**
+ * Would split the secret key sk at index mid, but a key of this
+ * implementation has no end index to stop at. This always returns -1.
+ */
+int xmssmt_core_split(const xmss_params *params, unsigned char *sk,
+                      unsigned char *shard, unsigned long long mid)
+{
+    (void)params;
+    (void)sk;
+    (void)shard;
+    (void)mid;
+    return -1;
+}
 
+/**
+ * As xmss_core_restore_state, for XMSSMT.
+ */
+int xmssmt_core_restore_state(const xmss_params *params, unsigned char *sk,
+                              unsigned long long target_idx)
+{
+    if (target_idx < bytes_to_ull(sk, params->index_bytes) ||
+            target_idx >= (1ULL << params->full_height)) {
+        return -1;
+    }
+    ull_to_bytes(sk, params->index_bytes, target_idx);
     return 0;
 }
@@ -1,8 +1,13 @@
 #ifndef XMSS_CORE_H
 #define XMSS_CORE_H
 
+#include <sys/uio.h>
+
 #include "params.h"
 
+/* The size of the index that the traversal state of a secret key is for. */
+#define XMSS_SK_STATE_IDX_BYTES 8
+
 /**
  * Given a set of parameters, this function returns the size of the secret key.
  * This is implementation specific, as varying choices in tree traversal will
@@ -12,6 +17,75 @@
  */
 unsigned long long xmss_xmssmt_core_sk_bytes(const xmss_params *params);
 
+/**
+ * Completes params for the secret key sk, e.g. with the BDS traversal
+ * parameter it was generated with, as that affects its layout.
+ * Returns -1 if sk is not consistent with params, 0 otherwise.
+ */
+int xmss_xmssmt_core_sk_params(xmss_params *params, const unsigned char *sk);
+
+/**
+ * Returns the index that signing with the secret key sk stops at; this is
+ * below 2^full_height for a key that was split with xmss[mt]_core_split.
+ */
+unsigned long long xmss_xmssmt_core_sk_end(const xmss_params *params,
+                                           const unsigned char *sk);
+
+/**
+ * Returns the offset in the secret key of the XMSS_SK_STATE_IDX_BYTES index
+ * that its traversal state is for, which signing updates after the state
+ * itself; a key whose index is ahead of it has its state restored before it
+ * signs. Returns 0 if keys of this implementation keep no traversal state.
+ */
+unsigned long long xmss_xmssmt_core_sk_state_idx_offset(const xmss_params *params);
+
+/**
+ * Writes the secret key sk to out in a compact, versioned encoding, for
+ * storing or replicating it, and sets *outlen to its size; this is at most
+ * sk_bytes + 1. The encoding starts with the same fields as sk, so that
+ * xmss_xmssmt_core_sk_params also reads it, followed by a version byte and
+ * only the part of the traversal state that signing still reads.
+ * Returns -1 on failure, 0 otherwise.
+ */
+int xmss_xmssmt_core_sk_compact(const xmss_params *params,
+                                unsigned char *out, unsigned long long *outlen,
+                                const unsigned char *sk);
+
+/**
+ * Reads the secret key that xmss_xmssmt_core_sk_compact wrote to in, and
+ * completes params for it as xmss_xmssmt_core_sk_params does; sk must have
+ * room for params->sk_bytes then. The key signs as the one that was encoded.
+ * Returns -1 if in is not a valid compact encoding of a key for params,
+ * e.g. one of another version, 0 otherwise.
+ */
+int xmss_xmssmt_core_sk_expand(xmss_params *params, unsigned char *sk,
+                               const unsigned char *in, unsigned long long inlen);
+
+/**
+ * Converts the secret key old, of the layout that keys of this implementation
+ * had before their head held a version byte, to a key of the current layout
+ * in sk, for params->bds_k and params->bds_schedule. Only the index, the
+ * seeds and the root of old are read; any traversal state is rebuilt for
+ * the index, as xmss_core_restore_state does.
+ * Returns -1 if old has no index left or its root does not match its seeds.
+ */
+int xmss_xmssmt_core_sk_convert(const xmss_params *params, unsigned char *sk,
+                                const unsigned char *old);
+
+/**
+ * Signs the concatenation of the iovcnt buffers in m at index idx of the
+ * secret key sk, without reading or updating the index in sk, so that any
+ * number of threads may sign with the same sk at once; the caller must make
+ * sure that no index is used twice.
+ * This handles both XMSS and XMSSMT parameter sets.
+ * Returns -1 if idx is past the last index, or if keys of this implementation
+ * keep a traversal state, which can only sign the index that follows it.
+ */
+int xmss_xmssmt_core_sign_at(const xmss_params *params,
+                             const unsigned char *sk, unsigned long long idx,
+                             unsigned char *sig, unsigned long long *siglen,
+                             const struct iovec *m, unsigned int iovcnt);
+
 /*
  * Generates a XMSS key pair for a given parameter set.
  * Format sk: [(32bit) index || SK_SEED || SK_PRF || PUB_SEED || root]
@@ -20,6 +94,24 @@ unsigned long long xmss_xmssmt_core_sk_bytes(const xmss_params *params);
 int xmss_core_keypair(const xmss_params *params,
                       unsigned char *pk, unsigned char *sk);
 
+/*
+ * Derives a XMSS key pair for a given parameter set from a 3*n byte seed,
+ * in the format [SK_SEED || SK_PRF || PUB_SEED]. The subtree is computed
+ * using params->threads threads.
+ */
+int xmss_core_seed_keypair(const xmss_params *params,
+                           unsigned char *pk, unsigned char *sk,
+                           const unsigned char *seed);
+
+/*
+ * Generates a XMSS key pair for a given parameter set, reporting progress
+ * and checkpointing as opts asks for, and resuming from the checkpoint file
+ * if there is one.
+ */
+int xmss_core_keypair_resumable(const xmss_params *params,
+                                unsigned char *pk, unsigned char *sk,
+                                const xmss_keygen_opts *opts);
+
 /**
  * Signs a message. Returns an array containing the signature followed by the
  * message and an updated secret key.
@@ -29,6 +121,96 @@ int xmss_core_sign(const xmss_params *params,
                    unsigned char *sm, unsigned long long *smlen,
                    const unsigned char *m, unsigned long long mlen);
 
+/**
+ * Signs the concatenation of the iovcnt buffers in m, without copying it.
+ * Writes the params->sig_bytes byte signature to sig and updates the secret
+ * key.
+ */
+int xmss_core_sign_detached(const xmss_params *params,
+                            unsigned char *sk,
+                            unsigned char *sig, unsigned long long *siglen,
+                            const struct iovec *m, unsigned int iovcnt);
+
+/**
+ * Splits the secret key sk at index mid: shard becomes a secret key for the
+ * indices from mid up to where sk stops, and sk stops at mid. Both can then
+ * sign independently, e.g. on different threads or machines.
+ * Returns -1 unless mid is past the index of sk and before where it stops,
+ * or if this implementation cannot split keys.
+ */
+int xmss_core_split(const xmss_params *params, unsigned char *sk,
+                    unsigned char *shard, unsigned long long mid);
+
+/**
+ * Moves the secret key sk forward to index target_idx, rebuilding any
+ * traversal state from SK_SEED and PUB_SEED alone, at about the cost of
+ * generating a key rather than of signing up to target_idx. The indices that
+ * are skipped are lost; e.g. to recover a key from a backup of an earlier
+ * index, or to skip indices that may have been used.
+ * Returns -1 if target_idx is below the index of sk or not before where it
+ * stops, or if the root in sk does not match its seeds; sk is left as it was
+ * then.
+ */
+int xmss_core_restore_state(const xmss_params *params, unsigned char *sk,
+                            unsigned long long target_idx);
+
+/**
+ * Loads the secret key sk into a new signer, which keeps the signing state in
+ * memory of its own. Signing with it does not modify sk; use
+ * xmss_core_signer_flush to write the updated key back.
+ * This handles both XMSS and XMSSMT parameter sets.
+ * Returns NULL if out of memory.
+ */
+xmss_signer *xmss_core_signer_load(const xmss_params *params,
+                                   const unsigned char *sk);
+
+/**
+ * Signs the concatenation of the iovcnt buffers in m with the key in signer.
+ * Only the in-memory state of the signer is updated.
+ * Returns -1 if all signatures of the key have been used.
+ */
+int xmss_core_signer_sign_detached(xmss_signer *signer,
+                                   unsigned char *sig,
+                                   unsigned long long *siglen,
+                                   const struct iovec *m, unsigned int iovcnt);
+
+/**
+ * Starts a background thread that runs the BDS traversal of signer ahead of
+ * its signatures, preparing up to lookahead of them, so that signing only
+ * takes computing the WOTS signature on the message. A lookahead of 0 stops
+ * the thread, dropping the signatures it prepared that were not used.
+ * Flushing the signer writes the key as of the last signature handed out.
+ * Returns -1 if the thread cannot be started.
+ */
+int xmss_core_signer_precompute(xmss_signer *signer, unsigned int lookahead);
+
+/**
+ * Makes signer keep the WOTS signatures and authentication paths of the
+ * layers above the lowest, if enable is set, so that these are only
+ * recomputed when their tree or leaf changes; if not, they are dropped.
+ * This only affects the reference implementation; the BDS states of the
+ * fast one already hold them.
+ * Returns -1 if out of memory.
+ */
+int xmss_core_signer_cache(xmss_signer *signer, int enable);
+
+/**
+ * Sets the number of threads that signer computes the trees of a signature
+ * on; 0 and 1 mean the calling thread only. This only affects the reference
+ * implementation.
+ */
+void xmss_core_signer_threads(xmss_signer *signer, unsigned int threads);
+
+/**
+ * Writes the current state of signer to the secret key sk.
+ */
+void xmss_core_signer_flush(const xmss_signer *signer, unsigned char *sk);
+
+/**
+ * Frees a signer; its state is lost unless it was flushed.
+ */
+void xmss_core_signer_free(xmss_signer *signer);
+
 /**
  * Verifies a given message signature pair under a given public key.
  * Note that this assumes a pk without an OID, i.e. [root || PUB_SEED]
@@ -38,6 +220,31 @@ int xmss_core_sign_open(const xmss_params *params,
                         const unsigned char *sm, unsigned long long smlen,
                         const unsigned char *pk);
 
+/**
+ * Verifies a detached signature on the concatenation of the iovcnt buffers
+ * in m under a given public key [root || PUB_SEED].
+ */
+int xmss_core_verify_detached(const xmss_params *params,
+                              const unsigned char *sig,
+                              unsigned long long siglen,
+                              const struct iovec *m, unsigned int iovcnt,
+                              const unsigned char *pk);
+
+/**
+ * Verifies count detached signatures under a given public key
+ * [root || PUB_SEED]: signature k is sigs[k], of siglens[k] bytes, on the
+ * mlens[k] bytes at ms[k]. Sets results[k] to 0 if it is valid and to -1
+ * otherwise. The signatures are verified XMSS_VERIFY_BATCH at a time, with
+ * the WOTS, L-tree and hash tree calls of each group in joint batches.
+ * Returns 0 if all signatures are valid, -1 otherwise.
+ */
+int xmss_core_verify_batch(const xmss_params *params, int *results,
+                           const unsigned char *const sigs[],
+                           const unsigned long long siglens[],
+                           const unsigned char *const ms[],
+                           const unsigned long long mlens[],
+                           unsigned int count, const unsigned char *pk);
+
 /*
  * Generates a XMSSMT key pair for a given parameter set.
  * Format sk: [(ceil(h/8) bit) index || SK_SEED || SK_PRF || PUB_SEED || root]
@@ -46,6 +253,20 @@ int xmss_core_sign_open(const xmss_params *params,
 int xmssmt_core_keypair(const xmss_params *params,
                         unsigned char *pk, unsigned char *sk);
 
+/*
+ * As xmss_core_seed_keypair, for XMSSMT.
+ */
+int xmssmt_core_seed_keypair(const xmss_params *params,
+                             unsigned char *pk, unsigned char *sk,
+                             const unsigned char *seed);
+
+/*
+ * As xmss_core_keypair_resumable, for XMSSMT.
+ */
+int xmssmt_core_keypair_resumable(const xmss_params *params,
+                                  unsigned char *pk, unsigned char *sk,
+                                  const xmss_keygen_opts *opts);
+
 /**
  * Signs a message. Returns an array containing the signature followed by the
  * message and an updated secret key.
@@ -55,6 +276,26 @@ int xmssmt_core_sign(const xmss_params *params,
                      unsigned char *sm, unsigned long long *smlen,
                      const unsigned char *m, unsigned long long mlen);
 
+/**
+ * As xmss_core_sign_detached, for XMSSMT.
+ */
+int xmssmt_core_sign_detached(const xmss_params *params,
+                              unsigned char *sk,
+                              unsigned char *sig, unsigned long long *siglen,
+                              const struct iovec *m, unsigned int iovcnt);
+
+/**
+ * As xmss_core_split, for XMSSMT.
+ */
+int xmssmt_core_split(const xmss_params *params, unsigned char *sk,
+                      unsigned char *shard, unsigned long long mid);
+
+/**
+ * As xmss_core_restore_state, for XMSSMT.
+ */
+int xmssmt_core_restore_state(const xmss_params *params, unsigned char *sk,
+                              unsigned long long target_idx);
+
 /**
  * Verifies a given message signature pair under a given public key.
  * Note that this assumes a pk without an OID, i.e. [root || PUB_SEED]
@@ -64,4 +305,23 @@ int xmssmt_core_sign_open(const xmss_params *params,
                           const unsigned char *sm, unsigned long long smlen,
                           const unsigned char *pk);
 
+/**
+ * As xmss_core_verify_detached, for XMSSMT.
+ */
+int xmssmt_core_verify_detached(const xmss_params *params,
+                                const unsigned char *sig,
+                                unsigned long long siglen,
+                                const struct iovec *m, unsigned int iovcnt,
+                                const unsigned char *pk);
+
+/**
+ * As xmss_core_verify_batch, for XMSSMT.
+ */
+int xmssmt_core_verify_batch(const xmss_params *params, int *results,
+                             const unsigned char *const sigs[],
+                             const unsigned long long siglens[],
+                             const unsigned char *const ms[],
+                             const unsigned long long mlens[],
+                             unsigned int count, const unsigned char *pk);
+
 #endif
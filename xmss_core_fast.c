@@ -1,6 +1,9 @@
+#include <assert.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <sys/uio.h>
 
 #include "hash.h"
 #include "hash_address.h"
@@ -35,15 +38,118 @@ typedef struct {
    byte array that is the secret key.
    They will probably be refactored in a non-backwards-compatible way, soon. */
 
+/**
+ * Returns which of the 2d - 1 states is stored in slot s of the secret key.
+ * Every layer but the top one has two slots, one for the current tree
+ * (states[i]) and one for the next (states[d + i]); a selector byte per
+ * layer, at the very end of sk, tells which is which. Moving on to the next
+ * tree then only takes swapping the two bds_state structs and flipping the
+ * selector, rather than copying the states themselves.
+ */
+static unsigned int state_slot(const xmss_params *params,
+                               const unsigned char *selectors, unsigned int s)
+{
+    unsigned int layer = s < params->d ? s : s - params->d;
+
+    if (layer == params->d - 1 || !selectors[layer]) {
+        return s;
+    }
+    return s < params->d ? s + params->d : s - params->d;
+}
+
+/* The version of the layout of the secret key, which the byte right after the
+   'regular' sk holds. Keys of the baseline layout had their BDS states there;
+   see xmss_xmssmt_core_sk_convert. */
+#define SK_VERSION 1
+/* The size of the version, bds_k and bds_schedule bytes in the secret key. */
+#define SK_PARAMS_BYTES 3
+/* The size of the index that signing stops at, in the secret key. */
+#define SK_END_BYTES 8
+/* The size of the index that the BDS states in the secret key are for. */
+#define SK_STATE_IDX_BYTES XMSS_SK_STATE_IDX_BYTES
+
+/**
+ * Returns the size of the part of sk that precedes the BDS states; the
+ * 'regular' sk, followed by a byte holding the version of the layout, one
+ * holding the bds_k it was generated with, one holding the bds_schedule, the
+ * index that signing stops at, and the index that the BDS states are for.
+ */
+static unsigned long long sk_head_bytes(const xmss_params *params)
+{
+    return params->index_bytes + 4*params->n + SK_PARAMS_BYTES + SK_END_BYTES + SK_STATE_IDX_BYTES;
+}
+
+/**
+ * Returns the index that the BDS states and WOTS signatures in sk are for.
+ * This is below the index of sk if indices were reserved by writing only the
+ * index, e.g. by xmss_sk_file; the states must then be restored first.
+ */
+static unsigned long long sk_state_idx(const xmss_params *params,
+                                       const unsigned char *sk)
+{
+    return bytes_to_ull(sk + params->index_bytes + 4*params->n + SK_PARAMS_BYTES + SK_END_BYTES, SK_STATE_IDX_BYTES);
+}
+
+/**
+ * Sets the index of sk, along with the index that its states are for.
+ */
+static void sk_set_idx(const xmss_params *params, unsigned char *sk,
+                       unsigned long long idx)
+{
+    ull_to_bytes(sk, params->index_bytes, idx);
+    ull_to_bytes(sk + params->index_bytes + 4*params->n + SK_PARAMS_BYTES + SK_END_BYTES, SK_STATE_IDX_BYTES, idx);
+}
+
+/**
+ * Returns the index that signing with sk stops at; 2^full_height, unless sk
+ * was split with xmss_core_split or xmssmt_core_split.
+ */
+static unsigned long long sk_end(const xmss_params *params,
+                                 const unsigned char *sk)
+{
+    return bytes_to_ull(sk + params->index_bytes + 4*params->n + SK_PARAMS_BYTES, SK_END_BYTES);
+}
+
+/**
+ * Writes the part of the head of a new key sk that follows its 'regular' sk:
+ * the version of the layout, the BDS traversal parameters that its states
+ * are laid out for, and 2^full_height as the index that signing stops at.
+ */
+static void sk_init_head(const xmss_params *params, unsigned char *sk)
+{
+    unsigned char *p = sk + params->index_bytes + 4*params->n;
+
+    p[0] = SK_VERSION;
+    p[1] = params->bds_k;
+    p[2] = params->bds_schedule;
+    ull_to_bytes(p + SK_PARAMS_BYTES, SK_END_BYTES, 1ULL << params->full_height);
+}
+
+/**
+ * Returns where the WOTS signatures on the roots of the next trees start in
+ * sk, followed by a byte per layer that tells whether it was computed yet.
+ * Only keys with XMSS_BDS_SCHEDULE_CONSTANT have these; they are right in
+ * front of the selectors.
+ */
+static unsigned char *sk_next_wots_sigs(const xmss_params *params,
+                                        const unsigned char *sk)
+{
+    return (unsigned char *)sk + params->sk_bytes
+        - (params->d - 1) * (params->wots_sig_bytes + 2);
+}
+
 static void xmssmt_serialize_state(const xmss_params *params,
                                    unsigned char *sk, bds_state *states)
 {
-    unsigned int i, j;
+    const unsigned char *selectors = sk + params->sk_bytes - (params->d - 1);
+    unsigned int i, j, s;
 
-    /* Skip past the 'regular' sk */
-    sk += params->index_bytes + 4*params->n;
+    /* Skip past the head: the 'regular' sk, the version, bds_k and
+       bds_schedule bytes, the end index and the index of the states */
+    sk += sk_head_bytes(params);
 
-    for (i = 0; i < 2*params->d - 1; i++) {
+    for (s = 0; s < 2*params->d - 1; s++) {
+        i = state_slot(params, selectors, s);
         sk += (params->tree_height + 1) * params->n; /* stack */
 
         ull_to_bytes(sk, 4, states[i].stackoffset);
@@ -82,15 +188,20 @@ static void xmssmt_deserialize_state(const xmss_params *params,
                                      unsigned char **wots_sigs,
                                      unsigned char *sk)
 {
-    unsigned int i, j;
+    const unsigned char *selectors = sk + params->sk_bytes - (params->d - 1);
+    unsigned int i, j, s;
 
-    /* Skip past the 'regular' sk */
-    sk += params->index_bytes + 4*params->n;
+    /* Skip past the head: the 'regular' sk, the version, bds_k and
+       bds_schedule bytes, the end index and the index of the states */
+    sk += sk_head_bytes(params);
 
-    // TODO These data sizes follow from the (former) test xmss_core_fast.c
-    // TODO They should be reconsidered / motivated more explicitly
+    /* Per state: a stack of h + 1 nodes with a 4-byte offset and a level
+       byte per node, h auth nodes, h/2 kept nodes, h - bds_k treehash
+       instances of 7 bytes and a node, 2^bds_k - bds_k - 1 retained nodes,
+       and the 4-byte next leaf; indices take 4 bytes, as h is at most 20. */
 
-    for (i = 0; i < 2*params->d - 1; i++) {
+    for (s = 0; s < 2*params->d - 1; s++) {
+        i = state_slot(params, selectors, s);
         states[i].stack = sk;
         sk += (params->tree_height + 1) * params->n;
 
@@ -147,51 +258,6 @@ static void xmss_deserialize_state(const xmss_params *params,
     xmssmt_deserialize_state(params, state, NULL, sk);
 }
 
-static void memswap(void *a, void *b, void *t, unsigned long long len)
-{
-    memcpy(t, a, len);
-    memcpy(a, b, len);
-    memcpy(b, t, len);
-}
-
-/**
- * Swaps the content of two bds_state objects, swapping actual memory rather
- * than pointers.
- * As we're mapping memory chunks in the secret key to bds state objects,
- * it is now necessary to make swaps 'real swaps'. This could be done in the
- * serialization function as well, but that causes more overhead
- */
-// TODO this should not be necessary if we keep better track of the states
-static void deep_state_swap(const xmss_params *params,
-                            bds_state *a, bds_state *b)
-{
-    // TODO this is extremely ugly and should be refactored
-    // TODO right now, this ensures that both 'stack' and 'retain' fit
-    unsigned char t[
-        ((params->tree_height + 1) > ((1 << params->bds_k) - params->bds_k - 1)
-         ? (params->tree_height + 1)
-         : ((1 << params->bds_k) - params->bds_k - 1))
-        * params->n];
-    unsigned int i;
-
-    memswap(a->stack, b->stack, t, (params->tree_height + 1) * params->n);
-    memswap(&a->stackoffset, &b->stackoffset, t, sizeof(a->stackoffset));
-    memswap(a->stacklevels, b->stacklevels, t, params->tree_height + 1);
-    memswap(a->auth, b->auth, t, params->tree_height * params->n);
-    memswap(a->keep, b->keep, t, (params->tree_height >> 1) * params->n);
-
-    for (i = 0; i < params->tree_height - params->bds_k; i++) {
-        memswap(&a->treehash[i].h, &b->treehash[i].h, t, sizeof(a->treehash[i].h));
-        memswap(&a->treehash[i].next_idx, &b->treehash[i].next_idx, t, sizeof(a->treehash[i].next_idx));
-        memswap(&a->treehash[i].stackusage, &b->treehash[i].stackusage, t, sizeof(a->treehash[i].stackusage));
-        memswap(&a->treehash[i].completed, &b->treehash[i].completed, t, sizeof(a->treehash[i].completed));
-        memswap(a->treehash[i].node, b->treehash[i].node, t, params->n);
-    }
-
-    memswap(a->retain, b->retain, t, ((1 << params->bds_k) - params->bds_k - 1) * params->n);
-    memswap(&a->next_leaf, &b->next_leaf, t, sizeof(a->next_leaf));
-}
-
 static int treehash_minheight_on_stack(const xmss_params *params,
                                        bds_state *state,
                                        const treehash_inst *treehash)
@@ -206,85 +272,87 @@ static int treehash_minheight_on_stack(const xmss_params *params,
     return r;
 }
 
+/* Identifies the BDS state that bds_init_node fills for treehash_roots. */
+typedef struct {
+    const xmss_params *params;
+    bds_state *state;
+    uint32_t leaf;
+} bds_init_ctx;
+
 /**
- * Merkle's TreeHash algorithm. The address only needs to initialize the first 78 bits of addr. Everything else will be set by treehash.
- * Currently only used for key generation.
- *
+ * Stores the nodes that a BDS state needs for signing leaf, as treehash_roots
+ * passes them by: the auth path, the next right node each treehash instance
+ * hands to bds_round, the node that bds_round kept for computing a left auth
+ * node, if it is still to be used, and the right nodes on the retained top
+ * levels. For the first leaf, there is nothing kept and every treehash
+ * instance has the node with index 3. Different nodes end up in different
+ * places, so this may be called concurrently.
  */
-static void treehash_init(const xmss_params *params,
-                          unsigned char *node, int height, int index,
-                          bds_state *state, const unsigned char *sk_seed,
-                          const unsigned char *pub_seed, const uint32_t addr[8])
+static void bds_init_node(void *ctx, unsigned int nodeh, uint32_t index,
+                          const unsigned char *node)
 {
-    unsigned int idx = index;
-    // use three different addresses because at this point we use all three formats in parallel
-    uint32_t ots_addr[8] = {0};
-    uint32_t ltree_addr[8] = {0};
-    uint32_t node_addr[8] = {0};
-    // only copy layer and tree address parts
-    copy_subtree_addr(ots_addr, addr);
-    // type = ots
-    set_type(ots_addr, 0);
-    copy_subtree_addr(ltree_addr, addr);
-    set_type(ltree_addr, 1);
-    copy_subtree_addr(node_addr, addr);
-    set_type(node_addr, 2);
-
-    uint32_t lastnode, i;
-    unsigned char stack[(height+1)*params->n];
-    unsigned int stacklevels[height+1];
-    unsigned int stackoffset=0;
-    unsigned int nodeh;
-
-    lastnode = idx+(1<<height);
+    const xmss_params *params = ((bds_init_ctx *)ctx)->params;
+    bds_state *state = ((bds_init_ctx *)ctx)->state;
+    uint32_t leaf = ((bds_init_ctx *)ctx)->leaf;
 
-    for (i = 0; i < params->tree_height-params->bds_k; i++) {
-        state->treehash[i].h = i;
-        state->treehash[i].completed = 1;
-        state->treehash[i].stackusage = 0;
+    if (index == ((leaf >> nodeh) ^ 1)) {
+        memcpy(state->auth + nodeh*params->n, node, params->n);
     }
-
-    i = 0;
-    for (; idx < lastnode; idx++) {
-        set_ltree_addr(ltree_addr, idx);
-        set_ots_addr(ots_addr, idx);
-        gen_leaf_wots(params, stack+stackoffset*params->n, sk_seed, pub_seed, ltree_addr, ots_addr);
-        stacklevels[stackoffset] = 0;
-        stackoffset++;
-        if (params->tree_height - params->bds_k > 0 && i == 3) {
-            memcpy(state->treehash[0].node, stack+stackoffset*params->n, params->n);
-        }
-        while (stackoffset>1 && stacklevels[stackoffset-1] == stacklevels[stackoffset-2]) {
-            nodeh = stacklevels[stackoffset-1];
-            if (i >> nodeh == 1) {
-                memcpy(state->auth + nodeh*params->n, stack+(stackoffset-1)*params->n, params->n);
-            }
-            else {
-                if (nodeh < params->tree_height - params->bds_k && i >> nodeh == 3) {
-                    memcpy(state->treehash[nodeh].node, stack+(stackoffset-1)*params->n, params->n);
-                }
-                else if (nodeh >= params->tree_height - params->bds_k) {
-                    memcpy(state->retain + ((1 << (params->tree_height - 1 - nodeh)) + nodeh - params->tree_height + (((i >> nodeh) - 3) >> 1)) * params->n, stack+(stackoffset-1)*params->n, params->n);
-                }
-            }
-            set_tree_height(node_addr, stacklevels[stackoffset-1]);
-            set_tree_index(node_addr, (idx >> (stacklevels[stackoffset-1]+1)));
-            thash_h(params, stack+(stackoffset-2)*params->n, stack+(stackoffset-2)*params->n, pub_seed, node_addr);
-            stacklevels[stackoffset-2]++;
-            stackoffset--;
+    // bds_round keeps the right node on the path of leaf from the round
+    // before leaf >> nodeh was reached, until it becomes a left auth node
+    if (index == (leaf >> nodeh) && (index & 3) == 1 && nodeh < params->tree_height - 1) {
+        memcpy(state->keep + (nodeh >> 1)*params->n, node, params->n);
+    }
+    if (nodeh < params->tree_height - params->bds_k) {
+        if (index == (((leaf >> (nodeh + 1)) + 1) << 1) + 1) {
+            memcpy(state->treehash[nodeh].node, node, params->n);
         }
-        i++;
     }
+    else if ((index & 1) && index >= 3) {
+        memcpy(state->retain + ((1 << (params->tree_height - 1 - nodeh)) + nodeh - params->tree_height + ((index - 3) >> 1)) * params->n, node, params->n);
+    }
+}
 
-    for (i = 0; i < params->n; i++) {
-        node[i] = stack[i];
+/**
+ * Merkle's TreeHash algorithm, for the count trees whose layer and tree
+ * address parts are given by addr. Computes their roots, and initializes the
+ * corresponding BDS states for signing leaves[i] of tree i, or their first
+ * leaf if leaves is NULL. Every treehash instance is left completed.
+ * The trees are computed in parallel using treehash_roots, which also
+ * reports progress and checkpoints sk as opts asks for, if not NULL.
+ */
+static int treehash_init(const xmss_params *params,
+                         unsigned char *roots, bds_state *states,
+                         unsigned int count, const uint32_t *leaves,
+                         const xmss_prf_ctx *sk_seed,
+                         const xmss_prf_ctx *pub_seed,
+                         const uint32_t addr[][8],
+                         unsigned char *sk, const xmss_keygen_opts *opts)
+{
+    bds_init_ctx ctx[count];
+    void *ctx_ptrs[count];
+    unsigned int i, j;
+
+    for (i = 0; i < count; i++) {
+        for (j = 0; j < params->tree_height-params->bds_k; j++) {
+            states[i].treehash[j].h = j;
+            states[i].treehash[j].completed = 1;
+            states[i].treehash[j].stackusage = 0;
+        }
+        ctx[i].params = params;
+        ctx[i].state = states + i;
+        ctx[i].leaf = leaves != NULL ? leaves[i] : 0;
+        ctx_ptrs[i] = ctx + i;
     }
+
+    return treehash_roots(params, roots, sk_seed, pub_seed, addr, count,
+                          bds_init_node, ctx_ptrs, sk, opts);
 }
 
 static void treehash_update(const xmss_params *params,
                             treehash_inst *treehash, bds_state *state,
-                            const unsigned char *sk_seed,
-                            const unsigned char *pub_seed,
+                            const xmss_prf_ctx *sk_seed,
+                            const xmss_prf_ctx *pub_seed,
                             const uint32_t addr[8])
 {
     uint32_t ots_addr[8] = {0};
@@ -334,8 +402,8 @@ static void treehash_update(const xmss_params *params,
  **/
 static char bds_treehash_update(const xmss_params *params,
                                 bds_state *state, unsigned int updates,
-                                const unsigned char *sk_seed,
-                                unsigned char *pub_seed,
+                                const xmss_prf_ctx *sk_seed,
+                                const xmss_prf_ctx *pub_seed,
                                 const uint32_t addr[8])
 {
     uint32_t i, j;
@@ -374,8 +442,8 @@ static char bds_treehash_update(const xmss_params *params,
  * Returns -1 if all leaf nodes have already been processed
  **/
 static char bds_state_update(const xmss_params *params,
-                             bds_state *state, const unsigned char *sk_seed,
-                             const unsigned char *pub_seed,
+                             bds_state *state, const xmss_prf_ctx *sk_seed,
+                             const xmss_prf_ctx *pub_seed,
                              const uint32_t addr[8])
 {
     uint32_t ltree_addr[8] = {0};
@@ -438,8 +506,8 @@ static char bds_state_update(const xmss_params *params,
  */
 static void bds_round(const xmss_params *params,
                       bds_state *state, const unsigned long leaf_idx,
-                      const unsigned char *sk_seed,
-                      const unsigned char *pub_seed, uint32_t addr[8])
+                      const xmss_prf_ctx *sk_seed,
+                      const xmss_prf_ctx *pub_seed, uint32_t addr[8])
 {
     unsigned int i;
     unsigned int tau = params->tree_height;
@@ -508,123 +576,320 @@ static void bds_round(const xmss_params *params,
 }
 
 /**
- * Given a set of parameters, this function returns the size of the secret key.
- * This is implementation specific, as varying choices in tree traversal will
- * result in varying requirements for state storage.
- *
- * This function handles both XMSS and XMSSMT parameter sets.
+ * The part of the secret key that signing works on: the index, seeds and
+ * root, the BDS states and the WOTS signatures on the lower roots.
+ * xmssmt_core_sign_detached maps it onto the bytes of a secret key for every
+ * signature, while xmss_core_signer_load copies it into memory of its own.
  */
-unsigned long long xmss_xmssmt_core_sk_bytes(const xmss_params *params)
+struct xmss_signer {
+    xmss_params params;
+    unsigned char *sk; /* [idx || SK_SEED || SK_PRF || root || PUB_SEED] */
+    xmss_prf_ctx sk_seed;
+    xmss_prf_ctx sk_prf;
+    xmss_prf_ctx pub_seed;
+    bds_state *states;
+    unsigned char *wots_sigs;
+    unsigned char *selectors; /* see state_slot */
+    unsigned char *next_wots_sigs; /* see bds_schedule_fill */
+    unsigned char *next_wots_ready;
+    struct signer_precomp *precomp; /* see xmss_core_signer_precompute */
+};
+
+/**
+ * A signature prepared ahead by the precomputation thread: the part of it
+ * that does not depend on the message, and the secret key after it.
+ */
+typedef struct {
+    unsigned long long idx;
+    unsigned char *tail;
+    unsigned char *sk;
+} precomputed_sig;
+
+/**
+ * The background thread that runs the BDS traversal of a signer ahead of its
+ * signatures, and the ring of up to lookahead signatures it prepared. While
+ * it runs, the thread owns the index and BDS states of the signer.
+ */
+struct signer_precomp {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    unsigned int lookahead;
+    unsigned long long produced; /* written by the thread only */
+    unsigned long long consumed; /* written by the signing thread only */
+    int exhausted;
+    int stop;
+    unsigned char *sk; /* the secret key as of the last signature handed out */
+    precomputed_sig *sigs;
+};
+
+/**
+ * Sets up signer for the secret key sk, with the BDS states mapped onto sk.
+ * The treehash instances of states must already be set.
+ */
+static void signer_map(const xmss_params *params, xmss_signer *signer,
+                       bds_state *states, unsigned char *sk)
 {
-    return params->index_bytes + 4 * params->n
-        + (2 * params->d - 1) * (
-            (params->tree_height + 1) * params->n
-            + 4
-            + params->tree_height + 1
-            + params->tree_height * params->n
-            + (params->tree_height >> 1) * params->n
-            + (params->tree_height - params->bds_k) * (7 + params->n)
-            + ((1 << params->bds_k) - params->bds_k - 1) * params->n
-            + 4
-         )
-        + (params->d - 1) * params->wots_sig_bytes;
+    signer->params = *params;
+    signer->sk = sk;
+    signer->states = states;
+    signer->wots_sigs = NULL;
+    signer->precomp = NULL;
+    signer->selectors = sk + params->sk_bytes - (params->d - 1);
+    signer->next_wots_sigs = NULL;
+    signer->next_wots_ready = NULL;
+    if (params->bds_schedule == XMSS_BDS_SCHEDULE_CONSTANT) {
+        signer->next_wots_sigs = sk_next_wots_sigs(params, sk);
+        signer->next_wots_ready = signer->next_wots_sigs + (params->d - 1) * params->wots_sig_bytes;
+    }
+    xmssmt_deserialize_state(params, states, &signer->wots_sigs, sk);
+
+    prf_ctx_init(params, &signer->sk_seed, sk + params->index_bytes);
+    prf_ctx_init(params, &signer->sk_prf, sk + params->index_bytes + params->n);
+    prf_ctx_init(params, &signer->pub_seed, sk + params->index_bytes + 3*params->n);
 }
 
-/*
- * Generates a XMSS key pair for a given parameter set.
- * Format sk: [(32bit) idx || SK_SEED || SK_PRF || root || PUB_SEED]
- * Format pk: [root || PUB_SEED] omitting algo oid.
+/**
+ * Copies the contents of BDS state src to dst, which may use another layout.
  */
-int xmss_core_keypair(const xmss_params *params,
-                      unsigned char *pk, unsigned char *sk)
+static void bds_state_copy(const xmss_params *params,
+                           bds_state *dst, const bds_state *src)
 {
-    uint32_t addr[8] = {0};
+    unsigned int i;
 
-    // TODO refactor BDS state not to need separate treehash instances
-    bds_state state;
-    treehash_inst treehash[params->tree_height - params->bds_k];
-    state.treehash = treehash;
+    memcpy(dst->stack, src->stack, (params->tree_height + 1) * params->n);
+    dst->stackoffset = src->stackoffset;
+    memcpy(dst->stacklevels, src->stacklevels, params->tree_height + 1);
+    memcpy(dst->auth, src->auth, params->tree_height * params->n);
+    memcpy(dst->keep, src->keep, (params->tree_height >> 1) * params->n);
 
-    xmss_deserialize_state(params, &state, sk);
+    for (i = 0; i < params->tree_height - params->bds_k; i++) {
+        dst->treehash[i].h = src->treehash[i].h;
+        dst->treehash[i].next_idx = src->treehash[i].next_idx;
+        dst->treehash[i].stackusage = src->treehash[i].stackusage;
+        dst->treehash[i].completed = src->treehash[i].completed;
+        memcpy(dst->treehash[i].node, src->treehash[i].node, params->n);
+    }
 
-    state.stackoffset = 0;
-    state.next_leaf = 0;
+    memcpy(dst->retain, src->retain, ((1 << params->bds_k) - params->bds_k - 1) * params->n);
+    dst->next_leaf = src->next_leaf;
+}
 
-    // Set idx = 0
-    sk[0] = 0;
-    sk[1] = 0;
-    sk[2] = 0;
-    sk[3] = 0;
-    // Init SK_SEED (n byte) and SK_PRF (n byte)
-    randombytes(sk + params->index_bytes, 2*params->n);
+/* Rounds up to a multiple of the cache line size. */
+#define CACHE_LINE_BYTES 64
+#define CACHE_ALIGN(x) (((x) + CACHE_LINE_BYTES - 1) & ~(size_t)(CACHE_LINE_BYTES - 1))
 
-    // Init PUB_SEED (n byte)
-    randombytes(sk + params->index_bytes + 3*params->n, params->n);
-    // Copy PUB_SEED to public key
-    memcpy(pk + params->n, sk + params->index_bytes + 3*params->n, params->n);
+/* Returns the next aligned chunk of len bytes from *mem. */
+static unsigned char *carve(unsigned char **mem, size_t len)
+{
+    unsigned char *r = *mem;
 
-    // Compute root
-    treehash_init(params, pk, params->tree_height, 0, &state, sk + params->index_bytes, sk + params->index_bytes + 3*params->n, addr);
-    // copy root to sk
-    memcpy(sk + params->index_bytes + 2*params->n, pk, params->n);
+    *mem += CACHE_ALIGN(len);
+    return r;
+}
 
-    /* Write the BDS state into sk. */
-    xmss_serialize_state(params, sk, &state);
+/**
+ * Copies the index, BDS states and WOTS signatures of the secret key sk into
+ * the memory of signer.
+ */
+static void signer_read(xmss_signer *signer, const unsigned char *sk)
+{
+    const xmss_params *params = &signer->params;
+    const unsigned int nstates = 2*params->d - 1;
+    const unsigned int nth = params->tree_height - params->bds_k;
+    unsigned char *sk_wots_sigs = NULL;
+    unsigned int i;
 
-    return 0;
+    // the states mapped onto sk, to copy from
+    bds_state sk_states[nstates];
+    treehash_inst sk_treehash[nstates * nth];
+    for (i = 0; i < nstates; i++) {
+        sk_states[i].treehash = sk_treehash + i * nth;
+    }
+    xmssmt_deserialize_state(params, sk_states, &sk_wots_sigs, (unsigned char *)sk);
+
+    memcpy(signer->sk, sk, sk_head_bytes(params));
+    if (params->d > 1) {
+        memcpy(signer->wots_sigs, sk_wots_sigs, (params->d - 1) * params->wots_sig_bytes);
+    }
+    // the selectors say where flush should write each state to
+    memcpy(signer->selectors, sk + params->sk_bytes - (params->d - 1), params->d - 1);
+    if (params->bds_schedule == XMSS_BDS_SCHEDULE_CONSTANT) {
+        memcpy(signer->next_wots_sigs, sk_next_wots_sigs(params, sk),
+               (params->d - 1) * (params->wots_sig_bytes + 1));
+    }
+    for (i = 0; i < nstates; i++) {
+        bds_state_copy(params, signer->states + i, sk_states + i);
+    }
 }
 
 /**
- * Signs a message.
- * Returns
- * 1. an array containing the signature followed by the message AND
- * 2. an updated secret key!
- *
+ * Writes the index, BDS states and WOTS signatures of signer to the secret
+ * key sk.
  */
-int xmss_core_sign(const xmss_params *params,
-                   unsigned char *sk,
-                   unsigned char *sm, unsigned long long *smlen,
-                   const unsigned char *m, unsigned long long mlen)
+static void signer_write(const xmss_signer *signer, unsigned char *sk)
 {
-    const unsigned char *pub_root = sk + params->index_bytes + 2*params->n;
+    const xmss_params *params = &signer->params;
+    const unsigned int nstates = 2*params->d - 1;
+    const unsigned int nth = params->tree_height - params->bds_k;
+    unsigned char *sk_wots_sigs = NULL;
+    unsigned int i;
 
-    uint16_t i = 0;
+    bds_state sk_states[nstates];
+    treehash_inst sk_treehash[nstates * nth];
+    for (i = 0; i < nstates; i++) {
+        sk_states[i].treehash = sk_treehash + i * nth;
+    }
 
-    // TODO refactor BDS state not to need separate treehash instances
-    bds_state state;
-    treehash_inst treehash[params->tree_height - params->bds_k];
-    state.treehash = treehash;
+    memcpy(sk + params->sk_bytes - (params->d - 1), signer->selectors, params->d - 1);
+    xmssmt_deserialize_state(params, sk_states, &sk_wots_sigs, sk);
+    for (i = 0; i < nstates; i++) {
+        bds_state_copy(params, sk_states + i, signer->states + i);
+    }
+    xmssmt_serialize_state(params, sk, sk_states);
 
-    /* Load the BDS state from sk. */
-    xmss_deserialize_state(params, &state, sk);
+    memcpy(sk, signer->sk, sk_head_bytes(params));
+    if (params->d > 1) {
+        memcpy(sk_wots_sigs, signer->wots_sigs, (params->d - 1) * params->wots_sig_bytes);
+    }
+    if (params->bds_schedule == XMSS_BDS_SCHEDULE_CONSTANT) {
+        memcpy(sk_next_wots_sigs(params, sk), signer->next_wots_sigs,
+               (params->d - 1) * (params->wots_sig_bytes + 1));
+    }
+}
 
-    // Extract SK
-    unsigned long idx = ((unsigned long)sk[0] << 24) | ((unsigned long)sk[1] << 16) | ((unsigned long)sk[2] << 8) | sk[3];
-    unsigned char sk_seed[params->n];
-    memcpy(sk_seed, sk + params->index_bytes, params->n);
-    unsigned char sk_prf[params->n];
-    memcpy(sk_prf, sk + params->index_bytes + params->n, params->n);
-    unsigned char pub_seed[params->n];
-    memcpy(pub_seed, sk + params->index_bytes + 3*params->n, params->n);
+static int restore_state(const xmss_params *params, unsigned char *sk,
+                         unsigned long long target_idx);
 
-    // index as 32 bytes string
-    unsigned char idx_bytes_32[32];
-    ull_to_bytes(idx_bytes_32, 32, idx);
+/**
+ * Loads the secret key sk into a new signer, which keeps the BDS states in
+ * memory of its own, with every node array starting at a cache line.
+ * Signing with it does not modify sk; use xmss_core_signer_flush to write
+ * the updated key back. If the states in sk are behind its index, they are
+ * restored for it first.
+ * Returns NULL if out of memory, or if the states cannot be restored.
+ */
+xmss_signer *xmss_core_signer_load(const xmss_params *params,
+                                   const unsigned char *sk)
+{
+    const unsigned int nstates = 2*params->d - 1;
+    const unsigned int nth = params->tree_height - params->bds_k;
+    const size_t head_bytes = sk_head_bytes(params);
+    const size_t wots_bytes = (params->d - 1) * params->wots_sig_bytes;
+    const size_t next_wots_bytes = params->bds_schedule == XMSS_BDS_SCHEDULE_CONSTANT ?
+        (params->d - 1) * (params->wots_sig_bytes + 1) : 0;
+    const size_t retain_bytes = ((1 << params->bds_k) - params->bds_k - 1) * params->n;
+    size_t state_bytes;
+    size_t total;
+    const unsigned long long idx = bytes_to_ull(sk, params->index_bytes);
+    unsigned char *restored = NULL;
+    xmss_signer *signer;
+    unsigned char *mem;
+    unsigned int i, j;
+
+    if (sk_state_idx(params, sk) != idx && idx < sk_end(params, sk)) {
+        // indices were reserved past the states; rebuild them in a copy
+        restored = malloc(params->sk_bytes);
+        if (restored == NULL) {
+            return NULL;
+        }
+        memcpy(restored, sk, params->sk_bytes);
+        if (restore_state(params, restored, idx)) {
+            free(restored);
+            return NULL;
+        }
+        sk = restored;
+    }
+
+    state_bytes = CACHE_ALIGN((params->tree_height + 1) * params->n)
+        + CACHE_ALIGN(params->tree_height + 1)
+        + CACHE_ALIGN(params->tree_height * params->n)
+        + CACHE_ALIGN((params->tree_height >> 1) * params->n)
+        + CACHE_ALIGN(nth * params->n)
+        + CACHE_ALIGN(retain_bytes);
+    total = CACHE_ALIGN(sizeof(xmss_signer))
+        + CACHE_ALIGN(nstates * sizeof(bds_state))
+        + CACHE_ALIGN(nstates * nth * sizeof(treehash_inst))
+        + CACHE_ALIGN(head_bytes)
+        + CACHE_ALIGN(wots_bytes)
+        + CACHE_ALIGN(next_wots_bytes)
+        + CACHE_ALIGN(params->d - 1)
+        + nstates * state_bytes;
+
+    mem = aligned_alloc(CACHE_LINE_BYTES, total);
+    if (mem == NULL) {
+        free(restored);
+        return NULL;
+    }
+    signer = (xmss_signer *)carve(&mem, sizeof(xmss_signer));
+
+    signer->params = *params;
+    signer->precomp = NULL;
+
+    signer->sk = carve(&mem, head_bytes);
+    signer->wots_sigs = params->d > 1 ? carve(&mem, wots_bytes) : NULL;
+    if (params->d == 1) {
+        mem += CACHE_ALIGN(wots_bytes);
+    }
+    signer->next_wots_sigs = NULL;
+    signer->next_wots_ready = NULL;
+    if (next_wots_bytes > 0) {
+        signer->next_wots_sigs = carve(&mem, next_wots_bytes);
+        signer->next_wots_ready = signer->next_wots_sigs + wots_bytes;
+    }
+    signer->selectors = carve(&mem, params->d - 1);
+    signer->states = (bds_state *)carve(&mem, nstates * sizeof(bds_state));
+    treehash_inst *treehash = (treehash_inst *)carve(&mem, nstates * nth * sizeof(treehash_inst));
+    for (i = 0; i < nstates; i++) {
+        bds_state *state = signer->states + i;
+        unsigned char *nodes;
+
+        state->stack = carve(&mem, (params->tree_height + 1) * params->n);
+        state->stacklevels = carve(&mem, params->tree_height + 1);
+        state->auth = carve(&mem, params->tree_height * params->n);
+        state->keep = carve(&mem, (params->tree_height >> 1) * params->n);
+        state->treehash = treehash + i * nth;
+        nodes = carve(&mem, nth * params->n);
+        for (j = 0; j < nth; j++) {
+            state->treehash[j].node = nodes + j * params->n;
+        }
+        state->retain = carve(&mem, retain_bytes);
+    }
+    signer_read(signer, sk);
+    free(restored);
+
+    // the contexts refer to their keys, so these must be the signer's own
+    prf_ctx_init(params, &signer->sk_seed, signer->sk + params->index_bytes);
+    prf_ctx_init(params, &signer->sk_prf,
+                 signer->sk + params->index_bytes + params->n);
+    prf_ctx_init(params, &signer->pub_seed,
+                 signer->sk + params->index_bytes + 3*params->n);
+
+    return signer;
+}
+
+/**
+ * Writes the part of the signature of index idx that depends on the message
+ * to sig: the index, R and the WOTS signature on the lowest layer. This only
+ * reads the seeds and root of signer, not its BDS states.
+ */
+static void signer_sign_message(const xmss_params *params,
+                                const xmss_signer *signer,
+                                unsigned long long idx, unsigned char *sig,
+                                const struct iovec *m, unsigned int iovcnt)
+{
+    const unsigned char *pub_root = signer->sk + params->index_bytes + 2*params->n;
 
-    // Update SK
-    sk[0] = ((idx + 1) >> 24) & 255;
-    sk[1] = ((idx + 1) >> 16) & 255;
-    sk[2] = ((idx + 1) >> 8) & 255;
-    sk[3] = (idx + 1) & 255;
-    // Secret key for this non-forward-secure version is now updated.
-    // A production implementation should consider using a file handle instead,
-    //  and write the updated secret key at this point!
+    uint64_t idx_tree;
+    uint32_t idx_leaf;
+    uint64_t i;
 
     // Init working params
     unsigned char R[params->n];
     unsigned char msg_h[params->n];
     unsigned char ots_seed[params->n];
     uint32_t ots_addr[8] = {0};
+    unsigned char idx_bytes_32[32];
 
     // ---------------------------------
     // Message Hashing
@@ -632,274 +897,221 @@ int xmss_core_sign(const xmss_params *params,
 
     // Message Hash:
     // First compute pseudorandom value
-    prf(params, R, idx_bytes_32, sk_prf);
-
-    /* Already put the message in the right place, to make it easier to prepend
-     * things when computing the hash over the message. */
-    memcpy(sm + params->sig_bytes, m, mlen);
+    ull_to_bytes(idx_bytes_32, 32, idx);
+    prf(params, R, idx_bytes_32, &signer->sk_prf);
 
     /* Compute the message hash. */
-    hash_message(params, msg_h, R, pub_root, idx,
-                 sm + params->sig_bytes - 4*params->n, mlen);
-
-    // Start collecting signature
-    *smlen = 0;
+    hash_message_iov(params, msg_h, R, pub_root, idx, m, iovcnt);
 
     // Copy index to signature
-    sm[0] = (idx >> 24) & 255;
-    sm[1] = (idx >> 16) & 255;
-    sm[2] = (idx >> 8) & 255;
-    sm[3] = idx & 255;
+    for (i = 0; i < params->index_bytes; i++) {
+        sig[i] = (idx >> 8*(params->index_bytes - 1 - i)) & 255;
+    }
 
-    sm += 4;
-    *smlen += 4;
+    sig += params->index_bytes;
 
     // Copy R to signature
     for (i = 0; i < params->n; i++) {
-        sm[i] = R[i];
+        sig[i] = R[i];
     }
 
-    sm += params->n;
-    *smlen += params->n;
+    sig += params->n;
 
     // ----------------------------------
     // Now we start to "really sign"
     // ----------------------------------
 
+    // Handle lowest layer separately as it is slightly different...
+
     // Prepare Address
     set_type(ots_addr, 0);
-    set_ots_addr(ots_addr, idx);
+    idx_tree = idx >> params->tree_height;
+    idx_leaf = (idx & ((1 << params->tree_height)-1));
+    set_layer_addr(ots_addr, 0);
+    set_tree_addr(ots_addr, idx_tree);
+    set_ots_addr(ots_addr, idx_leaf);
 
     // Compute seed for OTS key pair
-    get_seed(params, ots_seed, sk_seed, ots_addr);
+    get_seed(params, ots_seed, &signer->sk_seed, ots_addr);
 
     // Compute WOTS signature
-    wots_sign(params, sm, msg_h, ots_seed, pub_seed, ots_addr);
-
-    sm += params->wots_sig_bytes;
-    *smlen += params->wots_sig_bytes;
+    wots_sign(params, sig, msg_h, ots_seed, &signer->pub_seed, ots_addr);
+}
 
-    // the auth path was already computed during the previous round
-    memcpy(sm, state.auth, params->tree_height*params->n);
+/**
+ * Returns the number of leaf computations and WOTS signatures that signing
+ * spends on every index with XMSS_BDS_SCHEDULE_CONSTANT. Per tree, the BDS
+ * rounds compute 2^(h-1) leaves, the treehash instance of height i that is
+ * started at every 2^(i+1)-th leaf, unless it would start past 3 * 2^i
+ * before the end, computes 2^(h-i-1) - 2 times 2^i leaves, and the next tree
+ * takes 2^h leaves and the WOTS signature on its root. The budget exceeds
+ * that average by enough to build the next trees of the upper layers, and
+ * is no less than what bds_round and bds_treehash_update do in one go.
+ * It is capped at the most that an index may take, i.e. a leaf for the BDS
+ * round, (h-k)/2 treehash updates and what bds_schedule_due asks for on top
+ * of those: 2 on the lowest layer and 1 on every other one but the top.
+ */
+static unsigned int bds_schedule_budget(const xmss_params *params)
+{
+    const unsigned int h = params->tree_height;
+    const unsigned int most = 1 + ((h - params->bds_k) >> 1)
+                              + (params->d > 1 ? params->d : 0);
+    unsigned long long per_tree = (1ULL << (h - 1)) + (1ULL << h) + 1;
+    unsigned long long budget;
+    unsigned int i;
 
-    if (idx < (1U << params->tree_height) - 1) {
-        bds_round(params, &state, idx, sk_seed, pub_seed, ots_addr);
-        bds_treehash_update(params, &state, (params->tree_height - params->bds_k) >> 1, sk_seed, pub_seed, ots_addr);
+    for (i = 0; i + 3 <= h && i < h - params->bds_k; i++) {
+        per_tree += (1ULL << (h - 1)) - (2ULL << i);
     }
+    // the upper layers need at most twice per_tree for every 2^2h indices
+    budget = (per_tree * (1ULL << h) + 2 * per_tree) / (1ULL << (2 * h)) + 1;
+    return budget < most ? budget : most;
+}
 
-    sm += params->tree_height*params->n;
-    *smlen += params->tree_height*params->n;
-
-    memcpy(sm, m, mlen);
-    *smlen += mlen;
-
-    /* Write the updated BDS state back into sk. */
-    xmss_serialize_state(params, sk, &state);
+/**
+ * Returns how many of the leaf computations and the WOTS signature that the
+ * next tree of layer i takes must be done, with XMSS_BDS_SCHEDULE_CONSTANT,
+ * once idx is the index of the upcoming signature. The 2^h + 1 of them have
+ * the 2^((i+1)h) - 1 signatures that follow the swap that started the tree,
+ * until the last of them swaps it in. As few as possible are due early, so
+ * that the budget can do them while the BDS rounds leave it room; at the
+ * end, they fall due at the even rate that fits them in, i.e. 2 per
+ * signature on the lowest layer and 1 on the others.
+ */
+static unsigned long long bds_schedule_due(const xmss_params *params,
+                                           unsigned int i,
+                                           unsigned long long idx)
+{
+    const unsigned long long signatures = (1ULL << ((i+1) * params->tree_height)) - 1;
+    const unsigned long long units = (1ULL << params->tree_height) + 1;
+    const unsigned long long rate = (units + signatures - 1) / signatures;
+    const unsigned long long left = signatures - (idx & signatures);
 
-    return 0;
+    return units > rate * left ? units - rate * left : 0;
 }
 
-/*
- * Generates a XMSSMT key pair for a given parameter set.
- * Format sk: [(ceil(h/8) bit) idx || SK_SEED || SK_PRF || root || PUB_SEED]
- * Format pk: [root || PUB_SEED] omitting algo oid.
+/**
+ * With XMSS_BDS_SCHEDULE_CONSTANT, computes a leaf of the next tree of layer
+ * i, which follows the tree that index idx is in, if it is not complete yet,
+ * or else the WOTS signature on its root, which the swap to it then only
+ * copies. Returns -1 if there is no next tree or it is already signed.
  */
-int xmssmt_core_keypair(const xmss_params *params,
-                        unsigned char *pk, unsigned char *sk)
+static int bds_schedule_step(const xmss_params *params, xmss_signer *signer,
+                             unsigned int i, unsigned long long idx)
 {
+    const unsigned long long next_tree = (idx >> ((i+1) * params->tree_height)) + 1;
+    bds_state *next = &signer->states[params->d + i];
+
     unsigned char ots_seed[params->n];
     uint32_t addr[8] = {0};
-    unsigned int i;
-    unsigned char *wots_sigs;
+    uint32_t ots_addr[8] = {0};
 
-    // TODO refactor BDS state not to need separate treehash instances
-    bds_state states[2*params->d - 1];
-    treehash_inst treehash[(2*params->d - 1) * (params->tree_height - params->bds_k)];
-    for (i = 0; i < 2*params->d - 1; i++) {
-        states[i].treehash = treehash + i * (params->tree_height - params->bds_k);
+    if (next_tree >= (1ULL << (params->full_height - (i+1) * params->tree_height))) {
+        return -1;
     }
-
-    xmssmt_deserialize_state(params, states, &wots_sigs, sk);
-
-    for (i = 0; i < 2 * params->d - 1; i++) {
-        states[i].stackoffset = 0;
-        states[i].next_leaf = 0;
+    if (next->next_leaf < (1ULL << params->tree_height)) {
+        set_layer_addr(addr, i);
+        set_tree_addr(addr, next_tree);
+        bds_state_update(params, next, &signer->sk_seed, &signer->pub_seed, addr);
+        return 0;
     }
-
-    // Set idx = 0
-    for (i = 0; i < params->index_bytes; i++) {
-        sk[i] = 0;
+    if (signer->next_wots_ready[i]) {
+        return -1;
     }
-    // Init SK_SEED (params->n byte) and SK_PRF (params->n byte)
-    randombytes(sk+params->index_bytes, 2*params->n);
+    set_type(ots_addr, 0);
+    set_layer_addr(ots_addr, i + 1);
+    set_tree_addr(ots_addr, next_tree >> params->tree_height);
+    set_ots_addr(ots_addr, next_tree & ((1 << params->tree_height)-1));
+    get_seed(params, ots_seed, &signer->sk_seed, ots_addr);
+    wots_sign(params, signer->next_wots_sigs + i*params->wots_sig_bytes, next->stack, ots_seed, &signer->pub_seed, ots_addr);
+    signer->next_wots_ready[i] = 1;
+    return 0;
+}
 
-    // Init PUB_SEED (params->n byte)
-    randombytes(sk+params->index_bytes + 3*params->n, params->n);
-    // Copy PUB_SEED to public key
-    memcpy(pk+params->n, sk+params->index_bytes+3*params->n, params->n);
+/**
+ * With XMSS_BDS_SCHEDULE_CONSTANT, first brings the next trees of all but
+ * the top layer up to what bds_schedule_due asks for, and then spends what
+ * is left of units leaf computations or WOTS signatures on getting ahead of
+ * that, lowest layer first. idx is the index of the upcoming signature.
+ */
+static void bds_schedule_fill(const xmss_params *params, xmss_signer *signer,
+                              unsigned long long idx, unsigned int units)
+{
+    unsigned int i;
 
-    // Start with the bottom-most layer
-    set_layer_addr(addr, 0);
-    // Set up state and compute wots signatures for all but topmost tree root
-    for (i = 0; i < params->d - 1; i++) {
-        // Compute seed for OTS key pair
-        treehash_init(params, pk, params->tree_height, 0, states + i, sk+params->index_bytes, pk+params->n, addr);
-        set_layer_addr(addr, (i+1));
-        get_seed(params, ots_seed, sk + params->index_bytes, addr);
-        wots_sign(params, wots_sigs + i*params->wots_sig_bytes, pk, ots_seed, pk+params->n, addr);
+    for (i = 0; i + 1 < params->d; i++) {
+        while (signer->states[params->d + i].next_leaf + signer->next_wots_ready[i]
+                    < bds_schedule_due(params, i, idx) &&
+                bds_schedule_step(params, signer, i, idx) == 0) {
+            if (units > 0) {
+                units--;
+            }
+        }
+    }
+    while (units > 0) {
+        for (i = 0; i + 1 < params->d; i++) {
+            if (bds_schedule_step(params, signer, i, idx) == 0) {
+                break;
+            }
+        }
+        if (i + 1 >= params->d) {
+            // everything up to the next swap is done already
+            break;
+        }
+        units--;
     }
-    // Address now points to the single tree on layer d-1
-    treehash_init(params, pk, params->tree_height, 0, states + i, sk+params->index_bytes, pk+params->n, addr);
-    memcpy(sk + params->index_bytes + 2*params->n, pk, params->n);
-
-    xmssmt_serialize_state(params, sk, states);
-
-    return 0;
 }
 
 /**
- * Signs a message.
- * Returns
- * 1. an array containing the signature followed by the message AND
- * 2. an updated secret key!
- *
+ * Writes the part of the signature of index idx that does not depend on the
+ * message to tail: the authentication paths and the WOTS signatures on the
+ * lower roots, which follow the WOTS signature on the lowest layer. Then
+ * advances the BDS states of signer past idx.
  */
-int xmssmt_core_sign(const xmss_params *params,
-                     unsigned char *sk,
-                     unsigned char *sm, unsigned long long *smlen,
-                     const unsigned char *m, unsigned long long mlen)
+static void signer_advance(const xmss_params *params, xmss_signer *signer,
+                           unsigned long long idx, unsigned char *tail)
 {
-    const unsigned char *pub_root = sk + params->index_bytes + 2*params->n;
+    bds_state *states = signer->states;
+    bds_state tmp_state;
+    unsigned char *wots_sigs = signer->wots_sigs;
 
     uint64_t idx_tree;
     uint32_t idx_leaf;
     uint64_t i, j;
     int needswap_upto = -1;
     unsigned int updates;
+    const int constant = params->bds_schedule == XMSS_BDS_SCHEDULE_CONSTANT;
+    // with the constant schedule; leaves and WOTS signatures computed so far
+    unsigned int used = 0;
 
-    unsigned char sk_seed[params->n];
-    unsigned char sk_prf[params->n];
-    unsigned char pub_seed[params->n];
-    // Init working params
-    unsigned char R[params->n];
-    unsigned char msg_h[params->n];
     unsigned char ots_seed[params->n];
     uint32_t addr[8] = {0};
     uint32_t ots_addr[8] = {0};
-    unsigned char idx_bytes_32[32];
-
-    unsigned char *wots_sigs;
-
-    // TODO refactor BDS state not to need separate treehash instances
-    bds_state states[2*params->d - 1];
-    treehash_inst treehash[(2*params->d - 1) * (params->tree_height - params->bds_k)];
-    for (i = 0; i < 2*params->d - 1; i++) {
-        states[i].treehash = treehash + i * (params->tree_height - params->bds_k);
-    }
-
-    xmssmt_deserialize_state(params, states, &wots_sigs, sk);
-
-    // Extract SK
-    unsigned long long idx = 0;
-    for (i = 0; i < params->index_bytes; i++) {
-        idx |= ((unsigned long long)sk[i]) << 8*(params->index_bytes - 1 - i);
-    }
-
-    memcpy(sk_seed, sk+params->index_bytes, params->n);
-    memcpy(sk_prf, sk+params->index_bytes+params->n, params->n);
-    memcpy(pub_seed, sk+params->index_bytes+3*params->n, params->n);
-
-    // Update SK
-    for (i = 0; i < params->index_bytes; i++) {
-        sk[i] = ((idx + 1) >> 8*(params->index_bytes - 1 - i)) & 255;
-    }
-    // Secret key for this non-forward-secure version is now updated.
-    // A production implementation should consider using a file handle instead,
-    //  and write the updated secret key at this point!
-
-    // ---------------------------------
-    // Message Hashing
-    // ---------------------------------
-
-    // Message Hash:
-    // First compute pseudorandom value
-    ull_to_bytes(idx_bytes_32, 32, idx);
-    prf(params, R, idx_bytes_32, sk_prf);
-
-    /* Already put the message in the right place, to make it easier to prepend
-     * things when computing the hash over the message. */
-    memcpy(sm + params->sig_bytes, m, mlen);
-
-    /* Compute the message hash. */
-    hash_message(params, msg_h, R, pub_root, idx,
-                 sm + params->sig_bytes - 4*params->n, mlen);
-
-    // Start collecting signature
-    *smlen = 0;
-
-    // Copy index to signature
-    for (i = 0; i < params->index_bytes; i++) {
-        sm[i] = (idx >> 8*(params->index_bytes - 1 - i)) & 255;
-    }
-
-    sm += params->index_bytes;
-    *smlen += params->index_bytes;
-
-    // Copy R to signature
-    for (i = 0; i < params->n; i++) {
-        sm[i] = R[i];
-    }
-
-    sm += params->n;
-    *smlen += params->n;
-
-    // ----------------------------------
-    // Now we start to "really sign"
-    // ----------------------------------
-
-    // Handle lowest layer separately as it is slightly different...
-
-    // Prepare Address
-    set_type(ots_addr, 0);
-    idx_tree = idx >> params->tree_height;
-    idx_leaf = (idx & ((1 << params->tree_height)-1));
-    set_layer_addr(ots_addr, 0);
-    set_tree_addr(ots_addr, idx_tree);
-    set_ots_addr(ots_addr, idx_leaf);
-
-    // Compute seed for OTS key pair
-    get_seed(params, ots_seed, sk_seed, ots_addr);
-
-    // Compute WOTS signature
-    wots_sign(params, sm, msg_h, ots_seed, pub_seed, ots_addr);
-
-    sm += params->wots_sig_bytes;
-    *smlen += params->wots_sig_bytes;
 
-    memcpy(sm, states[0].auth, params->tree_height*params->n);
-    sm += params->tree_height*params->n;
-    *smlen += params->tree_height*params->n;
+    memcpy(tail, states[0].auth, params->tree_height*params->n);
+    tail += params->tree_height*params->n;
 
     // prepare signature of remaining layers
     for (i = 1; i < params->d; i++) {
         // put WOTS signature in place
-        memcpy(sm, wots_sigs + (i-1)*params->wots_sig_bytes, params->wots_sig_bytes);
-
-        sm += params->wots_sig_bytes;
-        *smlen += params->wots_sig_bytes;
+        memcpy(tail, wots_sigs + (i-1)*params->wots_sig_bytes, params->wots_sig_bytes);
+        tail += params->wots_sig_bytes;
 
         // put AUTH nodes in place
-        memcpy(sm, states[i].auth, params->tree_height*params->n);
-        sm += params->tree_height*params->n;
-        *smlen += params->tree_height*params->n;
+        memcpy(tail, states[i].auth, params->tree_height*params->n);
+        tail += params->tree_height*params->n;
     }
 
     updates = (params->tree_height - params->bds_k) >> 1;
 
+    idx_tree = idx >> params->tree_height;
+    idx_leaf = (idx & ((1 << params->tree_height)-1));
+    set_type(ots_addr, 0);
     set_tree_addr(addr, (idx_tree + 1));
-    // mandatory update for NEXT_0 (does not count towards h-k/2) if NEXT_0 exists
-    if ((1 + idx_tree) * (1 << params->tree_height) + idx_leaf < (1ULL << params->full_height)) {
-        bds_state_update(params, &states[params->d], sk_seed, pub_seed, addr);
+    // mandatory update for NEXT_0 (does not count towards h-k/2) if NEXT_0 exists;
+    // the constant schedule does it from its budget in bds_schedule_fill instead
+    if (!constant && (1 + idx_tree) * (1 << params->tree_height) + idx_leaf < (1ULL << params->full_height)) {
+        bds_state_update(params, &states[params->d], &signer->sk_seed, &signer->pub_seed, addr);
     }
 
     for (i = 0; i < params->d; i++) {
@@ -910,32 +1122,49 @@ int xmssmt_core_sign(const xmss_params *params,
             set_layer_addr(addr, i);
             set_tree_addr(addr, idx_tree);
             if (i == (unsigned int) (needswap_upto + 1)) {
-                bds_round(params, &states[i], idx_leaf, sk_seed, pub_seed, addr);
+                bds_round(params, &states[i], idx_leaf, &signer->sk_seed, &signer->pub_seed, addr);
+                // the round computes a leaf for every other index
+                used += !(idx_leaf & 1);
             }
-            updates = bds_treehash_update(params, &states[i], updates, sk_seed, pub_seed, addr);
+            updates = bds_treehash_update(params, &states[i], updates, &signer->sk_seed, &signer->pub_seed, addr);
             set_tree_addr(addr, (idx_tree + 1));
             // if a NEXT-tree exists for this level;
-            if ((1 + idx_tree) * (1 << params->tree_height) + idx_leaf < (1ULL << (params->full_height - params->tree_height * i))) {
+            if (!constant && (1 + idx_tree) * (1 << params->tree_height) + idx_leaf < (1ULL << (params->full_height - params->tree_height * i))) {
                 if (i > 0 && updates > 0 && states[params->d + i].next_leaf < (1ULL << params->full_height)) {
-                    bds_state_update(params, &states[params->d + i], sk_seed, pub_seed, addr);
+                    bds_state_update(params, &states[params->d + i], &signer->sk_seed, &signer->pub_seed, addr);
                     updates--;
                 }
             }
         }
         else if (idx < (1ULL << params->full_height) - 1) {
-            deep_state_swap(params, states+params->d + i, states + i);
+            // bds_schedule_fill keeps to bds_schedule_due, which has the next
+            // tree complete and signed by now
+            assert(!constant || (states[params->d + i].next_leaf == 1U << params->tree_height && signer->next_wots_ready[i]));
+            // the next tree becomes the current one; see state_slot
+            tmp_state = states[params->d + i];
+            states[params->d + i] = states[i];
+            states[i] = tmp_state;
+            signer->selectors[i] ^= 1;
 
             set_layer_addr(ots_addr, (i+1));
             set_tree_addr(ots_addr, ((idx + 1) >> ((i+2) * params->tree_height)));
             set_ots_addr(ots_addr, (((idx >> ((i+1) * params->tree_height)) + 1) & ((1 << params->tree_height)-1)));
 
-            get_seed(params, ots_seed, sk+params->index_bytes, ots_addr);
-            wots_sign(params, wots_sigs + i*params->wots_sig_bytes, states[i].stack, ots_seed, pub_seed, ots_addr);
+            if (constant) {
+                memcpy(wots_sigs + i*params->wots_sig_bytes, signer->next_wots_sigs + i*params->wots_sig_bytes, params->wots_sig_bytes);
+                signer->next_wots_ready[i] = 0;
+            }
+            else {
+                get_seed(params, ots_seed, &signer->sk_seed, ots_addr);
+                wots_sign(params, wots_sigs + i*params->wots_sig_bytes, states[i].stack, ots_seed, &signer->pub_seed, ots_addr);
+            }
 
             states[params->d + i].stackoffset = 0;
             states[params->d + i].next_leaf = 0;
 
-            updates--; // WOTS-signing counts as one update
+            if (!constant) {
+                updates--; // WOTS-signing counts as one update
+            }
             needswap_upto = i;
             for (j = 0; j < params->tree_height-params->bds_k; j++) {
                 states[i].treehash[j].completed = 1;
@@ -943,9 +1172,1228 @@ int xmssmt_core_sign(const xmss_params *params,
         }
     }
 
-    memcpy(sm, m, mlen);
-    *smlen += mlen;
+    if (constant) {
+        used += ((params->tree_height - params->bds_k) >> 1) - updates;
+        bds_schedule_fill(params, signer, idx + 1,
+                          used < bds_schedule_budget(params) ? bds_schedule_budget(params) - used : 0);
+    }
+}
+
+/**
+ * Signs the concatenation of the iovcnt buffers in m with the key in signer,
+ * and advances its index and BDS states.
+ * Returns -1 if all signatures of the key have been used.
+ */
+static int signer_sign(const xmss_params *params, xmss_signer *signer,
+                       unsigned char *sig, unsigned long long *siglen,
+                       const struct iovec *m, unsigned int iovcnt)
+{
+    unsigned long long idx = bytes_to_ull(signer->sk, params->index_bytes);
+
+    if (idx >= sk_end(params, signer->sk)) {
+        // all one-time keys in the range of the key have been used
+        *siglen = 0;
+        return -1;
+    }
+
+    // Update SK; to keep an index from being used twice, it must be stored
+    // before the signature is released, as xmss_sk_file does
+    sk_set_idx(params, signer->sk, idx + 1);
+
+    signer_sign_message(params, signer, idx, sig, m, iovcnt);
+    signer_advance(params, signer, idx,
+                   sig + params->index_bytes + params->n + params->wots_sig_bytes);
+    *siglen = params->sig_bytes;
+
+    return 0;
+}
+
+/**
+ * Prepares the upcoming signatures of the signer passed as arg, until the
+ * ring holds lookahead of them or the key is exhausted, and waits for the
+ * signing thread to take one then.
+ */
+static void *precompute_thread(void *arg)
+{
+    xmss_signer *signer = arg;
+    const xmss_params *params = &signer->params;
+    struct signer_precomp *pc = signer->precomp;
+    precomputed_sig *next;
+    unsigned long long idx;
+
+    pthread_mutex_lock(&pc->lock);
+    while (!pc->stop) {
+        if (pc->exhausted || pc->produced - pc->consumed == pc->lookahead) {
+            pthread_cond_wait(&pc->cond, &pc->lock);
+            continue;
+        }
+        pthread_mutex_unlock(&pc->lock);
+
+        idx = bytes_to_ull(signer->sk, params->index_bytes);
+        if (idx < sk_end(params, signer->sk)) {
+            next = pc->sigs + pc->produced % pc->lookahead;
+            next->idx = idx;
+            sk_set_idx(params, signer->sk, idx + 1);
+            signer_advance(params, signer, idx, next->tail);
+            signer_write(signer, next->sk);
+        }
+
+        pthread_mutex_lock(&pc->lock);
+        if (idx < sk_end(params, signer->sk)) {
+            pc->produced++;
+        }
+        else {
+            pc->exhausted = 1;
+        }
+        pthread_cond_broadcast(&pc->cond);
+    }
+    pthread_mutex_unlock(&pc->lock);
+
+    return NULL;
+}
+
+/**
+ * Signs the concatenation of the iovcnt buffers in m with the next signature
+ * the precomputation thread of signer prepared, waiting for it if needed.
+ * Returns -1 if all signatures of the key have been used.
+ */
+static int signer_sign_precomputed(const xmss_params *params,
+                                   xmss_signer *signer,
+                                   unsigned char *sig,
+                                   unsigned long long *siglen,
+                                   const struct iovec *m, unsigned int iovcnt)
+{
+    const unsigned long long head_bytes = params->index_bytes + params->n + params->wots_sig_bytes;
+    struct signer_precomp *pc = signer->precomp;
+    precomputed_sig *next;
+
+    pthread_mutex_lock(&pc->lock);
+    while (pc->produced == pc->consumed && !pc->exhausted) {
+        pthread_cond_wait(&pc->cond, &pc->lock);
+    }
+    if (pc->produced == pc->consumed) {
+        // all one-time keys have been used
+        pthread_mutex_unlock(&pc->lock);
+        *siglen = 0;
+        return -1;
+    }
+    pthread_mutex_unlock(&pc->lock);
+
+    next = pc->sigs + pc->consumed % pc->lookahead;
+    signer_sign_message(params, signer, next->idx, sig, m, iovcnt);
+    memcpy(sig + head_bytes, next->tail, params->sig_bytes - head_bytes);
+    memcpy(pc->sk, next->sk, params->sk_bytes);
+    *siglen = params->sig_bytes;
+
+    pthread_mutex_lock(&pc->lock);
+    pc->consumed++;
+    pthread_cond_broadcast(&pc->cond);
+    pthread_mutex_unlock(&pc->lock);
+
+    return 0;
+}
+
+/**
+ * Signs the concatenation of the iovcnt buffers in m with the key in signer.
+ * Only the in-memory state of the signer is updated.
+ * Returns -1 if all signatures of the key have been used.
+ */
+int xmss_core_signer_sign_detached(xmss_signer *signer,
+                                   unsigned char *sig,
+                                   unsigned long long *siglen,
+                                   const struct iovec *m, unsigned int iovcnt)
+{
+    if (signer->precomp != NULL) {
+        return signer_sign_precomputed(&signer->params, signer,
+                                       sig, siglen, m, iovcnt);
+    }
+    return signer_sign(&signer->params, signer, sig, siglen, m, iovcnt);
+}
+
+/**
+ * Starts a background thread that runs the BDS traversal of signer ahead of
+ * its signatures, preparing up to lookahead of them, so that signing only
+ * takes computing the WOTS signature on the message. A lookahead of 0 stops
+ * the thread, dropping the signatures it prepared that were not used.
+ * Flushing the signer writes the key as of the last signature handed out.
+ * Returns -1 if the thread cannot be started.
+ */
+int xmss_core_signer_precompute(xmss_signer *signer, unsigned int lookahead)
+{
+    const xmss_params *params = &signer->params;
+    const size_t tail_bytes = params->sig_bytes - params->index_bytes - params->n - params->wots_sig_bytes;
+    struct signer_precomp *pc = signer->precomp;
+    unsigned char *mem;
+    unsigned int i;
+
+    if (pc != NULL) {
+        pthread_mutex_lock(&pc->lock);
+        pc->stop = 1;
+        pthread_cond_broadcast(&pc->cond);
+        pthread_mutex_unlock(&pc->lock);
+        pthread_join(pc->thread, NULL);
+
+        // go back to the state as of the last signature handed out
+        signer_read(signer, pc->sk);
+
+        pthread_cond_destroy(&pc->cond);
+        pthread_mutex_destroy(&pc->lock);
+        free(pc);
+        signer->precomp = NULL;
+    }
+    if (lookahead == 0) {
+        return 0;
+    }
+
+    mem = aligned_alloc(CACHE_LINE_BYTES,
+                        CACHE_ALIGN(sizeof(struct signer_precomp))
+                        + CACHE_ALIGN(lookahead * sizeof(precomputed_sig))
+                        + CACHE_ALIGN(params->sk_bytes)
+                        + lookahead * (CACHE_ALIGN(tail_bytes)
+                                       + CACHE_ALIGN(params->sk_bytes)));
+    if (mem == NULL) {
+        return -1;
+    }
+    pc = (struct signer_precomp *)carve(&mem, sizeof(struct signer_precomp));
+    pc->sigs = (precomputed_sig *)carve(&mem, lookahead * sizeof(precomputed_sig));
+    pc->sk = carve(&mem, params->sk_bytes);
+    for (i = 0; i < lookahead; i++) {
+        pc->sigs[i].tail = carve(&mem, tail_bytes);
+        pc->sigs[i].sk = carve(&mem, params->sk_bytes);
+    }
+    signer_write(signer, pc->sk);
+
+    pthread_mutex_init(&pc->lock, NULL);
+    pthread_cond_init(&pc->cond, NULL);
+    pc->lookahead = lookahead;
+    pc->produced = 0;
+    pc->consumed = 0;
+    pc->exhausted = 0;
+    pc->stop = 0;
+
+    signer->precomp = pc;
+    if (pthread_create(&pc->thread, NULL, precompute_thread, signer)) {
+        pthread_cond_destroy(&pc->cond);
+        pthread_mutex_destroy(&pc->lock);
+        free(pc);
+        signer->precomp = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Would make signer keep the WOTS signatures and authentication paths of the
+ * layers above the lowest, but its BDS states already hold these; see
+ * xmss_core_signer_cache in xmss_core.c. This always returns 0.
+ */
+int xmss_core_signer_cache(xmss_signer *signer, int enable)
+{
+    (void)signer;
+    (void)enable;
+    return 0;
+}
+
+/**
+ * Would make signer compute the trees of a signature on several threads, but
+ * its BDS states spread that computation over the signatures; see
+ * xmss_core_signer_threads in xmss_core.c.
+ */
+void xmss_core_signer_threads(xmss_signer *signer, unsigned int threads)
+{
+    (void)signer;
+    (void)threads;
+}
+
+/**
+ * Writes the current state of signer to the secret key sk, in the format
+ * that xmss_core_signer_load and the signing functions expect.
+ */
+void xmss_core_signer_flush(const xmss_signer *signer, unsigned char *sk)
+{
+    if (signer->precomp != NULL) {
+        // the states have run ahead of the signatures handed out so far
+        memcpy(sk, signer->precomp->sk, signer->params.sk_bytes);
+        return;
+    }
+    signer_write(signer, sk);
+}
+
+/**
+ * Frees a signer; its state is lost unless it was flushed.
+ */
+void xmss_core_signer_free(xmss_signer *signer)
+{
+    xmss_core_signer_precompute(signer, 0);
+    free(signer);
+}
+
+/**
+ * Given a set of parameters, this function returns the size of the secret key.
+ * This is implementation specific, as varying choices in tree traversal will
+ * result in varying requirements for state storage.
+ *
+ * This function handles both XMSS and XMSSMT parameter sets.
+ */
+unsigned long long xmss_xmssmt_core_sk_bytes(const xmss_params *params)
+{
+    return sk_head_bytes(params)
+        + (2 * params->d - 1) * (
+            (params->tree_height + 1) * params->n
+            + 4
+            + params->tree_height + 1
+            + params->tree_height * params->n
+            + (params->tree_height >> 1) * params->n
+            + (params->tree_height - params->bds_k) * (7 + params->n)
+            + ((1 << params->bds_k) - params->bds_k - 1) * params->n
+            + 4
+         )
+        + (params->d - 1) * params->wots_sig_bytes
+        + (params->bds_schedule == XMSS_BDS_SCHEDULE_CONSTANT ?
+           (params->d - 1) * (params->wots_sig_bytes + 1) : 0)
+        + (params->d - 1);
+}
+
+/**
+ * Sets params->bds_k to the value the secret key sk was generated with, which
+ * determines the layout of the BDS states in sk.
+ * Returns -1 if sk is not of the current version of the layout, or if its
+ * head holds a value that is not legal for params, 0 otherwise.
+ */
+int xmss_xmssmt_core_sk_params(xmss_params *params, const unsigned char *sk)
+{
+    const unsigned char *p = sk + params->index_bytes + 4*params->n;
+    const unsigned long long idx = bytes_to_ull(sk, params->index_bytes);
+
+    // A key of the baseline layout has the stack of a BDS state where the
+    // version is; checking the whole head leaves next to no chance that it
+    // is taken for a key of the current one
+    if (p[0] != SK_VERSION || xmss_xmssmt_set_bds_k(params, p[1]) ||
+            xmss_xmssmt_set_bds_schedule(params, p[2])) {
+        return -1;
+    }
+    if (sk_end(params, sk) > (1ULL << params->full_height) ||
+            idx > sk_end(params, sk) || sk_state_idx(params, sk) > idx) {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Converts the secret key old, of the baseline layout that had its BDS
+ * states right after the 'regular' sk, to a key of the current layout in sk,
+ * for params->bds_k and params->bds_schedule. Only the index, the seeds and
+ * the root of old are read, which are at the same offsets in both; the BDS
+ * states are then built for the index as by xmss_core_restore_state.
+ * Returns -1 if old has no index left or its root does not match its seeds.
+ */
+int xmss_xmssmt_core_sk_convert(const xmss_params *params, unsigned char *sk,
+                                const unsigned char *old)
+{
+    const unsigned long long idx = bytes_to_ull(old, params->index_bytes);
+
+    memset(sk, 0, params->sk_bytes);
+    memcpy(sk, old, params->index_bytes + 4*params->n);
+    sk_init_head(params, sk);
+    sk_set_idx(params, sk, 0);
+    return restore_state(params, sk, idx);
+}
+
+/**
+ * Returns the index that signing with the secret key sk stops at.
+ */
+unsigned long long xmss_xmssmt_core_sk_end(const xmss_params *params,
+                                           const unsigned char *sk)
+{
+    return sk_end(params, sk);
+}
+
+/**
+ * Returns the offset in the secret key of the index that its BDS states and
+ * WOTS signatures are for; see sk_state_idx.
+ */
+unsigned long long xmss_xmssmt_core_sk_state_idx_offset(const xmss_params *params)
+{
+    return params->index_bytes + 4*params->n + SK_PARAMS_BYTES + SK_END_BYTES;
+}
 
+/*
+ * Derives a XMSS key pair from a 3*n byte seed, reporting progress and
+ * checkpointing as opts asks for, if not NULL.
+ */
+static int xmss_seed_keypair(const xmss_params *params,
+                             unsigned char *pk, unsigned char *sk,
+                             const unsigned char *seed,
+                             const xmss_keygen_opts *opts)
+{
+    uint32_t addr[8] = {0};
+    xmss_prf_ctx sk_seed;
+    xmss_prf_ctx pub_seed;
+
+    // TODO refactor BDS state not to need separate treehash instances
+    bds_state state;
+    treehash_inst treehash[params->tree_height - params->bds_k];
+    state.treehash = treehash;
+
+    xmss_deserialize_state(params, &state, sk);
+
+    state.stackoffset = 0;
+    state.next_leaf = 0;
+
+    // Init SK_SEED (n byte) and SK_PRF (n byte)
+    memcpy(sk + params->index_bytes, seed, 2*params->n);
+
+    // Init PUB_SEED (n byte)
+    memcpy(sk + params->index_bytes + 3*params->n, seed + 2*params->n, params->n);
+    // Copy PUB_SEED to public key
+    memcpy(pk + params->n, sk + params->index_bytes + 3*params->n, params->n);
+
+    // Record the BDS traversal parameters the states are laid out for
+    sk_init_head(params, sk);
+    // Set idx = 0
+    sk_set_idx(params, sk, 0);
+
+    prf_ctx_init(params, &sk_seed, sk + params->index_bytes);
+    prf_ctx_init(params, &pub_seed, sk + params->index_bytes + 3*params->n);
+
+    // Compute root
+    if (treehash_init(params, pk, &state, 1, NULL, &sk_seed, &pub_seed,
+                      (const uint32_t (*)[8])&addr, sk, opts)) {
+        return -1;
+    }
+    // copy root to sk
+    memcpy(sk + params->index_bytes + 2*params->n, pk, params->n);
+
+    /* Write the BDS state into sk. */
+    xmss_serialize_state(params, sk, &state);
+
+    return 0;
+}
+
+/*
+ * Generates a XMSS key pair for a given parameter set.
+ * Format sk: [(32bit) idx || SK_SEED || SK_PRF || root || PUB_SEED]
+ * Format pk: [root || PUB_SEED] omitting algo oid.
+ */
+int xmss_core_keypair(const xmss_params *params,
+                      unsigned char *pk, unsigned char *sk)
+{
+    unsigned char seed[3 * params->n];
+
+    randombytes(seed, 3 * params->n);
+    return xmss_core_seed_keypair(params, pk, sk, seed);
+}
+
+/*
+ * Derives a XMSS key pair for a given parameter set from a 3*n byte seed,
+ * in the format [SK_SEED || SK_PRF || PUB_SEED].
+ * Format sk: [(32bit) idx || SK_SEED || SK_PRF || root || PUB_SEED]
+ * Format pk: [root || PUB_SEED] omitting algo oid.
+ */
+int xmss_core_seed_keypair(const xmss_params *params,
+                           unsigned char *pk, unsigned char *sk,
+                           const unsigned char *seed)
+{
+    return xmss_seed_keypair(params, pk, sk, seed, NULL);
+}
+
+/*
+ * Generates a XMSS key pair for a given parameter set, reporting progress
+ * and checkpointing as opts asks for, and resuming from the checkpoint file
+ * if there is one.
+ */
+int xmss_core_keypair_resumable(const xmss_params *params,
+                                unsigned char *pk, unsigned char *sk,
+                                const xmss_keygen_opts *opts)
+{
+    unsigned char seed[3 * params->n];
+    int ret;
+
+    // When resuming, the seed comes from the checkpoint
+    ret = keygen_checkpoint_seed(params, seed, opts);
+    if (ret < 0) {
+        return -1;
+    }
+    if (ret == 0) {
+        randombytes(seed, 3 * params->n);
+    }
+    return xmss_seed_keypair(params, pk, sk, seed, opts);
+}
+
+/**
+ * Signs a message.
+ * Returns
+ * 1. an array containing the signature followed by the message AND
+ * 2. an updated secret key!
+ *
+ */
+int xmss_core_sign(const xmss_params *params,
+                   unsigned char *sk,
+                   unsigned char *sm, unsigned long long *smlen,
+                   const unsigned char *m, unsigned long long mlen)
+{
+    struct iovec iov;
+
+    iov.iov_base = (void *)m;
+    iov.iov_len = mlen;
+
+    if (xmss_core_sign_detached(params, sk, sm, smlen, &iov, 1)) {
+        return -1;
+    }
+    memcpy(sm + params->sig_bytes, m, mlen);
+    *smlen += mlen;
+
+    return 0;
+}
+
+/**
+ * Signs the concatenation of the iovcnt buffers in m.
+ * Returns
+ * 1. the signature, without the message, in sig AND
+ * 2. an updated secret key!
+ */
+int xmss_core_sign_detached(const xmss_params *params,
+                            unsigned char *sk,
+                            unsigned char *sig, unsigned long long *siglen,
+                            const struct iovec *m, unsigned int iovcnt)
+{
+    /* With d = 1, the XMSSMT signing routine degenerates to exactly the
+       BDS round and treehash updates of the single tree. */
+    return xmssmt_core_sign_detached(params, sk, sig, siglen, m, iovcnt);
+}
+
+/*
+ * Derives a XMSSMT key pair from a 3*n byte seed, reporting progress and
+ * checkpointing as opts asks for, if not NULL.
+ */
+static int xmssmt_seed_keypair(const xmss_params *params,
+                               unsigned char *pk, unsigned char *sk,
+                               const unsigned char *seed,
+                               const xmss_keygen_opts *opts)
+{
+    unsigned char ots_seed[params->n];
+    unsigned char roots[params->d * params->n];
+    uint32_t addr[params->d][8];
+    unsigned int i;
+    unsigned char *wots_sigs;
+    xmss_prf_ctx sk_seed;
+    xmss_prf_ctx pub_seed;
+
+    // TODO refactor BDS state not to need separate treehash instances
+    bds_state states[2*params->d - 1];
+    treehash_inst treehash[(2*params->d - 1) * (params->tree_height - params->bds_k)];
+    for (i = 0; i < 2*params->d - 1; i++) {
+        states[i].treehash = treehash + i * (params->tree_height - params->bds_k);
+    }
+
+    // Start with the first slot of every layer as the current tree
+    memset(sk + params->sk_bytes - (params->d - 1), 0, params->d - 1);
+    if (params->bds_schedule == XMSS_BDS_SCHEDULE_CONSTANT) {
+        // None of the next trees has been built, let alone signed
+        memset(sk_next_wots_sigs(params, sk), 0, (params->d - 1) * (params->wots_sig_bytes + 1));
+    }
+    xmssmt_deserialize_state(params, states, &wots_sigs, sk);
+
+    for (i = 0; i < 2 * params->d - 1; i++) {
+        states[i].stackoffset = 0;
+        states[i].next_leaf = 0;
+    }
+
+    // Init SK_SEED (params->n byte) and SK_PRF (params->n byte)
+    memcpy(sk+params->index_bytes, seed, 2*params->n);
+
+    // Init PUB_SEED (params->n byte)
+    memcpy(sk+params->index_bytes + 3*params->n, seed + 2*params->n, params->n);
+    // Copy PUB_SEED to public key
+    memcpy(pk+params->n, sk+params->index_bytes+3*params->n, params->n);
+
+    // Record the BDS traversal parameters the states are laid out for
+    sk_init_head(params, sk);
+    // Set idx = 0
+    sk_set_idx(params, sk, 0);
+
+    prf_ctx_init(params, &sk_seed, sk+params->index_bytes);
+    prf_ctx_init(params, &pub_seed, pk+params->n);
+
+    // The first tree on every layer is independent of the others, so all
+    // of them are computed in one go
+    memset(addr, 0, sizeof(addr));
+    for (i = 0; i < params->d; i++) {
+        set_layer_addr(addr[i], i);
+    }
+    if (treehash_init(params, roots, states, params->d, NULL, &sk_seed, &pub_seed,
+                      (const uint32_t (*)[8])addr, sk, opts)) {
+        return -1;
+    }
+
+    // Compute wots signatures for all but topmost tree root
+    for (i = 0; i < params->d - 1; i++) {
+        // Compute seed for OTS key pair
+        get_seed(params, ots_seed, &sk_seed, addr[i + 1]);
+        wots_sign(params, wots_sigs + i*params->wots_sig_bytes, roots + i*params->n, ots_seed, &pub_seed, addr[i + 1]);
+    }
+    // The root of the single tree on layer d-1 is the public root
+    memcpy(pk, roots + (params->d - 1)*params->n, params->n);
+    memcpy(sk + params->index_bytes + 2*params->n, pk, params->n);
+
+    xmssmt_serialize_state(params, sk, states);
+
+    return 0;
+}
+
+/*
+ * Generates a XMSSMT key pair for a given parameter set.
+ * Format sk: [(ceil(h/8) bit) idx || SK_SEED || SK_PRF || root || PUB_SEED]
+ * Format pk: [root || PUB_SEED] omitting algo oid.
+ */
+int xmssmt_core_keypair(const xmss_params *params,
+                        unsigned char *pk, unsigned char *sk)
+{
+    unsigned char seed[3 * params->n];
+
+    randombytes(seed, 3 * params->n);
+    return xmssmt_core_seed_keypair(params, pk, sk, seed);
+}
+
+/*
+ * Derives a XMSSMT key pair for a given parameter set from a 3*n byte seed,
+ * in the format [SK_SEED || SK_PRF || PUB_SEED].
+ * Format sk: [(ceil(h/8) bit) idx || SK_SEED || SK_PRF || root || PUB_SEED]
+ * Format pk: [root || PUB_SEED] omitting algo oid.
+ */
+int xmssmt_core_seed_keypair(const xmss_params *params,
+                             unsigned char *pk, unsigned char *sk,
+                             const unsigned char *seed)
+{
+    return xmssmt_seed_keypair(params, pk, sk, seed, NULL);
+}
+
+/*
+ * Generates a XMSSMT key pair for a given parameter set, reporting progress
+ * and checkpointing as opts asks for, and resuming from the checkpoint file
+ * if there is one.
+ */
+int xmssmt_core_keypair_resumable(const xmss_params *params,
+                                  unsigned char *pk, unsigned char *sk,
+                                  const xmss_keygen_opts *opts)
+{
+    unsigned char seed[3 * params->n];
+    int ret;
+
+    // When resuming, the seed comes from the checkpoint
+    ret = keygen_checkpoint_seed(params, seed, opts);
+    if (ret < 0) {
+        return -1;
+    }
+    if (ret == 0) {
+        randombytes(seed, 3 * params->n);
+    }
+    return xmssmt_seed_keypair(params, pk, sk, seed, opts);
+}
+
+/**
+ * Builds the BDS states and WOTS signatures that the secret key sk needs for
+ * signing index idx, given only its 'regular' sk, bds_k and bds_schedule.
+ * The current tree on every layer is computed once, keeping the nodes that
+ * the BDS state needs for the leaf that idx is at, with all treehash
+ * instances completed; the next trees are computed in full, and with
+ * XMSS_BDS_SCHEDULE_CONSTANT their roots signed, as if signing had run ahead
+ * of schedule. Returns -1 if the root does not match.
+ */
+static int build_state(const xmss_params *params, unsigned char *sk,
+                       unsigned long long idx)
+{
+    const unsigned int h = params->tree_height;
+    unsigned char ots_seed[params->n];
+    unsigned char roots[(2*params->d - 1) * params->n];
+    uint32_t addr[2*params->d - 1][8];
+    uint32_t ots_addr[8] = {0};
+    uint32_t leaves[2*params->d - 1];
+    unsigned int count = params->d;
+    unsigned char *wots_sigs = NULL;
+    xmss_prf_ctx sk_seed;
+    xmss_prf_ctx pub_seed;
+    unsigned int i;
+
+    bds_state states[2*params->d - 1];
+    treehash_inst treehash[(2*params->d - 1) * (params->tree_height - params->bds_k)];
+    for (i = 0; i < 2*params->d - 1; i++) {
+        states[i].treehash = treehash + i * (params->tree_height - params->bds_k);
+    }
+
+    memset(sk + params->sk_bytes - (params->d - 1), 0, params->d - 1);
+    if (params->bds_schedule == XMSS_BDS_SCHEDULE_CONSTANT) {
+        memset(sk_next_wots_sigs(params, sk), 0, (params->d - 1) * (params->wots_sig_bytes + 1));
+    }
+    xmssmt_deserialize_state(params, states, &wots_sigs, sk);
+    for (i = 0; i < 2*params->d - 1; i++) {
+        states[i].stackoffset = 0;
+        states[i].next_leaf = 0;
+    }
+
+    prf_ctx_init(params, &sk_seed, sk + params->index_bytes);
+    prf_ctx_init(params, &pub_seed, sk + params->index_bytes + 3*params->n);
+
+    memset(addr, 0, sizeof(addr));
+    for (i = 0; i < params->d; i++) {
+        set_layer_addr(addr[i], i);
+        set_tree_addr(addr[i], idx >> ((i+1) * h));
+        leaves[i] = (idx >> (i * h)) & ((1 << h) - 1);
+    }
+    // Once a layer is on its last tree, so are all layers above it
+    for (i = 0; i + 1 < params->d; i++) {
+        if ((idx >> ((i+1) * h)) + 1 >= (1ULL << (params->full_height - (i+1) * h))) {
+            break;
+        }
+        set_layer_addr(addr[count], i);
+        set_tree_addr(addr[count], (idx >> ((i+1) * h)) + 1);
+        leaves[count] = 0;
+        count++;
+    }
+    if (treehash_init(params, roots, states, count, leaves, &sk_seed, &pub_seed,
+                      (const uint32_t (*)[8])addr, sk, NULL)) {
+        return -1;
+    }
+    if (memcmp(roots + (params->d - 1)*params->n, sk + params->index_bytes + 2*params->n, params->n)) {
+        return -1;
+    }
+
+    // The next trees are complete, with their roots on the stack
+    for (i = params->d; i < count; i++) {
+        memcpy(states[i].stack, roots + i*params->n, params->n);
+        states[i].stacklevels[0] = h;
+        states[i].stackoffset = 1;
+        states[i].next_leaf = 1 << h;
+    }
+
+    // Sign the current root on every layer but the top one
+    for (i = 0; i + 1 < params->d; i++) {
+        set_layer_addr(ots_addr, i + 1);
+        set_tree_addr(ots_addr, idx >> ((i+2) * h));
+        set_ots_addr(ots_addr, leaves[i + 1]);
+        get_seed(params, ots_seed, &sk_seed, ots_addr);
+        wots_sign(params, wots_sigs + i*params->wots_sig_bytes, roots + i*params->n, ots_seed, &pub_seed, ots_addr);
+    }
+
+    xmssmt_serialize_state(params, sk, states);
+
+    // The constant schedule also has the next roots signed ahead of the swap
+    if (params->bds_schedule == XMSS_BDS_SCHEDULE_CONSTANT) {
+        unsigned char *next_wots_sigs = sk_next_wots_sigs(params, sk);
+
+        for (i = params->d; i < count; i++) {
+            set_layer_addr(ots_addr, i - params->d + 1);
+            set_tree_addr(ots_addr, ((idx >> ((i - params->d + 1) * h)) + 1) >> h);
+            set_ots_addr(ots_addr, ((idx >> ((i - params->d + 1) * h)) + 1) & ((1 << h) - 1));
+            get_seed(params, ots_seed, &sk_seed, ots_addr);
+            wots_sign(params, next_wots_sigs + (i - params->d)*params->wots_sig_bytes, roots + i*params->n, ots_seed, &pub_seed, ots_addr);
+            next_wots_sigs[(params->d - 1)*params->wots_sig_bytes + i - params->d] = 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Sets the index of sk to target_idx and builds its BDS states for it.
+ * The states are built in a copy of sk, as build_state overwrites them before
+ * it can check the root, so that sk is left as it was if that fails.
+ * Returns -1 if target_idx is below the index of sk or not before where it
+ * stops, if the root does not match, or if out of memory.
+ */
+static int restore_state(const xmss_params *params, unsigned char *sk,
+                         unsigned long long target_idx)
+{
+    unsigned char *scratch;
+
+    if (target_idx < bytes_to_ull(sk, params->index_bytes) || target_idx >= sk_end(params, sk)) {
+        return -1;
+    }
+    scratch = malloc(params->sk_bytes);
+    if (scratch == NULL) {
+        return -1;
+    }
+    memcpy(scratch, sk, params->sk_bytes);
+    if (build_state(params, scratch, target_idx)) {
+        free(scratch);
+        return -1;
+    }
+    sk_set_idx(params, scratch, target_idx);
+    memcpy(sk, scratch, params->sk_bytes);
+    free(scratch);
+    return 0;
+}
+
+/**
+ * Moves the secret key sk forward to index target_idx, rebuilding its BDS
+ * states and WOTS signatures from SK_SEED and PUB_SEED alone; the state
+ * that sk holds is not read. The indices that are skipped are lost.
+ * This costs about as much as generating d + (d - 1) trees, independent of
+ * how far sk moves; e.g. to recover a key from a backup of an earlier index.
+ * Returns -1 if target_idx is below the index of sk or not before where it
+ * stops, or if the root in sk does not match its seeds; sk is left as it was
+ * then.
+ */
+int xmss_core_restore_state(const xmss_params *params, unsigned char *sk,
+                            unsigned long long target_idx)
+{
+    return restore_state(params, sk, target_idx);
+}
+
+/**
+ * As xmss_core_restore_state, for XMSSMT.
+ */
+int xmssmt_core_restore_state(const xmss_params *params, unsigned char *sk,
+                              unsigned long long target_idx)
+{
+    return restore_state(params, sk, target_idx);
+}
+
+/**
+ * Hands the indices from mid up to where sk stops to shard, with the BDS
+ * states restored for signing mid, and makes sk stop at mid.
+ * Returns -1 unless mid is past the index of sk and before where it stops.
+ */
+static int split_sk(const xmss_params *params, unsigned char *sk,
+                    unsigned char *shard, unsigned long long mid)
+{
+    if (mid <= bytes_to_ull(sk, params->index_bytes) || mid >= sk_end(params, sk)) {
+        return -1;
+    }
+    memcpy(shard, sk, sk_head_bytes(params));
+    if (restore_state(params, shard, mid)) {
+        return -1;
+    }
+    ull_to_bytes(sk + params->index_bytes + 4*params->n + SK_PARAMS_BYTES, SK_END_BYTES, mid);
+    return 0;
+}
+
+/**
+ * Splits the secret key sk at index mid: shard becomes a secret key for the
+ * indices from mid up to where sk stops, and sk stops at mid. Both can then
+ * sign independently, e.g. on different threads or machines; building the
+ * BDS states of shard takes about as long as generating d + (d - 1) trees.
+ * Returns -1 unless mid is past the index of sk and before where it stops.
+ */
+int xmss_core_split(const xmss_params *params, unsigned char *sk,
+                    unsigned char *shard, unsigned long long mid)
+{
+    return split_sk(params, sk, shard, mid);
+}
+
+/**
+ * As xmss_core_split, for XMSSMT.
+ */
+int xmssmt_core_split(const xmss_params *params, unsigned char *sk,
+                      unsigned char *shard, unsigned long long mid)
+{
+    return split_sk(params, sk, shard, mid);
+}
+
+/* The version of the compact encoding of the traversal state, which
+   xmss_xmssmt_core_sk_compact writes right after the head of the key. */
+#define SK_COMPACT_VERSION 1
+
+/**
+ * Returns whether state i of the secret key sk is used by any signature that
+ * is still to come: the current trees always are, the next tree of a layer
+ * only if it starts before where sk stops.
+ */
+static int compact_state_used(const xmss_params *params,
+                              const unsigned char *sk, unsigned int i)
+{
+    unsigned int shift;
+
+    if (i < params->d) {
+        return 1;
+    }
+    shift = (i - params->d + 1) * params->tree_height;
+    return ((sk_state_idx(params, sk) >> shift) + 1) << shift < sk_end(params, sk);
+}
+
+/* Appends len bytes from src at *out. */
+static void compact_put(unsigned char **out, const void *src, size_t len)
+{
+    memcpy(*out, src, len);
+    *out += len;
+}
+
+/**
+ * Returns the next len bytes of the compact encoding at *in, of which *left
+ * are left, or NULL if there are not as many.
+ */
+static const unsigned char *compact_get(const unsigned char **in,
+                                        unsigned long long *left, size_t len)
+{
+    const unsigned char *r = *in;
+
+    if (*left < len) {
+        return NULL;
+    }
+    *in += len;
+    *left -= len;
+    return r;
+}
+
+/**
+ * Writes the secret key sk to out in the compact encoding: its head as is,
+ * followed by a version byte and the parts of the BDS states that signing
+ * still reads. That leaves out the stack above its top, the bookkeeping of
+ * completed treehash instances and the nodes of those that are not, the
+ * kept nodes of the next trees, which are only written once they are
+ * current, anything of a next tree that was not started, and the states of
+ * next trees that come after the last index. The levels on the stacks and
+ * the counters take a byte, and the treehash indices as few as the tree
+ * height needs. Sets *outlen to its size, which is at most sk_bytes.
+ */
+int xmss_xmssmt_core_sk_compact(const xmss_params *params,
+                                unsigned char *out, unsigned long long *outlen,
+                                const unsigned char *sk)
+{
+    const unsigned int nstates = 2*params->d - 1;
+    const unsigned int nth = params->tree_height - params->bds_k;
+    const unsigned int idx_bytes = (params->tree_height + 7) / 8;
+    const unsigned int leaf_bytes = (params->tree_height + 8) / 8;
+    const size_t retain_bytes = ((1 << params->bds_k) - params->bds_k - 1) * params->n;
+    const unsigned char *selectors = sk + params->sk_bytes - (params->d - 1);
+    unsigned char *wots_sigs = NULL;
+    unsigned char *start = out;
+    unsigned char buf[4];
+    unsigned char completed[(nth + 7) / 8];
+    unsigned int i, j;
+
+    bds_state states[nstates];
+    treehash_inst treehash[nstates * nth];
+    for (i = 0; i < nstates; i++) {
+        states[i].treehash = treehash + i * nth;
+    }
+    xmssmt_deserialize_state(params, states, &wots_sigs, (unsigned char *)sk);
+
+    compact_put(&out, sk, sk_head_bytes(params));
+    buf[0] = SK_COMPACT_VERSION;
+    compact_put(&out, buf, 1);
+    compact_put(&out, selectors, params->d - 1);
+
+    for (i = 0; i < nstates; i++) {
+        const bds_state *state = states + i;
+
+        if (!compact_state_used(params, sk, i)) {
+            continue;
+        }
+        if (i >= params->d) {
+            ull_to_bytes(buf, leaf_bytes, state->next_leaf);
+            compact_put(&out, buf, leaf_bytes);
+            if (state->next_leaf == 0) {
+                continue;
+            }
+        }
+        buf[0] = state->stackoffset;
+        compact_put(&out, buf, 1);
+        compact_put(&out, state->stacklevels, state->stackoffset);
+        compact_put(&out, state->stack, state->stackoffset * params->n);
+        compact_put(&out, state->auth, params->tree_height * params->n);
+        if (i >= params->d) {
+            // the next tree only needs what bds_state_update writes
+            for (j = 0; j < nth; j++) {
+                compact_put(&out, state->treehash[j].node, params->n);
+            }
+            compact_put(&out, state->retain, retain_bytes);
+            continue;
+        }
+        compact_put(&out, state->keep, (params->tree_height >> 1) * params->n);
+        memset(completed, 0, sizeof(completed));
+        for (j = 0; j < nth; j++) {
+            completed[j >> 3] |= (state->treehash[j].completed != 0) << (j & 7);
+        }
+        compact_put(&out, completed, sizeof(completed));
+        for (j = 0; j < nth; j++) {
+            if (state->treehash[j].completed) {
+                compact_put(&out, state->treehash[j].node, params->n);
+            }
+            else {
+                ull_to_bytes(buf, idx_bytes, state->treehash[j].next_idx);
+                compact_put(&out, buf, idx_bytes);
+                buf[0] = state->treehash[j].stackusage;
+                compact_put(&out, buf, 1);
+            }
+        }
+        compact_put(&out, state->retain, retain_bytes);
+    }
+
+    if (params->d > 1) {
+        compact_put(&out, wots_sigs, (params->d - 1) * params->wots_sig_bytes);
+    }
+    if (params->bds_schedule == XMSS_BDS_SCHEDULE_CONSTANT) {
+        const unsigned char *next_wots_sigs = sk_next_wots_sigs(params, sk);
+        const unsigned char *ready = next_wots_sigs + (params->d - 1) * params->wots_sig_bytes;
+
+        for (i = 0; i + 1 < params->d; i++) {
+            buf[0] = ready[i] && compact_state_used(params, sk, params->d + i);
+            compact_put(&out, buf, 1);
+        }
+        for (i = 0; i + 1 < params->d; i++) {
+            if (ready[i] && compact_state_used(params, sk, params->d + i)) {
+                compact_put(&out, next_wots_sigs + i * params->wots_sig_bytes,
+                            params->wots_sig_bytes);
+            }
+        }
+    }
+    *outlen = out - start;
+    return 0;
+}
+
+/**
+ * Reads the secret key that xmss_xmssmt_core_sk_compact wrote to in, and
+ * completes params for it as xmss_xmssmt_core_sk_params does; sk must have
+ * room for params->sk_bytes then. What the compact encoding leaves out is
+ * zeroed, which signing overwrites before it reads it.
+ * Returns -1 if in is not a valid compact encoding of a key for params,
+ * e.g. of another version, 0 otherwise.
+ */
+int xmss_xmssmt_core_sk_expand(xmss_params *params, unsigned char *sk,
+                               const unsigned char *in, unsigned long long inlen)
+{
+    unsigned long long head_bytes;
+    unsigned int nstates, nth, idx_bytes, leaf_bytes;
+    size_t retain_bytes;
+    unsigned char *wots_sigs = NULL;
+    const unsigned char *p;
+    unsigned int i, j;
+
+    if (inlen < sk_head_bytes(params) ||
+            xmss_xmssmt_core_sk_params(params, in)) {
+        return -1;
+    }
+    nstates = 2*params->d - 1;
+    nth = params->tree_height - params->bds_k;
+    idx_bytes = (params->tree_height + 7) / 8;
+    leaf_bytes = (params->tree_height + 8) / 8;
+    retain_bytes = ((1 << params->bds_k) - params->bds_k - 1) * params->n;
+    head_bytes = sk_head_bytes(params);
+
+    bds_state states[nstates];
+    treehash_inst treehash[nstates * nth];
+    for (i = 0; i < nstates; i++) {
+        states[i].treehash = treehash + i * nth;
+    }
+
+    memset(sk, 0, params->sk_bytes);
+    if ((p = compact_get(&in, &inlen, head_bytes)) == NULL) {
+        return -1;
+    }
+    memcpy(sk, p, head_bytes);
+    if ((p = compact_get(&in, &inlen, 1)) == NULL || p[0] != SK_COMPACT_VERSION) {
+        return -1;
+    }
+    if ((p = compact_get(&in, &inlen, params->d - 1)) == NULL) {
+        return -1;
+    }
+    for (i = 0; i + 1 < params->d; i++) {
+        if (p[i] > 1) {
+            return -1;
+        }
+    }
+    memcpy(sk + params->sk_bytes - (params->d - 1), p, params->d - 1);
+    xmssmt_deserialize_state(params, states, &wots_sigs, sk);
+
+    for (i = 0; i < nstates; i++) {
+        bds_state *state = states + i;
+        const unsigned char *completed;
+
+        for (j = 0; j < nth; j++) {
+            state->treehash[j].h = j;
+            state->treehash[j].next_idx = 0;
+            state->treehash[j].stackusage = 0;
+            state->treehash[j].completed = 1;
+        }
+        state->stackoffset = 0;
+        state->next_leaf = 0;
+        if (!compact_state_used(params, sk, i)) {
+            continue;
+        }
+        if (i >= params->d) {
+            if ((p = compact_get(&in, &inlen, leaf_bytes)) == NULL) {
+                return -1;
+            }
+            state->next_leaf = bytes_to_ull(p, leaf_bytes);
+            if (state->next_leaf > (1UL << params->tree_height)) {
+                return -1;
+            }
+            if (state->next_leaf == 0) {
+                continue;
+            }
+        }
+        if ((p = compact_get(&in, &inlen, 1)) == NULL ||
+                p[0] > params->tree_height + 1) {
+            return -1;
+        }
+        state->stackoffset = p[0];
+        if ((p = compact_get(&in, &inlen, state->stackoffset)) == NULL) {
+            return -1;
+        }
+        for (j = 0; j < state->stackoffset; j++) {
+            if (p[j] > params->tree_height) {
+                return -1;
+            }
+        }
+        memcpy(state->stacklevels, p, state->stackoffset);
+        if ((p = compact_get(&in, &inlen, state->stackoffset * params->n)) == NULL) {
+            return -1;
+        }
+        memcpy(state->stack, p, state->stackoffset * params->n);
+        if ((p = compact_get(&in, &inlen, params->tree_height * params->n)) == NULL) {
+            return -1;
+        }
+        memcpy(state->auth, p, params->tree_height * params->n);
+        if (i >= params->d) {
+            for (j = 0; j < nth; j++) {
+                if ((p = compact_get(&in, &inlen, params->n)) == NULL) {
+                    return -1;
+                }
+                memcpy(state->treehash[j].node, p, params->n);
+            }
+        }
+        else {
+            if ((p = compact_get(&in, &inlen, (params->tree_height >> 1) * params->n)) == NULL) {
+                return -1;
+            }
+            memcpy(state->keep, p, (params->tree_height >> 1) * params->n);
+            if ((completed = compact_get(&in, &inlen, (nth + 7) / 8)) == NULL) {
+                return -1;
+            }
+            for (j = 0; j < nth; j++) {
+                state->treehash[j].completed = (completed[j >> 3] >> (j & 7)) & 1;
+                if (state->treehash[j].completed) {
+                    if ((p = compact_get(&in, &inlen, params->n)) == NULL) {
+                        return -1;
+                    }
+                    memcpy(state->treehash[j].node, p, params->n);
+                    continue;
+                }
+                if ((p = compact_get(&in, &inlen, idx_bytes + 1)) == NULL) {
+                    return -1;
+                }
+                state->treehash[j].next_idx = bytes_to_ull(p, idx_bytes);
+                state->treehash[j].stackusage = p[idx_bytes];
+                if (state->treehash[j].next_idx >= (1UL << params->tree_height) ||
+                        state->treehash[j].stackusage > state->stackoffset) {
+                    return -1;
+                }
+            }
+        }
+        if ((p = compact_get(&in, &inlen, retain_bytes)) == NULL) {
+            return -1;
+        }
+        memcpy(state->retain, p, retain_bytes);
+    }
+    xmssmt_serialize_state(params, sk, states);
+
+    if (params->d > 1) {
+        if ((p = compact_get(&in, &inlen, (params->d - 1) * params->wots_sig_bytes)) == NULL) {
+            return -1;
+        }
+        memcpy(wots_sigs, p, (params->d - 1) * params->wots_sig_bytes);
+    }
+    if (params->bds_schedule == XMSS_BDS_SCHEDULE_CONSTANT) {
+        unsigned char *next_wots_sigs = sk_next_wots_sigs(params, sk);
+        unsigned char *ready = next_wots_sigs + (params->d - 1) * params->wots_sig_bytes;
+
+        if ((p = compact_get(&in, &inlen, params->d - 1)) == NULL) {
+            return -1;
+        }
+        memcpy(ready, p, params->d - 1);
+        for (i = 0; i + 1 < params->d; i++) {
+            if (ready[i] > 1 || (ready[i] && !compact_state_used(params, sk, params->d + i))) {
+                return -1;
+            }
+            if (!ready[i]) {
+                continue;
+            }
+            if ((p = compact_get(&in, &inlen, params->wots_sig_bytes)) == NULL) {
+                return -1;
+            }
+            memcpy(next_wots_sigs + i * params->wots_sig_bytes, p, params->wots_sig_bytes);
+        }
+    }
+    return inlen == 0 ? 0 : -1;
+}
+
+/**
+ * Would sign at index idx of sk without updating it, but the BDS states of
+ * a key can only sign the index that follows them. This always returns -1.
+ */
+int xmss_xmssmt_core_sign_at(const xmss_params *params,
+                             const unsigned char *sk, unsigned long long idx,
+                             unsigned char *sig, unsigned long long *siglen,
+                             const struct iovec *m, unsigned int iovcnt)
+{
+    (void)params;
+    (void)sk;
+    (void)idx;
+    (void)sig;
+    (void)m;
+    (void)iovcnt;
+    *siglen = 0;
+    return -1;
+}
+
+/**
+ * Signs a message.
+ * Returns
+ * 1. an array containing the signature followed by the message AND
+ * 2. an updated secret key!
+ *
+ */
+int xmssmt_core_sign(const xmss_params *params,
+                     unsigned char *sk,
+                     unsigned char *sm, unsigned long long *smlen,
+                     const unsigned char *m, unsigned long long mlen)
+{
+    struct iovec iov;
+
+    iov.iov_base = (void *)m;
+    iov.iov_len = mlen;
+
+    if (xmssmt_core_sign_detached(params, sk, sm, smlen, &iov, 1)) {
+        return -1;
+    }
+    memcpy(sm + params->sig_bytes, m, mlen);
+    *smlen += mlen;
+
+    return 0;
+}
+
+/**
+ * Signs the concatenation of the iovcnt buffers in m.
+ * Returns
+ * 1. the signature, without the message, in sig AND
+ * 2. an updated secret key!
+ */
+int xmssmt_core_sign_detached(const xmss_params *params,
+                              unsigned char *sk,
+                              unsigned char *sig, unsigned long long *siglen,
+                              const struct iovec *m, unsigned int iovcnt)
+{
+    xmss_signer signer;
+    unsigned int i;
+
+    // TODO refactor BDS state not to need separate treehash instances
+    bds_state states[2*params->d - 1];
+    treehash_inst treehash[(2*params->d - 1) * (params->tree_height - params->bds_k)];
+    for (i = 0; i < 2*params->d - 1; i++) {
+        states[i].treehash = treehash + i * (params->tree_height - params->bds_k);
+    }
+
+    // indices were reserved past the states; see sk_state_idx
+    if (sk_state_idx(params, sk) != bytes_to_ull(sk, params->index_bytes) &&
+            restore_state(params, sk, bytes_to_ull(sk, params->index_bytes))) {
+        *siglen = 0;
+        return -1;
+    }
+    signer_map(params, &signer, states, sk);
+    if (signer_sign(params, &signer, sig, siglen, m, iovcnt)) {
+        return -1;
+    }
     xmssmt_serialize_state(params, sk, states);
 
     return 0;
@@ -0,0 +1,891 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hash.h"
+#include "hash_address.h"
+#include "params.h"
+#include "utils.h"
+#include "wots.h"
+#include "xmss.h"
+#include "xmss_commons.h"
+#include "xmss_core.h"
+#include "xmss_file.h"
+
+struct xmss_sk_file {
+    xmss_params params;
+    int is_xmssmt;
+    char *path;
+    int fd; /* holds the lock on the file */
+    unsigned long long offset;
+    unsigned int batch; /* 0 if the file is mapped */
+    /* the contents of the file as it was opened, or its mapping */
+    unsigned char *file;
+    unsigned long long size;
+    unsigned long long idx; /* the index of the next signature */
+    unsigned long long reserved; /* the index in the file */
+    xmss_signer *signer;
+    /* if mapped, the key that signs, before its changes go to the mapping */
+    unsigned char *shadow;
+    unsigned long page_bytes;
+    /* if set, the file is mapped, and f->idx and f->reserved are only
+       accessed atomically or, to reserve the next batch, under lock */
+    int concurrent;
+    pthread_mutex_t lock;
+};
+
+/* Reads len bytes at offset of fd, or returns -1. */
+static int pread_all(int fd, unsigned char *buf, unsigned long long len,
+                     unsigned long long offset)
+{
+    ssize_t r;
+
+    while (len > 0) {
+        r = pread(fd, buf, len, offset);
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        if (r <= 0) {
+            return -1;
+        }
+        buf += r;
+        len -= r;
+        offset += r;
+    }
+    return 0;
+}
+
+/* Writes len bytes at offset of fd, or returns -1. */
+static int pwrite_all(int fd, const unsigned char *buf, unsigned long long len,
+                      unsigned long long offset)
+{
+    ssize_t r;
+
+    while (len > 0) {
+        r = pwrite(fd, buf, len, offset);
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        if (r <= 0) {
+            return -1;
+        }
+        buf += r;
+        len -= r;
+        offset += r;
+    }
+    return 0;
+}
+
+/**
+ * Opens the file at path and locks it. As closing replaces the file, the
+ * lock may turn out to be on a file that path no longer names once it is
+ * taken; the new file is opened then. Returns -1 on failure.
+ */
+static int open_locked(const char *path)
+{
+    struct stat st_fd, st_path;
+    int fd;
+
+    for (;;) {
+        fd = open(path, O_RDWR);
+        if (fd < 0) {
+            return -1;
+        }
+        while (flock(fd, LOCK_EX)) {
+            if (errno != EINTR) {
+                close(fd);
+                return -1;
+            }
+        }
+        if (fstat(fd, &st_fd) || stat(path, &st_path)) {
+            close(fd);
+            return -1;
+        }
+        if (st_fd.st_dev == st_path.st_dev && st_fd.st_ino == st_path.st_ino) {
+            return fd;
+        }
+        close(fd);
+    }
+}
+
+/* Makes the directory entry of the file at path durable, e.g. a rename. */
+static int sync_dir(const char *path)
+{
+    char dir_path[strlen(path) + 2];
+    char *slash;
+    int fd;
+
+    strcpy(dir_path, path);
+    slash = strrchr(dir_path, '/');
+    if (slash == NULL) {
+        strcpy(dir_path, ".");
+    }
+    else if (slash == dir_path) {
+        dir_path[1] = '\0';
+    }
+    else {
+        *slash = '\0';
+    }
+    fd = open(dir_path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    if (fsync(fd)) {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+/**
+ * Atomically replaces the file of f with its contents in f->file, keeping
+ * its mode, and makes that durable.
+ */
+static int replace_file(const xmss_sk_file *f)
+{
+    char tmp_path[strlen(f->path) + 5];
+    struct stat st;
+    int fd;
+
+    strcpy(tmp_path, f->path);
+    strcat(tmp_path, ".tmp");
+
+    fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(f->fd, &st) || fchmod(fd, st.st_mode & 07777) ||
+            pwrite_all(fd, f->file, f->size, 0) || fsync(fd)) {
+        close(fd);
+        unlink(tmp_path);
+        return -1;
+    }
+    close(fd);
+    if (rename(tmp_path, f->path)) {
+        unlink(tmp_path);
+        return -1;
+    }
+
+    /* The rename itself is only durable once the directory is synced. */
+    return sync_dir(f->path);
+}
+
+/* Frees f and unlocks its file, without writing it. */
+static void sk_file_free(xmss_sk_file *f)
+{
+    if (f->signer != NULL) {
+        xmss_core_signer_free(f->signer);
+    }
+    if (f->batch == 0 || f->concurrent) {
+        if (f->file != NULL) {
+            munmap(f->file, f->size);
+        }
+    }
+    else {
+        free(f->file);
+    }
+    if (f->concurrent) {
+        pthread_mutex_destroy(&f->lock);
+    }
+    if (f->fd >= 0) {
+        close(f->fd);
+    }
+    free(f->shadow);
+    free(f->path);
+    free(f);
+}
+
+/* Opens and locks the file at path for sk_file_open or sk_file_map, without
+   reading it yet. */
+static xmss_sk_file *sk_file_new(const char *path, unsigned long long offset,
+                                 unsigned int batch, int is_xmssmt)
+{
+    xmss_sk_file *f;
+    struct stat st;
+
+    f = calloc(1, sizeof(xmss_sk_file));
+    if (f == NULL) {
+        return NULL;
+    }
+    f->is_xmssmt = is_xmssmt;
+    f->fd = -1;
+    f->offset = offset;
+    f->batch = batch;
+    f->path = malloc(strlen(path) + 1);
+    if (f->path == NULL) {
+        sk_file_free(f);
+        return NULL;
+    }
+    strcpy(f->path, path);
+
+    f->fd = open_locked(path);
+    if (f->fd < 0 || fstat(f->fd, &st) ||
+            (unsigned long long)st.st_size < offset + XMSS_OID_LEN) {
+        sk_file_free(f);
+        return NULL;
+    }
+    f->size = st.st_size;
+    return f;
+}
+
+/* Parses the key in the contents of f, and sets its parameters and index.
+   Returns -1 if it does not hold a valid key. */
+static int sk_file_parse(xmss_sk_file *f)
+{
+    const unsigned char *sk = f->file + f->offset;
+    unsigned long long head;
+    uint32_t oid;
+
+    /* Parsing sk reads the head that precedes the traversal state, if the
+       core keeps one, i.e. up to the index that the state is for. */
+    oid = bytes_to_ull(sk, XMSS_OID_LEN);
+    if ((f->is_xmssmt ? xmssmt_parse_oid : xmss_parse_oid)(&f->params, oid)) {
+        return -1;
+    }
+    head = xmss_xmssmt_core_sk_state_idx_offset(&f->params);
+    head = head ? head + XMSS_SK_STATE_IDX_BYTES
+                : f->params.index_bytes + 4*f->params.n;
+    if (f->size - f->offset < XMSS_OID_LEN + head ||
+            (f->is_xmssmt ? xmssmt_parse_sk : xmss_parse_sk)(&f->params, sk) ||
+            f->size - f->offset < XMSS_OID_LEN + f->params.sk_bytes) {
+        return -1;
+    }
+    f->idx = bytes_to_ull(sk + XMSS_OID_LEN, f->params.index_bytes);
+    f->reserved = f->idx;
+    return 0;
+}
+
+static xmss_sk_file *sk_file_open(const char *path, unsigned long long offset,
+                                  unsigned int batch, int is_xmssmt)
+{
+    xmss_sk_file *f;
+
+    if (batch == 0) {
+        return NULL;
+    }
+    f = sk_file_new(path, offset, batch, is_xmssmt);
+    if (f == NULL) {
+        return NULL;
+    }
+    f->file = malloc(f->size);
+    if (f->file == NULL || pread_all(f->fd, f->file, f->size, 0) ||
+            sk_file_parse(f)) {
+        sk_file_free(f);
+        return NULL;
+    }
+    f->signer = xmss_core_signer_load(&f->params,
+                                      f->file + offset + XMSS_OID_LEN);
+    if (f->signer == NULL) {
+        sk_file_free(f);
+        return NULL;
+    }
+    return f;
+}
+
+/* Maps the file of f and parses the key in it. Returns -1 if the file cannot
+   be mapped or does not hold a valid key. */
+static int sk_file_mmap(xmss_sk_file *f)
+{
+    f->file = mmap(NULL, f->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   f->fd, 0);
+    if (f->file == MAP_FAILED) {
+        f->file = NULL;
+        return -1;
+    }
+    f->page_bytes = sysconf(_SC_PAGESIZE);
+    return sk_file_parse(f);
+}
+
+static xmss_sk_file *sk_file_map(const char *path, unsigned long long offset,
+                                 int is_xmssmt)
+{
+    xmss_sk_file *f;
+
+    f = sk_file_new(path, offset, 0, is_xmssmt);
+    if (f == NULL) {
+        return NULL;
+    }
+    if (sk_file_mmap(f)) {
+        sk_file_free(f);
+        return NULL;
+    }
+    f->shadow = malloc(f->params.sk_bytes);
+    if (f->shadow == NULL) {
+        sk_file_free(f);
+        return NULL;
+    }
+    memcpy(f->shadow, f->file + offset + XMSS_OID_LEN, f->params.sk_bytes);
+    return f;
+}
+
+static xmss_sk_file *sk_file_open_concurrent(const char *path,
+                                             unsigned long long offset,
+                                             unsigned int batch, int is_xmssmt)
+{
+    xmss_sk_file *f;
+
+    if (batch == 0) {
+        return NULL;
+    }
+    f = sk_file_new(path, offset, batch, is_xmssmt);
+    if (f == NULL) {
+        return NULL;
+    }
+    if (pthread_mutex_init(&f->lock, NULL)) {
+        sk_file_free(f);
+        return NULL;
+    }
+    f->concurrent = 1;
+    /* Only keys without a traversal state can sign any index. */
+    if (sk_file_mmap(f) ||
+            xmss_xmssmt_core_sk_state_idx_offset(&f->params) != 0) {
+        sk_file_free(f);
+        return NULL;
+    }
+    /* The signing threads already keep the processors busy. */
+    f->params.threads = 1;
+    return f;
+}
+
+xmss_sk_file *xmss_sk_file_open(const char *path, unsigned long long offset,
+                                 unsigned int batch)
+{
+    return sk_file_open(path, offset, batch, 0);
+}
+
+xmss_sk_file *xmssmt_sk_file_open(const char *path, unsigned long long offset,
+                                  unsigned int batch)
+{
+    return sk_file_open(path, offset, batch, 1);
+}
+
+xmss_sk_file *xmss_sk_file_map(const char *path, unsigned long long offset)
+{
+    return sk_file_map(path, offset, 0);
+}
+
+xmss_sk_file *xmssmt_sk_file_map(const char *path, unsigned long long offset)
+{
+    return sk_file_map(path, offset, 1);
+}
+
+xmss_sk_file *xmss_sk_file_open_concurrent(const char *path,
+                                            unsigned long long offset,
+                                            unsigned int batch)
+{
+    return sk_file_open_concurrent(path, offset, batch, 0);
+}
+
+xmss_sk_file *xmssmt_sk_file_open_concurrent(const char *path,
+                                              unsigned long long offset,
+                                              unsigned int batch)
+{
+    return sk_file_open_concurrent(path, offset, batch, 1);
+}
+
+const xmss_params *xmss_sk_file_params(const xmss_sk_file *f)
+{
+    return &f->params;
+}
+
+/**
+ * Makes sure that the index of the next signature is reserved, by durably
+ * writing the index that follows the next batch to the file if it is not.
+ * Returns -1 if the key is exhausted or the index cannot be written.
+ */
+static int sk_file_reserve(xmss_sk_file *f)
+{
+    const unsigned char *sk = f->file + f->offset + XMSS_OID_LEN;
+    unsigned long long end = xmss_xmssmt_core_sk_end(&f->params, sk);
+    unsigned char buf[f->params.index_bytes];
+    unsigned long long reserved;
+
+    if (f->idx < f->reserved) {
+        return 0;
+    }
+    if (f->idx >= end) {
+        return -1;
+    }
+    reserved = end - f->idx > f->batch ? f->idx + f->batch : end;
+
+    /* The index takes a few bytes of a single sector, so it is either
+       written as a whole or not at all. */
+    ull_to_bytes(buf, f->params.index_bytes, reserved);
+    if (pwrite_all(f->fd, buf, f->params.index_bytes,
+                   f->offset + XMSS_OID_LEN) || fdatasync(f->fd)) {
+        return -1;
+    }
+    f->reserved = reserved;
+    return 0;
+}
+
+/* Makes the len bytes at p in the mapping of f durable. */
+static int sk_file_sync(const xmss_sk_file *f, unsigned char *p,
+                        unsigned long long len)
+{
+    uintptr_t start = (uintptr_t)p & ~(uintptr_t)(f->page_bytes - 1);
+
+    return msync((void *)start, (uintptr_t)p + len - start, MS_SYNC);
+}
+
+/**
+ * Signs with the shadow key of a mapped f, and writes what that changed to
+ * the mapping, syncing only the pages that it touched. The kernel may write
+ * back a page of the mapping at any time, so the state is never changed
+ * there before the index is durable, and its own index only follows once all
+ * of it is; if just part of it is written, it is then restored on load.
+ */
+static int sk_file_sign_mapped(xmss_sk_file *f,
+                               unsigned char *sig, unsigned long long *siglen,
+                               const struct iovec *iov, unsigned int iovcnt)
+{
+    unsigned char *sk = f->file + f->offset + XMSS_OID_LEN;
+    const unsigned long long sk_bytes = f->params.sk_bytes;
+    const unsigned long long state_idx =
+        xmss_xmssmt_core_sk_state_idx_offset(&f->params);
+    unsigned char new_state_idx[XMSS_SK_STATE_IDX_BYTES];
+    unsigned long long start, end, dirty_start = 0, dirty_end = 0;
+
+    if ((f->is_xmssmt ? xmssmt_core_sign_detached : xmss_core_sign_detached)(
+            &f->params, f->shadow, sig, siglen, iov, iovcnt)) {
+        return -1;
+    }
+
+    memcpy(sk, f->shadow, f->params.index_bytes);
+    if (sk_file_sync(f, sk, f->params.index_bytes)) {
+        *siglen = 0;
+        return -1;
+    }
+
+    /* Keep the old index of the state in the mapping while the state is
+       compared and copied page by page. Without a state, the offset is that
+       of the index, which is already the same in both. */
+    memcpy(new_state_idx, f->shadow + state_idx, XMSS_SK_STATE_IDX_BYTES);
+    memcpy(f->shadow + state_idx, sk + state_idx, XMSS_SK_STATE_IDX_BYTES);
+    for (start = 0; start < sk_bytes; start = end) {
+        end = ((uintptr_t)(sk + start) / f->page_bytes + 1) * f->page_bytes
+              - (uintptr_t)sk;
+        if (end > sk_bytes) {
+            end = sk_bytes;
+        }
+        if (!memcmp(sk + start, f->shadow + start, end - start)) {
+            continue;
+        }
+        memcpy(sk + start, f->shadow + start, end - start);
+        if (dirty_end != start) {
+            if (dirty_end > dirty_start &&
+                    sk_file_sync(f, sk + dirty_start, dirty_end - dirty_start)) {
+                *siglen = 0;
+                return -1;
+            }
+            dirty_start = start;
+        }
+        dirty_end = end;
+    }
+    if (dirty_end > dirty_start &&
+            sk_file_sync(f, sk + dirty_start, dirty_end - dirty_start)) {
+        *siglen = 0;
+        return -1;
+    }
+    memcpy(f->shadow + state_idx, new_state_idx, XMSS_SK_STATE_IDX_BYTES);
+    if (state_idx) {
+        memcpy(sk + state_idx, new_state_idx, XMSS_SK_STATE_IDX_BYTES);
+        if (sk_file_sync(f, sk + state_idx, XMSS_SK_STATE_IDX_BYTES)) {
+            *siglen = 0;
+            return -1;
+        }
+    }
+    f->idx++;
+    return 0;
+}
+
+/**
+ * Makes sure that idx is reserved for a concurrent f, by durably writing the
+ * index that follows the batch from idx on to the mapping if it is not. The
+ * threads that run past the reserved indices at the same time wait for the
+ * one that writes it, and find their index reserved then.
+ */
+static int sk_file_reserve_concurrent(xmss_sk_file *f, unsigned long long idx)
+{
+    unsigned char *sk = f->file + f->offset + XMSS_OID_LEN;
+    unsigned long long end = xmss_xmssmt_core_sk_end(&f->params, sk);
+    unsigned long long reserved;
+    int ret = 0;
+
+    pthread_mutex_lock(&f->lock);
+    if (idx >= __atomic_load_n(&f->reserved, __ATOMIC_RELAXED)) {
+        if (idx >= end) {
+            ret = -1;
+        }
+        else {
+            reserved = end - idx > f->batch ? idx + f->batch : end;
+            ull_to_bytes(sk, f->params.index_bytes, reserved);
+            if (sk_file_sync(f, sk, f->params.index_bytes)) {
+                ret = -1;
+            }
+            else {
+                __atomic_store_n(&f->reserved, reserved, __ATOMIC_RELEASE);
+            }
+        }
+    }
+    pthread_mutex_unlock(&f->lock);
+    return ret;
+}
+
+/**
+ * Signs with a concurrent f. The index is taken with an atomic increment,
+ * and only needs the lock when it is past the reserved ones; the key itself
+ * is only read, so any number of threads sign at once. f->idx may be
+ * private to this process, as the file lock that f holds keeps every other
+ * open of the file out until f is closed.
+ */
+static int sk_file_sign_concurrent(xmss_sk_file *f,
+                                   unsigned char *sig,
+                                   unsigned long long *siglen,
+                                   const struct iovec *iov,
+                                   unsigned int iovcnt)
+{
+    const unsigned char *sk = f->file + f->offset + XMSS_OID_LEN;
+    unsigned long long idx;
+
+    idx = __atomic_fetch_add(&f->idx, 1, __ATOMIC_RELAXED);
+    if (idx >= __atomic_load_n(&f->reserved, __ATOMIC_ACQUIRE) &&
+            sk_file_reserve_concurrent(f, idx)) {
+        *siglen = 0;
+        return -1;
+    }
+    return xmss_xmssmt_core_sign_at(&f->params, sk, idx, sig, siglen,
+                                    iov, iovcnt);
+}
+
+int xmss_sk_file_sign(xmss_sk_file *f,
+                      unsigned char *sm, unsigned long long *smlen,
+                      const unsigned char *m, unsigned long long mlen)
+{
+    struct iovec iov;
+
+    iov.iov_base = (void *)m;
+    iov.iov_len = mlen;
+    if (xmss_sk_file_sign_detached_iov(f, sm, smlen, &iov, 1)) {
+        return -1;
+    }
+    memcpy(sm + *smlen, m, mlen);
+    *smlen += mlen;
+    return 0;
+}
+
+int xmss_sk_file_sign_detached_iov(xmss_sk_file *f,
+                                   unsigned char *sig,
+                                   unsigned long long *siglen,
+                                   const struct iovec *iov,
+                                   unsigned int iovcnt)
+{
+    if (f->batch == 0) {
+        return sk_file_sign_mapped(f, sig, siglen, iov, iovcnt);
+    }
+    if (f->concurrent) {
+        return sk_file_sign_concurrent(f, sig, siglen, iov, iovcnt);
+    }
+    if (sk_file_reserve(f)) {
+        *siglen = 0;
+        return -1;
+    }
+    if (xmss_core_signer_sign_detached(f->signer, sig, siglen, iov, iovcnt)) {
+        return -1;
+    }
+    f->idx++;
+    return 0;
+}
+
+int xmss_sk_file_close(xmss_sk_file *f)
+{
+    unsigned char *sk = f->file + f->offset + XMSS_OID_LEN;
+    unsigned long long idx;
+    int ret = 0;
+
+    /* Give back the reserved indices that no thread took. */
+    if (f->concurrent) {
+        idx = f->idx < f->reserved ? f->idx : f->reserved;
+        if (idx != bytes_to_ull(sk, f->params.index_bytes)) {
+            ull_to_bytes(sk, f->params.index_bytes, idx);
+            ret = sk_file_sync(f, sk, f->params.index_bytes);
+        }
+        sk_file_free(f);
+        return ret;
+    }
+
+    /* Nothing changed unless indices were reserved; a mapped file is up to
+       date after every signature. */
+    if (f->batch != 0 && f->reserved != bytes_to_ull(sk, f->params.index_bytes)) {
+        xmss_core_signer_flush(f->signer, sk);
+        ret = replace_file(f);
+    }
+    sk_file_free(f);
+    return ret;
+}
+
+/* The magic string that node store files start with. */
+#define XMSS_NODE_STORE_MAGIC "XMSSNOD1"
+/* The header also holds the OID, PUB_SEED and the root. */
+#define XMSS_NODE_STORE_HEADER_BYTES(n) (8 + XMSS_OID_LEN + 2*(n))
+
+struct xmss_node_store {
+    xmss_params params;
+    unsigned char *file;
+    unsigned long long size;
+};
+
+/* Returns the offset in a node store file of the node at index of the level
+   at height; the levels follow each other from the leaves up to the root. */
+static unsigned long long node_offset(const xmss_params *params,
+                                      unsigned int height, uint32_t index)
+{
+    unsigned long long level = (2ULL << params->tree_height)
+                               - (2ULL << (params->tree_height - height));
+
+    return XMSS_NODE_STORE_HEADER_BYTES(params->n)
+           + (level + index) * params->n;
+}
+
+/* Returns the size of the node store file for params. */
+static unsigned long long node_store_bytes(const xmss_params *params)
+{
+    return node_offset(params, params->tree_height, 0) + params->n;
+}
+
+/* Parses the XMSS secret key sk (including OID) for a node store. Returns -1
+   if it is malformed or has more than one layer. */
+static int node_store_params(xmss_params *params, const unsigned char *sk)
+{
+    if (xmss_parse_sk(params, sk) || params->d != 1) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Writes the header of a node store file for the key sk (including OID). */
+static void node_store_header(const xmss_params *params, unsigned char *buf,
+                              const unsigned char *sk)
+{
+    memcpy(buf, XMSS_NODE_STORE_MAGIC, 8);
+    memcpy(buf + 8, sk, XMSS_OID_LEN);
+    sk += XMSS_OID_LEN + params->index_bytes;
+    memcpy(buf + 8 + XMSS_OID_LEN, sk + 3*params->n, params->n);
+    memcpy(buf + 8 + XMSS_OID_LEN + params->n, sk + 2*params->n, params->n);
+}
+
+struct node_store_ctx {
+    const xmss_params *params;
+    unsigned char *file;
+};
+
+/* Writes a node to its place in the mapped node store file. */
+static void node_store_write(void *ctx, unsigned int height, uint32_t index,
+                             const unsigned char *node)
+{
+    const struct node_store_ctx *store = ctx;
+
+    memcpy(store->file + node_offset(store->params, height, index), node,
+           store->params->n);
+}
+
+/**
+ * Computes every node of the tree of the XMSS secret key sk (including OID),
+ * on threads threads, and writes them to a new file at path, or
+ * atomically replaces the file that is there.
+ * Returns -1 if sk is not a valid XMSS key, if its seeds do not give its
+ * root, or if the file cannot be written.
+ */
+int xmss_node_store_create(const char *path, const unsigned char *sk,
+                           unsigned int threads)
+{
+    xmss_params params;
+    struct node_store_ctx ctx;
+    xmss_prf_ctx sk_seed;
+    xmss_prf_ctx pub_seed;
+    uint32_t top_tree_addr[8] = {0};
+    unsigned long long size;
+    const unsigned char *seeds = sk + XMSS_OID_LEN;
+    char tmp_path[strlen(path) + 5];
+    void *store_ctx = &ctx;
+    int fd, ret = 0;
+
+    if (node_store_params(&params, sk)) {
+        return -1;
+    }
+    if (threads > 1) {
+        params.threads = threads;
+    }
+    seeds += params.index_bytes;
+    size = node_store_bytes(&params);
+    unsigned char root[params.n];
+
+    strcpy(tmp_path, path);
+    strcat(tmp_path, ".tmp");
+    fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        return -1;
+    }
+    ctx.params = &params;
+    ctx.file = MAP_FAILED;
+    if (ftruncate(fd, size) == 0) {
+        ctx.file = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                        fd, 0);
+    }
+    if (ctx.file == MAP_FAILED) {
+        close(fd);
+        unlink(tmp_path);
+        return -1;
+    }
+
+    prf_ctx_init(&params, &sk_seed, seeds);
+    prf_ctx_init(&params, &pub_seed, seeds + 3*params.n);
+    node_store_header(&params, ctx.file, sk);
+    if (treehash_roots(&params, root, &sk_seed, &pub_seed,
+                       (const uint32_t (*)[8])&top_tree_addr, 1,
+                       node_store_write, &store_ctx, NULL, NULL) ||
+            memcmp(root, seeds + 2*params.n, params.n)) {
+        ret = -1;
+    }
+    else {
+        memcpy(ctx.file + node_offset(&params, params.tree_height, 0), root,
+               params.n);
+    }
+
+    if (munmap(ctx.file, size) || ret || fsync(fd)) {
+        close(fd);
+        unlink(tmp_path);
+        return -1;
+    }
+    close(fd);
+    if (rename(tmp_path, path)) {
+        unlink(tmp_path);
+        return -1;
+    }
+    return sync_dir(path);
+}
+
+/**
+ * Maps the node store file at path for signing with the XMSS secret key sk
+ * (including OID), which it must have been created for.
+ * Returns NULL if the file cannot be mapped, or does not hold the tree of sk.
+ */
+xmss_node_store *xmss_node_store_open(const char *path,
+                                      const unsigned char *sk)
+{
+    xmss_node_store *s;
+    struct stat st;
+    int fd;
+
+    s = calloc(1, sizeof(xmss_node_store));
+    if (s == NULL) {
+        return NULL;
+    }
+    if (node_store_params(&s->params, sk)) {
+        free(s);
+        return NULL;
+    }
+    s->size = node_store_bytes(&s->params);
+    unsigned char header[XMSS_NODE_STORE_HEADER_BYTES(s->params.n)];
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        free(s);
+        return NULL;
+    }
+    if (fstat(fd, &st) || (unsigned long long)st.st_size != s->size) {
+        close(fd);
+        free(s);
+        return NULL;
+    }
+    s->file = mmap(NULL, s->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (s->file == MAP_FAILED) {
+        free(s);
+        return NULL;
+    }
+
+    node_store_header(&s->params, header, sk);
+    if (memcmp(s->file, header, sizeof(header))) {
+        xmss_node_store_close(s);
+        return NULL;
+    }
+    return s;
+}
+
+/**
+ * As xmss_sign_detached_iov, but copies the authentication path from the
+ * node store s rather than computing it, so that signing only computes the
+ * WOTS signature. sk must be the key that s was opened for.
+ * Returns -1 if the key is exhausted.
+ */
+int xmss_node_store_sign_detached_iov(const xmss_node_store *s,
+                                      unsigned char *sk,
+                                      unsigned char *sig,
+                                      unsigned long long *siglen,
+                                      const struct iovec *iov,
+                                      unsigned int iovcnt)
+{
+    const xmss_params *params = &s->params;
+    unsigned char mhash[params->n];
+    unsigned char ots_seed[params->n];
+    unsigned char idx_bytes_32[32];
+    unsigned long long idx;
+    xmss_prf_ctx sk_seed;
+    xmss_prf_ctx sk_prf;
+    xmss_prf_ctx pub_seed;
+    unsigned int i;
+
+    uint32_t ots_addr[8] = {0};
+    set_type(ots_addr, XMSS_ADDR_TYPE_OTS);
+
+    sk += XMSS_OID_LEN;
+    idx = bytes_to_ull(sk, params->index_bytes);
+    if (idx >= xmss_xmssmt_core_sk_end(params, sk)) {
+        *siglen = 0;
+        return -1;
+    }
+    memcpy(sig, sk, params->index_bytes);
+    ull_to_bytes(sk, params->index_bytes, idx + 1);
+
+    prf_ctx_init(params, &sk_seed, sk + params->index_bytes);
+    prf_ctx_init(params, &sk_prf, sk + params->index_bytes + params->n);
+    prf_ctx_init(params, &pub_seed, sk + params->index_bytes + 3*params->n);
+
+    /* Compute the digest randomization value and the message hash. */
+    ull_to_bytes(idx_bytes_32, 32, idx);
+    prf(params, sig + params->index_bytes, idx_bytes_32, &sk_prf);
+    hash_message_iov(params, mhash, sig + params->index_bytes,
+                     sk + params->index_bytes + 2*params->n, idx, iov, iovcnt);
+    sig += params->index_bytes + params->n;
+
+    set_ots_addr(ots_addr, idx);
+    get_seed(params, ots_seed, &sk_seed, ots_addr);
+    wots_sign(params, sig, mhash, ots_seed, &pub_seed, ots_addr);
+    sig += params->wots_sig_bytes;
+
+    for (i = 0; i < params->tree_height; i++) {
+        memcpy(sig + i*params->n,
+               s->file + node_offset(params, i, (idx >> i) ^ 0x1), params->n);
+    }
+    *siglen = params->sig_bytes;
+    return 0;
+}
+
+/**
+ * Unmaps the node store s.
+ */
+void xmss_node_store_close(xmss_node_store *s)
+{
+    munmap(s->file, s->size);
+    free(s);
+}
@@ -0,0 +1,159 @@
+#ifndef XMSS_FILE_H
+#define XMSS_FILE_H
+
+#include <sys/uio.h>
+
+#include "params.h"
+
+/* A secret key in a file, opened for signing; see xmss_sk_file_open. */
+typedef struct xmss_sk_file xmss_sk_file;
+
+/**
+ * Opens the XMSS secret key (including OID) that starts at offset in the file
+ * at path and runs to its end, for signing many messages; e.g. at offset
+ * XMSS_OID_LEN + pk_bytes in a file that holds [pk || sk].
+ * The key is loaded into a signer, and the file is locked against other
+ * processes that use this function until it is closed.
+ * Indices are reserved batch at a time: before the first signature of a
+ * batch is released, the index in the file is advanced past the batch with a
+ * single write, and made durable with fdatasync. Signing in the batch then
+ * takes no I/O, and a crash loses at most batch indices, but never causes one
+ * to be used twice. The traversal state is only written on close; after a
+ * crash it is restored from the seeds when the key is next loaded.
+ * Returns NULL if the file cannot be read or does not hold a valid key.
+ */
+xmss_sk_file *xmss_sk_file_open(const char *path, unsigned long long offset,
+                                 unsigned int batch);
+
+/**
+ * As xmss_sk_file_open, for an XMSSMT secret key.
+ */
+xmss_sk_file *xmssmt_sk_file_open(const char *path, unsigned long long offset,
+                                  unsigned int batch);
+
+/**
+ * Opens the XMSS secret key (including OID) that starts at offset in the file
+ * at path, as xmss_sk_file_open does, but maps the file instead of loading
+ * the key into a signer. Each signature then updates the key in the mapping
+ * and syncs only the pages it changed, so that the file is up to date after
+ * every signature, at a cost of a few pages of I/O rather than the whole key.
+ * Returns NULL if the file cannot be mapped or does not hold a valid key.
+ */
+xmss_sk_file *xmss_sk_file_map(const char *path, unsigned long long offset);
+
+/**
+ * As xmss_sk_file_map, for an XMSSMT secret key.
+ */
+xmss_sk_file *xmssmt_sk_file_map(const char *path, unsigned long long offset);
+
+/**
+ * Opens the XMSS secret key (including OID) that starts at offset in the file
+ * at path, as xmss_sk_file_open does, for signing on any number of threads at
+ * once. This takes a key without a traversal state, i.e. of the reference
+ * implementation, which can sign any index; the key is mapped and only read.
+ * Each signature takes its index with an atomic increment of a counter in
+ * memory, and indices are reserved batch at a time, as xmss_sk_file_open
+ * does, by durably writing the index in the mapping; threads only wait for
+ * each other for that. Signatures are thus released in no particular order.
+ * The counter is private to f, so only one f may sign with the file at a
+ * time: the file is locked as by xmss_sk_file_open until f is closed, and
+ * any other open of it, by this process or another one, waits until then.
+ * f must only be closed once no thread signs with it anymore.
+ * Returns NULL if the file cannot be mapped or does not hold a valid key of
+ * this implementation, or if it keeps a traversal state.
+ */
+xmss_sk_file *xmss_sk_file_open_concurrent(const char *path,
+                                            unsigned long long offset,
+                                            unsigned int batch);
+
+/**
+ * As xmss_sk_file_open_concurrent, for an XMSSMT secret key.
+ */
+xmss_sk_file *xmssmt_sk_file_open_concurrent(const char *path,
+                                              unsigned long long offset,
+                                              unsigned int batch);
+
+/**
+ * Returns the parameters of the key in f.
+ */
+const xmss_params *xmss_sk_file_params(const xmss_sk_file *f);
+
+/**
+ * As xmss_sign, using the key in f.
+ * Returns -1 if the key is exhausted or the next batch cannot be reserved,
+ * or, for a mapped file, if the key cannot be written.
+ */
+int xmss_sk_file_sign(xmss_sk_file *f,
+                      unsigned char *sm, unsigned long long *smlen,
+                      const unsigned char *m, unsigned long long mlen);
+
+/**
+ * As xmss_sign_detached_iov, using the key in f. This may be called by
+ * several threads at once only for a file opened with
+ * xmss_sk_file_open_concurrent.
+ * Returns -1 if the key is exhausted or the next batch cannot be reserved,
+ * or, for a mapped file, if the key cannot be written.
+ */
+int xmss_sk_file_sign_detached_iov(xmss_sk_file *f,
+                                   unsigned char *sig,
+                                   unsigned long long *siglen,
+                                   const struct iovec *iov,
+                                   unsigned int iovcnt);
+
+/**
+ * Writes the key with its state as of the last signature back to the file,
+ * which gives back the indices of the batch that were not used, and closes
+ * it. The file is replaced atomically, so it holds either the old or the new
+ * key after a crash. A mapped file is just unmapped, and a concurrent one
+ * only gets the index that follows the last one that was taken.
+ * Returns -1 if the key cannot be written; its reserved indices are lost then.
+ */
+int xmss_sk_file_close(xmss_sk_file *f);
+
+/* The nodes of the tree of an XMSS key in a file; see
+   xmss_node_store_create. */
+typedef struct xmss_node_store xmss_node_store;
+
+/**
+ * Computes every node of the tree of the XMSS secret key sk (including OID),
+ * on threads threads, and writes them to a new file at path, or
+ * atomically replaces the file that is there; e.g. right after generating
+ * the key, at about the same cost. The file takes 2^(h+1) * n bytes, e.g.
+ * 64 KiB for a tree of height 10 or 4 MiB for one of height 16, so this is
+ * for XMSS keys only.
+ * Returns -1 if sk is not a valid XMSS key, if its seeds do not give its
+ * root, or if the file cannot be written.
+ */
+int xmss_node_store_create(const char *path, const unsigned char *sk,
+                           unsigned int threads);
+
+/**
+ * Maps the node store file at path for signing with the XMSS secret key sk
+ * (including OID), which it must have been created for.
+ * Returns NULL if the file cannot be mapped, or does not hold the tree of sk.
+ */
+xmss_node_store *xmss_node_store_open(const char *path,
+                                      const unsigned char *sk);
+
+/**
+ * As xmss_sign_detached_iov, but copies the authentication path from the
+ * node store s rather than computing it, so that signing only computes the
+ * WOTS signature, whichever implementation the key is of. Only the index of
+ * sk is updated; the BDS traversal state of a key of the fast implementation
+ * is restored if it signs without s again. sk must be the key that s was
+ * opened for; s itself is only read, so threads may share it.
+ * Returns -1 if the key is exhausted.
+ */
+int xmss_node_store_sign_detached_iov(const xmss_node_store *s,
+                                      unsigned char *sk,
+                                      unsigned char *sig,
+                                      unsigned long long *siglen,
+                                      const struct iovec *iov,
+                                      unsigned int iovcnt);
+
+/**
+ * Unmaps the node store s.
+ */
+void xmss_node_store_close(xmss_node_store *s);
+
+#endif